@@ -0,0 +1,79 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Interfaces to the user-mode build of the libdtrace consumer (see README).
+ * A driver describes its enabled probes and aggregations as the kernel
+ * would describe them, and gives the harness the data that each CPU's
+ * principal and aggregation buffers are to hold.  It then calls the
+ * consumer interfaces of libdtrace on bench_dtp, whose DTRACEIOC_* calls
+ * are answered from those descriptions and that data.
+ */
+
+#ifndef _BENCH_H
+#define	_BENCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <dt_impl.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A record that an enabling traces.  The harness lays records out as the
+ * kernel does, each aligned to its size (to 8 bytes if it is larger), and
+ * fills in the rest of the record description.
+ */
+typedef struct bench_rec {
+	dtrace_actkind_t br_kind;		/* kind of action */
+	uint32_t br_size;			/* size of record */
+	uint64_t br_arg;			/* action argument */
+} bench_rec_t;
+
+#define	BENCH_NELEM(a)	(sizeof (a) / sizeof ((a)[0]))
+
+extern dtrace_hdl_t *bench_dtp;
+
+extern void bench_init(int);
+extern void bench_fini(void);
+extern void bench_setopt(int, dtrace_optval_t);
+extern void bench_go(void);
+
+extern dtrace_epid_t bench_eprobe(const char *, const bench_rec_t *, int,
+    const char *);
+extern dtrace_aggid_t bench_agg(dtrace_epid_t, const bench_rec_t *, int,
+    const bench_rec_t *);
+extern const dtrace_eprobedesc_t *bench_eprobedesc(dtrace_epid_t);
+extern const dtrace_aggdesc_t *bench_aggdesc(dtrace_aggid_t);
+
+extern void bench_setbuf(processorid_t, const void *, size_t);
+extern void bench_setaggbuf(processorid_t, const void *, size_t);
+
+extern FILE *bench_devnull(void);
+extern uint64_t bench_hrtime(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* _BENCH_H */
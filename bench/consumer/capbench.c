@@ -0,0 +1,328 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Rate at which a capture is written and read back.
+ *
+ * Each set of clauses of clauses.c is consumed with a capture being written
+ * to a temporary file, as dtrace -W writes one, and with callbacks that do
+ * nothing else.  The capture is then read back with dtrace_capture_iter().
+ * Each row reports the records per pass, the rate of the best pass in
+ * records per second of
+ *
+ *	WRITE	dtrace_consume() writing the capture
+ *	READ	dtrace_capture_iter() reading it, with a callback that only
+ *		counts records
+ *
+ * and the size of the capture.  The capture is also read once more to
+ * check that every record comes back with the CPU, EPID, probe description,
+ * format and data with which it was traced.  Finally, a capture whose magic
+ * number is byte-swapped must be refused with EDT_DATAMODEL, and one that is
+ * cut short must fail with EDT_BADCAPTURE.
+ *
+ * usage: capbench [-n passes] [clauses ...]
+ */
+
+#include <string.h>
+#include "clauses.h"
+
+typedef struct check {
+	const clause_t *ck_clause;		/* set of clauses traced */
+	dtrace_capture_t *ck_cap;		/* capture being read */
+	size_t ck_offs[CLAUSE_NCPUS];		/* offset in each buffer */
+	ulong_t ck_nrecs;			/* records read */
+	ulong_t ck_nbad;			/* records that differ */
+} check_t;
+
+static int
+count(const dtrace_capdata_t *data, void *arg)
+{
+	(*(ulong_t *)arg)++;
+	return (DTRACE_CONSUME_NEXT);
+}
+
+static int
+check(const dtrace_capdata_t *data, void *arg)
+{
+	check_t *ck = arg;
+	const clause_t *c = ck->ck_clause;
+	const dtrace_probedesc_t *pd = data->dtcd_pdesc;
+	const dtrace_eprobedesc_t *epd = data->dtcd_edesc;
+	char name[DTRACE_FULLNAMELEN];
+	processorid_t cpu = data->dtcd_cpu;
+	int i, bad = 0;
+
+	ck->ck_nrecs++;
+
+	(void) snprintf(name, sizeof (name), "%s:%s:%s:%s",
+	    pd->dtpd_provider, pd->dtpd_mod, pd->dtpd_func, pd->dtpd_name);
+
+	if (cpu < 0 || cpu >= CLAUSE_NCPUS || data->dtcd_epid != c->c_epid ||
+	    strcmp(name, c->c_probe) != 0 || epd->dtepd_nrecs != c->c_nrecs ||
+	    ck->ck_offs[cpu] + epd->dtepd_size > CLAUSE_BUFSIZE) {
+		ck->ck_nbad++;
+		return (DTRACE_CONSUME_NEXT);
+	}
+
+	for (i = 0; i < epd->dtepd_nrecs; i++) {
+		const dtrace_recdesc_t *rec = &epd->dtepd_rec[i];
+		const char *fmt;
+
+		if (!DTRACEACT_ISPRINTFLIKE(rec->dtrd_action))
+			continue;
+
+		fmt = dtrace_capture_format(ck->ck_cap, rec->dtrd_format);
+
+		if (fmt == NULL || c->c_fmt == NULL ||
+		    strcmp(fmt, c->c_fmt) != 0)
+			bad = 1;
+	}
+
+	if (bcmp(data->dtcd_data, clause_bufs[cpu] + ck->ck_offs[cpu],
+	    epd->dtepd_size) != 0)
+		bad = 1;
+
+	ck->ck_offs[cpu] += epd->dtepd_size;
+	ck->ck_nbad += bad;
+
+	return (DTRACE_CONSUME_NEXT);
+}
+
+static int
+nop(const dtrace_probedata_t *data, void *arg)
+{
+	return (DTRACE_CONSUME_NEXT);
+}
+
+static int
+noprec(const dtrace_probedata_t *data, const dtrace_recdesc_t *rec,
+    void *arg)
+{
+	return (DTRACE_CONSUME_NEXT);
+}
+
+/*
+ * Writes a capture of the buffers to a new temporary file, and returns it
+ * rewound.
+ */
+static FILE *
+capture(const clause_t *c)
+{
+	FILE *fp;
+
+	if ((fp = tmpfile()) == NULL) {
+		(void) fprintf(stderr, "capbench: failed to create capture\n");
+		exit(1);
+	}
+
+	if (dtrace_capture(bench_dtp, fp) != 0 ||
+	    dtrace_consume(bench_dtp, bench_devnull(), nop, noprec,
+	    NULL) != 0 || dtrace_capture(bench_dtp, NULL) != 0) {
+		(void) fprintf(stderr, "capbench: %s: %s\n", c->c_name,
+		    dtrace_errmsg(bench_dtp, dtrace_errno(bench_dtp)));
+		exit(1);
+	}
+
+	rewind(fp);
+	return (fp);
+}
+
+/*
+ * Opens the capture in the stream and iterates over it.  Returns the error
+ * with which the capture could not be read, or 0.
+ */
+static int
+replay(FILE *fp, dtrace_capture_f *func, void *arg)
+{
+	dtrace_capture_t *cap;
+	int err = 0;
+
+	rewind(fp);
+
+	if ((cap = dtrace_capture_open(fp, &err)) == NULL)
+		return (err);
+
+	if (func == check)
+		((check_t *)arg)->ck_cap = cap;
+
+	if (dtrace_capture_iter(cap, func, arg) != 0)
+		err = dtrace_capture_errno(cap);
+
+	dtrace_capture_close(cap);
+
+	return (err);
+}
+
+/*
+ * Copies the capture in the stream to a new temporary file, with its magic
+ * number byte-swapped or with its last byte left off, and returns the error
+ * with which the copy could not be read.
+ */
+static int
+corrupt(FILE *fp, int swap)
+{
+	ulong_t nrecs = 0;
+	char *buf;
+	long size;
+	FILE *nfp;
+	int err, i;
+
+	(void) fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+
+	if ((buf = malloc(size)) == NULL || (nfp = tmpfile()) == NULL ||
+	    fread(buf, size, 1, fp) != 1) {
+		(void) fprintf(stderr, "capbench: failed to copy capture\n");
+		exit(1);
+	}
+
+	if (swap) {
+		for (i = 0; i < 2; i++) {
+			char t = buf[i];
+
+			buf[i] = buf[3 - i];
+			buf[3 - i] = t;
+		}
+	} else {
+		size--;
+	}
+
+	(void) fwrite(buf, size, 1, nfp);
+	err = replay(nfp, count, &nrecs);
+
+	(void) fclose(nfp);
+	free(buf);
+
+	return (err);
+}
+
+int
+main(int argc, char **argv)
+{
+	int passes = 20, bad = 0;
+	FILE *fp = NULL;
+	clause_t *c;
+	int err;
+
+	for (; argc > 2 && argv[1][0] == '-'; argc -= 2, argv += 2) {
+		if (strcmp(argv[1], "-n") == 0)
+			passes = atoi(argv[2]);
+		else
+			break;
+	}
+
+	if (clause_args(argc, argv) != argc || passes < 1) {
+		(void) fprintf(stderr, "usage: capbench [-n passes] "
+		    "[clauses ...]\n");
+		return (2);
+	}
+
+	if (clause_init() != 0) {
+		(void) fprintf(stderr, "capbench: out of memory\n");
+		return (1);
+	}
+
+	bench_go();
+
+	(void) printf("%-10s %10s %12s %12s %10s\n", "CLAUSES", "RECORDS",
+	    "WRITE/S", "READ/S", "BYTES");
+
+	for (c = clauses; c->c_name != NULL; c++) {
+		uint64_t wbest = 0, rbest = 0, start, elapsed;
+		check_t ck;
+		ulong_t n;
+		int p;
+
+		if (!clause_selected(c, argc, argv))
+			continue;
+
+		n = clause_setbufs(c);
+
+		for (p = 0; p < passes; p++) {
+			if (fp != NULL)
+				(void) fclose(fp);
+
+			start = bench_hrtime();
+			fp = capture(c);
+			elapsed = bench_hrtime() - start;
+
+			if (p == 0 || elapsed < wbest)
+				wbest = elapsed;
+		}
+
+		for (p = 0; p < passes; p++) {
+			ulong_t nrecs = 0;
+
+			start = bench_hrtime();
+			err = replay(fp, count, &nrecs);
+			elapsed = bench_hrtime() - start;
+
+			if (err != 0 || nrecs != n) {
+				(void) fprintf(stderr, "capbench: %s: read "
+				    "%llu of %llu records: %s\n", c->c_name,
+				    nrecs, n, dtrace_errmsg(NULL, err));
+				return (1);
+			}
+
+			if (p == 0 || elapsed < rbest)
+				rbest = elapsed;
+		}
+
+		bzero(&ck, sizeof (ck));
+		ck.ck_clause = c;
+
+		if ((err = replay(fp, check, &ck)) != 0 || ck.ck_nrecs != n ||
+		    ck.ck_nbad != 0) {
+			(void) fprintf(stderr, "capbench: %s: %llu of %llu "
+			    "records differ\n", c->c_name,
+			    ck.ck_nbad + (n - MIN(n, ck.ck_nrecs)), n);
+			bad = 1;
+		}
+
+		(void) fseek(fp, 0, SEEK_END);
+		(void) printf("%-10s %10llu %12.0f %12.0f %10ld\n", c->c_name,
+		    n, n * 1e9 / wbest, n * 1e9 / rbest, ftell(fp));
+		(void) fflush(stdout);
+
+		(void) clause_setbufs(NULL);
+	}
+
+	if (fp != NULL) {
+		if ((err = corrupt(fp, 1)) != EDT_DATAMODEL) {
+			(void) fprintf(stderr, "capbench: byte-swapped capture "
+			    "read with \"%s\"\n", dtrace_errmsg(NULL, err));
+			bad = 1;
+		}
+
+		if ((err = corrupt(fp, 0)) != EDT_BADCAPTURE) {
+			(void) fprintf(stderr, "capbench: short capture read "
+			    "with \"%s\"\n", dtrace_errmsg(NULL, err));
+			bad = 1;
+		}
+
+		(void) fclose(fp);
+	}
+
+	bench_fini();
+
+	return (bad);
+}
@@ -0,0 +1,246 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The sets of clauses whose records the consumer benchmarks take in.
+ *
+ * Each set is described to the library as the kernel would describe it, and
+ * each of 4 CPUs' principal buffers is filled with 1M of its records.  The
+ * sets are
+ *
+ *	trace	syscall::NtReadFile:entry
+ *		{
+ *			trace(pid); trace(tid); trace(execname); trace(arg0);
+ *		}
+ *
+ *	stack	fbt::ExAllocatePoolWithTag:entry
+ *		{
+ *			stack();
+ *		}
+ *
+ *	printf	syscall::NtWriteFile:entry
+ *		{
+ *			printf("%s[%d]: %s fd=%d size=%u off=0x%x\n",
+ *			    execname, pid, probefunc, arg0, arg1, arg2);
+ *		}
+ *
+ * The values traced vary from record to record, and are a function of the
+ * record's position alone, so that two runs fill identical buffers.
+ */
+
+#include <string.h>
+#include "clauses.h"
+
+#define	DEPTH		16
+
+static const char *const execnames[] = {
+	"sqlservr.exe", "svchost.exe", "explorer.exe", "MsMpEng.exe",
+	"chrome.exe", "System", "lsass.exe", "devenv.exe"
+};
+
+#define	REC(data, epd, i, type)	\
+	(*(type *)((data) + (epd)->dtepd_rec[i].dtrd_offset))
+
+static const bench_rec_t trace_recs[] = {
+	{ DTRACEACT_DIFEXPR, sizeof (uint32_t), 0 },	/* pid */
+	{ DTRACEACT_DIFEXPR, sizeof (uint64_t), 0 },	/* tid */
+	{ DTRACEACT_DIFEXPR, CLAUSE_STRSIZE, 0 },	/* execname */
+	{ DTRACEACT_DIFEXPR, sizeof (uint64_t), 0 }	/* arg0 */
+};
+
+static void
+trace_fill(char *data, const dtrace_eprobedesc_t *epd, ulong_t i)
+{
+	REC(data, epd, 0, uint32_t) = 1000 + 4 * (i % 97);
+	REC(data, epd, 1, uint64_t) = 4000 + 4 * (i % 389);
+	(void) strcpy(&REC(data, epd, 2, char),
+	    execnames[i % BENCH_NELEM(execnames)]);
+	REC(data, epd, 3, uint64_t) = 0xffffc00000000000ULL + 0x1040 * i;
+}
+
+static const bench_rec_t stack_recs[] = {
+	{ DTRACEACT_STACK, DEPTH * sizeof (uint64_t), DEPTH }
+};
+
+static void
+stack_fill(char *data, const dtrace_eprobedesc_t *epd, ulong_t i)
+{
+	uint64_t *pcs = &REC(data, epd, 0, uint64_t);
+	int d, depth = DEPTH - 4 + i % 5;
+
+	for (d = 0; d < depth; d++)
+		pcs[d] = 0xfffff80000000000ULL + 0x10000 * d + 0x37 * (i % 61);
+}
+
+static const bench_rec_t printf_recs[] = {
+	{ DTRACEACT_PRINTF, CLAUSE_STRSIZE, 0 },	/* execname */
+	{ DTRACEACT_PRINTF, sizeof (uint32_t), 0 },	/* pid */
+	{ DTRACEACT_PRINTF, CLAUSE_STRSIZE, 0 },	/* probefunc */
+	{ DTRACEACT_PRINTF, sizeof (uint64_t), 0 },	/* arg0 */
+	{ DTRACEACT_PRINTF, sizeof (uint64_t), 0 },	/* arg1 */
+	{ DTRACEACT_PRINTF, sizeof (uint64_t), 0 }	/* arg2 */
+};
+
+static const char printf_fmt[] =
+	"%s[%d]: %s fd=%d size=%u off=0x%x\n";
+
+static void
+printf_fill(char *data, const dtrace_eprobedesc_t *epd, ulong_t i)
+{
+	(void) strcpy(&REC(data, epd, 0, char),
+	    execnames[i % BENCH_NELEM(execnames)]);
+	REC(data, epd, 1, uint32_t) = 1000 + 4 * (i % 97);
+	(void) strcpy(&REC(data, epd, 2, char), "NtWriteFile");
+	REC(data, epd, 3, uint64_t) = 4 + 4 * (i % 23);
+	REC(data, epd, 4, uint64_t) = 512 << (i % 8);
+	REC(data, epd, 5, uint64_t) = 0x1000 * i;
+}
+
+char *clause_bufs[CLAUSE_NCPUS];
+
+clause_t clauses[] = {
+	{ "trace", "syscall::NtReadFile:entry",
+	    trace_recs, BENCH_NELEM(trace_recs), NULL, trace_fill },
+	{ "stack", "fbt::ExAllocatePoolWithTag:entry",
+	    stack_recs, BENCH_NELEM(stack_recs), NULL, stack_fill },
+	{ "printf", "syscall::NtWriteFile:entry",
+	    printf_recs, BENCH_NELEM(printf_recs), printf_fmt, printf_fill },
+	{ NULL }
+};
+
+/*
+ * Checks that each of the specified arguments names a set of clauses.
+ * Returns the index of the first argument that does not, or argc.
+ */
+int
+clause_args(int argc, char **argv)
+{
+	const clause_t *c;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		for (c = clauses; c->c_name != NULL; c++) {
+			if (strcmp(c->c_name, argv[i]) == 0)
+				break;
+		}
+
+		if (c->c_name == NULL || argv[i][0] == '-')
+			break;
+	}
+
+	return (i);
+}
+
+/*
+ * Returns non-zero if the set of clauses is to be run:  if it is named by
+ * one of the arguments, or if no set is named.
+ */
+int
+clause_selected(const clause_t *c, int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(c->c_name, argv[i]) == 0)
+			return (1);
+	}
+
+	return (argc == 1);
+}
+
+/*
+ * Initializes the harness for CLAUSE_NCPUS CPUs with the buffer size and
+ * string size of the sets, describes every set to it, and allocates the
+ * CPUs' buffers.  Returns -1 if they cannot be allocated.
+ */
+int
+clause_init(void)
+{
+	processorid_t cpu;
+	clause_t *c;
+
+	bench_init(CLAUSE_NCPUS);
+	bench_setopt(DTRACEOPT_BUFSIZE, CLAUSE_BUFSIZE);
+	bench_setopt(DTRACEOPT_STRSIZE, CLAUSE_STRSIZE);
+
+	for (c = clauses; c->c_name != NULL; c++)
+		c->c_epid = bench_eprobe(c->c_probe, c->c_recs, c->c_nrecs,
+		    c->c_fmt);
+
+	for (cpu = 0; cpu < CLAUSE_NCPUS; cpu++) {
+		if ((clause_bufs[cpu] = malloc(CLAUSE_BUFSIZE)) == NULL)
+			return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Fills a principal buffer with records of the set of clauses, and returns
+ * how many it holds.
+ */
+static ulong_t
+clause_fill(char *buf, const clause_t *c, processorid_t cpu)
+{
+	const dtrace_eprobedesc_t *epd = bench_eprobedesc(c->c_epid);
+	ulong_t i, n = CLAUSE_BUFSIZE / epd->dtepd_size;
+
+	bzero(buf, CLAUSE_BUFSIZE);
+
+	for (i = 0; i < n; i++) {
+		char *data = buf + i * epd->dtepd_size;
+		dtrace_rechdr_t *hdr = (dtrace_rechdr_t *)data;
+		uint64_t ts = 1000000000ULL + (i * CLAUSE_NCPUS + cpu) * 1000;
+
+		hdr->dtrh_epid = c->c_epid;
+		DTRACE_RECORD_STORE_TIMESTAMP(hdr, ts);
+		c->c_fill(data, epd, i * CLAUSE_NCPUS + cpu);
+	}
+
+	return (n);
+}
+
+/*
+ * Fills each CPU's buffer with records of the set of clauses, gives them to
+ * the harness, and returns how many records they hold in all.  If the set
+ * is NULL, the harness is left with empty buffers.
+ */
+ulong_t
+clause_setbufs(const clause_t *c)
+{
+	ulong_t n = 0, nrecs;
+	processorid_t cpu;
+	size_t size;
+
+	for (cpu = 0; cpu < CLAUSE_NCPUS; cpu++) {
+		if (c == NULL) {
+			bench_setbuf(cpu, NULL, 0);
+			continue;
+		}
+
+		size = bench_eprobedesc(c->c_epid)->dtepd_size;
+		nrecs = clause_fill(clause_bufs[cpu], c, cpu);
+		bench_setbuf(cpu, clause_bufs[cpu], nrecs * size);
+		n += nrecs;
+	}
+
+	return (n);
+}
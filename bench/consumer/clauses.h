@@ -0,0 +1,64 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Sets of clauses whose records fill the principal buffers of the drivers
+ * that consume them (see clauses.c).
+ */
+
+#ifndef _CLAUSES_H
+#define	_CLAUSES_H
+
+#include "bench.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	CLAUSE_NCPUS	4			/* CPUs with buffers */
+#define	CLAUSE_BUFSIZE	(1024 * 1024)		/* size of each buffer */
+#define	CLAUSE_STRSIZE	256			/* strsize option */
+
+typedef void clause_fill_f(char *, const dtrace_eprobedesc_t *, ulong_t);
+
+typedef struct clause {
+	const char *c_name;			/* name of set of clauses */
+	const char *c_probe;			/* name of probe */
+	const bench_rec_t *c_recs;		/* records traced */
+	int c_nrecs;				/* number of records */
+	const char *c_fmt;			/* printf() format, if any */
+	clause_fill_f *c_fill;			/* fills in a record */
+	dtrace_epid_t c_epid;			/* EPID once described */
+} clause_t;
+
+extern clause_t clauses[];
+extern char *clause_bufs[CLAUSE_NCPUS];
+
+extern int clause_args(int, char **);
+extern int clause_selected(const clause_t *, int, char **);
+extern int clause_init(void);
+extern ulong_t clause_setbufs(const clause_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* _CLAUSES_H */
@@ -0,0 +1,201 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Rate at which dtrace_consume() formats what the kernel traced.
+ *
+ * Each set of clauses of clauses.c is consumed with callbacks that print
+ * what dtrace(1M) prints by default:  the CPU and the probe, then the
+ * records as the library formats them.  The stack frames are printed as
+ * addresses, because this build finds no symbols.  Where the library has
+ * the "oformat" option, each set is then consumed again as JSON lines, as
+ * dtrace -x oformat=json prints them.  Each row reports the records consumed
+ * per pass, the rate of the best pass in records per second, and the time
+ * per record in nanoseconds.  With -f, only the named format is used.
+ *
+ * Output goes to /dev/null, or to a file with -o, to compare the output of
+ * one build of the library with that of another.
+ *
+ * usage: consbench [-n passes] [-f text|json] [-o file] [clauses ...]
+ */
+
+#include <string.h>
+#include "clauses.h"
+
+static const struct {
+	const char *f_name;			/* name of format */
+	dtrace_optval_t f_oformat;		/* value of "oformat" */
+} formats[] = {
+	{ "text", 0 },
+#ifdef DTRACEOPT_OFORMAT
+	{ "json", DTRACEOPT_OFORMAT_JSON },
+#endif
+	{ NULL }
+};
+
+static int json;
+
+/*
+ * The probe and record callbacks of dtrace(1M), less its options.
+ */
+static int
+chew(const dtrace_probedata_t *data, void *arg)
+{
+	dtrace_probedesc_t *pd = data->dtpda_pdesc;
+	char name[DTRACE_FUNCNAMELEN + DTRACE_NAMELEN + 2];
+
+	/*
+	 * In JSON mode, the CPU and probe are members of the record itself.
+	 */
+	if (json)
+		return (DTRACE_CONSUME_THIS);
+
+	(void) snprintf(name, sizeof (name), "%s:%s", pd->dtpd_func,
+	    pd->dtpd_name);
+	(void) fprintf(arg, "%3d %6d %32s ", data->dtpda_cpu, pd->dtpd_id,
+	    name);
+
+	return (DTRACE_CONSUME_THIS);
+}
+
+static int
+chewrec(const dtrace_probedata_t *data, const dtrace_recdesc_t *rec,
+    void *arg)
+{
+	if (rec == NULL) {
+		if (!json)
+			(void) fprintf(arg, "\n");
+
+		return (DTRACE_CONSUME_NEXT);
+	}
+
+	return (DTRACE_CONSUME_THIS);
+}
+
+/*
+ * Consumes the n records of the set of clauses in the buffers in the
+ * specified format, and reports the rate of the best of the passes.  The
+ * output of the first pass, which is enough to compare, goes to ofp.
+ */
+static void
+consume(const clause_t *c, ulong_t n, int f, int passes, FILE *ofp)
+{
+	uint64_t best = 0;
+	int p;
+
+#ifdef DTRACEOPT_OFORMAT
+	bench_setopt(DTRACEOPT_OFORMAT, formats[f].f_oformat);
+#endif
+	json = formats[f].f_oformat != 0;
+
+	for (p = 0; p < passes; p++) {
+		FILE *fp = p == 0 ? ofp : bench_devnull();
+		uint64_t start = bench_hrtime(), elapsed;
+
+		if (dtrace_consume(bench_dtp, fp, chew, chewrec, fp) != 0) {
+			(void) fprintf(stderr, "consbench: %s: %s\n",
+			    c->c_name, dtrace_errmsg(bench_dtp,
+			    dtrace_errno(bench_dtp)));
+			exit(1);
+		}
+
+		elapsed = bench_hrtime() - start;
+
+		if (p == 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	(void) printf("%-10s %-6s %10llu %12.0f %10.1f\n", c->c_name,
+	    formats[f].f_name, n, n * 1e9 / best, (double)best / n);
+	(void) fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *out = NULL, *format = NULL;
+	int passes = 20, f;
+	clause_t *c;
+	FILE *ofp;
+	ulong_t n;
+
+	for (; argc > 2 && argv[1][0] == '-'; argc -= 2, argv += 2) {
+		if (strcmp(argv[1], "-n") == 0)
+			passes = atoi(argv[2]);
+		else if (strcmp(argv[1], "-f") == 0)
+			format = argv[2];
+		else if (strcmp(argv[1], "-o") == 0)
+			out = argv[2];
+		else
+			break;
+	}
+
+	for (f = 0; format != NULL && formats[f].f_name != NULL; f++) {
+		if (strcmp(formats[f].f_name, format) == 0)
+			break;
+	}
+
+	if (clause_args(argc, argv) != argc || passes < 1 ||
+	    (format != NULL && formats[f].f_name == NULL)) {
+		(void) fprintf(stderr, "usage: consbench [-n passes] "
+		    "[-f text|json] [-o file] [clauses ...]\n");
+		return (2);
+	}
+
+	if (out == NULL) {
+		ofp = bench_devnull();
+	} else if ((ofp = fopen(out, "w")) == NULL) {
+		(void) fprintf(stderr, "consbench: failed to open %s\n", out);
+		return (1);
+	}
+
+	if (clause_init() != 0) {
+		(void) fprintf(stderr, "consbench: out of memory\n");
+		return (1);
+	}
+
+	bench_go();
+
+	(void) printf("%-10s %-6s %10s %12s %10s\n", "CLAUSES", "FORMAT",
+	    "RECORDS", "RECORDS/S", "NS/REC");
+
+	for (c = clauses; c->c_name != NULL; c++) {
+		if (!clause_selected(c, argc, argv))
+			continue;
+
+		n = clause_setbufs(c);
+
+		for (f = 0; formats[f].f_name != NULL; f++) {
+			if (format == NULL ||
+			    strcmp(formats[f].f_name, format) == 0)
+				consume(c, n, f, passes, ofp);
+		}
+
+		(void) clause_setbufs(NULL);
+	}
+
+	if (out != NULL)
+		(void) fclose(ofp);
+
+	bench_fini();
+
+	return (0);
+}
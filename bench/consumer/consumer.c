@@ -0,0 +1,775 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The consumer side of libdtrace, built for Linux (see README).  This file
+ * stands in for the parts of the library and of the system that the
+ * consumer interfaces reach but that a benchmark of them does not need --
+ * processes, modules, symbols and the D compiler -- and for dtrace(7D)
+ * itself, which it reaches through the vector of a vectored open.
+ */
+
+#include <bench.h>
+#include <dt_printf.h>
+#include <dt_program.h>
+#include <dt_pid.h>
+#include <dt_etw_trace.h>
+#include <ctf_impl.h>
+
+/*
+ * The inline functions of <ntcompat.h> and <pthread.h> need an external
+ * definition for the calls that the compiler chooses not to inline.
+ */
+extern hrtime_t gethrtime(void);
+extern int pthread_mutex_init(pthread_mutex_t *, const pthread_mutexattr_t *);
+extern int pthread_mutex_destroy(pthread_mutex_t *);
+extern int pthread_mutex_lock(pthread_mutex_t *);
+extern int pthread_mutex_trylock(pthread_mutex_t *);
+extern int pthread_mutex_unlock(pthread_mutex_t *);
+extern int pthread_cond_init(pthread_cond_t *, const pthread_condattr_t *);
+extern int pthread_cond_destroy(pthread_cond_t *);
+extern int pthread_cond_reltimedwait_np(pthread_cond_t *, pthread_mutex_t *,
+    const struct timespec *);
+extern int pthread_cond_wait(pthread_cond_t *, pthread_mutex_t *);
+extern int pthread_cond_broadcast(pthread_cond_t *);
+
+#define	BENCH_MAXDESC	64		/* descriptions of each kind */
+
+typedef struct bench_buf {
+	const void *bb_data;			/* data to snapshot */
+	size_t bb_size;				/* size of data */
+} bench_buf_t;
+
+typedef struct bench_state {
+	int bs_ncpus;				/* number of CPUs */
+	bench_buf_t *bs_buf;			/* principal buffers */
+	bench_buf_t *bs_aggbuf;			/* aggregation buffers */
+	dtrace_eprobedesc_t *bs_eprobe[BENCH_MAXDESC];
+	dtrace_probedesc_t bs_probe[BENCH_MAXDESC];
+	dtrace_aggdesc_t *bs_agg[BENCH_MAXDESC];
+	char *bs_format[BENCH_MAXDESC];		/* format strings */
+	int bs_neprobes;			/* EPIDs handed out */
+	int bs_naggs;				/* aggregation IDs handed out */
+	int bs_nformats;			/* formats handed out */
+} bench_state_t;
+
+static bench_state_t bench_state;
+static FILE *bench_null;
+
+dtrace_hdl_t *bench_dtp;
+
+int _dtrace_debug = 0;
+int _dtrace_strbuckets = 211;
+uint_t _dtrace_stkindent = 14;
+dt_pcb_t *yypcb;
+
+/*
+ * The driver.  Snapshots copy the data that the benchmark gave for the CPU;
+ * descriptions are those that bench_eprobe() and bench_agg() built.
+ */
+static int
+bench_snap(const bench_buf_t *bb, dtrace_bufdesc_t *buf)
+{
+	if (buf->dtbd_cpu >= bench_state.bs_ncpus) {
+		errno = ENOENT;
+		return (-1);
+	}
+
+	bb = &bb[buf->dtbd_cpu];
+
+	if (bb->bb_size > buf->dtbd_size) {
+		errno = ENOMEM;
+		return (-1);
+	}
+
+	bcopy(bb->bb_data, buf->dtbd_data, bb->bb_size);
+	buf->dtbd_size = bb->bb_size;
+	buf->dtbd_oldest = 0;
+	buf->dtbd_drops = 0;
+	buf->dtbd_errors = 0;
+#ifdef DTRACEBD_SPILLED
+	buf->dtbd_flags = 0;
+#endif
+	buf->dtbd_timestamp = gethrtime();
+
+	return (0);
+}
+
+static int
+bench_ioctl(void *arg, ulong_t cmd, void *data)
+{
+	bench_state_t *bs = arg;
+	dtrace_eprobedesc_t *epd = data, *ep;
+	dtrace_aggdesc_t *agd = data, *ag;
+	dtrace_probedesc_t *pd = data;
+	dtrace_fmtdesc_t *fmt = data;
+	int nrecs;
+
+	switch (cmd) {
+	case DTRACEIOC_BUFSNAP:
+		return (bench_snap(bs->bs_buf, data));
+
+	case DTRACEIOC_AGGSNAP:
+		return (bench_snap(bs->bs_aggbuf, data));
+
+	case DTRACEIOC_EPROBE:
+		if (epd->dtepd_epid == DTRACE_EPIDNONE ||
+		    epd->dtepd_epid > bs->bs_neprobes)
+			break;
+
+		ep = bs->bs_eprobe[epd->dtepd_epid - 1];
+		nrecs = MIN(epd->dtepd_nrecs, ep->dtepd_nrecs);
+		bcopy(ep, epd, offsetof(dtrace_eprobedesc_t, dtepd_rec));
+		bcopy(ep->dtepd_rec, epd->dtepd_rec,
+		    nrecs * sizeof (dtrace_recdesc_t));
+		return (0);
+
+	case DTRACEIOC_PROBES:
+		if (pd->dtpd_id == DTRACE_IDNONE ||
+		    pd->dtpd_id > bs->bs_neprobes)
+			break;
+
+		*pd = bs->bs_probe[pd->dtpd_id - 1];
+		return (0);
+
+	case DTRACEIOC_AGGDESC:
+		if (agd->dtagd_id == DTRACE_AGGIDNONE ||
+		    agd->dtagd_id > bs->bs_naggs)
+			break;
+
+		ag = bs->bs_agg[agd->dtagd_id - 1];
+		nrecs = MIN(agd->dtagd_nrecs, ag->dtagd_nrecs);
+		bcopy(ag, agd, offsetof(dtrace_aggdesc_t, dtagd_rec));
+		bcopy(ag->dtagd_rec, agd->dtagd_rec,
+		    nrecs * sizeof (dtrace_recdesc_t));
+		return (0);
+
+	case DTRACEIOC_FORMAT:
+		if (fmt->dtfd_format == 0 ||
+		    fmt->dtfd_format > bs->bs_nformats)
+			break;
+
+		if (fmt->dtfd_length == 0) {
+			fmt->dtfd_length =
+			    strlen(bs->bs_format[fmt->dtfd_format - 1]) + 1;
+		} else {
+			(void) strcpy(fmt->dtfd_string,
+			    bs->bs_format[fmt->dtfd_format - 1]);
+		}
+		return (0);
+
+	default:
+		errno = ENOTTY;
+		return (-1);
+	}
+
+	errno = EINVAL;
+	return (-1);
+}
+
+/*ARGSUSED*/
+static int
+bench_lookup_by_addr(void *arg, GElf_Addr addr, GElf_Sym *symp,
+    dtrace_syminfo_t *sip)
+{
+	return (-1);
+}
+
+static int
+bench_status(void *arg, processorid_t cpu)
+{
+	bench_state_t *bs = arg;
+
+	return (cpu >= 0 && cpu < bs->bs_ncpus ? P_ONLINE : -1);
+}
+
+static long
+bench_sysconf(void *arg, int name)
+{
+	bench_state_t *bs = arg;
+
+	switch (name) {
+	case _SC_CPUID_MAX:
+		return (bs->bs_ncpus - 1);
+	case _SC_NPROCESSORS_MAX:
+		return (bs->bs_ncpus);
+	default:
+		return (-1);
+	}
+}
+
+static const dtrace_vector_t bench_vector = {
+	bench_ioctl,
+	bench_lookup_by_addr,
+	bench_status,
+	bench_sysconf
+};
+
+/*
+ * Lays out the records of an enabled probe or of an aggregation from off
+ * onwards, as the kernel does, and returns the offset of their end.
+ */
+static uint32_t
+bench_layout(dtrace_recdesc_t *rec, const bench_rec_t *br, int nrecs,
+    uint32_t off, uint16_t format)
+{
+	int i;
+
+	for (i = 0; i < nrecs; i++) {
+		uint32_t size = br[i].br_size;
+		uint16_t align = (size & 7) ? (size == 1 || size == 2 ||
+		    size == 4 ? size : 1) : 8;
+
+		off = P2ROUNDUP(off, align);
+		bzero(&rec[i], sizeof (dtrace_recdesc_t));
+		rec[i].dtrd_action = br[i].br_kind;
+		rec[i].dtrd_size = size;
+		rec[i].dtrd_offset = off;
+		rec[i].dtrd_alignment = align;
+		rec[i].dtrd_arg = br[i].br_arg;
+
+		if (DTRACEACT_ISPRINTFLIKE(br[i].br_kind))
+			rec[i].dtrd_format = format;
+
+		off += size;
+	}
+
+	return (off);
+}
+
+static void
+bench_probedesc(dtrace_probedesc_t *pd, const char *name)
+{
+	char *fields[] = { pd->dtpd_name, pd->dtpd_func, pd->dtpd_mod,
+	    pd->dtpd_provider };
+	const size_t lens[] = { DTRACE_NAMELEN, DTRACE_FUNCNAMELEN,
+	    DTRACE_MODNAMELEN, DTRACE_PROVNAMELEN };
+	char buf[DTRACE_FULLNAMELEN], *p;
+	int i;
+
+	(void) snprintf(buf, sizeof (buf), "%s", name);
+
+	for (i = 0; i < BENCH_NELEM(fields); i++) {
+		if ((p = strrchr(buf, ':')) != NULL)
+			*p++ = '\0';
+		else
+			p = buf;
+
+		(void) strncpy(fields[i], p, lens[i] - 1);
+
+		if (p == buf)
+			break;
+	}
+}
+
+/*
+ * Describes an enabled probe that traces the given records, and returns its
+ * EPID, which is also its probe's ID.  The probe is named as in D, with any
+ * of provider, module and function left out from the left.  If fmt is not
+ * NULL, it is the format of the printf()-like actions among the records.
+ */
+dtrace_epid_t
+bench_eprobe(const char *name, const bench_rec_t *br, int nrecs,
+    const char *fmt)
+{
+	bench_state_t *bs = &bench_state;
+	dtrace_eprobedesc_t *epd;
+	dtrace_probedesc_t *pd;
+	dtrace_epid_t epid = bs->bs_neprobes + 1;
+	uint16_t format = 0;
+	uint32_t size;
+
+	if (bs->bs_neprobes == BENCH_MAXDESC)
+		abort();
+
+	if (fmt != NULL) {
+		if (bs->bs_nformats == BENCH_MAXDESC)
+			abort();
+
+		bs->bs_format[bs->bs_nformats++] = strdup(fmt);
+		format = bs->bs_nformats;
+	}
+
+	epd = calloc(1, sizeof (dtrace_eprobedesc_t) +
+	    MAX(nrecs, 1) * sizeof (dtrace_recdesc_t));
+
+	if (epd == NULL)
+		abort();
+
+	size = bench_layout(epd->dtepd_rec, br, nrecs,
+	    sizeof (dtrace_rechdr_t), format);
+
+	epd->dtepd_epid = epid;
+	epd->dtepd_probeid = epid;
+	epd->dtepd_size = P2ROUNDUP(size, sizeof (uint64_t));
+	epd->dtepd_nrecs = nrecs;
+
+	pd = &bs->bs_probe[bs->bs_neprobes];
+	bzero(pd, sizeof (dtrace_probedesc_t));
+	pd->dtpd_id = epid;
+	bench_probedesc(pd, name);
+
+	bs->bs_eprobe[bs->bs_neprobes++] = epd;
+
+	return (epid);
+}
+
+/*
+ * Describes an aggregation of the given enabled probe, and returns its ID.
+ * Its data are laid out as those of the kernel: the aggregation ID, the
+ * variable ID (in a record of its own, as the first key), the keys and the
+ * value.
+ */
+dtrace_aggid_t
+bench_agg(dtrace_epid_t epid, const bench_rec_t *keys, int nkeys,
+    const bench_rec_t *val)
+{
+	bench_state_t *bs = &bench_state;
+	dtrace_aggdesc_t *agd;
+	bench_rec_t varid = { DTRACEACT_DIFEXPR, sizeof (uint64_t), 0 };
+	uint32_t size;
+
+	if (bs->bs_naggs == BENCH_MAXDESC)
+		abort();
+
+	agd = calloc(1, sizeof (dtrace_aggdesc_t) +
+	    (nkeys + 2) * sizeof (dtrace_recdesc_t));
+
+	if (agd == NULL)
+		abort();
+
+	size = bench_layout(&agd->dtagd_rec[0], &varid, 1,
+	    sizeof (dtrace_aggid_t), 0);
+	size = bench_layout(&agd->dtagd_rec[1], keys, nkeys, size, 0);
+	size = bench_layout(&agd->dtagd_rec[nkeys + 1], val, 1, size, 0);
+
+	agd->dtagd_id = bs->bs_naggs + 1;
+	agd->dtagd_epid = epid;
+	agd->dtagd_size = size;
+	agd->dtagd_nrecs = nkeys + 2;
+
+	bs->bs_agg[bs->bs_naggs++] = agd;
+
+	return (agd->dtagd_id);
+}
+
+const dtrace_eprobedesc_t *
+bench_eprobedesc(dtrace_epid_t epid)
+{
+	return (bench_state.bs_eprobe[epid - 1]);
+}
+
+const dtrace_aggdesc_t *
+bench_aggdesc(dtrace_aggid_t id)
+{
+	return (bench_state.bs_agg[id - 1]);
+}
+
+/*
+ * Gives the data that the principal or the aggregation buffer of a CPU
+ * holds.  The data are copied out on each snapshot of the buffer, and must
+ * remain valid until they are replaced.
+ */
+void
+bench_setbuf(processorid_t cpu, const void *data, size_t size)
+{
+	bench_state.bs_buf[cpu].bb_data = data;
+	bench_state.bs_buf[cpu].bb_size = size;
+}
+
+void
+bench_setaggbuf(processorid_t cpu, const void *data, size_t size)
+{
+	bench_state.bs_aggbuf[cpu].bb_data = data;
+	bench_state.bs_aggbuf[cpu].bb_size = size;
+}
+
+/*
+ * Opens a handle on a system of ncpus CPUs.  This builds the handle as
+ * dtrace_vopen() does, less everything that serves the compiler.
+ */
+void
+bench_init(int ncpus)
+{
+	bench_state_t *bs = &bench_state;
+	dtrace_hdl_t *dtp;
+	int i;
+
+	bs->bs_ncpus = ncpus;
+	bs->bs_buf = calloc(ncpus, sizeof (bench_buf_t));
+	bs->bs_aggbuf = calloc(ncpus, sizeof (bench_buf_t));
+
+	if ((dtp = calloc(1, sizeof (dtrace_hdl_t))) == NULL ||
+	    bs->bs_buf == NULL || bs->bs_aggbuf == NULL)
+		abort();
+
+	dtp->dt_version = DTRACE_VERSION;
+	dtp->dt_fd = -1;
+	dtp->dt_ftfd = -1;
+	dtp->dt_cdefs_fd = -1;
+	dtp->dt_ddefs_fd = -1;
+	dtp->dt_vector = &bench_vector;
+	dtp->dt_varg = bs;
+	dtp->dt_beganon = -1;
+	dtp->dt_endedon = -1;
+
+	for (i = 0; i < DTRACEOPT_MAX; i++)
+		dtp->dt_options[i] = DTRACEOPT_UNSET;
+
+	/*
+	 * Consume and snapshot whenever asked to, and on every CPU.
+	 */
+	dtp->dt_options[DTRACEOPT_SWITCHRATE] = 0;
+	dtp->dt_options[DTRACEOPT_AGGRATE] = 0;
+	dtp->dt_options[DTRACEOPT_CPU] = DTRACE_CPUALL;
+
+	if (dt_pfdict_create(dtp) == -1)
+		abort();
+
+	bench_dtp = dtp;
+}
+
+void
+bench_setopt(int option, dtrace_optval_t val)
+{
+	bench_dtp->dt_options[option] = val;
+}
+
+/*
+ * Starts tracing: the counterpart of dtrace_go() once the kernel has
+ * taken the enablings.
+ */
+void
+bench_go(void)
+{
+	bench_dtp->dt_active = 1;
+
+	if (dt_aggregate_go(bench_dtp) != 0)
+		abort();
+}
+
+/*
+ * Closes the handle, and forgets the descriptions and the buffers, so that
+ * bench_init() may open another.
+ */
+void
+bench_fini(void)
+{
+	bench_state_t *bs = &bench_state;
+	dtrace_hdl_t *dtp = bench_dtp;
+	int i;
+
+	dt_aggregate_destroy(dtp);
+	dt_aggid_destroy(dtp);
+	dt_format_destroy(dtp);
+	dt_strdata_destroy(dtp);
+	dt_epid_destroy(dtp);
+	dt_pfdict_destroy(dtp);
+	free(dtp);
+
+	for (i = 0; i < bs->bs_neprobes; i++)
+		free(bs->bs_eprobe[i]);
+
+	for (i = 0; i < bs->bs_naggs; i++)
+		free(bs->bs_agg[i]);
+
+	for (i = 0; i < bs->bs_nformats; i++)
+		free(bs->bs_format[i]);
+
+	free(bs->bs_buf);
+	free(bs->bs_aggbuf);
+	bzero(bs, sizeof (bench_state_t));
+	bench_dtp = NULL;
+}
+
+FILE *
+bench_devnull(void)
+{
+	if (bench_null == NULL &&
+	    (bench_null = fopen("/dev/null", "w")) == NULL)
+		abort();
+
+	return (bench_null);
+}
+
+/*
+ * What follows stands in for the rest of the library.  Symbols are never
+ * found, and there are no processes or modules.
+ */
+/*ARGSUSED*/
+int
+dtrace_lookup_by_addr(dtrace_hdl_t *dtp, GElf_Addr addr, GElf_Sym *symp,
+    dtrace_syminfo_t *sip)
+{
+	return (dt_set_errno(dtp, EDT_NOSYMADDR));
+}
+
+/*ARGSUSED*/
+int
+dtrace_object_info(dtrace_hdl_t *dtp, const char *object,
+    dtrace_objinfo_t *dto)
+{
+	return (dt_set_errno(dtp, EDT_NOMOD));
+}
+
+/*
+ * Of the options, only those that the kernel reports are read by the
+ * consumer interfaces; none is set by them here.
+ */
+int
+dtrace_getopt(dtrace_hdl_t *dtp, const char *opt, dtrace_optval_t *val)
+{
+	static const struct {
+		const char *o_name;
+		int o_option;
+	} opts[] = {
+		{ "aggsize", DTRACEOPT_AGGSIZE },
+		{ "bufsize", DTRACEOPT_BUFSIZE },
+		{ "cpu", DTRACEOPT_CPU },
+		{ "strsize", DTRACEOPT_STRSIZE }
+	};
+	int i;
+
+	for (i = 0; i < BENCH_NELEM(opts); i++) {
+		if (strcmp(opts[i].o_name, opt) == 0) {
+			*val = dtp->dt_options[opts[i].o_option];
+			return (0);
+		}
+	}
+
+	return (dt_set_errno(dtp, EDT_BADOPTNAME));
+}
+
+/*ARGSUSED*/
+int
+dtrace_setopt(dtrace_hdl_t *dtp, const char *opt, const char *val)
+{
+	return (dt_set_errno(dtp, EDT_BADOPTNAME));
+}
+
+/*
+ * The printf() conversions refer to D types, which this build has none of.
+ * Those types only serve to check the arguments of a conversion when a
+ * program is compiled.
+ */
+/*ARGSUSED*/
+int
+dtrace_lookup_by_type(dtrace_hdl_t *dtp, const char *object,
+    const char *name, dtrace_typeinfo_t *tip)
+{
+	bzero(tip, sizeof (dtrace_typeinfo_t));
+	return (0);
+}
+
+/*ARGSUSED*/
+dt_module_t *
+dt_module_lookup_by_name(dtrace_hdl_t *dtp, const char *name)
+{
+	return (NULL);
+}
+
+/*ARGSUSED*/
+ctf_file_t *
+dt_module_getctf(dtrace_hdl_t *dtp, dt_module_t *dmp)
+{
+	return (NULL);
+}
+
+/*
+ * CPUs are online as the driver says.  CTF containers are only ever built
+ * in memory, never read from a file.
+ */
+/*ARGSUSED*/
+int
+p_online(processorid_t cpu, int flag)
+{
+	return (bench_status(&bench_state, cpu));
+}
+
+/*ARGSUSED*/
+void
+ctf_sect_munmap(const ctf_sect_t *sp)
+{
+}
+
+/*ARGSUSED*/
+void *
+ctf_zopen(int *errp)
+{
+	*errp = ECTF_ZMISSING;
+	return (NULL);
+}
+
+/*ARGSUSED*/
+int
+z_uncompress(void *dst, size_t *dstlen, const void *src, size_t srclen)
+{
+	return (-1);
+}
+
+/*ARGSUSED*/
+const char *
+z_strerror(int err)
+{
+	return ("compression is not supported");
+}
+
+/*ARGSUSED*/
+struct ps_prochandle *
+dt_proc_grab(dtrace_hdl_t *dtp, pid_t pid, int flags, int nomonitor)
+{
+	(void) dt_set_errno(dtp, ENOTSUP);
+	return (NULL);
+}
+
+/*ARGSUSED*/
+void
+dt_proc_release(dtrace_hdl_t *dtp, struct ps_prochandle *P)
+{
+}
+
+/*ARGSUSED*/
+void
+dt_proc_lock(dtrace_hdl_t *dtp, struct ps_prochandle *P)
+{
+}
+
+/*ARGSUSED*/
+void
+dt_proc_unlock(dtrace_hdl_t *dtp, struct ps_prochandle *P)
+{
+}
+
+/*ARGSUSED*/
+dt_ident_t *
+dt_idhash_lookup(dt_idhash_t *dhp, const char *name)
+{
+	return (NULL);
+}
+
+/*
+ * Nodes of the parse tree only reach the printf() code when a program is
+ * compiled.
+ */
+/*ARGSUSED*/
+size_t
+dt_node_type_size(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dt_node_is_integer(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dt_node_is_float(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dt_node_is_string(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dt_node_is_stack(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dt_node_is_symaddr(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dt_node_is_usymaddr(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dt_node_is_pointer(const dt_node_t *dnp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+void
+yywarn(const char *format, ...)
+{
+}
+
+/*ARGSUSED*/
+char *
+proc_objname(struct proc_handle *P, uintptr_t addr, char *buf, size_t len)
+{
+	return (NULL);
+}
+
+/*ARGSUSED*/
+int
+proc_addr2sym(struct proc_handle *P, uintptr_t addr, char *buf, size_t len,
+    GElf_Sym *symp)
+{
+	return (-1);
+}
+
+/*ARGSUSED*/
+uint64_t
+proc_addr2map(struct proc_handle *P, uintptr_t addr)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+uint64_t
+proc_name2map(struct proc_handle *P, const char *name)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+void
+dt_etw_trace_validate(dt_etw_trace_desc_t *desc)
+{
+}
+
+/*ARGSUSED*/
+int
+dt_etw_trace(dtrace_hdl_t *dtp, FILE *fp, dt_etw_trace_desc_t *desc,
+    const dtrace_recdesc_t *rec, uint_t nrecs, const void *buf, size_t len)
+{
+	return (dt_set_errno(dtp, ENOTSUP));
+}
@@ -0,0 +1,214 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The parts of the C runtime and of Win32 that libdtrace calls, and the
+ * clock.  This is the one file of the user-mode build that is compiled
+ * against the host's headers rather than the shims in inc/.
+ */
+
+#define	_GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef unsigned int DWORD;
+typedef DWORD (*bench_thread_f)(void *);
+
+typedef struct bench_thread {
+	bench_thread_f bt_func;			/* thread function */
+	void *bt_arg;				/* its argument */
+} bench_thread_t;
+
+uint64_t
+bench_hrtime(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+void
+QueryInterruptTimePrecise(uint64_t *t)
+{
+	/*
+	 * The interrupt time counts in units of 100ns.
+	 */
+	*t = bench_hrtime() / 100;
+}
+
+void
+InitializeSRWLock(pthread_mutex_t *lock)
+{
+	(void) pthread_mutex_init(lock, NULL);
+}
+
+void
+AcquireSRWLockExclusive(pthread_mutex_t *lock)
+{
+	(void) pthread_mutex_lock(lock);
+}
+
+unsigned char
+TryAcquireSRWLockExclusive(pthread_mutex_t *lock)
+{
+	return (pthread_mutex_trylock(lock) == 0);
+}
+
+void
+ReleaseSRWLockExclusive(pthread_mutex_t *lock)
+{
+	(void) pthread_mutex_unlock(lock);
+}
+
+void
+InitializeConditionVariable(pthread_cond_t *cv)
+{
+	(void) pthread_cond_init(cv, NULL);
+}
+
+int
+SleepConditionVariableSRW(pthread_cond_t *cv, pthread_mutex_t *lock,
+    DWORD ms, unsigned int flags)
+{
+	struct timespec ts;
+
+	if (ms == 0xffffffff)
+		return (pthread_cond_wait(cv, lock) == 0);
+
+	(void) clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (long)(ms % 1000) * 1000000;
+
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	return (pthread_cond_timedwait(cv, lock, &ts) == 0);
+}
+
+void
+WakeAllConditionVariable(pthread_cond_t *cv)
+{
+	(void) pthread_cond_broadcast(cv);
+}
+
+static void *
+bench_thread(void *arg)
+{
+	bench_thread_t t = *(bench_thread_t *)arg;
+
+	free(arg);
+	(void) t.bt_func(t.bt_arg);
+
+	return (NULL);
+}
+
+/*
+ * Threads are only ever created running and joined, so a thread's handle
+ * is its pthread_t.
+ */
+void *
+CreateThread(void *attr, size_t stack, bench_thread_f func, void *arg,
+    DWORD flags, DWORD *id)
+{
+	bench_thread_t *t;
+	pthread_t tid;
+
+	if ((t = malloc(sizeof (bench_thread_t))) == NULL)
+		return (NULL);
+
+	t->bt_func = func;
+	t->bt_arg = arg;
+
+	if (pthread_create(&tid, NULL, bench_thread, t) != 0) {
+		free(t);
+		return (NULL);
+	}
+
+	return ((void *)tid);
+}
+
+DWORD
+WaitForSingleObject(void *handle, DWORD ms)
+{
+	return (pthread_join((pthread_t)handle, NULL) == 0 ? 0 : 0xffffffff);
+}
+
+int
+CloseHandle(void *handle)
+{
+	return (1);
+}
+
+char *
+_strdup(const char *s)
+{
+	return (strdup(s));
+}
+
+int
+_stricmp(const char *s1, const char *s2)
+{
+	return (strcasecmp(s1, s2));
+}
+
+int
+_fileno(FILE *fp)
+{
+	return (fileno(fp));
+}
+
+int
+_write(int fd, const void *buf, unsigned int len)
+{
+	return ((int)write(fd, buf, len));
+}
+
+unsigned long long
+_strtoui64(const char *s, char **end, int base)
+{
+	return (strtoull(s, end, base));
+}
+
+size_t
+strlcpy(char *dst, const char *src, size_t len)
+{
+	size_t n = strlen(src);
+
+	if (len != 0) {
+		size_t c = n < len - 1 ? n : len - 1;
+
+		(void) memcpy(dst, src, c);
+		dst[c] = '\0';
+	}
+
+	return (n);
+}
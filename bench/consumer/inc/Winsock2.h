@@ -0,0 +1,68 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The parts of Winsock that dt_printf.c and <libproc_compat.h> use.  Only the
+ * printf() conversions for addresses and ports call these, and nothing here
+ * formats those.
+ */
+
+#ifndef _BENCH_WINSOCK2_H
+#define	_BENCH_WINSOCK2_H
+
+typedef unsigned char u_char;
+typedef unsigned short u_short;
+typedef unsigned int u_int;
+typedef unsigned long u_long;
+
+#define	AF_INET		2
+#define	AF_INET6	23
+
+struct in_addr {
+	union {
+		u_char s_b[4];
+		u_int S_addr;
+	} S_un;
+};
+
+struct hostent {
+	char *h_name;
+	char **h_aliases;
+	short h_addrtype;
+	short h_length;
+	char **h_addr_list;
+};
+
+struct servent {
+	char *s_name;
+	char **s_aliases;
+	char *s_proto;
+	short s_port;
+};
+
+extern u_short htons(u_short);
+extern u_short ntohs(u_short);
+extern u_long htonl(u_long);
+extern u_long ntohl(u_long);
+extern struct hostent *gethostbyaddr(const char *, int, int);
+extern struct servent *getservbyport(int, const char *);
+
+#endif /* _BENCH_WINSOCK2_H */
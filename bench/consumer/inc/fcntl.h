@@ -0,0 +1,39 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The open flags of the Microsoft CRT.  The host's <fcntl.h> would bring in
+ * POSIX types that <ntcompat.h> defines differently.
+ */
+
+#ifndef _BENCH_FCNTL_H
+#define	_BENCH_FCNTL_H
+
+#define	O_RDONLY	0x0000
+#define	O_WRONLY	0x0001
+#define	O_RDWR		0x0002
+#define	O_APPEND	0x0008
+#define	O_CREAT		0x0100
+#define	O_TRUNC		0x0200
+#define	O_EXCL		0x0400
+#define	O_BINARY	0x8000
+
+#endif /* _BENCH_FCNTL_H */
@@ -0,0 +1,47 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The integer limits that the Microsoft toolset defines in <intsafe.h>.
+ * <ntcompat.h> includes this after <stdarg.h> and then defines va_copy()
+ * itself, so the host's definition is dropped here rather than redefined
+ * (<stdint.h> puts it back).
+ */
+
+#ifndef _BENCH_INTSAFE_H
+#define	_BENCH_INTSAFE_H
+
+#undef	va_copy
+
+#define	INT8_MIN	(-127 - 1)
+#define	INT16_MIN	(-32767 - 1)
+#define	INT32_MIN	(-2147483647 - 1)
+#define	INT64_MIN	(-9223372036854775807LL - 1)
+#define	INT8_MAX	127
+#define	INT16_MAX	32767
+#define	INT32_MAX	2147483647
+#define	INT64_MAX	9223372036854775807LL
+#define	UINT8_MAX	0xff
+#define	UINT16_MAX	0xffff
+#define	UINT32_MAX	0xffffffffU
+#define	UINT64_MAX	0xffffffffffffffffULL
+
+#endif /* _BENCH_INTSAFE_H */
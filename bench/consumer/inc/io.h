@@ -0,0 +1,36 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The low-level I/O of the Microsoft CRT.  host.c implements those that the
+ * consumer calls.
+ */
+
+#ifndef _BENCH_IO_H
+#define	_BENCH_IO_H
+
+extern int _open(const char *, int, ...);
+extern int _close(int);
+extern int _read(int, void *, unsigned int);
+extern int _write(int, const void *, unsigned int);
+extern long _lseek(int, long, int);
+
+#endif /* _BENCH_IO_H */
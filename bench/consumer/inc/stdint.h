@@ -0,0 +1,37 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * <ntcompat.h> defines the fixed-width types itself, so this only supplies
+ * SIZE_MAX (see <limits.h>).  Its va_copy() assigns one va_list to another,
+ * which gcc's array va_list does not allow; files that include <stdint.h>
+ * after it get gcc's.
+ */
+
+#ifndef _BENCH_STDINT_H
+#define	_BENCH_STDINT_H
+
+#include <limits.h>
+
+#undef	va_copy
+#define	va_copy(d, s)	__builtin_va_copy(d, s)
+
+#endif /* _BENCH_STDINT_H */
@@ -0,0 +1,34 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The host's <stdlib.h>, and the Microsoft CRT names that <ntcompat.h> maps
+ * the POSIX ones to (see <string.h>).
+ */
+
+#ifndef _BENCH_STDLIB_H
+#define	_BENCH_STDLIB_H
+
+#include_next <stdlib.h>
+
+extern unsigned long long _strtoui64(const char *, char **, int);
+
+#endif /* _BENCH_STDLIB_H */
@@ -0,0 +1,134 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The parts of the Windows SDK that libdtrace and <ntcompat.h> use in user
+ * mode.  Only the consumer side is built here, so most of these are the
+ * types that its headers mention.
+ */
+
+#ifndef _BENCH_WINDOWS_H
+#define	_BENCH_WINDOWS_H
+
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+typedef long long intptr_t;
+typedef unsigned long long uintptr_t;
+
+#define	WINAPI
+#define	__in
+#define	_In_
+#define	_Inout_
+#define	_Out_
+#define	__declspec(x)
+#define	__forceinline	static __inline__
+#define	_alloca		__builtin_alloca
+
+#define	VOID		void
+#define	TRUE		1
+#define	FALSE		0
+#define	MAX_PATH	260
+
+typedef char CHAR, *PCHAR, *PSTR, *LPSTR;
+typedef const char *PCSTR, *LPCSTR;
+typedef unsigned char UCHAR, BYTE, BOOLEAN, *PBYTE;
+typedef short SHORT;
+typedef unsigned short USHORT, WORD, WCHAR, *PWSTR;
+typedef const unsigned short *PCWSTR, *LPCWSTR;
+typedef int LONG, BOOL, NTSTATUS;
+typedef unsigned int ULONG, DWORD, *PULONG, *PDWORD, *LPDWORD;
+typedef long long LONGLONG, LONG64, LONG_PTR;
+typedef unsigned long long ULONGLONG, ULONG64, DWORD64, *PULONGLONG;
+typedef unsigned long long ULONG_PTR, DWORD_PTR, SIZE_T, *PULONG_PTR;
+typedef void *PVOID, *LPVOID, *HANDLE, *HMODULE;
+
+typedef struct _GUID {
+	ULONG Data1;
+	USHORT Data2;
+	USHORT Data3;
+	UCHAR Data4[8];
+} GUID;
+
+typedef struct _FILETIME {
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME;
+
+/*
+ * host.c implements these with the host's threads.  The locks and condition
+ * variables are as large as a pthread_mutex_t and a pthread_cond_t, which
+ * are ready to use when zeroed, as SRW locks and condition variables are.
+ */
+typedef struct _SRWLOCK {
+	PVOID Ptr[5];
+} SRWLOCK;
+
+typedef struct _CONDITION_VARIABLE {
+	PVOID Ptr[6];
+} CONDITION_VARIABLE;
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID);
+
+/*
+ * <pthread.h> of the compatibility layer implements these with the routines
+ * above, which host.c implements with the host's own.  The external
+ * definitions in consumer.c must therefore not take the host's names.
+ */
+#define	pthread_mutex_init		bench_pthread_mutex_init
+#define	pthread_mutex_destroy		bench_pthread_mutex_destroy
+#define	pthread_mutex_lock		bench_pthread_mutex_lock
+#define	pthread_mutex_trylock		bench_pthread_mutex_trylock
+#define	pthread_mutex_unlock		bench_pthread_mutex_unlock
+#define	pthread_cond_init		bench_pthread_cond_init
+#define	pthread_cond_destroy		bench_pthread_cond_destroy
+#define	pthread_cond_reltimedwait_np	bench_pthread_cond_reltimedwait_np
+#define	pthread_cond_wait		bench_pthread_cond_wait
+#define	pthread_cond_broadcast		bench_pthread_cond_broadcast
+
+#define	SRWLOCK_INIT	{ 0 }
+#define	INFINITE	0xffffffff
+
+#define	C_ASSERT(e)	typedef char __C_ASSERT__[(e) ? 1 : -1]
+
+#define	FILE_DEVICE_NULL	0x00000015
+#define	METHOD_NEITHER		3
+#define	FILE_ANY_ACCESS		0
+#define	CTL_CODE(t, f, m, a)	(((t) << 16) | ((a) << 14) | ((f) << 2) | (m))
+
+#define	_TRUNCATE	((size_t)-1)
+
+extern void QueryInterruptTimePrecise(PULONGLONG);
+extern void InitializeSRWLock(SRWLOCK *);
+extern void AcquireSRWLockExclusive(SRWLOCK *);
+extern BOOLEAN TryAcquireSRWLockExclusive(SRWLOCK *);
+extern void ReleaseSRWLockExclusive(SRWLOCK *);
+extern void InitializeConditionVariable(CONDITION_VARIABLE *);
+extern BOOL SleepConditionVariableSRW(CONDITION_VARIABLE *, SRWLOCK *,
+    DWORD, ULONG);
+extern void WakeAllConditionVariable(CONDITION_VARIABLE *);
+extern HANDLE CreateThread(PVOID, SIZE_T, LPTHREAD_START_ROUTINE, LPVOID,
+    DWORD, LPDWORD);
+extern DWORD WaitForSingleObject(HANDLE, DWORD);
+extern BOOL CloseHandle(HANDLE);
+
+#endif /* _BENCH_WINDOWS_H */
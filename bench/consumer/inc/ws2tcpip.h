@@ -0,0 +1,44 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The IPv6 parts of Winsock that dt_printf.c uses (see <Winsock2.h>).
+ */
+
+#ifndef _BENCH_WS2TCPIP_H
+#define	_BENCH_WS2TCPIP_H
+
+#include <Winsock2.h>
+
+#define	INET_ADDRSTRLEN		22
+#define	INET6_ADDRSTRLEN	65
+
+struct in6_addr {
+	union {
+		u_char Byte[16];
+		u_short Word[8];
+	} u;
+};
+
+extern int inet_pton(int, const char *, void *);
+extern const char *inet_ntop(int, const void *, char *, size_t);
+
+#endif /* _BENCH_WS2TCPIP_H */
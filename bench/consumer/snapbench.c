@@ -0,0 +1,207 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Cost of aggregation snapshots against the number of keys.
+ *
+ * The aggregation is that of
+ *
+ *	fbt:::entry
+ *	{
+ *		@[tid, arg0] = count();
+ *	}
+ *
+ * with keys -- a thread ID and a kernel address -- that are all distinct.
+ * The keys are spread over as many CPUs as it takes for no CPU to hold more
+ * than 65536 of them, as a large aggregation would be.  Each row reports the
+ * time per key, in nanoseconds, of
+ *
+ *	INSERT	the first snapshot, which finds none of the keys and adds each
+ *		of them to the consumer's hash table
+ *	UPDATE	the best of the snapshots that follow, which find every key and
+ *		add its count to the one that the consumer holds
+ *
+ * Both should stay flat as the number of keys grows.  Every key must be
+ * walked once with the count of all of the snapshots.
+ *
+ * usage: snapbench [-r repetitions] [keys ...]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define	PERCPU		65536
+#define	THREADS		4096
+
+static const ulong_t defsizes[] = { 1000, 10000, 100000, 1000000, 10000000 };
+
+static const bench_rec_t keyrecs[] = {
+	{ DTRACEACT_DIFEXPR, sizeof (uint64_t), 0 },	/* tid */
+	{ DTRACEACT_DIFEXPR, sizeof (uint64_t), 0 }	/* arg0 */
+};
+
+static const bench_rec_t valrec = {
+	DTRACEAGG_COUNT, sizeof (uint64_t), 0
+};
+
+typedef struct walk {
+	ulong_t w_keys;				/* keys walked */
+	ulong_t w_bad;				/* keys with the wrong count */
+	uint64_t w_count;			/* count that each must have */
+} walk_t;
+
+static int
+walk(const dtrace_aggdata_t *agd, void *arg)
+{
+	const dtrace_aggdesc_t *desc = agd->dtada_desc;
+	const dtrace_recdesc_t *rec = &desc->dtagd_rec[desc->dtagd_nrecs - 1];
+	walk_t *w = arg;
+
+	w->w_keys++;
+
+	if (*(uint64_t *)(agd->dtada_data + rec->dtrd_offset) != w->w_count)
+		w->w_bad++;
+
+	return (DTRACE_AGGWALK_NEXT);
+}
+
+static double
+snap(ulong_t n)
+{
+	uint64_t start = bench_hrtime();
+
+	if (dtrace_aggregate_snap(bench_dtp) != 0) {
+		(void) fprintf(stderr, "snapbench: snapshot failed: %s\n",
+		    dtrace_errmsg(bench_dtp, dtrace_errno(bench_dtp)));
+		exit(1);
+	}
+
+	return ((double)(bench_hrtime() - start) / n);
+}
+
+int
+main(int argc, char **argv)
+{
+	ulong_t sizes[32];
+	int nsizes = 0, reps = 3;
+	int i;
+
+	if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+		reps = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+
+	for (i = 1; i < argc && nsizes < BENCH_NELEM(sizes); i++)
+		sizes[nsizes++] = strtoul(argv[i], NULL, 0);
+
+	if (i != argc || reps < 1) {
+		(void) fprintf(stderr, "usage: snapbench [-r repetitions] "
+		    "[keys ...]\n");
+		return (2);
+	}
+
+	if (nsizes == 0) {
+		for (i = 0; i < BENCH_NELEM(defsizes); i++)
+			sizes[nsizes++] = defsizes[i];
+	}
+
+	(void) printf("%10s %6s %10s %10s\n", "KEYS", "CPUS", "INSERT",
+	    "UPDATE");
+
+	for (i = 0; i < nsizes; i++) {
+		ulong_t n = sizes[i], k;
+		int ncpus = (n + PERCPU - 1) / PERCPU;
+		const dtrace_aggdesc_t *agd;
+		dtrace_aggid_t aggid;
+		walk_t w;
+		size_t size;
+		char *data;
+		double ins, upd = 0;
+		int cpu, r;
+
+		if (n == 0) {
+			(void) fprintf(stderr, "snapbench: no keys\n");
+			return (2);
+		}
+
+		bench_init(ncpus);
+		aggid = bench_agg(bench_eprobe("entry", NULL, 0, NULL),
+		    keyrecs, BENCH_NELEM(keyrecs), &valrec);
+		agd = bench_aggdesc(aggid);
+		size = agd->dtagd_size;
+
+		if ((data = calloc(n, size)) == NULL) {
+			(void) fprintf(stderr, "snapbench: out of memory\n");
+			return (1);
+		}
+
+		for (k = 0; k < n; k++) {
+			char *rec = data + k * size;
+
+			*(dtrace_aggid_t *)rec = aggid;
+			*(uint64_t *)(rec + agd->dtagd_rec[0].dtrd_offset) = 1;
+			*(uint64_t *)(rec + agd->dtagd_rec[1].dtrd_offset) =
+			    1000 + 4 * (k % THREADS);
+			*(uint64_t *)(rec + agd->dtagd_rec[2].dtrd_offset) =
+			    0xfffff80000000000ULL + 64 * (k / THREADS);
+			*(uint64_t *)(rec + agd->dtagd_rec[3].dtrd_offset) = 1;
+		}
+
+		for (cpu = 0; cpu < ncpus; cpu++) {
+			ulong_t first = (ulong_t)cpu * PERCPU;
+
+			bench_setaggbuf(cpu, data + first * size,
+			    MIN(n - first, PERCPU) * size);
+		}
+
+		bench_setopt(DTRACEOPT_AGGSIZE, PERCPU * size);
+		bench_go();
+
+		ins = snap(n);
+
+		for (r = 0; r < reps; r++) {
+			double ns = snap(n);
+
+			if (r == 0 || ns < upd)
+				upd = ns;
+		}
+
+		bzero(&w, sizeof (w));
+		w.w_count = reps + 1;
+		(void) dtrace_aggregate_walk(bench_dtp, walk, &w);
+
+		if (w.w_keys != n || w.w_bad != 0) {
+			(void) fprintf(stderr, "snapbench: walked %llu keys of "
+			    "%llu, %llu with the wrong count\n", w.w_keys, n,
+			    w.w_bad);
+			return (1);
+		}
+
+		(void) printf("%10llu %6d %10.1f %10.1f\n", n, ncpus, ins, upd);
+		(void) fflush(stdout);
+
+		bench_fini();
+		free(data);
+	}
+
+	return (0);
+}
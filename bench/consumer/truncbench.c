@@ -0,0 +1,351 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Cost of trunc() against the number of entries of an aggregation.
+ *
+ * The aggregation is that of
+ *
+ *	profile-997
+ *	{
+ *		@stacks[stack()] = sum(arg0);
+ *		@threads[tid] = count();
+ *	}
+ *
+ * with stacks of 8 frames, all distinct, and sums that are often tied.  Each
+ * row reports the time, in milliseconds, of trunc(@stacks, N) by
+ *
+ *	HEAP	dt_aggregate_trunc(), which selects the N entries to keep with
+ *		a bounded heap and sorts only those
+ *	SORTED	a walk in value order that removes every entry past the Nth,
+ *		as dt_trunc() did before
+ *
+ * Each is the best of several runs, each on a fresh snapshot of the same
+ * data.  Both must keep the same stacks, and every entry of @threads.
+ *
+ * usage: truncbench [-r repetitions] [-n keep] [entries ...]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define	PERCPU		65536
+#define	DEPTH		8
+#define	THREADS		1000
+
+#define	STACKS_VARID	1
+#define	THREADS_VARID	2
+
+static const ulong_t defsizes[] = { 10000, 100000, 1000000 };
+
+static const bench_rec_t stackrecs[] = {
+	{ DTRACEACT_STACK, DEPTH * sizeof (uint64_t), DEPTH }
+};
+
+static const bench_rec_t sumrec = { DTRACEAGG_SUM, sizeof (uint64_t), 0 };
+
+static const bench_rec_t tidrecs[] = {
+	{ DTRACEACT_DIFEXPR, sizeof (uint64_t), 0 }
+};
+
+static const bench_rec_t countrec = {
+	DTRACEAGG_COUNT, sizeof (uint64_t), 0
+};
+
+/*
+ * What dt_trunc() did before dt_aggregate_trunc():  remove every entry of
+ * the variable past the Nth of a walk sorted by value.
+ */
+typedef struct trunc {
+	dtrace_aggvarid_t t_id;
+	uint64_t t_remaining;
+} trunc_t;
+
+static int
+trunc_agg(const dtrace_aggdata_t *aggdata, void *arg)
+{
+	trunc_t *trunc = arg;
+	dtrace_aggdesc_t *agg = aggdata->dtada_desc;
+
+	if (agg->dtagd_nrecs == 0)
+		return (DTRACE_AGGWALK_NEXT);
+
+	if (agg->dtagd_varid != trunc->t_id)
+		return (DTRACE_AGGWALK_NEXT);
+
+	if (trunc->t_remaining == 0)
+		return (DTRACE_AGGWALK_REMOVE);
+
+	trunc->t_remaining--;
+	return (DTRACE_AGGWALK_NEXT);
+}
+
+/*
+ * The first frame of each stack is unique to it; the stack's sum is its
+ * place in the stack order, scrambled, and shared by about four stacks.
+ */
+static void
+fill(char *data, const dtrace_aggdesc_t *agd, ulong_t n, ulong_t k)
+{
+	uint64_t *pcs = (uint64_t *)(data + agd->dtagd_rec[1].dtrd_offset);
+	uint64_t x = (k + 1) * 0x9e3779b97f4a7c15ULL;
+	int i;
+
+	*(dtrace_aggid_t *)data = agd->dtagd_id;
+	*(uint64_t *)(data + agd->dtagd_rec[0].dtrd_offset) = STACKS_VARID;
+
+	pcs[0] = 0xfffff80000000000ULL + 16 * k;
+
+	for (i = 1; i < DEPTH; i++)
+		pcs[i] = 0xfffff80100000000ULL + 64 * ((k >> i) & 0xff);
+
+	x ^= x >> 29;
+	*(uint64_t *)(data + agd->dtagd_rec[2].dtrd_offset) =
+	    x % (n / 4 + 1);
+}
+
+typedef struct kept {
+	uint64_t *k_pcs;			/* first frames kept */
+	ulong_t k_max;				/* room in k_pcs */
+	ulong_t k_nstacks;			/* stacks kept */
+	ulong_t k_nthreads;			/* threads kept */
+} kept_t;
+
+static int
+kept(const dtrace_aggdata_t *agd, void *arg)
+{
+	const dtrace_aggdesc_t *desc = agd->dtada_desc;
+	kept_t *k = arg;
+
+	if (desc->dtagd_varid == THREADS_VARID) {
+		k->k_nthreads++;
+	} else if (k->k_nstacks++ < k->k_max) {
+		k->k_pcs[k->k_nstacks - 1] = *(uint64_t *)(agd->dtada_data +
+		    desc->dtagd_rec[1].dtrd_offset);
+	}
+
+	return (DTRACE_AGGWALK_NEXT);
+}
+
+static int
+pccmp(const void *l, const void *r)
+{
+	uint64_t lhs = *(const uint64_t *)l, rhs = *(const uint64_t *)r;
+
+	return (lhs < rhs ? -1 : lhs > rhs);
+}
+
+/*
+ * Snapshots the aggregations afresh, truncates @stacks to its top keep
+ * entries with one method or the other, and returns the time it took, in
+ * milliseconds.  The stacks kept are left in k.
+ */
+static double
+run(const char *data, const char *tdata, ulong_t n, ulong_t keep,
+    int sorted, kept_t *k)
+{
+	const dtrace_aggdesc_t *agd;
+	dtrace_epid_t epid;
+	dtrace_aggid_t aggid, tid;
+	size_t size;
+	int ncpus = (n + PERCPU - 1) / PERCPU, cpu, rval;
+	uint64_t start, elapsed;
+
+	bench_init(ncpus + 1);
+	epid = bench_eprobe("profile-997", NULL, 0, NULL);
+	aggid = bench_agg(epid, stackrecs, BENCH_NELEM(stackrecs), &sumrec);
+	tid = bench_agg(epid, tidrecs, BENCH_NELEM(tidrecs), &countrec);
+	agd = bench_aggdesc(aggid);
+	size = agd->dtagd_size;
+
+	for (cpu = 0; cpu < ncpus; cpu++) {
+		ulong_t first = (ulong_t)cpu * PERCPU;
+
+		bench_setaggbuf(cpu, data + first * size,
+		    MIN(n - first, PERCPU) * size);
+	}
+
+	bench_setaggbuf(ncpus, tdata, THREADS * bench_aggdesc(tid)->dtagd_size);
+	bench_setopt(DTRACEOPT_AGGSIZE, PERCPU * size);
+	bench_go();
+
+	if (dtrace_aggregate_snap(bench_dtp) != 0) {
+		(void) fprintf(stderr, "truncbench: snapshot failed: %s\n",
+		    dtrace_errmsg(bench_dtp, dtrace_errno(bench_dtp)));
+		exit(1);
+	}
+
+	start = bench_hrtime();
+
+	if (sorted) {
+		trunc_t trunc;
+
+		trunc.t_id = STACKS_VARID;
+		trunc.t_remaining = keep;
+		rval = dtrace_aggregate_walk_valrevsorted(bench_dtp,
+		    trunc_agg, &trunc);
+	} else {
+		rval = dt_aggregate_trunc(bench_dtp, STACKS_VARID, keep,
+		    B_TRUE);
+	}
+
+	elapsed = bench_hrtime() - start;
+
+	if (rval != 0) {
+		(void) fprintf(stderr, "truncbench: trunc failed: %s\n",
+		    dtrace_errmsg(bench_dtp, dtrace_errno(bench_dtp)));
+		exit(1);
+	}
+
+	k->k_nstacks = 0;
+	k->k_nthreads = 0;
+	(void) dtrace_aggregate_walk(bench_dtp, kept, k);
+	qsort(k->k_pcs, MIN(k->k_nstacks, k->k_max), sizeof (uint64_t), pccmp);
+
+	bench_fini();
+
+	return ((double)elapsed / 1000000);
+}
+
+int
+main(int argc, char **argv)
+{
+	ulong_t sizes[32], keep = 20;
+	int nsizes = 0, reps = 3;
+	int i;
+
+	for (; argc > 2 && argv[1][0] == '-'; argc -= 2, argv += 2) {
+		if (strcmp(argv[1], "-r") == 0)
+			reps = atoi(argv[2]);
+		else if (strcmp(argv[1], "-n") == 0)
+			keep = strtoul(argv[2], NULL, 0);
+		else
+			break;
+	}
+
+	for (i = 1; i < argc && nsizes < BENCH_NELEM(sizes); i++)
+		sizes[nsizes++] = strtoul(argv[i], NULL, 0);
+
+	if (i != argc || reps < 1 || keep == 0) {
+		(void) fprintf(stderr, "usage: truncbench [-r repetitions] "
+		    "[-n keep] [entries ...]\n");
+		return (2);
+	}
+
+	if (nsizes == 0) {
+		for (i = 0; i < BENCH_NELEM(defsizes); i++)
+			sizes[nsizes++] = defsizes[i];
+	}
+
+	(void) printf("%10s %8s %10s %10s\n", "ENTRIES", "KEEP", "HEAP",
+	    "SORTED");
+
+	for (i = 0; i < nsizes; i++) {
+		ulong_t n = sizes[i], k;
+		const dtrace_aggdesc_t *agd, *tagd;
+		char *data, *tdata;
+		double ms[2];
+		kept_t kept[2];
+		int m, r;
+
+		if (n <= keep) {
+			(void) fprintf(stderr, "truncbench: %llu entries are "
+			    "no more than the %llu to keep\n", n, keep);
+			return (2);
+		}
+
+		/*
+		 * Describe the aggregations once, to lay out their data.
+		 */
+		bench_init(1);
+		agd = bench_aggdesc(bench_agg(bench_eprobe("profile-997",
+		    NULL, 0, NULL), stackrecs, BENCH_NELEM(stackrecs),
+		    &sumrec));
+		tagd = bench_aggdesc(bench_agg(agd->dtagd_epid, tidrecs,
+		    BENCH_NELEM(tidrecs), &countrec));
+
+		data = calloc(n, agd->dtagd_size);
+		tdata = calloc(THREADS, tagd->dtagd_size);
+		kept[0].k_pcs = calloc(keep, sizeof (uint64_t));
+		kept[1].k_pcs = calloc(keep, sizeof (uint64_t));
+		kept[0].k_max = kept[1].k_max = keep;
+
+		if (data == NULL || tdata == NULL ||
+		    kept[0].k_pcs == NULL || kept[1].k_pcs == NULL) {
+			(void) fprintf(stderr, "truncbench: out of memory\n");
+			return (1);
+		}
+
+		for (k = 0; k < n; k++)
+			fill(data + k * agd->dtagd_size, agd, n, k);
+
+		for (k = 0; k < THREADS; k++) {
+			char *rec = tdata + k * tagd->dtagd_size;
+
+			*(dtrace_aggid_t *)rec = tagd->dtagd_id;
+			*(uint64_t *)(rec + tagd->dtagd_rec[0].dtrd_offset) =
+			    THREADS_VARID;
+			*(uint64_t *)(rec + tagd->dtagd_rec[1].dtrd_offset) =
+			    1000 + 4 * k;
+			*(uint64_t *)(rec + tagd->dtagd_rec[2].dtrd_offset) = 1;
+		}
+
+		bench_fini();
+
+		for (m = 0; m < 2; m++) {
+			for (r = 0; r < reps; r++) {
+				double t = run(data, tdata, n, keep, m,
+				    &kept[m]);
+
+				if (r == 0 || t < ms[m])
+					ms[m] = t;
+			}
+
+			if (kept[m].k_nstacks != keep ||
+			    kept[m].k_nthreads != THREADS) {
+				(void) fprintf(stderr, "truncbench: %s kept "
+				    "%llu stacks of %llu, %llu threads of %d\n",
+				    m ? "sorted walk" : "heap",
+				    kept[m].k_nstacks, keep,
+				    kept[m].k_nthreads, THREADS);
+				return (1);
+			}
+		}
+
+		if (memcmp(kept[0].k_pcs, kept[1].k_pcs,
+		    keep * sizeof (uint64_t)) != 0) {
+			(void) fprintf(stderr, "truncbench: the heap and the "
+			    "sorted walk kept different stacks\n");
+			return (1);
+		}
+
+		(void) printf("%10llu %8llu %10.2f %10.2f\n", n, keep, ms[0],
+		    ms[1]);
+		(void) fflush(stdout);
+
+		free(data);
+		free(tdata);
+		free(kept[0].k_pcs);
+		free(kept[1].k_pcs);
+	}
+
+	return (0);
+}
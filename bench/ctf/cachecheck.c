@@ -0,0 +1,322 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Check of the CTF cache format of libdtrace (dt_ctfcache.c).
+ *
+ * A container and its type index map are saved as a cache entry for the key
+ * of one build of a module, and reloaded:  the map must come back as it was
+ * saved, and each type must look up by name to the identifier it was saved
+ * with.  The entry must then be rejected for the key of another build (a
+ * stale key, whether the image or the PDB differs), once its version has been
+ * changed, and once it has been truncated or its magic number damaged.  The
+ * file names of the cache entries of a module must match that module alone.
+ *
+ * usage: cachecheck
+ */
+
+#include <ctf_impl.h>
+#include <string.h>
+#include <dt_ctfcache.h>
+
+#define	MODULE		"ntoskrnl"
+#define	TIMESTAMP	0x5f3e2a10
+#define	CHECKSUM	0x00a1b2c3
+#define	IMAGESIZE	0x00a46000
+#define	PDBAGE		1
+
+static const uint8_t pdbsig[16] = {
+	0x3a, 0x9e, 0x4b, 0x5c, 0x12, 0x77, 0x40, 0x8f,
+	0x91, 0x0c, 0xde, 0x23, 0x6b, 0x55, 0xa0, 0x01
+};
+
+static const char *names[] = {
+	"int", "long", "struct list", "list_t", "list_t *", "enum state"
+};
+
+#define	NTYPES	(sizeof (names) / sizeof (names[0]))
+
+static uint_t nchecks, nbad;
+
+static void
+check(int ok, const char *what)
+{
+	nchecks++;
+
+	if (!ok) {
+		(void) printf("%s: failed\n", what);
+		nbad++;
+	}
+}
+
+static void
+die(const char *what)
+{
+	(void) fprintf(stderr, "cachecheck: failed to %s\n", what);
+	exit(1);
+}
+
+/*
+ * Build a container of the named types, recording in ids the identifier of
+ * each under a made-up PDB type index.
+ */
+static ctf_file_t *
+build(dt_ctfcache_id_t *ids)
+{
+	ctf_encoding_t enc = { CTF_INT_SIGNED, 0, 32 };
+	ctf_id_t id[NTYPES];
+	ctf_file_t *fp;
+	int err, i;
+
+	if ((fp = ctf_create(&err)) == NULL)
+		die("create container");
+
+	id[0] = ctf_add_integer(fp, CTF_ADD_ROOT, "int", &enc);
+	enc.cte_bits = 64;
+	id[1] = ctf_add_integer(fp, CTF_ADD_ROOT, "long", &enc);
+	id[2] = ctf_add_struct(fp, CTF_ADD_ROOT, "list");
+	id[3] = ctf_add_typedef(fp, CTF_ADD_ROOT, "list_t", id[2]);
+	id[4] = ctf_add_pointer(fp, CTF_ADD_ROOT, id[3]);
+	id[5] = ctf_add_enum(fp, CTF_ADD_ROOT, "state");
+
+	/*
+	 * The members' types must be committed before they can be sized.
+	 */
+	if (ctf_update(fp) == CTF_ERR ||
+	    ctf_add_member(fp, id[2], "next", id[4]) == CTF_ERR ||
+	    ctf_add_member(fp, id[2], "value", id[1]) == CTF_ERR ||
+	    ctf_add_enumerator(fp, id[5], "IDLE", 0) == CTF_ERR ||
+	    ctf_add_enumerator(fp, id[5], "BUSY", 1) == CTF_ERR ||
+	    ctf_update(fp) == CTF_ERR)
+		die("add types");
+
+	for (i = 0; i < NTYPES; i++) {
+		if (id[i] == CTF_ERR)
+			die("add types");
+
+		ids[i].dci_pdbidx = 0x1000 + 3 * i;
+		ids[i].dci_ctfid = id[i];
+	}
+
+	return (fp);
+}
+
+/*
+ * Save a cache entry for key, and read the whole file back into memory.
+ */
+static char *
+save(const dt_ctfcache_hdr_t *key, const dt_ctfcache_id_t *ids,
+    ctf_file_t *fp, size_t *sizep)
+{
+	char *data;
+	long size;
+	FILE *f;
+
+	if ((f = tmpfile()) == NULL ||
+	    dt_ctfcache_write(f, key, ids, NTYPES, fp) != 0)
+		die("save cache entry");
+
+	if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 ||
+	    (data = malloc(size)) == NULL || fseek(f, 0, SEEK_SET) != 0 ||
+	    fread(data, size, 1, f) != 1)
+		die("read cache entry");
+
+	(void) fclose(f);
+	*sizep = size;
+
+	return (data);
+}
+
+/*
+ * Reload the cache entry at data as libdtrace does, and check that it holds
+ * what was saved.
+ */
+static void
+reload(const char *data, size_t size, const dt_ctfcache_hdr_t *key,
+    const dt_ctfcache_id_t *saved)
+{
+	const dt_ctfcache_id_t *ids;
+	ctf_sect_t sect;
+	ctf_file_t *fp;
+	uint32_t nids;
+	int err, i;
+
+	err = dt_ctfcache_check(data, size, key, &ids, &nids, &sect);
+	check(err == 0, "entry accepted for its own key");
+
+	if (err != 0)
+		return;
+
+	check(nids == NTYPES &&
+	    memcmp(ids, saved, NTYPES * sizeof (*ids)) == 0,
+	    "type index map reloaded");
+
+	if ((fp = ctf_bufopen(&sect, NULL, NULL, &err)) == NULL) {
+		check(0, "container reloaded");
+		return;
+	}
+
+	for (i = 0; i < NTYPES; i++) {
+		check(ctf_lookup_by_name(fp, names[i]) == saved[i].dci_ctfid,
+		    names[i]);
+	}
+
+	check(ctf_type_size(fp, saved[2].dci_ctfid) == 16,
+	    "size of struct list");
+
+	ctf_close(fp);
+}
+
+/*
+ * Check the cache entry at data against key, expecting it to be rejected
+ * with err.
+ */
+static void
+reject(const char *data, size_t size, const dt_ctfcache_hdr_t *key, int err,
+    const char *what)
+{
+	const dt_ctfcache_id_t *ids;
+	ctf_sect_t sect;
+	uint32_t nids;
+
+	check(dt_ctfcache_check(data, size, key, &ids, &nids, &sect) == err,
+	    what);
+}
+
+int
+main(int argc, char **argv)
+{
+	dt_ctfcache_id_t ids[NTYPES];
+	dt_ctfcache_hdr_t key, other;
+	char name[PATH_MAX], oname[PATH_MAX], *data, *copy;
+	uint8_t osig[16];
+	ctf_file_t *fp;
+	size_t size;
+
+	if (argc != 1) {
+		(void) fprintf(stderr, "usage: cachecheck\n");
+		return (2);
+	}
+
+	dt_ctfcache_key(&key, TIMESTAMP, CHECKSUM, IMAGESIZE, pdbsig, PDBAGE);
+	fp = build(ids);
+
+	/*
+	 * Save and reload.
+	 */
+	data = save(&key, ids, fp, &size);
+	reload(data, size, &key, ids);
+
+	/*
+	 * A stale key:  another build of the image, or the same image with
+	 * another PDB.  Its entry has another name, too.
+	 */
+	(void) dt_ctfcache_name(MODULE, &key, name, sizeof (name));
+
+	dt_ctfcache_key(&other, TIMESTAMP + 1, CHECKSUM, IMAGESIZE, pdbsig,
+	    PDBAGE);
+	reject(data, size, &other, DT_CTFCACHE_ESTALE, "image timestamp");
+	(void) dt_ctfcache_name(MODULE, &other, oname, sizeof (oname));
+	check(strcmp(name, oname) != 0, "name of other image");
+
+	dt_ctfcache_key(&other, TIMESTAMP, CHECKSUM + 1, IMAGESIZE, pdbsig,
+	    PDBAGE);
+	reject(data, size, &other, DT_CTFCACHE_ESTALE, "image checksum");
+
+	dt_ctfcache_key(&other, TIMESTAMP, CHECKSUM, IMAGESIZE + 0x1000,
+	    pdbsig, PDBAGE);
+	reject(data, size, &other, DT_CTFCACHE_ESTALE, "image size");
+
+	bcopy(pdbsig, osig, sizeof (osig));
+	osig[15] ^= 1;
+	dt_ctfcache_key(&other, TIMESTAMP, CHECKSUM, IMAGESIZE, osig, PDBAGE);
+	reject(data, size, &other, DT_CTFCACHE_ESTALE, "PDB signature");
+	(void) dt_ctfcache_name(MODULE, &other, oname, sizeof (oname));
+	check(strcmp(name, oname) != 0, "name of other PDB");
+
+	dt_ctfcache_key(&other, TIMESTAMP, CHECKSUM, IMAGESIZE, pdbsig,
+	    PDBAGE + 1);
+	reject(data, size, &other, DT_CTFCACHE_ESTALE, "PDB age");
+
+	other = key;
+	other.dch_model = key.dch_model == CTF_MODEL_LP64 ?
+	    CTF_MODEL_ILP32 : CTF_MODEL_LP64;
+	reject(data, size, &other, DT_CTFCACHE_ESTALE, "data model");
+
+	/*
+	 * A version mismatch, and damaged entries.
+	 */
+	if ((copy = malloc(size)) == NULL)
+		die("allocate memory");
+
+	bcopy(data, copy, size);
+	((dt_ctfcache_hdr_t *)copy)->dch_version = DT_CTFCACHE_VERSION + 1;
+	reject(copy, size, &key, DT_CTFCACHE_EVERSION, "version");
+
+	bcopy(data, copy, size);
+	((dt_ctfcache_hdr_t *)copy)->dch_magic ^= 1;
+	reject(copy, size, &key, DT_CTFCACHE_EFORMAT, "magic number");
+
+	bcopy(data, copy, size);
+	((dt_ctfcache_hdr_t *)copy)->dch_nids = 0;
+	reject(copy, size, &key, DT_CTFCACHE_EFORMAT, "empty map");
+
+	reject(data, sizeof (dt_ctfcache_hdr_t) - 1, &key,
+	    DT_CTFCACHE_EFORMAT, "truncated header");
+	reject(data, sizeof (dt_ctfcache_hdr_t) +
+	    NTYPES * sizeof (dt_ctfcache_id_t), &key, DT_CTFCACHE_EFORMAT,
+	    "truncated container");
+
+	/*
+	 * Saved again for another build, the entry is accepted for that
+	 * build's key alone.
+	 */
+	free(data);
+	dt_ctfcache_key(&other, TIMESTAMP + 1, CHECKSUM, IMAGESIZE, pdbsig,
+	    PDBAGE);
+	data = save(&other, ids, fp, &size);
+	reload(data, size, &other, ids);
+	reject(data, size, &key, DT_CTFCACHE_ESTALE, "old key after resave");
+
+	/*
+	 * File names.
+	 */
+	check(dt_ctfcache_match(MODULE, name), "own name");
+	check(dt_ctfcache_match("NTOSKRNL", name), "name in another case");
+	check(!dt_ctfcache_match("ntos", name), "name of a prefix");
+	(void) dt_ctfcache_name("api-ms-win-core-file-l1-1-0", &key, oname,
+	    sizeof (oname));
+	check(dt_ctfcache_match("api-ms-win-core-file-l1-1-0", oname),
+	    "own hyphenated name");
+	check(!dt_ctfcache_match("api-ms-win-core", oname),
+	    "name of a hyphenated prefix");
+	(void) strcpy(oname, name);
+	(void) strcpy(strrchr(oname, '.'), ".ctf.1234");
+	check(!dt_ctfcache_match(MODULE, oname), "temporary file");
+
+	(void) printf("%u checks, %u failed\n", nchecks, nbad);
+
+	free(copy);
+	free(data);
+	ctf_close(fp);
+
+	return (nbad != 0);
+}
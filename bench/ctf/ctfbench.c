@@ -0,0 +1,379 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Time to look up type names against the number of types in a container.
+ *
+ * A container of the specified number of types -- structs and typedefs, with
+ * names like those of a Windows kernel module -- is built, written out with
+ * its index and read back, as libdtrace's CTF cache does.  Each row then
+ * reports the time per lookup, in nanoseconds, of every name of the container
+ * in a random order and of as many names that it does not have:
+ *
+ *	OPEN	ctf_hash_lookup() in the open-addressed tables of ctf_hash.c
+ *	CHAINED	the same, in chained tables laid out as ctf_hash.c laid them
+ *		out before, built from the same names
+ *	NAME	ctf_lookup_by_name() of "struct _KTHREAD" and the like, which
+ *		parses the name and then looks it up in the open-addressed table
+ *
+ * Misses matter as much as hits:  dtrace_lookup_by_type() looks for a name in
+ * one module after another until it is found.  Both tables must find the same
+ * types.
+ *
+ * usage: ctfbench [-r repetitions] [types ...]
+ */
+
+#include <ctf_impl.h>
+#include <string.h>
+#include <time.h>
+
+#define	NELEM(a)	(sizeof (a) / sizeof ((a)[0]))
+
+static const char *const prefixes[] = {
+	"KTHREAD", "EPROCESS", "IRP", "MDL", "FILE_OBJECT", "DEVICE_OBJECT",
+	"DRIVER_OBJECT", "KEVENT", "ERESOURCE", "IO_STACK_LOCATION",
+	"OBJECT_HEADER", "HANDLE_TABLE", "MMPFN", "KAPC", "KDPC", "ETHREAD"
+};
+
+static const ulong_t defsizes[] = { 1000, 4000, 16000, 32000 };
+
+/*
+ * The chained hash table of ctf_hash.c before it was open-addressed:  a fixed
+ * number of buckets, selected by the ELF hash of the name, each heading a
+ * chain of elements linked by ushort_t indices.  Element zero is the sentinel.
+ */
+#define	CHAIN_NBUCKETS	211
+
+typedef struct chelem {
+	uint_t ch_name;		/* reference to name in string table */
+	ushort_t ch_type;	/* corresponding type ID number */
+	ushort_t ch_next;	/* index of next element in hash chain */
+} chelem_t;
+
+typedef struct chash {
+	ushort_t ch_buckets[CHAIN_NBUCKETS];
+	chelem_t *ch_chains;
+	uint_t ch_free;
+} chash_t;
+
+static ulong_t
+chash_compute(const char *key, size_t len)
+{
+	ulong_t g, h = 0;
+	const char *p, *q = key + len;
+
+	for (p = key; p < q; p++) {
+		h = (h << 4) + *p;
+
+		if ((g = (h & 0xf0000000)) != 0) {
+			h ^= (g >> 24);
+			h ^= g;
+		}
+	}
+
+	return (h);
+}
+
+/*
+ * Build a chained table of the elements of the open-addressed table hp.
+ */
+static void
+chash_create(chash_t *chp, ctf_file_t *fp, const ctf_hash_t *hp)
+{
+	const ctf_helem_t *hep;
+	const char *str;
+	ulong_t h;
+	uint_t i;
+
+	bzero(chp->ch_buckets, sizeof (chp->ch_buckets));
+	chp->ch_chains = calloc(hp->h_nelems + 1, sizeof (chelem_t));
+	chp->ch_free = 1;
+
+	for (i = 0; hp->h_nelems != 0 && i <= hp->h_mask; i++) {
+		hep = &hp->h_table[i];
+
+		if (hep->h_type == 0)
+			continue;
+
+		str = ctf_strptr(fp, hep->h_name);
+		h = chash_compute(str, strlen(str)) % CHAIN_NBUCKETS;
+
+		chp->ch_chains[chp->ch_free].ch_name = hep->h_name;
+		chp->ch_chains[chp->ch_free].ch_type = hep->h_type;
+		chp->ch_chains[chp->ch_free].ch_next = chp->ch_buckets[h];
+		chp->ch_buckets[h] = chp->ch_free++;
+	}
+}
+
+static ctf_id_t
+chash_lookup(const chash_t *chp, ctf_file_t *fp, const char *key, size_t len)
+{
+	const chelem_t *hep;
+	ctf_strs_t *ctsp;
+	const char *str;
+	ushort_t i;
+
+	ulong_t h = chash_compute(key, len) % CHAIN_NBUCKETS;
+
+	for (i = chp->ch_buckets[h]; i != 0; i = hep->ch_next) {
+		hep = &chp->ch_chains[i];
+		ctsp = &fp->ctf_str[CTF_NAME_STID(hep->ch_name)];
+		str = ctsp->cts_strs + CTF_NAME_OFFSET(hep->ch_name);
+
+		if (strncmp(key, str, len) == 0 && str[len] == '\0')
+			return (hep->ch_type);
+	}
+
+	return (0);
+}
+
+typedef struct lkey {
+	char k_name[48];	/* name as it is in the string table */
+	char k_decl[56];	/* name as it is passed to ctf_lookup_by_name */
+	size_t k_len;		/* length of k_name */
+	int k_struct;		/* name is in the struct table */
+	ctf_id_t k_type;	/* type of name, or zero if a miss */
+} lkey_t;
+
+static uint64_t seed = 1;
+
+static uint64_t
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (seed);
+}
+
+static uint64_t
+now(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static ctf_file_t *
+build(ulong_t n, lkey_t *keys)
+{
+	ctf_encoding_t en = { CTF_INT_SIGNED, 0, 32 };
+	ctf_file_t *fp, *nfp;
+	ctf_id_t id, intid;
+	ulong_t i;
+	FILE *f;
+	int err;
+
+	if ((fp = ctf_create(&err)) == NULL ||
+	    (intid = ctf_add_integer(fp, CTF_ADD_ROOT, "int", &en)) ==
+	    CTF_ERR || ctf_update(fp) == CTF_ERR) {
+		(void) fprintf(stderr, "failed to create container\n");
+		exit(1);
+	}
+
+	/*
+	 * Every other name is a struct, _NAME12; the rest are typedefs,
+	 * PNAME12.  The names with odd numbers are the misses.
+	 */
+	for (i = 0; i < 2 * n; i++) {
+		lkey_t *kp = &keys[i];
+		const char *pfx = prefixes[(i / 2) % NELEM(prefixes)];
+
+		kp->k_struct = (i / 2) % 2 == 0;
+		(void) snprintf(kp->k_name, sizeof (kp->k_name), "%s%s%lu",
+		    kp->k_struct ? "_" : "P", pfx, i);
+		(void) snprintf(kp->k_decl, sizeof (kp->k_decl), "%s%s",
+		    kp->k_struct ? "struct " : "", kp->k_name);
+		kp->k_len = strlen(kp->k_name);
+		kp->k_type = 0;
+
+		if (i % 2 != 0)
+			continue;
+
+		if (kp->k_struct) {
+			id = ctf_add_struct(fp, CTF_ADD_ROOT, kp->k_name);
+
+			if (id != CTF_ERR &&
+			    ctf_add_member(fp, id, "Flags", intid) == CTF_ERR)
+				id = CTF_ERR;
+		} else {
+			id = ctf_add_typedef(fp, CTF_ADD_ROOT, kp->k_name,
+			    intid);
+		}
+
+		if (id == CTF_ERR) {
+			(void) fprintf(stderr, "failed to add type: %s\n",
+			    ctf_errmsg(ctf_errno(fp)));
+			exit(1);
+		}
+
+		kp->k_type = id;
+	}
+
+	if (ctf_update(fp) == CTF_ERR ||
+	    (f = tmpfile()) == NULL || ctf_write_indexed(fp, fileno(f)) != 0 ||
+	    (nfp = ctf_fdopen(fileno(f), &err)) == NULL) {
+		(void) fprintf(stderr, "failed to write container\n");
+		exit(1);
+	}
+
+	(void) fclose(f);
+	ctf_close(fp);
+
+	for (i = 2 * n - 1; i > 0; i--) {
+		ulong_t j = rnd() % (i + 1);
+		lkey_t k = keys[i];
+
+		keys[i] = keys[j];
+		keys[j] = k;
+	}
+
+	return (nfp);
+}
+
+/*
+ * Look up every name that is (hit) or is not (!hit) in the container, reps
+ * times, with method m, and return the time per lookup in nanoseconds.
+ */
+static double
+run(ctf_file_t *fp, const chash_t *ch, const lkey_t *keys, ulong_t nkeys,
+    int m, int hit, int reps)
+{
+	uint64_t start, elapsed;
+	ulong_t i, nlookups = 0;
+	ctf_helem_t *hep;
+	ctf_id_t id;
+	int r;
+
+	start = now();
+
+	for (r = 0; r < reps; r++) {
+		for (i = 0; i < nkeys; i++) {
+			const lkey_t *kp = &keys[i];
+
+			if ((kp->k_type != 0) != hit)
+				continue;
+
+			switch (m) {
+			case 0:
+				hep = ctf_hash_lookup(kp->k_struct ?
+				    &fp->ctf_structs : &fp->ctf_names, fp,
+				    kp->k_name, kp->k_len);
+				id = hep != NULL ? hep->h_type : 0;
+				break;
+			case 1:
+				id = chash_lookup(&ch[kp->k_struct], fp,
+				    kp->k_name, kp->k_len);
+				break;
+			default:
+				id = ctf_lookup_by_name(fp, kp->k_decl);
+				id = id == CTF_ERR ? 0 : id;
+				break;
+			}
+
+			if (id != kp->k_type) {
+				(void) fprintf(stderr, "%s: found %ld, not "
+				    "%ld\n", kp->k_decl, id, kp->k_type);
+				exit(1);
+			}
+
+			nlookups++;
+		}
+	}
+
+	elapsed = now() - start;
+
+	return ((double)elapsed / nlookups);
+}
+
+int
+main(int argc, char **argv)
+{
+	ulong_t sizes[32];
+	int nsizes = 0, reps = 0;
+	int i;
+
+	if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+		reps = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+
+	for (i = 1; i < argc && nsizes < NELEM(sizes); i++)
+		sizes[nsizes++] = strtoul(argv[i], NULL, 0);
+
+	if (i != argc || reps < 0) {
+		(void) fprintf(stderr, "usage: ctfbench [-r repetitions] "
+		    "[types ...]\n");
+		return (2);
+	}
+
+	if (nsizes == 0) {
+		for (i = 0; i < NELEM(defsizes); i++)
+			sizes[nsizes++] = defsizes[i];
+	}
+
+	(void) printf("%8s %9s %9s %9s %9s %9s %9s\n", "", "-------",
+	    "HITS", "-------", "-------", "MISSES", "-------");
+	(void) printf("%8s %9s %9s %9s %9s %9s %9s\n", "TYPES", "OPEN",
+	    "CHAINED", "NAME", "OPEN", "CHAINED", "NAME");
+
+	for (i = 0; i < nsizes; i++) {
+		ulong_t n = sizes[i];
+		lkey_t *keys;
+		ctf_file_t *fp;
+		chash_t ch[2];
+		double ns[6];
+		int m, r;
+
+		if (n == 0 || n >= CTF_MAX_TYPE >> 1) {
+			(void) fprintf(stderr, "ctfbench: a container holds "
+			    "at most %d types\n", (CTF_MAX_TYPE >> 1) - 1);
+			return (2);
+		}
+
+		keys = calloc(2 * n, sizeof (lkey_t));
+		fp = build(n, keys);
+		chash_create(&ch[0], fp, &fp->ctf_names);
+		chash_create(&ch[1], fp, &fp->ctf_structs);
+
+		/*
+		 * Aim for a few million lookups of each kind unless told.
+		 */
+		r = reps != 0 ? reps : MAX(1, 4000000 / n);
+
+		for (m = 0; m < 3; m++) {
+			ns[m] = run(fp, ch, keys, 2 * n, m, 1, r);
+			ns[m + 3] = run(fp, ch, keys, 2 * n, m, 0, r);
+		}
+
+		(void) printf("%8lu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+		    n, ns[0], ns[1], ns[2], ns[3], ns[4], ns[5]);
+
+		free(ch[0].ch_chains);
+		free(ch[1].ch_chains);
+		ctf_close(fp);
+		free(keys);
+	}
+
+	return (0);
+}
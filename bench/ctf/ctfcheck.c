@@ -0,0 +1,575 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Check of ctf_flatten().
+ *
+ * Each run follows a module's types through the on-disk cache kept by
+ * libdtrace.  A random parent container is built with the ctf_add_*()
+ * interfaces, written out with its index and read back.  A random child of
+ * it is then built, the two are merged with ctf_flatten(), and the merged
+ * container is written out and read back to serve as the parent of the next
+ * round.  After each merge, every type of the parent and of the child is
+ * compared with its counterpart in the merged container, before and after it
+ * is written out:  its kind, name, size and root flag; its encoding, the type
+ * it refers to, its array, function, member or enumerator information, with
+ * every type that these refer to mapped to its merged identifier; and the
+ * identifier that its name looks up to.
+ *
+ * usage: ctfcheck [-n runs] [-s seed]
+ */
+
+#include <ctf_impl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define	ROUNDS		4
+#define	BATCH		32		/* types added per ctf_update() */
+#define	MAXSIZE		(1 << 20)	/* largest member or array element */
+
+static uint64_t seed = 1;
+static uint_t serial;
+static uint64_t nbad;
+
+static uint64_t
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (seed);
+}
+
+#define	RND(n)		((uint_t)(rnd() % (n)))
+
+/*
+ * The types added to the container being built.  Those that have a size can
+ * be used for members and array elements; the integers can be used as array
+ * indices.
+ */
+static ctf_id_t *types, *sized, *ints;
+static uint_t ntypes, nsized, nints;
+
+static void
+fail(const char *what, ctf_id_t id, ctf_id_t nid)
+{
+	if (nbad++ < 20) {
+		(void) printf("type %ld (merged %ld): %s differs\n", id, nid,
+		    what);
+	}
+}
+
+static ctf_id_t
+any(void)
+{
+	return (types[RND(ntypes)]);
+}
+
+static ctf_id_t
+anysized(void)
+{
+	return (sized[RND(nsized)]);
+}
+
+static ctf_id_t
+ok(ctf_file_t *fp, ctf_id_t id)
+{
+	if (id == CTF_ERR) {
+		(void) fprintf(stderr, "failed to add type: %s\n",
+		    ctf_errmsg(ctf_errno(fp)));
+		exit(1);
+	}
+
+	return (id);
+}
+
+/*
+ * Make a type available to later types.  The ctf_type_*() interfaces only
+ * see types that have been committed with ctf_update().
+ */
+static void
+use(ctf_file_t *fp, ctf_id_t id)
+{
+	ssize_t size;
+
+	types[ntypes++] = id;
+
+	switch (ctf_type_kind(fp, ctf_type_resolve(fp, id))) {
+	case CTF_K_FUNCTION:
+	case CTF_K_FORWARD:
+		break;
+	case CTF_K_INTEGER:
+		ints[nints++] = id;
+		/*FALLTHRU*/
+	default:
+		if ((size = ctf_type_size(fp, id)) > 0 && size <= MAXSIZE)
+			sized[nsized++] = id;
+	}
+}
+
+static ctf_id_t pending[BATCH];
+static uint_t npending;
+
+static void
+commit(ctf_file_t *fp)
+{
+	uint_t i;
+
+	if (ctf_update(fp) == CTF_ERR) {
+		(void) fprintf(stderr, "failed to update container: %s\n",
+		    ctf_errmsg(ctf_errno(fp)));
+		exit(1);
+	}
+
+	for (i = 0; i < npending; i++)
+		use(fp, pending[i]);
+
+	npending = 0;
+}
+
+static void
+add(ctf_file_t *fp, ctf_id_t id)
+{
+	pending[npending++] = ok(fp, id);
+
+	if (npending == BATCH)
+		commit(fp);
+}
+
+static const char *
+name(const char *prefix)
+{
+	static char buf[32];
+
+	(void) snprintf(buf, sizeof (buf), "%s%u", prefix, serial++);
+	return (buf);
+}
+
+/*
+ * Add n random types to fp.  The types that fp already has -- those of its
+ * parent, if it has one -- are used in the new ones as they would be by the
+ * types of a child that libdtrace builds from a PDB.
+ */
+static void
+generate(ctf_file_t *fp, const char *prefix, ulong_t n)
+{
+	static const ushort_t bits[] = { 8, 16, 32, 64 };
+	char pname[16];
+	ulong_t i;
+
+	while (n-- != 0) {
+		uint_t flag = RND(8) ? CTF_ADD_ROOT : CTF_ADD_NONROOT;
+		ctf_encoding_t en;
+		ctf_arinfo_t ar;
+		ctf_funcinfo_t fi;
+		ctf_id_t argv[6], id;
+		ssize_t size;
+		int kind;
+
+		(void) snprintf(pname, sizeof (pname), "%s_", prefix);
+
+		switch (nsized == 0 || nints == 0 ? 0 : RND(12)) {
+		case 0:
+			en.cte_format = RND(2) ? CTF_INT_SIGNED : 0;
+			en.cte_offset = 0;
+			en.cte_bits = bits[RND(4)];
+			add(fp, ctf_add_integer(fp, flag, name(pname), &en));
+			break;
+
+		case 1:
+			en.cte_format = CTF_FP_SINGLE + RND(2);
+			en.cte_offset = 0;
+			en.cte_bits = en.cte_format == CTF_FP_SINGLE ? 32 : 64;
+			add(fp, ctf_add_float(fp, flag, name(pname), &en));
+			break;
+
+		case 2:
+		case 3:
+			add(fp, ctf_add_pointer(fp, flag, any()));
+			break;
+
+		case 4:
+			add(fp, ctf_add_typedef(fp, flag, name(pname),
+			    any()));
+			break;
+
+		case 5:
+			id = anysized();
+			add(fp, RND(3) == 0 ? ctf_add_const(fp, flag, id) :
+			    RND(2) ? ctf_add_volatile(fp, flag, id) :
+			    ctf_add_restrict(fp, flag, id));
+			break;
+
+		case 6:
+			ar.ctr_contents = anysized();
+			ar.ctr_index = ints[RND(nints)];
+			ar.ctr_nelems = RND(4) ? 1 + RND(16) : 1 + RND(4096);
+			size = ctf_type_size(fp, ar.ctr_contents);
+
+			if (size * ar.ctr_nelems > 4 * MAXSIZE)
+				ar.ctr_nelems = 1;
+
+			add(fp, ctf_add_array(fp, flag, &ar));
+			break;
+
+		case 7:
+			fi.ctc_return = any();
+			fi.ctc_argc = RND(6);
+			fi.ctc_flags = RND(4) ? 0 : CTF_FUNC_VARARG;
+
+			for (i = 0; i < fi.ctc_argc; i++)
+				argv[i] = any();
+
+			add(fp, ctf_add_function(fp, flag, &fi, argv));
+			break;
+
+		case 8:
+		case 9:
+			kind = RND(3) ? CTF_K_STRUCT : CTF_K_UNION;
+			id = ok(fp, kind == CTF_K_STRUCT ?
+			    ctf_add_struct(fp, flag, name(pname)) :
+			    ctf_add_union(fp, flag, name(pname)));
+
+			for (i = 1 + RND(8); i != 0; i--) {
+				(void) ok(fp, ctf_add_member(fp, id, name("m"),
+				    anysized()));
+			}
+
+			add(fp, id);
+			break;
+
+		case 10:
+			id = ok(fp, ctf_add_enum(fp, flag, name(pname)));
+
+			for (i = 1 + RND(6); i != 0; i--) {
+				(void) ok(fp, ctf_add_enumerator(fp, id,
+				    name(pname), (int)rnd()));
+			}
+
+			add(fp, id);
+			break;
+
+		case 11:
+			add(fp, ctf_add_forward(fp, flag, name(pname),
+			    RND(2) ? CTF_K_STRUCT : CTF_K_UNION));
+			break;
+		}
+	}
+
+	commit(fp);
+}
+
+/*
+ * Write fp out with its index and read it back, as libdtrace's cache does.
+ * The container read must use the index.
+ */
+static ctf_file_t *
+reopen(ctf_file_t *fp)
+{
+	ctf_file_t *nfp;
+	FILE *f;
+	int err;
+
+	if ((f = tmpfile()) == NULL || ctf_write_indexed(fp, fileno(f)) != 0) {
+		(void) fprintf(stderr, "failed to write container\n");
+		exit(1);
+	}
+
+	if ((nfp = ctf_fdopen(fileno(f), &err)) == NULL) {
+		(void) fprintf(stderr, "failed to read container: %s\n",
+		    ctf_errmsg(err));
+		exit(1);
+	}
+
+	if (!(nfp->ctf_flags & LCTF_INDEX)) {
+		(void) fprintf(stderr, "container read without its index\n");
+		exit(1);
+	}
+
+	(void) fclose(f);
+	return (nfp);
+}
+
+static ctf_id_t base;
+
+static ctf_id_t
+map(ctf_id_t id)
+{
+	return (CTF_TYPE_ISCHILD(id) ? base + CTF_TYPE_TO_INDEX(id) : id);
+}
+
+typedef struct memb {
+	char m_name[32];
+	ctf_id_t m_type;
+	ulong_t m_offset;
+} memb_t;
+
+typedef struct membs {
+	memb_t ms_membs[CTF_MAX_VLEN];
+	uint_t ms_n;
+	int ms_map;
+} membs_t;
+
+static int
+getmemb(const char *name, ctf_id_t type, ulong_t offset, void *arg)
+{
+	membs_t *msp = arg;
+	memb_t *mp = &msp->ms_membs[msp->ms_n++];
+
+	(void) strncpy(mp->m_name, name, sizeof (mp->m_name));
+	mp->m_type = msp->ms_map ? map(type) : type;
+	mp->m_offset = offset;
+	return (0);
+}
+
+static int
+getenum(const char *name, int value, void *arg)
+{
+	return (getmemb(name, CTF_ERR, (ulong_t)value, arg));
+}
+
+static const ctf_type_t *
+rawtype(ctf_file_t *fp, ctf_id_t id, ctf_file_t **fpp)
+{
+	*fpp = fp;
+	return (ctf_lookup_by_id(fpp, id));
+}
+
+/*
+ * Compare type id of fp with type nid of the merged container nfp.
+ */
+static void
+compare(ctf_file_t *fp, ctf_id_t id, ctf_file_t *nfp, ctf_id_t nid)
+{
+	static membs_t m[2];
+	char buf[2][512];
+	const ctf_type_t *tp[2];
+	ctf_file_t *tfp[2];
+	ctf_encoding_t en[2];
+	ctf_arinfo_t ar[2];
+	int kind, i;
+
+	if ((tp[0] = rawtype(fp, id, &tfp[0])) == NULL ||
+	    (tp[1] = rawtype(nfp, nid, &tfp[1])) == NULL) {
+		fail("existence", id, nid);
+		return;
+	}
+
+	if (tp[0]->ctt_info != tp[1]->ctt_info)
+		fail("kind, root flag or length", id, nid);
+
+	if (strcmp(ctf_strptr(tfp[0], tp[0]->ctt_name),
+	    ctf_strptr(tfp[1], tp[1]->ctt_name)) != 0)
+		fail("name", id, nid);
+
+	if (strcmp(ctf_type_name(fp, id, buf[0], sizeof (buf[0])) ?
+	    buf[0] : "", ctf_type_name(nfp, nid, buf[1], sizeof (buf[1])) ?
+	    buf[1] : "") != 0)
+		fail("declaration", id, nid);
+
+	if (ctf_type_size(fp, id) != ctf_type_size(nfp, nid))
+		fail("size", id, nid);
+
+	switch (kind = ctf_type_kind(fp, id)) {
+	case CTF_K_INTEGER:
+	case CTF_K_FLOAT:
+		if (ctf_type_encoding(fp, id, &en[0]) != 0 ||
+		    ctf_type_encoding(nfp, nid, &en[1]) != 0 ||
+		    bcmp(&en[0], &en[1], sizeof (en[0])) != 0)
+			fail("encoding", id, nid);
+		break;
+
+	case CTF_K_ARRAY:
+		if (ctf_array_info(fp, id, &ar[0]) != 0 ||
+		    ctf_array_info(nfp, nid, &ar[1]) != 0 ||
+		    map(ar[0].ctr_contents) != ar[1].ctr_contents ||
+		    map(ar[0].ctr_index) != ar[1].ctr_index ||
+		    ar[0].ctr_nelems != ar[1].ctr_nelems)
+			fail("array", id, nid);
+		break;
+
+	case CTF_K_FUNCTION: {
+		const ushort_t *argv[2];
+		ssize_t size, incr;
+
+		for (i = 0; i < 2; i++) {
+			(void) ctf_get_ctt_size(tfp[i], tp[i], &size, &incr);
+			argv[i] = (const ushort_t *)((uintptr_t)tp[i] + incr);
+		}
+
+		if (map(tp[0]->ctt_type) != tp[1]->ctt_type)
+			fail("return type", id, nid);
+
+		for (i = 0; i < LCTF_INFO_VLEN(fp, tp[0]->ctt_info); i++) {
+			if (map(argv[0][i]) != argv[1][i])
+				fail("argument", id, nid);
+		}
+		break;
+	}
+
+	case CTF_K_STRUCT:
+	case CTF_K_UNION:
+	case CTF_K_ENUM:
+		for (i = 0; i < 2; i++) {
+			m[i].ms_n = 0;
+			m[i].ms_map = i == 0;
+
+			if ((kind == CTF_K_ENUM ?
+			    ctf_enum_iter(i ? nfp : fp, i ? nid : id, getenum,
+			    &m[i]) : ctf_member_iter(i ? nfp : fp, i ? nid : id,
+			    getmemb, &m[i])) != 0)
+				fail("members", id, nid);
+		}
+
+		if (m[0].ms_n != m[1].ms_n || bcmp(m[0].ms_membs,
+		    m[1].ms_membs, sizeof (memb_t) * m[0].ms_n) != 0)
+			fail("members", id, nid);
+		break;
+
+	case CTF_K_FORWARD:
+		if (tp[0]->ctt_type != tp[1]->ctt_type)
+			fail("forward kind", id, nid);
+		break;
+
+	case CTF_K_POINTER:
+	case CTF_K_TYPEDEF:
+	case CTF_K_VOLATILE:
+	case CTF_K_CONST:
+	case CTF_K_RESTRICT:
+		if (map(ctf_type_reference(fp, id)) !=
+		    ctf_type_reference(nfp, nid))
+			fail("reference", id, nid);
+		break;
+	}
+
+	/*
+	 * Every name is unique, so every named root type but a forward
+	 * declaration must be found by name.
+	 */
+	if (tp[0]->ctt_name != 0 && LCTF_INFO_ROOT(fp, tp[0]->ctt_info) &&
+	    kind != CTF_K_FORWARD &&
+	    ctf_lookup_by_name(nfp, buf[0]) != nid)
+		fail("lookup", id, nid);
+}
+
+static void
+check(ctf_file_t *fp, ctf_file_t *nfp)
+{
+	ctf_file_t *pfp = ctf_parent_file(fp);
+	ctf_id_t id;
+
+	for (id = 1; id <= pfp->ctf_typemax; id++)
+		compare(pfp, id, nfp, id);
+
+	for (id = 1; id <= fp->ctf_typemax; id++)
+		compare(fp, CTF_INDEX_TO_TYPE(id, 1), nfp, base + id);
+
+	if (nfp->ctf_typemax != pfp->ctf_typemax + fp->ctf_typemax)
+		fail("number of types", 0, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint64_t n = 200, i, ntotal = 0;
+	ctf_file_t *pfp, *fp, *nfp, *rfp;
+	ctf_id_t id;
+	int r, err;
+
+	while (argc > 2 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-n") == 0) {
+			n = strtoul(argv[2], NULL, 0);
+		} else if (strcmp(argv[1], "-s") == 0) {
+			seed = strtoul(argv[2], NULL, 0);
+		} else {
+			break;
+		}
+
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || seed == 0) {
+		(void) fprintf(stderr, "usage: ctfcheck [-n runs] [-s seed]\n");
+		return (2);
+	}
+
+	types = malloc(sizeof (ctf_id_t) * CTF_MAX_TYPE);
+	sized = malloc(sizeof (ctf_id_t) * CTF_MAX_TYPE);
+	ints = malloc(sizeof (ctf_id_t) * CTF_MAX_TYPE);
+
+	for (i = 0; i < n; i++) {
+		ntypes = nsized = nints = 0;
+
+		if ((fp = ctf_create(&err)) == NULL) {
+			(void) fprintf(stderr, "failed to create container: "
+			    "%s\n", ctf_errmsg(err));
+			return (1);
+		}
+
+		generate(fp, "p", 1 + RND(2000));
+		pfp = reopen(fp);
+		ctf_close(fp);
+
+		for (r = 0; r < ROUNDS; r++) {
+			if ((fp = ctf_create(&err)) == NULL ||
+			    ctf_import(fp, pfp) != 0) {
+				(void) fprintf(stderr, "failed to create "
+				    "child container\n");
+				return (1);
+			}
+
+			generate(fp, "c", RND(1000));
+
+			if ((nfp = ctf_flatten(fp, &base, &err)) == NULL) {
+				(void) fprintf(stderr, "failed to merge "
+				    "containers: %s\n", ctf_errmsg(err));
+				return (1);
+			}
+
+			rfp = reopen(nfp);
+			check(fp, nfp);
+			check(fp, rfp);
+			ntotal += nfp->ctf_typemax;
+
+			ctf_close(nfp);
+			ctf_close(fp);
+			ctf_close(pfp);
+			pfp = rfp;
+
+			/*
+			 * The types of the next child refer to those of the
+			 * merged container, which now has them all.
+			 */
+			ntypes = nsized = nints = 0;
+
+			for (id = 1; id <= pfp->ctf_typemax; id++)
+				use(pfp, id);
+		}
+
+		ctf_close(pfp);
+	}
+
+	(void) printf("%llu runs, %llu merged types, %llu mismatched\n",
+	    (u_longlong_t)n, (u_longlong_t)ntotal, (u_longlong_t)nbad);
+
+	return (nbad != 0);
+}
@@ -0,0 +1,118 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Rewrite a CTF container with its type index.
+ *
+ * The container in the input file, in any layout, is written to the output
+ * file uncompressed and with its type index by ctf_write_indexed(), as the
+ * typeinfo containers that libdtrace embeds are shipped.  The output is then
+ * opened again, and must be indexed and have the input's types:  each type
+ * must have the same kind, name and size in both, and its name must look up
+ * to the same type in both.
+ *
+ * usage: ctfindex input output
+ */
+
+#include <ctf_impl.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/*
+ * Return non-zero if type id is the same in both containers.
+ */
+static int
+same(ctf_file_t *ifp, ctf_file_t *ofp, ctf_id_t id)
+{
+	char iname[512], oname[512];
+
+	if (ctf_type_kind(ifp, id) != ctf_type_kind(ofp, id) ||
+	    ctf_type_size(ifp, id) != ctf_type_size(ofp, id))
+		return (0);
+
+	if (ctf_type_name(ifp, id, iname, sizeof (iname)) == NULL)
+		return (ctf_type_name(ofp, id, oname, sizeof (oname)) == NULL);
+
+	if (ctf_type_name(ofp, id, oname, sizeof (oname)) == NULL ||
+	    strcmp(iname, oname) != 0)
+		return (0);
+
+	return (ctf_lookup_by_name(ifp, iname) ==
+	    ctf_lookup_by_name(ofp, oname));
+}
+
+int
+main(int argc, char **argv)
+{
+	ctf_file_t *ifp, *ofp;
+	ulong_t id, nbad = 0;
+	int fd, err;
+
+	if (argc != 3) {
+		(void) fprintf(stderr, "usage: ctfindex input output\n");
+		return (2);
+	}
+
+	if ((ifp = ctf_open(argv[1], &err)) == NULL) {
+		(void) fprintf(stderr, "ctfindex: failed to open %s: %s\n",
+		    argv[1], ctf_errmsg(err));
+		return (1);
+	}
+
+	if ((fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1 ||
+	    ctf_write_indexed(ifp, fd) != 0 || close(fd) != 0) {
+		(void) fprintf(stderr, "ctfindex: failed to write %s\n",
+		    argv[2]);
+		return (1);
+	}
+
+	if ((ofp = ctf_open(argv[2], &err)) == NULL) {
+		(void) fprintf(stderr, "ctfindex: failed to reopen %s: %s\n",
+		    argv[2], ctf_errmsg(err));
+		return (1);
+	}
+
+	if (!(ofp->ctf_flags & LCTF_INDEX) ||
+	    ofp->ctf_typemax != ifp->ctf_typemax) {
+		(void) fprintf(stderr, "ctfindex: %s is not indexed\n",
+		    argv[2]);
+		return (1);
+	}
+
+	for (id = 1; id <= ofp->ctf_typemax; id++) {
+		if (!same(ifp, ofp, id))
+			nbad++;
+	}
+
+	if (nbad != 0) {
+		(void) fprintf(stderr, "ctfindex: %lu types of %s differ\n",
+		    nbad, argv[2]);
+		return (1);
+	}
+
+	(void) printf("%s: %lu types indexed\n", argv[2], ofp->ctf_typemax);
+
+	ctf_close(ofp);
+	ctf_close(ifp);
+
+	return (0);
+}
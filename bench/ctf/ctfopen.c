@@ -0,0 +1,470 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Startup time and resident memory of opening a CTF container, by layout.
+ *
+ * The container in the named file (such as the typeinfo/dtrace.amd64.ctf that
+ * libdtrace embeds) is written out in each of three layouts:
+ *
+ *	COMPRESSED	zlib-compressed, as the CTF tools write it
+ *	PLAIN		uncompressed, as ctf_write() writes it
+ *	INDEXED		uncompressed with its type index, as ctf_write_indexed()
+ *			writes it
+ *
+ * Each layout is then opened as libdtrace opens it:  the file is mapped
+ * read-only and handed to ctf_bufopen().  Every open is made by a process of
+ * its own, so that no open finds pages that another has touched, and the
+ * file is in the page cache, so that the time is not that of the disk.  After
+ * the open, the process looks up the named struct types that a script might
+ * use, chosen at random from the container.  Each row reports the size of the
+ * file, and for the open and for the lookups, the median time and the memory
+ * that became resident, in KB.
+ *
+ * The kernel maps pages of a file in clusters around the page that faulted,
+ * so the resident set of a mapping says little about how much of it was read.
+ * The memory is therefore measured by one more process, whose mapping traps
+ * the first access to each page:  it is the pages of the file that were
+ * touched, and the anonymous memory (from /proc/self/smaps_rollup) that was
+ * allocated.
+ *
+ * Every lookup must find its type in every layout.
+ *
+ * usage: ctfopen [-r repetitions] [-l lookups] file
+ */
+
+#include <ctf_impl.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+enum { COMPRESSED, PLAIN, INDEXED, NLAYOUTS };
+
+static const char *const layouts[NLAYOUTS] = {
+	"COMPRESSED", "PLAIN", "INDEXED"
+};
+
+/*
+ * What one process measured of one open.
+ */
+typedef struct sample {
+	uint64_t s_open;		/* time to open, in ns */
+	uint64_t s_lookup;		/* time to make the lookups, in ns */
+	long s_openkb;			/* KB made resident by open */
+	long s_lookupkb;		/* KB made resident by lookups */
+	int s_missed;			/* lookups that failed */
+} sample_t;
+
+/*
+ * The mapping whose first access to each page traps, and the count of its
+ * pages that have been touched.
+ */
+static char *trap_base;
+static size_t trap_size, trap_pgsz;
+static volatile long trap_pages;
+
+static char **names;
+static int nnames, maxnames;
+
+static uint64_t
+now(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void
+die(const char *what)
+{
+	(void) fprintf(stderr, "ctfopen: failed to %s\n", what);
+	exit(1);
+}
+
+/*
+ * Return the process's anonymous memory in KB.
+ */
+static long
+anon(void)
+{
+	long kb = -1;
+	char buf[128];
+	FILE *f;
+
+	if ((f = fopen("/proc/self/smaps_rollup", "r")) != NULL) {
+		while (fgets(buf, sizeof (buf), f) != NULL) {
+			if (sscanf(buf, "Anonymous: %ld kB", &kb) == 1)
+				break;
+		}
+		(void) fclose(f);
+	}
+
+	if (kb < 0)
+		die("read /proc/self/smaps_rollup");
+
+	return (kb);
+}
+
+/*
+ * Make the page of the trapping mapping that faulted readable, and count it.
+ * A fault elsewhere is left to kill the process.
+ */
+/*ARGSUSED*/
+static void
+trap(int sig, siginfo_t *sip, void *arg)
+{
+	char *addr = sip->si_addr;
+
+	if (addr < trap_base || addr >= trap_base + trap_size) {
+		(void) signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	addr = trap_base + (addr - trap_base) / trap_pgsz * trap_pgsz;
+
+	if (mprotect(addr, trap_pgsz, PROT_READ) != 0)
+		_exit(1);
+
+	trap_pages++;
+}
+
+/*
+ * Return the KB of memory that are resident in the process:  the pages of the
+ * trapping mapping that have been touched, and its anonymous memory.
+ */
+static long
+resident(void)
+{
+	return (trap_pages * (trap_pgsz / 1024) + anon());
+}
+
+static int
+addname(ctf_id_t id, void *arg)
+{
+	ctf_file_t *fp = arg;
+	char buf[256];
+
+	if (ctf_type_kind(fp, id) != CTF_K_STRUCT ||
+	    ctf_type_name(fp, id, buf, sizeof (buf)) == NULL ||
+	    strcmp(buf, "struct ") == 0)
+		return (0);
+
+	if (nnames == maxnames) {
+		maxnames = maxnames == 0 ? 1024 : maxnames * 2;
+
+		names = realloc(names, maxnames * sizeof (char *));
+
+		if (names == NULL)
+			die("allocate memory");
+	}
+
+	if ((names[nnames++] = strdup(buf)) == NULL)
+		die("allocate memory");
+
+	return (0);
+}
+
+/*
+ * Write the container fp to a temporary file in the specified layout, and
+ * return the file's name.
+ */
+static char *
+save(ctf_file_t *fp, int layout, off_t *sizep)
+{
+	static char tmpl[] = "/tmp/ctfopenXXXXXX";
+	const uchar_t *body = (const uchar_t *)fp->ctf_base +
+	    sizeof (ctf_header_t);
+	uLong len = fp->ctf_size - sizeof (ctf_header_t);
+	uLongf zlen = compressBound(len);
+	uchar_t *zbuf = NULL;
+	ctf_header_t hdr;
+	char *path;
+	int fd, err;
+
+	if ((path = strdup(tmpl)) == NULL || (fd = mkstemp(path)) == -1)
+		die("create temporary file");
+
+	/*
+	 * The container may itself have been read from a file of any layout,
+	 * so its header's flags are set for the layout being written.
+	 */
+	bcopy(fp->ctf_base, &hdr, sizeof (hdr));
+	hdr.cth_flags &= ~(CTF_F_COMPRESS | CTF_F_INDEX);
+
+	switch (layout) {
+	case COMPRESSED:
+		if ((zbuf = malloc(zlen)) == NULL ||
+		    compress2(zbuf, &zlen, body, len, Z_BEST_COMPRESSION) !=
+		    Z_OK)
+			die("compress container");
+
+		hdr.cth_flags |= CTF_F_COMPRESS;
+		err = write(fd, &hdr, sizeof (hdr)) != sizeof (hdr) ||
+		    write(fd, zbuf, zlen) != zlen;
+		free(zbuf);
+		break;
+	case PLAIN:
+		err = write(fd, &hdr, sizeof (hdr)) != sizeof (hdr) ||
+		    write(fd, body, len) != len;
+		break;
+	default:
+		err = ctf_write_indexed(fp, fd);
+		break;
+	}
+
+	if (err != 0 || (*sizep = lseek(fd, 0, SEEK_END)) == -1 ||
+	    close(fd) != 0)
+		die("write temporary file");
+
+	return (path);
+}
+
+/*
+ * In a process of its own, open the container in the file at path and make
+ * the lookups, and write what was measured to fd.  If trapping, the file's
+ * mapping traps the first access to each page, and only the memory that was
+ * made resident is measured.
+ */
+static void
+measure(const char *path, const char **lookups, int nlookups, int fd,
+    int trapping)
+{
+	struct sigaction act;
+	ctf_sect_t sect;
+	ctf_file_t *fp;
+	struct stat st;
+	sample_t s;
+	uint64_t t;
+	long kb = 0;
+	void *data;
+	int cfd, err, i;
+
+	bzero(&s, sizeof (s));
+	bzero(&sect, sizeof (sect));
+
+	if ((cfd = open(path, O_RDONLY)) == -1 || fstat(cfd, &st) != 0 ||
+	    (data = mmap(NULL, st.st_size, trapping ? PROT_NONE : PROT_READ,
+	    MAP_PRIVATE, cfd, 0)) == MAP_FAILED)
+		die("map container");
+
+	if (trapping) {
+		bzero(&act, sizeof (act));
+		act.sa_sigaction = trap;
+		act.sa_flags = SA_SIGINFO;
+
+		if (sigaction(SIGSEGV, &act, NULL) != 0)
+			die("trap faults");
+
+		trap_base = data;
+		trap_size = st.st_size;
+		trap_pgsz = sysconf(_SC_PAGESIZE);
+	}
+
+	sect.cts_data = data;
+	sect.cts_size = st.st_size;
+
+	if (trapping)
+		kb = resident();
+
+	t = now();
+
+	if ((fp = ctf_bufopen(&sect, NULL, NULL, &err)) == NULL)
+		die("open container");
+
+	s.s_open = now() - t;
+
+	if (trapping) {
+		s.s_openkb = resident() - kb;
+		kb = resident();
+	}
+
+	t = now();
+
+	for (i = 0; i < nlookups; i++) {
+		ctf_id_t id = ctf_lookup_by_name(fp, lookups[i]);
+
+		if (id == CTF_ERR || ctf_type_size(fp, id) < 0)
+			s.s_missed++;
+	}
+
+	s.s_lookup = now() - t;
+
+	if (trapping)
+		s.s_lookupkb = resident() - kb;
+
+	if (write(fd, &s, sizeof (s)) != sizeof (s))
+		die("report sample");
+
+	ctf_close(fp);
+	_exit(0);
+}
+
+/*
+ * Measure the file at path in a process of its own.
+ */
+static void
+sample(const char *path, const char **lookups, int nlookups, int trapping,
+    sample_t *sp)
+{
+	int fds[2], status;
+	pid_t pid;
+
+	if (pipe(fds) != 0 || (pid = fork()) == -1)
+		die("start process");
+
+	if (pid == 0) {
+		(void) close(fds[0]);
+		measure(path, lookups, nlookups, fds[1], trapping);
+	}
+
+	(void) close(fds[1]);
+
+	if (read(fds[0], sp, sizeof (*sp)) != sizeof (*sp) ||
+	    waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		die("measure open");
+
+	(void) close(fds[0]);
+}
+
+static int
+cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char **lookups;
+	ctf_file_t *fp;
+	int reps = 15, nlookups = 100, missed = 0;
+	int c, err, i, l, r;
+	uint64_t seed = 1;
+
+	while ((c = getopt(argc, argv, "l:r:")) != -1) {
+		switch (c) {
+		case 'l':
+			nlookups = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			argc = 0;
+			break;
+		}
+	}
+
+	if (argc - optind != 1 || reps <= 0 || nlookups < 0) {
+		(void) fprintf(stderr, "usage: ctfopen [-r repetitions] "
+		    "[-l lookups] file\n");
+		return (2);
+	}
+
+	if ((fp = ctf_open(argv[optind], &err)) == NULL) {
+		(void) fprintf(stderr, "ctfopen: failed to open %s: %s\n",
+		    argv[optind], ctf_errmsg(err));
+		return (1);
+	}
+
+	if (fp->ctf_version != CTF_VERSION_2)
+		die("open a container of another CTF version");
+
+	(void) ctf_type_iter(fp, addname, fp);
+
+	if (nnames == 0)
+		die("find struct types");
+
+	if ((lookups = malloc((nlookups + 1) * sizeof (char *))) == NULL)
+		die("allocate memory");
+
+	for (i = 0; i < nlookups; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		lookups[i] = names[seed % nnames];
+	}
+
+	(void) printf("%u types, %d struct names, %d looked up\n",
+	    (uint_t)fp->ctf_typemax, nnames, nlookups);
+	(void) printf("%-10s %9s %9s %9s %9s %9s\n", "", "SIZE", "OPEN",
+	    "OPEN", "LOOKUP", "LOOKUP");
+	(void) printf("%-10s %9s %9s %9s %9s %9s\n", "LAYOUT", "KB", "US",
+	    "KB", "US", "KB");
+
+	/*
+	 * Output is flushed so that the processes do not inherit it.
+	 */
+	(void) fflush(stdout);
+
+	for (l = 0; l < NLAYOUTS; l++) {
+		uint64_t *open, *lookup;
+		sample_t s, mem;
+		off_t size;
+		char *path = save(fp, l, &size);
+
+		if ((open = malloc(reps * sizeof (uint64_t))) == NULL ||
+		    (lookup = malloc(reps * sizeof (uint64_t))) == NULL)
+			die("allocate memory");
+
+		for (r = 0; r < reps; r++) {
+			sample(path, lookups, nlookups, 0, &s);
+			open[r] = s.s_open;
+			lookup[r] = s.s_lookup;
+			missed += s.s_missed;
+		}
+
+		sample(path, lookups, nlookups, 1, &mem);
+		missed += mem.s_missed;
+
+		qsort(open, reps, sizeof (uint64_t), cmp);
+		qsort(lookup, reps, sizeof (uint64_t), cmp);
+
+		(void) printf("%-10s %9lu %9.1f %9ld %9.1f %9ld\n", layouts[l],
+		    (ulong_t)size / 1024, open[reps / 2] / 1000.0,
+		    mem.s_openkb, lookup[reps / 2] / 1000.0, mem.s_lookupkb);
+
+		(void) fflush(stdout);
+		(void) unlink(path);
+		free(path);
+		free(open);
+		free(lookup);
+	}
+
+	if (missed != 0) {
+		(void) fprintf(stderr, "ctfopen: %d lookups failed\n", missed);
+		return (1);
+	}
+
+	ctf_close(fp);
+
+	return (0);
+}
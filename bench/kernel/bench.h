@@ -0,0 +1,120 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Interfaces to the user-mode build of the DTrace framework (see README).
+ * The drivers build enablings directly out of DIF objects and action
+ * descriptions, exactly as dtrace_dof_ecbdesc() would have built them from
+ * DOF, and fire probes by calling dtrace_probe() themselves.
+ */
+
+#ifndef _BENCH_H
+#define	_BENCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/dtrace.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A DIF object in the form in which the compiler would have emitted it.
+ * The tables are copied; a variable table entry for a string variable with
+ * a zero size is given the default string size, as DOF loading does.
+ */
+typedef struct bench_difo {
+	const dif_instr_t *bdo_text;		/* DIF text */
+	uint_t bdo_len;				/* length of DIF text */
+	const uint64_t *bdo_ints;		/* integer table */
+	uint_t bdo_nints;			/* length of integer table */
+	const char *bdo_strs;			/* string table */
+	uint_t bdo_strlen;			/* size of string table */
+	const dtrace_difv_t *bdo_vars;		/* variable table */
+	uint_t bdo_nvars;			/* length of variable table */
+	dtrace_diftype_t bdo_rtype;		/* return type */
+} bench_difo_t;
+
+/*
+ * An action description; ba_difo is NULL for actions without a DIF object.
+ */
+typedef struct bench_act {
+	dtrace_actkind_t ba_kind;		/* kind of action */
+	uint32_t ba_ntuple;			/* number in tuple */
+	uint64_t ba_arg;			/* action argument */
+	const bench_difo_t *ba_difo;		/* DIF object, if any */
+} bench_act_t;
+
+#define	BENCH_NELEM(a)	(sizeof (a) / sizeof ((a)[0]))
+
+/*
+ * Return types: a 64-bit integer, a string of the default "strsize", and the
+ * untyped value that passes an argument to an aggregating action.
+ */
+#define	BENCH_INT	{ DIF_TYPE_CTF, CTF_K_INTEGER, 0, 0, sizeof (uint64_t) }
+#define	BENCH_STRING	{ DIF_TYPE_STRING, 0, DIF_TF_BYREF, 0, 256 }
+#define	BENCH_ARG	{ DIF_TYPE_CTF, CTF_K_INTEGER, 0, 0, 0 }
+
+extern void bench_init(void);
+extern void bench_fini(void);
+extern void bench_setopt(int, dtrace_optval_t);
+extern void bench_setproc(int, int, const char *);
+
+extern dtrace_provider_id_t bench_provider(const char *);
+extern dtrace_id_t bench_probe(dtrace_provider_id_t, const char *,
+    const char *, const char *);
+
+extern int bench_enable(const char *, const bench_difo_t *,
+    const bench_act_t *, int);
+extern int bench_go(void);
+extern void bench_stop(void);
+extern uint64_t bench_consume(uint64_t *, uint64_t *);
+extern uint64_t bench_records(void (*)(dtrace_id_t, const void *, size_t,
+    void *), void *);
+extern void bench_tick(void);
+extern void bench_dynstat(uint_t *, size_t *, size_t *);
+
+/*
+ * How bench_dif_eval() evaluates a DIF object.
+ */
+#define	BENCH_DIF_TEXT		0	/* emulated from its text */
+#define	BENCH_DIF_DECODED	1	/* emulated decoded */
+#define	BENCH_DIF_NATIVE	2	/* by its native code */
+
+extern dtrace_difo_t *bench_dif_create(const bench_difo_t *);
+extern uint16_t bench_dif_eval(dtrace_difo_t *, int, const uint64_t *,
+    uint64_t *, uint64_t *);
+extern void bench_dif_destroy(dtrace_difo_t *);
+
+extern uint64_t bench_hrtime(void);
+
+/*
+ * Framework tunables that a driver may set before it enables anything.
+ */
+extern int dtrace_dif_predecode;
+extern int dtrace_dif_native;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* _BENCH_H */
@@ -0,0 +1,397 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Probe-context cost of representative D clauses.
+ *
+ * Each clause below is enabled on a probe of its own and the probe is fired
+ * in a loop; the time per firing covers dtrace_probe() from end to end --
+ * predicate, DIF emulation, buffer reservation and the stores into the
+ * principal and aggregation buffers.  The DIF is what dtrace(1M) emits for
+ * the D shown, including the variable table entries for the built-in
+ * variables that decide whether a predicate can be cached.
+ *
+ * With -t, DIF objects are not decoded when they are initialized, and are
+ * emulated from their text.  With -j, DIF objects are also compiled to native
+ * code, which runs in place of the emulator for those that compile.
+ *
+ * usage: difbench [-t | -j] [-n firings] [clause ...]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define	STRJOIN_FMT(r)	DIF_INSTR_PUSHTS(DIF_OP_PUSHTR, DIF_TYPE_STRING, 0, r)
+#define	TUPLE_INT(r)	DIF_INSTR_PUSHTS(DIF_OP_PUSHTV, DIF_TYPE_CTF, 0, r)
+
+/*
+ * bench:::pred /execname == "bench" && arg0 > 100/ {}
+ */
+static const dif_instr_t pred_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_EXECNAME, 1),
+	DIF_INSTR_SETS(0, 2),
+	DIF_INSTR_CMP(DIF_OP_SCMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BNE, 10),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BLE, 10),
+	DIF_INSTR_SETX(1, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t pred_ints[] = { 100, 1 };
+static const char pred_strs[] = "bench\0execname\0arg0";
+static const dtrace_difv_t pred_vars[] = {
+	{ 6, DIF_VAR_EXECNAME, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_STRING },
+	{ 15, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+/*
+ * bench:::argpred /arg0 > 100 && arg1 != 0 && arg0 < 200/ {}
+ */
+static const dif_instr_t argpred_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BLE, 14),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG1, 1),
+	DIF_INSTR_SETX(1, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BE, 14),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(2, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BGE, 14),
+	DIF_INSTR_SETX(3, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t argpred_ints[] = { 100, 0, 200, 1 };
+static const char argpred_strs[] = "arg0\0arg1";
+static const dtrace_difv_t argpred_vars[] = {
+	{ 0, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT },
+	{ 5, DIF_VAR_ARG1, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+/*
+ * bench:::bigpred /(arg0 & 255) * 3 + arg1 % 7 > 100 &&
+ *     ((arg0 ^ arg1) & 7) != 5 && arg1 - arg0 > 10 && (arg0 | 1) != arg1/ {}
+ */
+static const dif_instr_t bigpred_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_FMT(DIF_OP_AND, 1, 2, 1),
+	DIF_INSTR_SETX(1, 2),
+	DIF_INSTR_FMT(DIF_OP_MUL, 1, 2, 1),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG1, 2),
+	DIF_INSTR_SETX(2, 3),
+	DIF_INSTR_FMT(DIF_OP_SREM, 2, 3, 2),
+	DIF_INSTR_FMT(DIF_OP_ADD, 1, 2, 1),
+	DIF_INSTR_SETX(3, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BLE, 34),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG1, 2),
+	DIF_INSTR_FMT(DIF_OP_XOR, 1, 2, 1),
+	DIF_INSTR_SETX(2, 2),
+	DIF_INSTR_FMT(DIF_OP_AND, 1, 2, 1),
+	DIF_INSTR_SETX(4, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BE, 34),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG1, 1),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 2),
+	DIF_INSTR_FMT(DIF_OP_SUB, 1, 2, 1),
+	DIF_INSTR_SETX(5, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BLE, 34),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(6, 2),
+	DIF_INSTR_FMT(DIF_OP_OR, 1, 2, 1),
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG1, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BE, 34),
+	DIF_INSTR_SETX(6, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t bigpred_ints[] = { 255, 3, 7, 100, 5, 10, 1 };
+
+/*
+ * bench:::string { trace(strlen(strjoin(execname, ".exe"))); }
+ */
+static const dif_instr_t string_text[] = {
+	DIF_INSTR_FLUSHTS,
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_EXECNAME, 1),
+	STRJOIN_FMT(1),
+	DIF_INSTR_SETS(0, 2),
+	STRJOIN_FMT(2),
+	DIF_INSTR_CALL(DIF_SUBR_STRJOIN, 1),
+	DIF_INSTR_FLUSHTS,
+	STRJOIN_FMT(1),
+	DIF_INSTR_CALL(DIF_SUBR_STRLEN, 1),
+	DIF_INSTR_RET(1)
+};
+static const char string_strs[] = ".exe\0execname";
+static const dtrace_difv_t string_vars[] = {
+	{ 5, DIF_VAR_EXECNAME, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_STRING }
+};
+
+/*
+ * bench:::assoc { trace(++x[arg0 & 1023]); }
+ */
+static const dif_instr_t assoc_text[] = {
+	DIF_INSTR_FLUSHTS,
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_FMT(DIF_OP_AND, 1, 2, 1),
+	TUPLE_INT(1),
+	DIF_INSTR_LDV(DIF_OP_LDGAA, DIF_VAR_OTHER_UBASE, 3),
+	DIF_INSTR_SETX(1, 2),
+	DIF_INSTR_FMT(DIF_OP_ADD, 3, 2, 3),
+	DIF_INSTR_STV(DIF_OP_STGAA, DIF_VAR_OTHER_UBASE, 3),
+	DIF_INSTR_RET(3)
+};
+static const uint64_t assoc_ints[] = { 1023, 1 };
+static const char assoc_strs[] = "x\0arg0";
+static const dtrace_difv_t assoc_vars[] = {
+	{ 0, DIF_VAR_OTHER_UBASE, DIFV_KIND_ARRAY, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF | DIFV_F_MOD, BENCH_INT },
+	{ 2, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+/*
+ * bench:::agg { @a[arg0 & 1023] = count(); @q = quantize(arg1); }
+ *
+ * Each aggregation tuple begins with the aggregation's ID, which dtrace(1M)
+ * records as a constant.
+ */
+static const dif_instr_t aggid_text[] = {
+	DIF_INSTR_SETX(0, 1),
+	DIF_INSTR_RET(1)
+};
+static const uint64_t aggid1_ints[] = { 1 };
+static const uint64_t aggid2_ints[] = { 2 };
+
+static const dif_instr_t key_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_FMT(DIF_OP_AND, 1, 2, 1),
+	DIF_INSTR_RET(1)
+};
+static const uint64_t key_ints[] = { 1023 };
+static const char arg0_strs[] = "arg0";
+static const dtrace_difv_t arg0_vars[] = {
+	{ 0, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+static const dif_instr_t arg1_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG1, 1),
+	DIF_INSTR_RET(1)
+};
+static const char arg1_strs[] = "arg1";
+static const dtrace_difv_t arg1_vars[] = {
+	{ 0, DIF_VAR_ARG1, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+static const bench_difo_t pred_difo = {
+	pred_text, BENCH_NELEM(pred_text), pred_ints, BENCH_NELEM(pred_ints),
+	pred_strs, sizeof (pred_strs), pred_vars, BENCH_NELEM(pred_vars),
+	BENCH_INT
+};
+
+static const bench_difo_t argpred_difo = {
+	argpred_text, BENCH_NELEM(argpred_text), argpred_ints,
+	BENCH_NELEM(argpred_ints), argpred_strs, sizeof (argpred_strs),
+	argpred_vars, BENCH_NELEM(argpred_vars), BENCH_INT
+};
+
+static const bench_difo_t bigpred_difo = {
+	bigpred_text, BENCH_NELEM(bigpred_text), bigpred_ints,
+	BENCH_NELEM(bigpred_ints), argpred_strs, sizeof (argpred_strs),
+	argpred_vars, BENCH_NELEM(argpred_vars), BENCH_INT
+};
+
+static const bench_difo_t string_difo = {
+	string_text, BENCH_NELEM(string_text), NULL, 0,
+	string_strs, sizeof (string_strs), string_vars,
+	BENCH_NELEM(string_vars), BENCH_INT
+};
+
+static const bench_difo_t assoc_difo = {
+	assoc_text, BENCH_NELEM(assoc_text), assoc_ints,
+	BENCH_NELEM(assoc_ints), assoc_strs, sizeof (assoc_strs),
+	assoc_vars, BENCH_NELEM(assoc_vars), BENCH_INT
+};
+
+static const bench_difo_t aggid1_difo = {
+	aggid_text, BENCH_NELEM(aggid_text), aggid1_ints, 1,
+	NULL, 0, NULL, 0, BENCH_INT
+};
+
+static const bench_difo_t aggid2_difo = {
+	aggid_text, BENCH_NELEM(aggid_text), aggid2_ints, 1,
+	NULL, 0, NULL, 0, BENCH_INT
+};
+
+static const bench_difo_t key_difo = {
+	key_text, BENCH_NELEM(key_text), key_ints, 1,
+	arg0_strs, sizeof (arg0_strs), arg0_vars, 1, BENCH_INT
+};
+
+static const bench_difo_t arg1_difo = {
+	arg1_text, BENCH_NELEM(arg1_text), NULL, 0,
+	arg1_strs, sizeof (arg1_strs), arg1_vars, 1, BENCH_ARG
+};
+
+static const bench_act_t trace_string[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &string_difo }
+};
+
+static const bench_act_t trace_assoc[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &assoc_difo }
+};
+
+static const bench_act_t aggregate[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &aggid1_difo },
+	{ DTRACEACT_DIFEXPR, 0, 0, &key_difo },
+	{ DTRACEAGG_COUNT, 2, 0, NULL },
+	{ DTRACEACT_DIFEXPR, 0, 0, &aggid2_difo },
+	{ DTRACEACT_DIFEXPR, 0, 0, &arg1_difo },
+	{ DTRACEAGG_QUANTIZE, 2, 0, NULL }
+};
+
+static struct clause {
+	const char *c_name;
+	const bench_difo_t *c_pred;
+	const bench_act_t *c_acts;
+	int c_nacts;
+	dtrace_id_t c_id;
+} clauses[] = {
+	{ "empty", NULL, NULL, 0 },		/* bench:::empty {} */
+	{ "pred", &pred_difo, NULL, 0 },
+	{ "argpred", &argpred_difo, NULL, 0 },
+	{ "bigpred", &bigpred_difo, NULL, 0 },
+	{ "string", NULL, trace_string, BENCH_NELEM(trace_string) },
+	{ "assoc", NULL, trace_assoc, BENCH_NELEM(trace_assoc) },
+	{ "agg", NULL, aggregate, BENCH_NELEM(aggregate) },
+	{ NULL }
+};
+
+#define	CONSUME_INTERVAL	4096
+
+int
+main(int argc, char **argv)
+{
+	dtrace_provider_id_t prov;
+	struct clause *c;
+	uint64_t n = 10000000, i, drops = 0, errors = 0, bytes;
+	hrtime_t start, elapsed;
+	int j;
+
+	if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+		dtrace_dif_predecode = 0;
+		argc--;
+		argv++;
+	} else if (argc > 1 && strcmp(argv[1], "-j") == 0) {
+		dtrace_dif_native = 1;
+		argc--;
+		argv++;
+	}
+
+	if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		n = strtoul(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	}
+
+	bench_init();
+	bench_setopt(DTRACEOPT_BUFSIZE, 4 * 1024 * 1024);
+	bench_setopt(DTRACEOPT_AGGSIZE, 4 * 1024 * 1024);
+	bench_setopt(DTRACEOPT_DYNVARSIZE, 4 * 1024 * 1024);
+
+	prov = bench_provider("bench");
+
+	for (c = clauses; c->c_name != NULL; c++) {
+		char spec[DTRACE_FULLNAMELEN];
+
+		c->c_id = bench_probe(prov, "", "", c->c_name);
+		(void) snprintf(spec, sizeof (spec), "bench:::%s", c->c_name);
+		(void) bench_enable(spec, c->c_pred, c->c_acts, c->c_nacts);
+	}
+
+	if (bench_go() != 0) {
+		(void) fprintf(stderr, "failed to start tracing\n");
+		return (1);
+	}
+
+	(void) printf("%-10s %12s %10s %12s\n", "CLAUSE", "FIRINGS",
+	    "NS/FIRING", "BYTES");
+
+	for (c = clauses; c->c_name != NULL; c++) {
+		for (j = 1; j < argc; j++) {
+			if (strcmp(argv[j], c->c_name) == 0)
+				break;
+		}
+
+		if (argc > 1 && j == argc)
+			continue;
+
+		bytes = 0;
+		elapsed = 0;
+
+		for (i = 0; i < n; i += CONSUME_INTERVAL) {
+			uint64_t k, lim = i + CONSUME_INTERVAL;
+
+			if (lim > n)
+				lim = n;
+
+			start = bench_hrtime();
+
+			for (k = i; k < lim; k++)
+				dtrace_probe(c->c_id, k & 0xff, k, 0, 0, NULL);
+
+			elapsed += bench_hrtime() - start;
+			bytes += bench_consume(&drops, &errors);
+		}
+
+		(void) printf("%-10s %12llu %10.1f %12llu\n", c->c_name,
+		    (u_longlong_t)n, (double)elapsed / n,
+		    (u_longlong_t)bytes);
+	}
+
+	if (drops != 0 || errors != 0) {
+		(void) printf("%llu drops, %llu errors\n", (u_longlong_t)drops,
+		    (u_longlong_t)errors);
+	}
+
+	bench_fini();
+
+	return (0);
+}
@@ -0,0 +1,365 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Differential check of decoded DIF emulation and of native DIF code.
+ *
+ * Random DIF objects -- valid, but otherwise arbitrary -- are evaluated from
+ * their text, as decoded by dtrace_difo_init() and by the native code that
+ * it compiled them to, each with a number of random argument vectors.  Any
+ * difference from the text in the result or in the fault taken and where is
+ * reported, as is any difference in the number of instructions that the
+ * decoded object executed (native code does not count them).  The programs
+ * are built mostly out of the sequences that decode to fused operations,
+ * with branches into the middle of them, and with enough bad loads, string
+ * compares of non-strings and divisions by zero to exercise the fault paths.
+ * Every program must have been compiled.
+ *
+ * usage: difcheck [-n programs] [-s seed]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define	MAXLEN		48
+#define	NREGS		8
+#define	NARGVECS	16
+
+static uint64_t seed = 1;
+
+static uint64_t
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (seed);
+}
+
+#define	RND(n)		((uint_t)(rnd() % (n)))
+#define	REG()		RND(NREGS)
+#define	DREG()		(1 + RND(NREGS - 1))
+
+static const uint64_t ints[] = {
+	0, 1, 100, 255, (uint64_t)-1, (uint64_t)INT64_MIN, INT64_MAX, 0x1000
+};
+
+static const char strs[] = "bench\0benc\0bencha\0\0";
+static const uint_t stroffs[] = { 0, 6, 11, 18 };
+
+/*
+ * sdiv and srem are left out:  the emulator divides INT64_MIN by -1 as the
+ * hardware does, and the hardware traps.  They are generated only with
+ * operands just set from the integers, the divisor from those other than -1.
+ */
+static const uint_t divisors[] = { 0, 1, 2, 3, 5, 6, 7 };
+
+static const uint_t alu[] = {
+	DIF_OP_OR, DIF_OP_XOR, DIF_OP_AND, DIF_OP_SLL, DIF_OP_SRL, DIF_OP_SUB,
+	DIF_OP_ADD, DIF_OP_MUL, DIF_OP_UDIV, DIF_OP_UREM
+};
+
+static const uint_t branches[] = {
+	DIF_OP_BA, DIF_OP_BE, DIF_OP_BNE, DIF_OP_BG, DIF_OP_BGU, DIF_OP_BGE,
+	DIF_OP_BGEU, DIF_OP_BL, DIF_OP_BLU, DIF_OP_BLE, DIF_OP_BLEU
+};
+
+static const uint_t loads[] = {
+	DIF_OP_LDSB, DIF_OP_LDUH, DIF_OP_LDSW, DIF_OP_LDX, DIF_OP_RLDUB,
+	DIF_OP_RLDX
+};
+
+static const uint_t vars[] = {
+	DIF_VAR_ARG0, DIF_VAR_ARG1, DIF_VAR_ARG2, DIF_VAR_ARG3,
+	DIF_VAR_EXECNAME, DIF_VAR_PID
+};
+
+static const dtrace_difv_t vartab[] = {
+	{ 0, DIF_VAR_EXECNAME, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_STRING },
+	{ 0, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+#define	ELEM(a)		((a)[RND(BENCH_NELEM(a))])
+
+static dif_instr_t
+branch(uint_t pc, uint_t len)
+{
+	return (DIF_INSTR_BRANCH(ELEM(branches), pc + 1 + RND(len - pc - 1)));
+}
+
+/*
+ * Fill text[0 .. len - 1] with a random program ending in a ret.  The
+ * emulator leaves the registers other than %r0 uninitialized, as the compiler
+ * never reads a register that it has not written; each program therefore
+ * begins by setting every register.
+ */
+static void
+generate(dif_instr_t *text, uint_t len)
+{
+	uint8_t back[MAXLEN];
+	uint_t pc, r;
+
+	bzero(back, sizeof (back));
+
+	for (pc = 0; pc < NREGS - 1; pc++) {
+		text[pc] = RND(2) ? DIF_INSTR_SETX(RND(BENCH_NELEM(ints)),
+		    pc + 1) : DIF_INSTR_LDV(DIF_OP_LDGS, ELEM(vars), pc + 1);
+	}
+
+	while (pc < len - 1) {
+		uint_t left = len - 1 - pc;
+
+		switch (RND(13)) {
+		case 0:
+			text[pc++] = DIF_INSTR_FMT(ELEM(alu), REG(), REG(),
+			    DREG());
+			break;
+		case 1:
+			text[pc++] = DIF_INSTR_FMT(RND(2) ? DIF_OP_NOT :
+			    DIF_OP_MOV, REG(), 0, DREG());
+			break;
+		case 2:
+			text[pc++] = DIF_INSTR_SETX(RND(BENCH_NELEM(ints)),
+			    DREG());
+			break;
+		case 3:
+			text[pc++] = DIF_INSTR_SETS(ELEM(stroffs), DREG());
+			break;
+		case 4:
+			text[pc++] = DIF_INSTR_LDV(DIF_OP_LDGS, ELEM(vars),
+			    DREG());
+			break;
+		case 5:
+			text[pc++] = RND(2) ? DIF_INSTR_CMP(DIF_OP_CMP, REG(),
+			    REG()) : DIF_INSTR_TST(REG());
+			break;
+		case 6:
+			text[pc] = branch(pc, len);
+			pc++;
+			break;
+		case 7:
+			if (RND(3) == 0) {
+				text[pc++] = DIF_INSTR_LOAD(ELEM(loads), REG(),
+				    DREG());
+			}
+			break;
+		case 8:
+			/*
+			 * ldgs argN, rA; setx, rB; cmp rA, rB; bcc
+			 */
+			if (left < 4)
+				break;
+			text[pc++] = DIF_INSTR_LDV(DIF_OP_LDGS,
+			    DIF_VAR_ARG0 + RND(4), 1 + RND(3));
+			text[pc++] = DIF_INSTR_SETX(RND(BENCH_NELEM(ints)),
+			    1 + RND(3));
+			text[pc++] = DIF_INSTR_CMP(DIF_OP_CMP, 1 + RND(3),
+			    1 + RND(3));
+			text[pc] = branch(pc, len);
+			pc++;
+			break;
+		case 9:
+			/*
+			 * setx, rB; cmp rA, rB; bcc
+			 */
+			if (left < 3)
+				break;
+			text[pc++] = DIF_INSTR_SETX(RND(BENCH_NELEM(ints)),
+			    1 + RND(3));
+			text[pc++] = DIF_INSTR_CMP(DIF_OP_CMP, RND(4),
+			    RND(4));
+			text[pc] = branch(pc, len);
+			pc++;
+			break;
+		case 10:
+			/*
+			 * ldgs execname, rA; sets, rB; scmp rA, rB; bcc
+			 */
+			if (left < 4)
+				break;
+			text[pc++] = DIF_INSTR_LDV(DIF_OP_LDGS,
+			    RND(4) ? DIF_VAR_EXECNAME : DIF_VAR_ARG0,
+			    1 + RND(3));
+			text[pc++] = DIF_INSTR_SETS(ELEM(stroffs), 1 + RND(3));
+			text[pc++] = DIF_INSTR_CMP(DIF_OP_SCMP, 1 + RND(3),
+			    1 + RND(3));
+			text[pc] = branch(pc, len);
+			pc++;
+			break;
+		case 11:
+			text[pc++] = RND(4) ? DIF_INSTR_NOP :
+			    DIF_INSTR_RET(REG());
+			break;
+		case 12:
+			/*
+			 * setx, rA; setx, rB; sdiv or srem rA, rB, rD
+			 */
+			if (left < 3)
+				break;
+			r = 1 + RND(NREGS - 2);
+			text[pc++] = DIF_INSTR_SETX(RND(BENCH_NELEM(ints)), r);
+			back[pc] = 1;
+			text[pc++] = DIF_INSTR_SETX(ELEM(divisors), r + 1);
+			back[pc] = 2;
+			text[pc++] = DIF_INSTR_FMT(RND(2) ? DIF_OP_SDIV :
+			    DIF_OP_SREM, r, r + 1, DREG());
+			break;
+		}
+	}
+
+	text[pc] = DIF_INSTR_RET(REG());
+
+	/*
+	 * A branch into the middle of an sdiv or srem sequence would skip the
+	 * setx of an operand, and goes to the start of the sequence instead.
+	 */
+	for (pc = 0; pc < len; pc++) {
+		uint_t op = DIF_INSTR_OP(text[pc]), label, i;
+
+		for (i = 0; i < BENCH_NELEM(branches); i++) {
+			if (branches[i] == op)
+				break;
+		}
+
+		if (i < BENCH_NELEM(branches)) {
+			label = DIF_INSTR_LABEL(text[pc]);
+			text[pc] = DIF_INSTR_BRANCH(op, label - back[label]);
+		}
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	static const char *const names[] = { "bench", "benc", "bencha" };
+	static const char *const hows[] = { "text", "decoded", "native" };
+	dif_instr_t text[MAXLEN];
+	bench_difo_t bdo;
+	uint64_t n = 100000, i, nevals = 0, nfaults = 0, nbad = 0;
+	uint64_t nnative = 0;
+	int c;
+
+	while (argc > 2 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-n") == 0) {
+			n = strtoul(argv[2], NULL, 0);
+		} else if (strcmp(argv[1], "-s") == 0) {
+			seed = strtoul(argv[2], NULL, 0);
+		} else {
+			break;
+		}
+
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || seed == 0) {
+		(void) fprintf(stderr, "usage: difcheck [-n programs] "
+		    "[-s seed]\n");
+		return (2);
+	}
+
+	dtrace_dif_native = 1;
+	bench_init();
+
+	bzero(&bdo, sizeof (bdo));
+	bdo.bdo_text = text;
+	bdo.bdo_ints = ints;
+	bdo.bdo_nints = BENCH_NELEM(ints);
+	bdo.bdo_strs = strs;
+	bdo.bdo_strlen = sizeof (strs);
+	bdo.bdo_vars = vartab;
+	bdo.bdo_nvars = BENCH_NELEM(vartab);
+	bdo.bdo_rtype.dtdt_kind = DIF_TYPE_CTF;
+	bdo.bdo_rtype.dtdt_size = sizeof (uint64_t);
+
+	for (i = 0; i < n; i++) {
+		dtrace_difo_t *dp;
+
+		bdo.bdo_len = NREGS + RND(MAXLEN - NREGS + 1);
+		generate(text, bdo.bdo_len);
+		dp = bench_dif_create(&bdo);
+
+		if (dp->dtdo_native != NULL)
+			nnative++;
+
+		for (c = 0; c < NARGVECS; c++) {
+			uint64_t args[4], rval[3], nops[3];
+			uint16_t flt[3];
+			int j, bad = 0;
+
+			for (j = 0; j < 4; j++)
+				args[j] = RND(2) ? ELEM(ints) : RND(512);
+
+			bench_setproc(1 + RND(4), 1, ELEM(names));
+
+			for (j = BENCH_DIF_TEXT; j <= BENCH_DIF_NATIVE; j++) {
+				flt[j] = bench_dif_eval(dp, j, args, &rval[j],
+				    &nops[j]);
+
+				if (flt[j] != flt[BENCH_DIF_TEXT] ||
+				    rval[j] != rval[BENCH_DIF_TEXT])
+					bad = 1;
+			}
+
+			nevals++;
+
+			if (flt[BENCH_DIF_TEXT] != 0)
+				nfaults++;
+
+			if (nops[BENCH_DIF_DECODED] != nops[BENCH_DIF_TEXT])
+				bad = 1;
+
+			if (!bad)
+				continue;
+
+			(void) printf("program %llu, arguments %llx %llx "
+			    "%llx %llx:", (u_longlong_t)i,
+			    (u_longlong_t)args[0], (u_longlong_t)args[1],
+			    (u_longlong_t)args[2], (u_longlong_t)args[3]);
+
+			for (j = BENCH_DIF_TEXT; j <= BENCH_DIF_NATIVE; j++) {
+				(void) printf(" %s %x/%llx/%llu", hows[j],
+				    flt[j], (u_longlong_t)rval[j],
+				    (u_longlong_t)nops[j]);
+			}
+
+			(void) printf("\n");
+
+			for (j = 0; j < bdo.bdo_len; j++)
+				(void) printf("\t%02d: %08x\n", j, text[j]);
+
+			nbad++;
+		}
+
+		bench_dif_destroy(dp);
+	}
+
+	(void) printf("%llu programs, %llu compiled, %llu evaluations, "
+	    "%llu faulted, %llu mismatched\n", (u_longlong_t)n,
+	    (u_longlong_t)nnative, (u_longlong_t)nevals,
+	    (u_longlong_t)nfaults, (u_longlong_t)nbad);
+
+	bench_fini();
+
+	return (nbad != 0 || nnative != n);
+}
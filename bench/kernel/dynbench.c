@@ -0,0 +1,232 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Growth of the dynamic variable space.
+ *
+ * An associative array is given more keys than the initial space can hold.
+ * Each pass stores every key, then runs the cleaner, which grows the space
+ * once the stores have exhausted it; the passes continue until every key has
+ * been stored.  After each pass, every key is looked up by a predicate that
+ * traces the keys whose value is missing or wrong.  Each row reports the
+ * regions added to the space, the buckets of its hash table and the longest
+ * hash chain, the keys missing and the time per lookup.
+ *
+ * The driver exits non-zero if a key is missing after a pass that did not
+ * grow the space, or if the hash table has not grown with the space.
+ *
+ * usage: dynbench [-k keys]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define	TUPLE_INT(r)	DIF_INSTR_PUSHTS(DIF_OP_PUSHTV, DIF_TYPE_CTF, 0, r)
+
+/*
+ * bench:::store { trace(x[arg0] = arg0 + 1); }
+ */
+static const dif_instr_t store_text[] = {
+	DIF_INSTR_FLUSHTS,
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	TUPLE_INT(1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_FMT(DIF_OP_ADD, 1, 2, 3),
+	DIF_INSTR_STV(DIF_OP_STGAA, DIF_VAR_OTHER_UBASE, 3),
+	DIF_INSTR_RET(3)
+};
+
+/*
+ * bench:::load /x[arg0] != arg0 + 1/ { trace(arg0); }
+ */
+static const dif_instr_t load_text[] = {
+	DIF_INSTR_FLUSHTS,
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	TUPLE_INT(1),
+	DIF_INSTR_LDV(DIF_OP_LDGAA, DIF_VAR_OTHER_UBASE, 2),
+	DIF_INSTR_SETX(0, 3),
+	DIF_INSTR_FMT(DIF_OP_ADD, 1, 3, 3),
+	DIF_INSTR_CMP(DIF_OP_CMP, 2, 3),
+	DIF_INSTR_BRANCH(DIF_OP_BE, 10),
+	DIF_INSTR_SETX(0, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t x_ints[] = { 1 };
+static const char x_strs[] = "x\0arg0";
+static const dtrace_difv_t x_vars[] = {
+	{ 0, DIF_VAR_OTHER_UBASE, DIFV_KIND_ARRAY, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF | DIFV_F_MOD, BENCH_INT },
+	{ 2, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+static const dif_instr_t arg0_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_RET(1)
+};
+static const char arg0_strs[] = "arg0";
+static const dtrace_difv_t arg0_vars[] = {
+	{ 0, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+static const bench_difo_t store_difo = {
+	store_text, BENCH_NELEM(store_text), x_ints, BENCH_NELEM(x_ints),
+	x_strs, sizeof (x_strs), x_vars, BENCH_NELEM(x_vars), BENCH_INT
+};
+
+static const bench_difo_t load_difo = {
+	load_text, BENCH_NELEM(load_text), x_ints, BENCH_NELEM(x_ints),
+	x_strs, sizeof (x_strs), x_vars, BENCH_NELEM(x_vars), BENCH_INT
+};
+
+static const bench_difo_t arg0_difo = {
+	arg0_text, BENCH_NELEM(arg0_text), NULL, 0,
+	arg0_strs, sizeof (arg0_strs), arg0_vars, 1, BENCH_INT
+};
+
+static const bench_act_t trace_store[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &store_difo }
+};
+
+static const bench_act_t trace_arg0[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &arg0_difo }
+};
+
+#define	CONSUME_INTERVAL	4096
+
+/*
+ * Fires the probe once for each of the keys, switching the buffer as
+ * difbench does, and returns the bytes traced.  The time spent in probe
+ * context is added to *elapsed.
+ */
+static uint64_t
+fire(dtrace_id_t id, uint64_t keys, hrtime_t *elapsed)
+{
+	uint64_t bytes = 0, drops = 0, i, k, lim;
+	hrtime_t start;
+
+	for (i = 0; i < keys; i += CONSUME_INTERVAL) {
+		if ((lim = i + CONSUME_INTERVAL) > keys)
+			lim = keys;
+
+		start = bench_hrtime();
+
+		for (k = i; k < lim; k++)
+			dtrace_probe(id, k, 0, 0, 0, NULL);
+
+		*elapsed += bench_hrtime() - start;
+		bytes += bench_consume(&drops, NULL);
+	}
+
+	if (drops != 0) {
+		(void) fprintf(stderr, "dynbench: %llu drops\n",
+		    (u_longlong_t)drops);
+		exit(1);
+	}
+
+	return (bytes);
+}
+
+int
+main(int argc, char **argv)
+{
+	dtrace_provider_id_t prov;
+	dtrace_id_t store, load;
+	uint64_t keys = 20000, missing, rec;
+	size_t basehash, hashsize, longest;
+	uint_t ngrow, lastgrow, pass;
+	hrtime_t elapsed;
+
+	if (argc > 2 && strcmp(argv[1], "-k") == 0) {
+		keys = strtoul(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || keys == 0) {
+		(void) fprintf(stderr, "usage: dynbench [-k keys]\n");
+		return (2);
+	}
+
+	bench_init();
+	bench_setopt(DTRACEOPT_BUFSIZE, 4 * 1024 * 1024);
+	bench_setopt(DTRACEOPT_DYNVARSIZE, 1024 * 1024);
+
+	prov = bench_provider("bench");
+	store = bench_probe(prov, "", "", "store");
+	load = bench_probe(prov, "", "", "load");
+
+	if (bench_enable("bench:::store", NULL, trace_store,
+	    BENCH_NELEM(trace_store)) != 1 ||
+	    bench_enable("bench:::load", &load_difo, trace_arg0,
+	    BENCH_NELEM(trace_arg0)) != 1 || bench_go() != 0) {
+		(void) fprintf(stderr, "failed to start tracing\n");
+		return (1);
+	}
+
+	/*
+	 * Nothing has been stored yet, so a single lookup measures the size
+	 * of the record traced for a missing key.
+	 */
+	elapsed = 0;
+	rec = fire(load, 1, &elapsed);
+	bench_dynstat(&ngrow, &basehash, &longest);
+
+	(void) printf("%-4s %7s %8s %7s %10s %10s\n", "PASS", "REGIONS",
+	    "BUCKETS", "LONGEST", "MISSING", "NS/LOOKUP");
+
+	for (pass = 1; ; pass++) {
+		lastgrow = ngrow;
+		elapsed = 0;
+		(void) fire(store, keys, &elapsed);
+		bench_tick();
+
+		elapsed = 0;
+		missing = fire(load, keys, &elapsed) / rec;
+		bench_dynstat(&ngrow, &hashsize, &longest);
+
+		(void) printf("%-4u %7u %8llu %7llu %10llu %10.1f\n", pass,
+		    ngrow, (u_longlong_t)hashsize, (u_longlong_t)longest,
+		    (u_longlong_t)missing, (double)elapsed / keys);
+
+		if (hashsize < basehash * (ngrow + 1) - 1) {
+			(void) fprintf(stderr, "dynbench: hash table of %llu "
+			    "buckets after %u regions added\n",
+			    (u_longlong_t)hashsize, ngrow);
+			return (1);
+		}
+
+		if (missing == 0)
+			break;
+
+		if (ngrow == lastgrow) {
+			(void) fprintf(stderr, "dynbench: %llu keys missing "
+			    "from a full space\n", (u_longlong_t)missing);
+			return (1);
+		}
+	}
+
+	bench_fini();
+
+	return (0);
+}
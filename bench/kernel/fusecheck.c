@@ -0,0 +1,265 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Output of fused clauses against that of the same clauses unfused.
+ *
+ * With the "clausefuse" option, the compiler gives adjacent clauses on one
+ * probe description with the same predicate (or none) a single ECB.  This
+ * driver enables the ECBs that the compiler emits for
+ *
+ *	bench:::P /arg0 > 100/ { trace(arg0); }
+ *	bench:::P /arg0 > 100/ { trace(arg1 + 1); trace(pid); }
+ *	bench:::P { trace(arg0 * 2); }
+ *
+ * both without fusion, as three ECBs on bench:::split, and with it, as two
+ * ECBs (the first with the actions of both predicated clauses) on
+ * bench:::fused.  Both probes are fired with the same arguments, and the data
+ * that each probe's actions recorded is compared byte for byte.
+ *
+ * The driver exits non-zero if the data differ, or if the fused probe did not
+ * record one record fewer per firing than the split one whenever the
+ * predicate held.
+ *
+ * usage: fusecheck [-n firings]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+/*
+ * /arg0 > 100/
+ */
+static const dif_instr_t pred_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BLE, 6),
+	DIF_INSTR_SETX(1, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t pred_ints[] = { 100, 1 };
+
+static const dif_instr_t arg0_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_RET(1)
+};
+
+/*
+ * arg1 + 1
+ */
+static const dif_instr_t arg1_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG1, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_FMT(DIF_OP_ADD, 1, 2, 1),
+	DIF_INSTR_RET(1)
+};
+static const uint64_t arg1_ints[] = { 1 };
+
+static const dif_instr_t pid_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_PID, 1),
+	DIF_INSTR_RET(1)
+};
+
+/*
+ * arg0 * 2
+ */
+static const dif_instr_t double_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_ARG0, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_FMT(DIF_OP_MUL, 1, 2, 1),
+	DIF_INSTR_RET(1)
+};
+static const uint64_t double_ints[] = { 2 };
+
+static const char arg0_strs[] = "arg0";
+static const dtrace_difv_t arg0_vars[] = {
+	{ 0, DIF_VAR_ARG0, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+static const char arg1_strs[] = "arg1";
+static const dtrace_difv_t arg1_vars[] = {
+	{ 0, DIF_VAR_ARG1, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+static const char pid_strs[] = "pid";
+static const dtrace_difv_t pid_vars[] = {
+	{ 0, DIF_VAR_PID, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+static const bench_difo_t pred_difo = {
+	pred_text, BENCH_NELEM(pred_text), pred_ints, BENCH_NELEM(pred_ints),
+	arg0_strs, sizeof (arg0_strs), arg0_vars, 1, BENCH_INT
+};
+
+static const bench_difo_t arg0_difo = {
+	arg0_text, BENCH_NELEM(arg0_text), NULL, 0,
+	arg0_strs, sizeof (arg0_strs), arg0_vars, 1, BENCH_INT
+};
+
+static const bench_difo_t arg1_difo = {
+	arg1_text, BENCH_NELEM(arg1_text), arg1_ints, 1,
+	arg1_strs, sizeof (arg1_strs), arg1_vars, 1, BENCH_INT
+};
+
+static const bench_difo_t pid_difo = {
+	pid_text, BENCH_NELEM(pid_text), NULL, 0,
+	pid_strs, sizeof (pid_strs), pid_vars, 1, BENCH_INT
+};
+
+static const bench_difo_t double_difo = {
+	double_text, BENCH_NELEM(double_text), double_ints, 1,
+	arg0_strs, sizeof (arg0_strs), arg0_vars, 1, BENCH_INT
+};
+
+static const bench_act_t first[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &arg0_difo }
+};
+
+static const bench_act_t second[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &arg1_difo },
+	{ DTRACEACT_DIFEXPR, 0, 0, &pid_difo }
+};
+
+static const bench_act_t fused[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &arg0_difo },
+	{ DTRACEACT_DIFEXPR, 0, 0, &arg1_difo },
+	{ DTRACEACT_DIFEXPR, 0, 0, &pid_difo }
+};
+
+static const bench_act_t third[] = {
+	{ DTRACEACT_DIFEXPR, 0, 0, &double_difo }
+};
+
+/*
+ * The data recorded by one probe, in the order in which it was recorded.
+ */
+typedef struct output {
+	dtrace_id_t o_id;			/* probe */
+	char *o_data;				/* data recorded */
+	size_t o_len;				/* length of data */
+	size_t o_size;				/* size of o_data */
+} output_t;
+
+static output_t outputs[2];
+
+static void
+record(dtrace_id_t id, const void *data, size_t size, void *arg)
+{
+	output_t *o = &outputs[outputs[0].o_id == id ? 0 : 1];
+
+	while (o->o_len + size > o->o_size) {
+		o->o_size = o->o_size == 0 ? 4096 : o->o_size * 2;
+
+		if ((o->o_data = realloc(o->o_data, o->o_size)) == NULL) {
+			(void) fprintf(stderr, "fusecheck: out of memory\n");
+			exit(1);
+		}
+	}
+
+	bcopy(data, o->o_data + o->o_len, size);
+	o->o_len += size;
+}
+
+#define	CONSUME_INTERVAL	1024
+
+int
+main(int argc, char **argv)
+{
+	dtrace_provider_id_t prov;
+	dtrace_id_t split, fuse;
+	uint64_t n = 100000, i, held = 0, nrecs = 0;
+
+	if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		n = strtoul(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1) {
+		(void) fprintf(stderr, "usage: fusecheck [-n firings]\n");
+		return (2);
+	}
+
+	bench_init();
+	bench_setopt(DTRACEOPT_BUFSIZE, 1024 * 1024);
+	bench_setproc(4, 8, "bench");
+
+	prov = bench_provider("bench");
+	split = bench_probe(prov, "", "", "split");
+	fuse = bench_probe(prov, "", "", "fused");
+	outputs[0].o_id = split;
+	outputs[1].o_id = fuse;
+
+	if (bench_enable("bench:::split", &pred_difo, first,
+	    BENCH_NELEM(first)) != 1 ||
+	    bench_enable("bench:::split", &pred_difo, second,
+	    BENCH_NELEM(second)) != 1 ||
+	    bench_enable("bench:::split", NULL, third,
+	    BENCH_NELEM(third)) != 1 ||
+	    bench_enable("bench:::fused", &pred_difo, fused,
+	    BENCH_NELEM(fused)) != 1 ||
+	    bench_enable("bench:::fused", NULL, third,
+	    BENCH_NELEM(third)) != 1 || bench_go() != 0) {
+		(void) fprintf(stderr, "failed to start tracing\n");
+		return (1);
+	}
+
+	for (i = 0; i < n; i++) {
+		uint64_t arg0 = i & 0xff, arg1 = i * 7;
+
+		dtrace_probe(split, arg0, arg1, 0, 0, NULL);
+		dtrace_probe(fuse, arg0, arg1, 0, 0, NULL);
+
+		if (arg0 > 100)
+			held++;
+
+		if ((i + 1) % CONSUME_INTERVAL == 0 || i + 1 == n)
+			nrecs += bench_records(record, NULL);
+	}
+
+	(void) printf("%llu firings, %llu records, %llu bytes recorded by "
+	    "each probe\n", (u_longlong_t)n, (u_longlong_t)nrecs,
+	    (u_longlong_t)outputs[0].o_len);
+
+	if (outputs[0].o_len != outputs[1].o_len ||
+	    bcmp(outputs[0].o_data, outputs[1].o_data,
+	    outputs[0].o_len) != 0) {
+		(void) fprintf(stderr, "fusecheck: fused output differs\n");
+		return (1);
+	}
+
+	/*
+	 * Each firing records one record for each ECB whose predicate held:
+	 * three split and two fused when arg0 > 100, and one of each when not.
+	 */
+	if (nrecs != held * 5 + (n - held) * 2) {
+		(void) fprintf(stderr, "fusecheck: %llu records for %llu "
+		    "firings\n", (u_longlong_t)nrecs, (u_longlong_t)n);
+		return (1);
+	}
+
+	bench_fini();
+
+	return (0);
+}
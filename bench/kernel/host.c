@@ -0,0 +1,76 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Host clocks and executable memory.  This is the one file of the user-mode
+ * build that is compiled against the host's headers rather than the NT shims
+ * in inc/.
+ */
+
+#define	_DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/mman.h>
+
+uint64_t
+bench_hrtime(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+uint64_t
+bench_hrestime(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_REALTIME, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * Memory for native DIF code, mapped read/write and then sealed read/execute
+ * as the driver's is.
+ */
+void *
+bench_text_alloc(size_t size)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	return (p == MAP_FAILED ? NULL : p);
+}
+
+int
+bench_text_seal(void *p, size_t size)
+{
+	return (mprotect(p, size, PROT_READ | PROT_EXEC));
+}
+
+void
+bench_text_free(void *p, size_t size)
+{
+	(void) munmap(p, size);
+}
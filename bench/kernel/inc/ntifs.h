@@ -0,0 +1,121 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The subset of the NT kernel interfaces that sys/compat/win32/dtrace.c and
+ * the DTrace/NT compatibility layer use, for the user-mode build of the
+ * driver's framework (see ../README.md).  The types have their NT sizes on an
+ * LP64 host, and the routines are implemented in ../kernel.c.
+ */
+
+#ifndef _BENCH_NTIFS_H
+#define	_BENCH_NTIFS_H
+
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+typedef long long intptr_t;
+typedef unsigned long long uintptr_t;
+
+#define	NTKERNELAPI
+#define	FASTCALL
+#define	__in
+#define	_In_
+#define	_Inout_
+#define	_Out_
+#define	__declspec(x)
+#define	__forceinline	static __inline__
+#define	_alloca		__builtin_alloca
+
+#define	VOID		void
+#define	TRUE		1
+#define	FALSE		0
+#define	MAX_PATH	260
+#define	PASSIVE_LEVEL	0
+#define	MANUALLY_INITIATED_CRASH	0xe2
+
+typedef char CHAR, CCHAR, *PCHAR;
+typedef const char *PCSTR;
+typedef unsigned char UCHAR, BOOLEAN, *PBOOLEAN, KIRQL;
+typedef short SHORT;
+typedef unsigned short USHORT, WCHAR;
+typedef const unsigned short *LPCWSTR;
+typedef int LONG, NTSTATUS;
+typedef unsigned int ULONG, *PULONG;
+typedef long long LONGLONG, LONG64, LONG_PTR;
+typedef unsigned long long ULONGLONG, ULONG64, *PULONGLONG;
+typedef unsigned long long ULONG_PTR, *PULONG_PTR, SIZE_T;
+typedef void *PVOID, *HANDLE;
+typedef CCHAR KPROCESSOR_MODE;
+
+typedef struct _EPROCESS *PEPROCESS;
+typedef struct _ETHREAD *PETHREAD;
+typedef struct _KTHREAD *PKTHREAD;
+typedef struct _DEVICE_OBJECT *PDEVICE_OBJECT;
+typedef struct _EX_TIMER *PEX_TIMER;
+struct _CONTEXT;
+struct _KTRAP_FRAME;
+typedef ULONG_PTR EX_PUSH_LOCK, *PEX_PUSH_LOCK;
+
+typedef struct _GUID {
+	ULONG Data1;
+	USHORT Data2;
+	USHORT Data3;
+	UCHAR Data4[8];
+} GUID;
+
+#define	KernelMode	0
+#define	UserMode	1
+
+#define	NT_SUCCESS(s)	((NTSTATUS)(s) >= 0)
+#define	STATUS_SUCCESS	0
+
+#define	C_ASSERT(e)	typedef char __C_ASSERT__[(e) ? 1 : -1]
+#define	NT_ASSERT(e)	((void)0)
+#define	ARGUMENT_PRESENT(p)	((p) != NULL)
+#define	DbgBreakPoint()	((void)0)
+
+#define	DPFLTR_DEFAULT_ID	101
+#define	DPFLTR_WARNING_LEVEL	1
+#define	DPFLTR_TRACE_LEVEL	2
+extern int bench_dbgprint(ULONG, ULONG, const char *, ...);
+#define	DbgPrintEx	bench_dbgprint
+
+#define	FILE_DEVICE_NULL	0x00000015
+#define	METHOD_NEITHER		3
+#define	FILE_ANY_ACCESS		0
+#define	CTL_CODE(t, f, m, a)	(((t) << 16) | ((a) << 14) | ((f) << 2) | (m))
+
+#define	_TRUNCATE	((size_t)-1)
+#define	_snprintf_s(b, s, t, ...)	snprintf(b, s, __VA_ARGS__)
+
+extern ULONG_PTR MmUserProbeAddress;
+
+extern PEPROCESS PsGetCurrentProcess(void);
+extern HANDLE PsGetProcessId(PEPROCESS);
+extern HANDLE PsGetCurrentThreadId(void);
+extern PKTHREAD KeGetCurrentThread(void);
+extern ULONG KeGetCurrentProcessorIndex(void);
+extern KPROCESSOR_MODE ExGetPreviousMode(void);
+extern ULONGLONG KeQueryInterruptTimePrecise(PULONGLONG);
+
+#endif /* _BENCH_NTIFS_H */
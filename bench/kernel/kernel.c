@@ -0,0 +1,1242 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * User-mode build of the DTrace framework.
+ *
+ * This file compiles sys/compat/win32/dtrace.c unmodified against the NT
+ * shims in inc/, and supplies the parts of the NT kernel, the DTrace/NT
+ * compatibility layer (dtrace_misc.c) and the kernel support routines that
+ * the framework calls.  It models a single CPU running a single thread of a
+ * single process; probe context is wherever a driver calls dtrace_probe().
+ * Loads through the DIF emulator use the framework's own safe-load path, so
+ * the cost of each DIF instruction is that of the driver.
+ *
+ * The framework is included rather than linked so that the harness can reach
+ * the static functions that the DTRACEIOC_ENABLE path uses.
+ */
+
+/*
+ * The framework is compiled with the warnings that its Windows build never
+ * sees turned off:  locals and static functions that only the other ports
+ * use, the bare statements that stand for UNREFERENCED_PARAMETER(), tags
+ * written as multi-character constants, and the NULL that the stubs for
+ * process helpers return, which gcc follows into dtrace_helpers_destroy().
+ * The MSVC build turns off its own warnings for possibly uninitialized
+ * variables in <ntcompat.h>.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-value"
+#pragma GCC diagnostic ignored "-Wmultichar"
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include "dtrace.c"
+#pragma GCC diagnostic pop
+
+#include "bench.h"
+
+#define	BENCH_USERLIMIT		0x10000		/* top of "user" space */
+#define	BENCH_NTHREADPRIV	4		/* thread-private slots */
+#define	BENCH_NTHREAD		64		/* live threads */
+#define	BENCH_NCALLOUT		8		/* armed callouts */
+#define	BENCH_NTASK		64		/* pending taskq entries */
+
+extern uint64_t bench_hrestime(void);
+extern void *bench_text_alloc(size_t);
+extern int bench_text_seal(void *, size_t);
+extern void bench_text_free(void *, size_t);
+
+/*
+ * NT kernel.
+ */
+struct _EPROCESS {
+	HANDLE p_pid;
+	HANDLE p_ppid;
+	char p_name[16];
+};
+
+struct _KTHREAD {
+	HANDLE t_tid;
+	ULONG_PTR t_private[BENCH_NTHREADPRIV];
+};
+
+static struct _EPROCESS bench_proc = { (HANDLE)100, (HANDLE)1, "bench" };
+static struct _KTHREAD bench_threads[BENCH_NTHREAD] = { { (HANDLE)101 } };
+static struct _KTHREAD *bench_thread = &bench_threads[0];
+static int bench_nthreads = 1;
+
+ULONG_PTR MmUserProbeAddress = BENCH_USERLIMIT;
+
+PEPROCESS
+PsGetCurrentProcess(void)
+{
+	return (&bench_proc);
+}
+
+HANDLE
+PsGetProcessId(PEPROCESS p)
+{
+	return (p->p_pid);
+}
+
+HANDLE
+PsGetProcessInheritedFromUniqueProcessId(PEPROCESS p)
+{
+	return (p->p_ppid);
+}
+
+PCSTR
+PsGetProcessImageFileName(PEPROCESS p)
+{
+	return (p->p_name);
+}
+
+HANDLE
+PsGetCurrentThreadId(void)
+{
+	return (bench_thread->t_tid);
+}
+
+PKTHREAD
+KeGetCurrentThread(void)
+{
+	return (bench_thread);
+}
+
+ULONG
+KeGetCurrentProcessorIndex(void)
+{
+	return (0);
+}
+
+KPROCESSOR_MODE
+ExGetPreviousMode(void)
+{
+	return (KernelMode);
+}
+
+ULONGLONG
+KeQueryInterruptTimePrecise(PULONGLONG qpc)
+{
+	uint64_t now = bench_hrtime();
+
+	*qpc = now;
+
+	return (now / 100);
+}
+
+int
+bench_dbgprint(ULONG id, ULONG level, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	(void) fprintf(stderr, "dtrace: ");
+	(void) vfprintf(stderr, fmt, ap);
+	(void) fprintf(stderr, "\n");
+	va_end(ap);
+
+	return (0);
+}
+
+/*
+ * DTrace/NT compatibility layer.
+ */
+static cpu_core_t bench_cpu_core[1];
+
+cpu_core_t *cpu_core = bench_cpu_core;
+kmutex_t cpu_lock;
+ULONG NCPU = 1;
+volatile const char *panicstr;
+dtrace_cacheid_t dtrace_predcache_id = 1;
+
+void
+mutex_enter(kmutex_t *mutex)
+{
+	if (mutex != NULL)
+		mutex->Lock++;
+}
+
+void
+mutex_exit(kmutex_t *mutex)
+{
+	if (mutex != NULL)
+		mutex->Lock--;
+}
+
+void *
+kmem_alloc(size_t size, int flag)
+{
+	void *p = malloc(size == 0 ? 1 : size);
+
+	if (p == NULL && flag == KM_SLEEP) {
+		(void) fprintf(stderr, "out of memory allocating %zu\n", size);
+		abort();
+	}
+
+	return (p);
+}
+
+void *
+kmem_zalloc(size_t size, int flag)
+{
+	void *p = kmem_alloc(size, flag);
+
+	if (p != NULL)
+		bzero(p, size);
+
+	return (p);
+}
+
+/*ARGSUSED*/
+void
+kmem_free(void *buf, size_t size)
+{
+	free(buf);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *cachep, int flags)
+{
+	return (kmem_alloc((size_t)cachep, flags));
+}
+
+void
+kmem_cache_free(struct kmem_cache *cachep, void *objp)
+{
+	kmem_free(objp, (size_t)cachep);
+}
+
+/*ARGSUSED*/
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t offset,
+    unsigned long flags, void (*ctor)(void *, kmem_cache_t *, unsigned long),
+    void (*dtor)(void *, kmem_cache_t *, unsigned long))
+{
+	return ((struct kmem_cache *)size);
+}
+
+/*ARGSUSED*/
+void
+kmem_cache_destroy(struct kmem_cache *cachep)
+{
+}
+
+/*
+ * The cookie for executable memory records where it is mapped and its size.
+ */
+typedef struct bench_text {
+	void *bt_addr;
+	size_t bt_size;
+} bench_text_t;
+
+void *
+kmem_text_alloc(size_t size, void **cookie)
+{
+	bench_text_t *bt = kmem_alloc(sizeof (bench_text_t), KM_SLEEP);
+
+	if ((bt->bt_addr = bench_text_alloc(size)) == NULL) {
+		kmem_free(bt, sizeof (bench_text_t));
+		return (NULL);
+	}
+
+	bt->bt_size = size;
+	*cookie = bt;
+
+	return (bt->bt_addr);
+}
+
+int
+kmem_text_seal(void *cookie)
+{
+	bench_text_t *bt = cookie;
+
+	return (bench_text_seal(bt->bt_addr, bt->bt_size));
+}
+
+void
+kmem_text_free(void *cookie)
+{
+	bench_text_t *bt = cookie;
+
+	bench_text_free(bt->bt_addr, bt->bt_size);
+	kmem_free(bt, sizeof (bench_text_t));
+}
+
+int
+copyin(const void *uaddr, void *kaddr, size_t len)
+{
+	bcopy(uaddr, kaddr, len);
+	return (0);
+}
+
+int
+copyout(const void *kaddr, void *uaddr, size_t len)
+{
+	bcopy(kaddr, uaddr, len);
+	return (0);
+}
+
+/*ARGSUSED*/
+void
+crfree(struct cred *cr)
+{
+}
+
+/*
+ * Tasks are deferred to bench_tick(), as a taskq thread would run them after
+ * the dispatching thread had dropped its locks.
+ */
+static struct {
+	task_func_t *bt_func;
+	void *bt_arg;
+} bench_tasks[BENCH_NTASK];
+static int bench_ntasks;
+
+/*ARGSUSED*/
+taskq_t *
+taskq_create(const char *name, int nthreads, pri_t pri, int minalloc,
+    int maxalloc, unsigned int flags)
+{
+	return ((taskq_t *)bench_tasks);
+}
+
+/*ARGSUSED*/
+void
+taskq_destroy(taskq_t *tq)
+{
+}
+
+/*ARGSUSED*/
+taskqid_t
+taskq_dispatch(taskq_t *tq, task_func_t func, void *arg, unsigned int flags)
+{
+	if (bench_ntasks == BENCH_NTASK)
+		return (0);
+
+	bench_tasks[bench_ntasks].bt_func = func;
+	bench_tasks[bench_ntasks].bt_arg = arg;
+
+	return (++bench_ntasks);
+}
+
+struct unrhdr {
+	int uh_low;
+	int uh_high;
+	int uh_cursor;
+	int uh_size;
+	uint8_t *uh_map;
+};
+
+/*ARGSUSED*/
+struct unrhdr *
+new_unrhdr(int low, int high, struct kmutex *mutex)
+{
+	struct unrhdr *uh = kmem_zalloc(sizeof (*uh), KM_SLEEP);
+
+	uh->uh_low = low;
+	uh->uh_high = high;
+
+	return (uh);
+}
+
+void
+delete_unrhdr(struct unrhdr *uh)
+{
+	kmem_free(uh->uh_map, uh->uh_size / NBBY);
+	kmem_free(uh, sizeof (*uh));
+}
+
+int
+alloc_unr(struct unrhdr *uh)
+{
+	int i, n;
+
+	for (n = 0; n < uh->uh_size; n++) {
+		i = (uh->uh_cursor + n) % uh->uh_size;
+
+		if (!(uh->uh_map[i / NBBY] & (1 << (i % NBBY))))
+			goto found;
+	}
+
+	if (uh->uh_size > uh->uh_high - uh->uh_low)
+		return (-1);
+
+	n = uh->uh_size == 0 ? 64 : uh->uh_size * 2;
+	uh->uh_map = realloc(uh->uh_map, n / NBBY);
+	bzero(uh->uh_map + uh->uh_size / NBBY, (n - uh->uh_size) / NBBY);
+	i = uh->uh_size;
+	uh->uh_size = n;
+
+found:
+	uh->uh_map[i / NBBY] |= (1 << (i % NBBY));
+	uh->uh_cursor = i + 1;
+
+	return (i + uh->uh_low);
+}
+
+void
+free_unr(struct unrhdr *uh, int item)
+{
+	item -= uh->uh_low;
+	uh->uh_map[item / NBBY] &= ~(1 << (item % NBBY));
+}
+
+/*
+ * Callouts never fire on their own; bench_tick() runs every armed callout
+ * once, which is how often the cleaner would run at its default rate over an
+ * interval of a few hundred milliseconds.
+ */
+static struct callout *bench_callouts[BENCH_NCALLOUT];
+
+void
+callout_init(struct callout *c, int mpsafe)
+{
+	bzero(c, sizeof (*c));
+}
+
+void
+callout_cleanup(struct callout *c)
+{
+	(void) callout_stop(c);
+}
+
+int
+callout_stop(struct callout *c)
+{
+	int i, armed = 0;
+
+	for (i = 0; i < BENCH_NCALLOUT; i++) {
+		if (bench_callouts[i] == c) {
+			bench_callouts[i] = NULL;
+			armed = 1;
+		}
+	}
+
+	return (armed);
+}
+
+int
+callout_drain(struct callout *c)
+{
+	return (callout_stop(c));
+}
+
+/*ARGSUSED*/
+int
+callout_reset(struct callout *c, int ticks, timeout_t *func, void *arg)
+{
+	int i, armed = callout_stop(c);
+
+	c->Callback = func;
+	c->Context = arg;
+
+	for (i = 0; i < BENCH_NCALLOUT; i++) {
+		if (bench_callouts[i] == NULL) {
+			bench_callouts[i] = c;
+			break;
+		}
+	}
+
+	return (armed);
+}
+
+/*
+ * Kernel support routines (dtrace_asm and dtrace_subr on other platforms).
+ */
+/*ARGSUSED*/
+uintptr_t
+dtrace_caller(int skip)
+{
+	return ((uintptr_t)-1);
+}
+
+uint32_t
+dtrace_cas32(uint32_t *target, uint32_t cmp, uint32_t new)
+{
+	return (__sync_val_compare_and_swap(target, cmp, new));
+}
+
+void *
+dtrace_casptr(volatile void *target, volatile void *cmp, volatile void *new)
+{
+	return (__sync_val_compare_and_swap((void *volatile *)target,
+	    (void *)cmp, (void *)new));
+}
+
+int
+dtrace_safememcpy(void *sys, uintptr_t untr, size_t size, size_t chunk,
+    int isread)
+{
+	if (isread)
+		bcopy((void *)untr, sys, size);
+	else
+		bcopy(sys, (void *)untr, size);
+
+	return (TRUE);
+}
+
+static int
+dtrace_inuser(uintptr_t p, size_t len)
+{
+	uintptr_t end = p + len - 1;
+
+	return (p <= end && end < MmUserProbeAddress);
+}
+
+#define	DTRACE_FUWORD(n)						\
+uint##n##_t								\
+dtrace_fuword##n(void *p)						\
+{									\
+	uint##n##_t v;							\
+	uintptr_t a = (uintptr_t)p;					\
+									\
+	if (!dtrace_inuser(a, sizeof (v)) ||				\
+	    !dtrace_safememcpy(&v, a, sizeof (v), sizeof (v), TRUE)) {	\
+		DTRACE_CPUFLAG_SET(CPU_DTRACE_BADADDR);			\
+		cpu_core[curcpu].cpuc_dtrace_illval = a;		\
+		v = 0;							\
+	}								\
+									\
+	return (v);							\
+}
+
+DTRACE_FUWORD(8)
+DTRACE_FUWORD(16)
+DTRACE_FUWORD(32)
+DTRACE_FUWORD(64)
+
+void
+dtrace_copyin(uintptr_t uaddr, uintptr_t kaddr, size_t size,
+    volatile uint16_t *flags)
+{
+	if (!dtrace_inuser(uaddr, size) ||
+	    !dtrace_safememcpy((void *)kaddr, uaddr, size, 1, TRUE)) {
+		cpu_core[curcpu].cpuc_dtrace_illval = uaddr;
+		DTRACE_CPUFLAG_SET(CPU_DTRACE_BADADDR);
+	}
+}
+
+void
+dtrace_copyinstr(uintptr_t uaddr, uintptr_t kaddr, size_t size,
+    volatile uint16_t *flags)
+{
+	dtrace_copyin(uaddr, kaddr, size, flags);
+}
+
+void
+dtrace_copyout(uintptr_t kaddr, uintptr_t uaddr, size_t size,
+    volatile uint16_t *flags)
+{
+	if (!dtrace_inuser(uaddr, size) ||
+	    !dtrace_safememcpy((void *)kaddr, uaddr, size, 1, FALSE)) {
+		cpu_core[curcpu].cpuc_dtrace_illval = uaddr;
+		DTRACE_CPUFLAG_SET(CPU_DTRACE_BADADDR);
+	}
+}
+
+void
+dtrace_copyoutstr(uintptr_t kaddr, uintptr_t uaddr, size_t size,
+    volatile uint16_t *flags)
+{
+	dtrace_copyout(kaddr, uaddr, size, flags);
+}
+
+int
+dtrace_cpusup_init(void)
+{
+	return (0);
+}
+
+void
+dtrace_cpusup_cleanup(void)
+{
+}
+
+/*ARGSUSED*/
+uint64_t
+dtrace_getarg(int arg, int aframes)
+{
+	return (0);
+}
+
+hrtime_t
+dtrace_gethrtime(void)
+{
+	return ((hrtime_t)bench_hrtime());
+}
+
+hrtime_t
+dtrace_gethrestime(void)
+{
+	return ((hrtime_t)bench_hrestime());
+}
+
+int
+dtrace_getipl(void)
+{
+	return (PASSIVE_LEVEL);
+}
+
+/*ARGSUSED*/
+void
+dtrace_getpcstack(pc_t *pcstack, int limit, int aframes, uint32_t *intrpc)
+{
+	bzero(pcstack, limit * sizeof (pc_t));
+}
+
+/*ARGSUSED*/
+ulong_t
+dtrace_getreg(struct _KTRAP_FRAME *tf, struct _CONTEXT *ctx, uint_t reg)
+{
+	DTRACE_CPUFLAG_SET(CPU_DTRACE_BADADDR);
+	cpu_core[curcpu].cpuc_dtrace_illval = 0;
+
+	return (0);
+}
+
+/*ARGSUSED*/
+int
+dtrace_getstackdepth(int aframes)
+{
+	return (0);
+}
+
+void
+dtrace_getupcstack(uint64_t *pcstack, int limit)
+{
+	if (limit < 1)
+		return;
+
+	bzero(pcstack, limit * sizeof (uint64_t));
+	pcstack[0] = (uint64_t)PsGetProcessId(PsGetCurrentProcess());
+}
+
+int
+dtrace_getustackdepth(void)
+{
+	return (0);
+}
+
+dtrace_icookie_t
+dtrace_interrupt_disable(void)
+{
+	return (PASSIVE_LEVEL);
+}
+
+/*ARGSUSED*/
+void
+dtrace_interrupt_enable(dtrace_icookie_t cookie)
+{
+}
+
+void
+dtrace_membar_producer(void)
+{
+	__sync_synchronize();
+}
+
+void
+dtrace_membar_consumer(void)
+{
+	__sync_synchronize();
+}
+
+/*ARGSUSED*/
+void
+dtrace_lkd(LPCWSTR component, ULONG code, ULONG_PTR p1, ULONG_PTR p2,
+    ULONG_PTR p3, ULONG_PTR p4, ULONG flags)
+{
+}
+
+/*ARGSUSED*/
+void
+dtrace_priv_filter(KPROCESSOR_MODE mode, PBOOLEAN kernel, PBOOLEAN user)
+{
+	*kernel = TRUE;
+	*user = TRUE;
+}
+
+PULONG_PTR
+dtrace_threadprivate(ULONG index)
+{
+	if (index >= BENCH_NTHREADPRIV)
+		return (NULL);
+
+	return (&bench_thread->t_private[index]);
+}
+
+PVOID
+dtrace_tf(void)
+{
+	return (NULL);
+}
+
+void
+dtrace_sync(void)
+{
+}
+
+void
+dtrace_vtime_enable(void)
+{
+}
+
+void
+dtrace_vtime_disable(void)
+{
+}
+
+/*ARGSUSED*/
+void
+dtrace_xcall(processorid_t cpu, dtrace_xcall_t func, void *arg)
+{
+	(*func)(arg);
+}
+
+void
+dtrace_vpanic(const char *format, __va_list alist)
+{
+	panicstr = format;
+	(void) fprintf(stderr, "dtrace: panic: ");
+	(void) vfprintf(stderr, format, alist);
+	(void) fprintf(stderr, "\n");
+	abort();
+}
+
+/*
+ * Harness.
+ */
+static dtrace_state_t *bench_state;
+
+void
+bench_init(void)
+{
+	dtrace_err_verbose = 1;
+
+	if (dtrace_load() != 0 || dtrace_open(NULL, &bench_state) != 0) {
+		(void) fprintf(stderr, "failed to initialize DTrace\n");
+		exit(1);
+	}
+}
+
+void
+bench_fini(void)
+{
+	bench_stop();
+	dtrace_close(bench_state);
+	bench_state = NULL;
+}
+
+void
+bench_setopt(int option, dtrace_optval_t val)
+{
+	bench_state->dts_options[option] = val;
+}
+
+/*
+ * Make the given thread of the given process the current one.  A thread that
+ * has been current before keeps its thread-private storage (and with it its
+ * predicate cache); a new thread starts out with none.  Once BENCH_NTHREAD
+ * threads have been seen, each new thread takes the place of the oldest,
+ * which is taken to have exited.
+ */
+void
+bench_setproc(int pid, int tid, const char *execname)
+{
+	static int next;
+	int i;
+
+	bench_proc.p_pid = (HANDLE)(uintptr_t)pid;
+	(void) strncpy(bench_proc.p_name, execname,
+	    sizeof (bench_proc.p_name) - 1);
+
+	for (i = 0; i < bench_nthreads; i++) {
+		if (bench_threads[i].t_tid == (HANDLE)(uintptr_t)tid) {
+			bench_thread = &bench_threads[i];
+			return;
+		}
+	}
+
+	if (bench_nthreads < BENCH_NTHREAD) {
+		i = bench_nthreads++;
+	} else {
+		i = next;
+		next = (next + 1) % BENCH_NTHREAD;
+	}
+
+	bench_thread = &bench_threads[i];
+	bench_thread->t_tid = (HANDLE)(uintptr_t)tid;
+	bzero(bench_thread->t_private, sizeof (bench_thread->t_private));
+}
+
+/*ARGSUSED*/
+static void
+bench_provide(void *arg, const char *prov, const char *mod, const char *func,
+    const char *name)
+{
+}
+
+/*ARGSUSED*/
+static void
+bench_enable_probe(void *arg, dtrace_id_t id, void *parg)
+{
+}
+
+/*ARGSUSED*/
+static void
+bench_disable_probe(void *arg, dtrace_id_t id, void *parg)
+{
+}
+
+/*ARGSUSED*/
+static void
+bench_destroy(void *arg, dtrace_id_t id, void *parg)
+{
+}
+
+static dtrace_pops_t bench_pops = {
+	bench_provide,
+	bench_enable_probe,
+	bench_disable_probe,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	bench_destroy
+};
+
+static dtrace_pattr_t bench_attr = {
+{ DTRACE_STABILITY_EVOLVING, DTRACE_STABILITY_EVOLVING, DTRACE_CLASS_COMMON },
+{ DTRACE_STABILITY_PRIVATE, DTRACE_STABILITY_PRIVATE, DTRACE_CLASS_UNKNOWN },
+{ DTRACE_STABILITY_PRIVATE, DTRACE_STABILITY_PRIVATE, DTRACE_CLASS_UNKNOWN },
+{ DTRACE_STABILITY_EVOLVING, DTRACE_STABILITY_EVOLVING, DTRACE_CLASS_COMMON },
+{ DTRACE_STABILITY_EVOLVING, DTRACE_STABILITY_EVOLVING, DTRACE_CLASS_COMMON },
+};
+
+dtrace_provider_id_t
+bench_provider(const char *name)
+{
+	dtrace_provider_id_t id;
+
+	if (dtrace_register(name, &bench_attr, DTRACE_PRIV_KERNEL, NULL,
+	    &bench_pops, NULL, &id) != 0) {
+		(void) fprintf(stderr, "failed to register %s\n", name);
+		exit(1);
+	}
+
+	return (id);
+}
+
+dtrace_id_t
+bench_probe(dtrace_provider_id_t prov, const char *mod, const char *func,
+    const char *name)
+{
+	dtrace_id_t id;
+
+	mutex_enter(&dtrace_provider_lock);
+	if ((id = dtrace_probe_lookup(prov, mod, func, name)) == 0)
+		id = dtrace_probe_create(prov, mod, func, name, 0, NULL);
+	mutex_exit(&dtrace_provider_lock);
+
+	return (id);
+}
+
+/*
+ * Build a DIF object as dtrace_dof_difo() would.
+ */
+static dtrace_difo_t *
+bench_difo(const bench_difo_t *bdo)
+{
+	dtrace_vstate_t *vstate = &bench_state->dts_vstate;
+	dtrace_difo_t *dp;
+	uint_t i;
+
+	dp = kmem_zalloc(sizeof (dtrace_difo_t), KM_SLEEP);
+
+	dp->dtdo_len = bdo->bdo_len;
+	dp->dtdo_buf = kmem_alloc(bdo->bdo_len * sizeof (dif_instr_t),
+	    KM_SLEEP);
+	bcopy(bdo->bdo_text, dp->dtdo_buf,
+	    bdo->bdo_len * sizeof (dif_instr_t));
+
+	if ((dp->dtdo_intlen = bdo->bdo_nints) != 0) {
+		dp->dtdo_inttab = kmem_alloc(bdo->bdo_nints *
+		    sizeof (uint64_t), KM_SLEEP);
+		bcopy(bdo->bdo_ints, dp->dtdo_inttab,
+		    bdo->bdo_nints * sizeof (uint64_t));
+	}
+
+	if ((dp->dtdo_strlen = bdo->bdo_strlen) != 0) {
+		dp->dtdo_strtab = kmem_alloc(bdo->bdo_strlen, KM_SLEEP);
+		bcopy(bdo->bdo_strs, dp->dtdo_strtab, bdo->bdo_strlen);
+	}
+
+	if ((dp->dtdo_varlen = bdo->bdo_nvars) != 0) {
+		dp->dtdo_vartab = kmem_alloc(bdo->bdo_nvars *
+		    sizeof (dtrace_difv_t), KM_SLEEP);
+		bcopy(bdo->bdo_vars, dp->dtdo_vartab,
+		    bdo->bdo_nvars * sizeof (dtrace_difv_t));
+	}
+
+	dp->dtdo_rtype = bdo->bdo_rtype;
+
+	for (i = 0; i < dp->dtdo_varlen; i++) {
+		dtrace_difv_t *v = &dp->dtdo_vartab[i];
+		dtrace_diftype_t *t = &v->dtdv_type;
+
+		if (v->dtdv_id < DIF_VAR_OTHER_UBASE)
+			continue;
+
+		if (t->dtdt_kind == DIF_TYPE_STRING && t->dtdt_size == 0)
+			t->dtdt_size = dtrace_strsize_default;
+	}
+
+	if (dtrace_difo_validate(dp, vstate, DIF_DIR_NREGS, NULL) != 0) {
+		(void) fprintf(stderr, "DIF object failed validation\n");
+		exit(1);
+	}
+
+	dtrace_difo_init(dp, vstate);
+
+	return (dp);
+}
+
+/*
+ * DIF objects evaluated outside of any enabling.  The object is built and
+ * validated as it would be for an enabling, and is evaluated with the given
+ * arguments and with loads checked, as for a consumer without kernel
+ * visibility.  It is evaluated as the emulator runs it from its text
+ * (BENCH_DIF_TEXT) or decoded (BENCH_DIF_DECODED), or by its native code
+ * (BENCH_DIF_NATIVE) if it was compiled when dtrace_dif_native was set.
+ * Returns the fault flags; *rval is set to the result or, on a fault, to the
+ * offset of the faulting instruction, and *nops to the number of
+ * instructions executed -- which native code does not count, so that it is
+ * zero for BENCH_DIF_NATIVE.
+ */
+static char bench_scratch[1024];
+
+dtrace_difo_t *
+bench_dif_create(const bench_difo_t *bdo)
+{
+	dtrace_difo_t *dp;
+
+	mutex_enter(&dtrace_lock);
+	dp = bench_difo(bdo);
+	mutex_exit(&dtrace_lock);
+
+	return (dp);
+}
+
+uint16_t
+bench_dif_eval(dtrace_difo_t *dp, int how, const uint64_t *args,
+    uint64_t *rval, uint64_t *nops)
+{
+	volatile uint16_t *flags = &cpu_core[0].cpuc_dtrace_flags;
+	struct dtrace_difdop *dops = dp->dtdo_dops;
+	dtrace_mstate_t mstate;
+	uint16_t fault;
+	int i;
+
+	bzero(&mstate, sizeof (mstate));
+	mstate.dtms_present = DTRACE_MSTATE_ARGS | DTRACE_MSTATE_PROBE;
+
+	if (how != BENCH_DIF_NATIVE)
+		mstate.dtms_present |= DTRACE_MSTATE_DIFOPS;
+
+	for (i = 0; i < BENCH_NELEM(mstate.dtms_arg); i++)
+		mstate.dtms_arg[i] = args[i];
+
+	mstate.dtms_scratch_base = (uintptr_t)bench_scratch;
+	mstate.dtms_scratch_ptr = (uintptr_t)bench_scratch;
+	mstate.dtms_scratch_size = sizeof (bench_scratch);
+	bzero(bench_scratch, sizeof (bench_scratch));
+
+	if (how == BENCH_DIF_TEXT)
+		dp->dtdo_dops = NULL;
+
+	*flags = 0;
+	cpu_core[0].cpuc_dtrace_illval = 0;
+	*rval = dtrace_dif_emulate(dp, &mstate, &bench_state->dts_vstate,
+	    bench_state);
+	fault = *flags & CPU_DTRACE_FAULT;
+	*flags = 0;
+
+	dp->dtdo_dops = dops;
+
+	if (fault != 0)
+		*rval = mstate.dtms_fltoffs;
+	*nops = mstate.dtms_difops;
+
+	return (fault);
+}
+
+void
+bench_dif_destroy(dtrace_difo_t *dp)
+{
+	mutex_enter(&dtrace_lock);
+	dtrace_difo_release(dp, &bench_state->dts_vstate);
+	mutex_exit(&dtrace_lock);
+}
+
+/*
+ * Enable the probes matching "provider:module:function:name" with the given
+ * predicate (which may be NULL) and actions; returns the number of probes
+ * that were matched.
+ */
+int
+bench_enable(const char *spec, const bench_difo_t *pred,
+    const bench_act_t *acts, int nacts)
+{
+	dtrace_vstate_t *vstate = &bench_state->dts_vstate;
+	dtrace_enabling_t *enab;
+	dtrace_ecbdesc_t *ep;
+	dtrace_actdesc_t *act, *last = NULL;
+	char buf[DTRACE_FULLNAMELEN], *fields[4], *p;
+	int i, err, nmatched = 0;
+
+	ep = kmem_zalloc(sizeof (dtrace_ecbdesc_t), KM_SLEEP);
+	ep->dted_probe.dtpd_id = DTRACE_IDNONE;
+
+	(void) strncpy(buf, spec, sizeof (buf) - 1);
+	buf[sizeof (buf) - 1] = '\0';
+
+	for (i = 0, p = buf; i < 4; i++) {
+		fields[i] = p;
+		if (p != NULL && (p = strchr(p, ':')) != NULL)
+			*p++ = '\0';
+	}
+
+	(void) strncpy(ep->dted_probe.dtpd_provider, fields[0],
+	    DTRACE_PROVNAMELEN - 1);
+	(void) strncpy(ep->dted_probe.dtpd_mod, fields[1] ? fields[1] : "",
+	    DTRACE_MODNAMELEN - 1);
+	(void) strncpy(ep->dted_probe.dtpd_func, fields[2] ? fields[2] : "",
+	    DTRACE_FUNCNAMELEN - 1);
+	(void) strncpy(ep->dted_probe.dtpd_name, fields[3] ? fields[3] : "",
+	    DTRACE_NAMELEN - 1);
+
+	mutex_enter(&cpu_lock);
+	mutex_enter(&dtrace_lock);
+
+	if (pred != NULL) {
+		ep->dted_pred.dtpdd_predicate =
+		    dtrace_predicate_create(bench_difo(pred));
+	}
+
+	for (i = 0; i < nacts; i++) {
+		act = dtrace_actdesc_create(acts[i].ba_kind,
+		    acts[i].ba_ntuple, 0, acts[i].ba_arg);
+
+		if (acts[i].ba_difo != NULL)
+			act->dtad_difo = bench_difo(acts[i].ba_difo);
+
+		if (last != NULL)
+			last->dtad_next = act;
+		else
+			ep->dted_action = act;
+
+		last = act;
+	}
+
+	enab = dtrace_enabling_create(vstate);
+	dtrace_enabling_add(enab, ep);
+
+	if ((err = dtrace_enabling_match(enab, &nmatched)) == 0)
+		err = dtrace_enabling_retain(enab);
+	else
+		dtrace_enabling_destroy(enab);
+
+	mutex_exit(&dtrace_lock);
+	mutex_exit(&cpu_lock);
+
+	if (err != 0) {
+		(void) fprintf(stderr, "failed to enable %s: %s\n", spec,
+		    strerror(err));
+		exit(1);
+	}
+
+	return (nmatched);
+}
+
+int
+bench_go(void)
+{
+	processorid_t cpu;
+
+	return (dtrace_ioctl(bench_state, DTRACEIOC_GO, &cpu));
+}
+
+void
+bench_stop(void)
+{
+	processorid_t cpu;
+
+	if (bench_state->dts_activity == DTRACE_ACTIVITY_ACTIVE ||
+	    bench_state->dts_activity == DTRACE_ACTIVITY_DRAINING)
+		(void) dtrace_ioctl(bench_state, DTRACEIOC_STOP, &cpu);
+}
+
+/*
+ * Switch the principal buffer as the consumer would, copying out what it
+ * holds.  Returns non-zero if the switch fails.
+ */
+static int
+bench_snap(dtrace_bufdesc_t *desc)
+{
+	static caddr_t data;
+	static size_t size;
+
+	if (size < bench_state->dts_options[DTRACEOPT_BUFSIZE]) {
+		size = bench_state->dts_options[DTRACEOPT_BUFSIZE];
+		data = realloc(data, size);
+	}
+
+	bzero(desc, sizeof (*desc));
+	desc->dtbd_data = data;
+	desc->dtbd_cpu = 0;
+
+	return (dtrace_ioctl(bench_state, DTRACEIOC_BUFSNAP, desc));
+}
+
+/*
+ * Switch the principal buffer as the consumer would, returning the number of
+ * bytes of trace data consumed and adding any drops and errors to *drops and
+ * *errors.
+ */
+uint64_t
+bench_consume(uint64_t *drops, uint64_t *errors)
+{
+	dtrace_bufdesc_t desc;
+
+	if (bench_snap(&desc) != 0)
+		return (0);
+
+	if (drops != NULL)
+		*drops += desc.dtbd_drops;
+
+	if (errors != NULL)
+		*errors += desc.dtbd_errors;
+
+	return (desc.dtbd_size);
+}
+
+/*
+ * Switch the principal buffer as the consumer would, and pass the data that
+ * each action recorded to func, in the order in which it was recorded, along
+ * with the ID of the probe that recorded it.  Returns the number of records
+ * (one per ECB per firing) in the buffer.
+ */
+uint64_t
+bench_records(void (*func)(dtrace_id_t, const void *, size_t, void *),
+    void *arg)
+{
+	dtrace_bufdesc_t desc;
+	dtrace_rechdr_t *dtrh;
+	dtrace_action_t *act;
+	dtrace_ecb_t *ecb;
+	uint64_t offs, nrecs = 0;
+
+	if (bench_snap(&desc) != 0)
+		return (0);
+
+	for (offs = 0; offs < desc.dtbd_size; offs += ecb->dte_size) {
+		dtrh = (dtrace_rechdr_t *)(desc.dtbd_data + offs);
+
+		while (dtrh->dtrh_epid == DTRACE_EPIDNONE) {
+			offs += sizeof (dtrace_epid_t);
+			dtrh = (dtrace_rechdr_t *)(desc.dtbd_data + offs);
+		}
+
+		ecb = bench_state->dts_ecbs[dtrh->dtrh_epid - 1];
+		nrecs++;
+
+		for (act = ecb->dte_action; act != NULL; act = act->dta_next) {
+			if (DTRACEACT_ISAGG(act->dta_kind) ||
+			    act->dta_rec.dtrd_size == 0)
+				continue;
+
+			(*func)(ecb->dte_probe->dtpr_id, (caddr_t)dtrh +
+			    act->dta_rec.dtrd_offset, act->dta_rec.dtrd_size,
+			    arg);
+		}
+	}
+
+	return (nrecs);
+}
+
+/*
+ * Report the number of regions added to the dynamic variable space, the
+ * number of buckets in its hash table, and the length of its longest chain.
+ */
+void
+bench_dynstat(uint_t *ngrow, size_t *hashsize, size_t *longest)
+{
+	dtrace_dstate_t *dstate = &bench_state->dts_vstate.dtvs_dynvars;
+	dtrace_dynvar_t *dvar;
+	size_t i, len;
+
+	*ngrow = dstate->dtds_ngrow;
+	*hashsize = dstate->dtds_hashsize;
+	*longest = 0;
+
+	for (i = 0; i < dstate->dtds_hashsize; i++) {
+		dvar = dstate->dtds_hash[i].dtdh_chain;
+
+		for (len = 0; dvar != &dtrace_dynhash_sink; len++)
+			dvar = dvar->dtdv_next;
+
+		if (len > *longest)
+			*longest = len;
+	}
+}
+
+/*
+ * Do the periodic work that the system would have done since the last call:
+ * report the consumer alive, run dispatched tasks, and fire every armed
+ * callout once.
+ */
+void
+bench_tick(void)
+{
+	struct callout *armed[BENCH_NCALLOUT];
+	int i;
+
+	if (bench_state != NULL)
+		bench_state->dts_alive = dtrace_gethrtime();
+
+	for (i = 0; i < bench_ntasks; i++)
+		(*bench_tasks[i].bt_func)(bench_tasks[i].bt_arg);
+
+	bench_ntasks = 0;
+
+	bcopy(bench_callouts, armed, sizeof (armed));
+	bzero(bench_callouts, sizeof (bench_callouts));
+
+	for (i = 0; i < BENCH_NCALLOUT; i++) {
+		if (armed[i] != NULL)
+			(*armed[i]->Callback)(armed[i]->Context);
+	}
+}
@@ -0,0 +1,201 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Time to enable a dozen glob clauses against the number of probes.
+ *
+ * fbt-like entry and return probes are created in "nt" and in a number of
+ * other modules.  A fixed set of functions in "nt" begins with each of
+ * twelve prefixes (Io, Ke, Mm and so on); the rest of the probes, whose
+ * functions begin with other prefixes, are added until there are as many
+ * probes as asked for.  Each row then enables the clauses
+ *
+ *	fbt:nt*:Io*:entry
+ *	fbt:nt*:Ke*:
+ *	...
+ *
+ * whose prefixes dtrace_match() can look up in its sorted buckets, and the
+ * same clauses written with a leading bracket expression, as in
+ *
+ *	fbt:[n]t*:[I]o*:entry
+ *
+ * which match the same probes but have no literal prefix.  Those are matched
+ * by walking the "entry" hash chain, or all probes when the name is empty, as
+ * every glob clause was before the sorted buckets.  The first enabling after
+ * probes are added also sorts the buckets again, and is reported on its own.
+ * Times are in microseconds for the whole set of clauses.
+ *
+ * usage: matchbench [-r repetitions] [probes ...]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define	NFUNCS		16		/* functions in "nt" per prefix */
+#define	NMODS		64		/* modules other than "nt" */
+
+static const char *const prefixes[] = {
+	"Io", "Ke", "Mm", "Ob", "Ps", "Se", "Ex", "Cc", "Fs", "Po", "Wmi", "Lpc"
+};
+
+static const char *const others[] = {
+	"Nt", "Zw", "Rtl", "Ki", "Mi", "Hal", "Cm", "Alpc", "Etw", "Wdf",
+	"Ndis", "Flt"
+};
+
+static const uint64_t defsizes[] = { 1000, 10000, 100000, 300000 };
+
+static dtrace_provider_id_t prov;
+static uint64_t nprobes;
+
+static void
+addfunc(const char *mod, const char *func)
+{
+	(void) bench_probe(prov, mod, func, "entry");
+	(void) bench_probe(prov, mod, func, "return");
+	nprobes += 2;
+}
+
+static void
+grow(uint64_t n)
+{
+	char mod[DTRACE_MODNAMELEN], func[DTRACE_FUNCNAMELEN];
+
+	while (nprobes < n) {
+		uint64_t i = nprobes / 2;
+
+		if (i % (NMODS + 1) == 0) {
+			(void) strcpy(mod, "nt");
+		} else {
+			(void) snprintf(mod, sizeof (mod), "drv%02d",
+			    (int)(i % (NMODS + 1)));
+		}
+
+		(void) snprintf(func, sizeof (func), "%s%07llu",
+		    others[i % BENCH_NELEM(others)], (u_longlong_t)i);
+		addfunc(mod, func);
+	}
+}
+
+/*
+ * Enable the set of clauses, in their indexed or their bracketed form, and
+ * return the time taken in nanoseconds.  The number of probes matched by the
+ * set is returned in *nmatched.
+ */
+static uint64_t
+enable(int bracketed, int *nmatched)
+{
+	char spec[DTRACE_FULLNAMELEN];
+	uint64_t start, elapsed = 0;
+	int i;
+
+	*nmatched = 0;
+
+	for (i = 0; i < BENCH_NELEM(prefixes); i++) {
+		const char *p = prefixes[i];
+
+		if (bracketed) {
+			(void) snprintf(spec, sizeof (spec),
+			    "fbt:[n]t*:[%c]%s*:%s", p[0], p + 1,
+			    i % 2 ? "" : "entry");
+		} else {
+			(void) snprintf(spec, sizeof (spec), "fbt:nt*:%s*:%s",
+			    p, i % 2 ? "" : "entry");
+		}
+
+		start = bench_hrtime();
+		*nmatched += bench_enable(spec, NULL, NULL, 0);
+		elapsed += bench_hrtime() - start;
+	}
+
+	return (elapsed);
+}
+
+int
+main(int argc, char **argv)
+{
+	char func[DTRACE_FUNCNAMELEN];
+	uint64_t sizes[32];
+	int nsizes = 0, reps = 10;
+	int i, j, r;
+
+	if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+		reps = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+
+	for (i = 1; i < argc && nsizes < BENCH_NELEM(sizes); i++)
+		sizes[nsizes++] = strtoul(argv[i], NULL, 0);
+
+	if (i != argc || reps < 1) {
+		(void) fprintf(stderr, "usage: matchbench [-r repetitions] "
+		    "[probes ...]\n");
+		return (2);
+	}
+
+	if (nsizes == 0) {
+		for (i = 0; i < BENCH_NELEM(defsizes); i++)
+			sizes[nsizes++] = defsizes[i];
+	}
+
+	bench_init();
+	prov = bench_provider("fbt");
+
+	for (i = 0; i < BENCH_NELEM(prefixes); i++) {
+		for (j = 0; j < NFUNCS; j++) {
+			(void) snprintf(func, sizeof (func), "%sFunction%02d",
+			    prefixes[i], j);
+			addfunc("nt", func);
+		}
+	}
+
+	(void) printf("%10s %8s %10s %10s %10s\n", "PROBES", "MATCHED",
+	    "SORT+INDEX", "INDEXED", "UNINDEXED");
+
+	for (i = 0; i < nsizes; i++) {
+		uint64_t first, t[2] = { 0, 0 };
+		int nmatched[2];
+
+		grow(sizes[i]);
+		first = enable(0, &nmatched[0]);
+
+		for (r = 0; r < reps; r++) {
+			t[0] += enable(0, &nmatched[0]);
+			t[1] += enable(1, &nmatched[1]);
+		}
+
+		if (nmatched[0] != nmatched[1]) {
+			(void) fprintf(stderr, "%llu probes: %d matched with "
+			    "prefixes, %d without\n", (u_longlong_t)nprobes,
+			    nmatched[0], nmatched[1]);
+			return (1);
+		}
+
+		(void) printf("%10llu %8d %10.1f %10.1f %10.1f\n",
+		    (u_longlong_t)nprobes, nmatched[0], first / 1000.0,
+		    t[0] / (1000.0 * reps), t[1] / (1000.0 * reps));
+	}
+
+	bench_fini();
+
+	return (0);
+}
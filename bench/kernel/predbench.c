@@ -0,0 +1,264 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Cost of predicates on thread-stable context, with and without the
+ * predicate cache.
+ *
+ * Each predicate is enabled on the entry and on the return probe of a
+ * system call, as in
+ *
+ *	syscall::NtReadFile:entry, syscall::NtReadFile:return
+ *	/pid == 1234/
+ *	{}
+ *
+ * A workload of 16 threads in 4 processes then makes the system call over
+ * and over, firing both probes each time.  Each thread makes 64 calls before
+ * the next thread is switched in.  Only the threads of one process (one
+ * thread, for the predicate on tid) satisfy the predicate; every other thread
+ * would evaluate it to false on every firing were it not for the cache.
+ * Every predicate is enabled twice, once as usual and once with predicate
+ * caching disabled -- as dtrace_predicate_create() disables it when it runs
+ * out of cache IDs -- and both are timed.  Both must trace the same data.
+ *
+ * usage: predbench [-n calls]
+ */
+
+#include <string.h>
+#include "bench.h"
+
+#define	PROCS		4
+#define	THREADS		16
+#define	BURST		64
+
+#define	TARGET_PID	1234
+#define	TARGET_TID	4321
+#define	TARGET_NAME	"sqlservr"
+
+/*
+ * /pid == 1234/
+ */
+static const dif_instr_t pid_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_PID, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BNE, 6),
+	DIF_INSTR_SETX(1, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t pid_ints[] = { TARGET_PID, 1 };
+static const char pid_strs[] = "pid";
+static const dtrace_difv_t pid_vars[] = {
+	{ 0, DIF_VAR_PID, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+/*
+ * /tid == 4321/
+ */
+static const dif_instr_t tid_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_TID, 1),
+	DIF_INSTR_SETX(0, 2),
+	DIF_INSTR_CMP(DIF_OP_CMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BNE, 6),
+	DIF_INSTR_SETX(1, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t tid_ints[] = { TARGET_TID, 1 };
+static const char tid_strs[] = "tid";
+static const dtrace_difv_t tid_vars[] = {
+	{ 0, DIF_VAR_TID, DIFV_KIND_SCALAR, DIFV_SCOPE_GLOBAL,
+	    DIFV_F_REF, BENCH_INT }
+};
+
+/*
+ * /execname == "sqlservr"/
+ */
+static const dif_instr_t execname_text[] = {
+	DIF_INSTR_LDV(DIF_OP_LDGS, DIF_VAR_EXECNAME, 1),
+	DIF_INSTR_SETS(0, 2),
+	DIF_INSTR_CMP(DIF_OP_SCMP, 1, 2),
+	DIF_INSTR_BRANCH(DIF_OP_BNE, 6),
+	DIF_INSTR_SETX(0, 1),
+	DIF_INSTR_RET(1),
+	DIF_INSTR_RET(0)
+};
+static const uint64_t execname_ints[] = { 1 };
+static const char execname_strs[] = TARGET_NAME "\0execname";
+static const dtrace_difv_t execname_vars[] = {
+	{ sizeof (TARGET_NAME), DIF_VAR_EXECNAME, DIFV_KIND_SCALAR,
+	    DIFV_SCOPE_GLOBAL, DIFV_F_REF, BENCH_STRING }
+};
+
+static const bench_difo_t pid_difo = {
+	pid_text, BENCH_NELEM(pid_text), pid_ints, BENCH_NELEM(pid_ints),
+	pid_strs, sizeof (pid_strs), pid_vars, BENCH_NELEM(pid_vars),
+	BENCH_INT
+};
+
+static const bench_difo_t tid_difo = {
+	tid_text, BENCH_NELEM(tid_text), tid_ints, BENCH_NELEM(tid_ints),
+	tid_strs, sizeof (tid_strs), tid_vars, BENCH_NELEM(tid_vars),
+	BENCH_INT
+};
+
+static const bench_difo_t execname_difo = {
+	execname_text, BENCH_NELEM(execname_text), execname_ints,
+	BENCH_NELEM(execname_ints), execname_strs, sizeof (execname_strs),
+	execname_vars, BENCH_NELEM(execname_vars), BENCH_INT
+};
+
+static struct pred {
+	const char *p_name;
+	const bench_difo_t *p_difo;
+	dtrace_id_t p_entry[2];			/* cached, uncached */
+	dtrace_id_t p_return[2];
+} preds[] = {
+	{ "pid", &pid_difo },
+	{ "execname", &execname_difo },
+	{ "tid", &tid_difo },
+	{ NULL }
+};
+
+static const char *const names[PROCS] = {
+	"svchost", "explorer", TARGET_NAME, "lsass"
+};
+
+static void
+setthread(int t)
+{
+	int p = t % PROCS;
+
+	bench_setproc(p == 2 ? TARGET_PID : 1000 + p,
+	    t == 2 ? TARGET_TID : 2000 + t, names[p]);
+}
+
+static double
+run(dtrace_id_t entry, dtrace_id_t ret, uint64_t n, uint64_t *bytes)
+{
+	hrtime_t start, elapsed = 0;
+	uint64_t i, k;
+	int t = 0;
+
+	for (i = 0; i < n; i += BURST) {
+		setthread(t);
+		t = (t + 1) % THREADS;
+
+		start = bench_hrtime();
+
+		for (k = i; k < i + BURST; k++) {
+			dtrace_probe(entry, k, 0, 0, 0, NULL);
+			dtrace_probe(ret, k, 0, 0, 0, NULL);
+		}
+
+		elapsed += bench_hrtime() - start;
+		*bytes += bench_consume(NULL, NULL);
+	}
+
+	return ((double)elapsed / (2 * n));
+}
+
+int
+main(int argc, char **argv)
+{
+	dtrace_provider_id_t prov;
+	dtrace_cacheid_t cacheid;
+	struct pred *p;
+	uint64_t n = 5000000;
+	int c;
+
+	if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		n = strtoul(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || n < BURST) {
+		(void) fprintf(stderr, "usage: predbench [-n calls]\n");
+		return (2);
+	}
+
+	n -= n % BURST;
+
+	bench_init();
+	bench_setopt(DTRACEOPT_BUFSIZE, 4 * 1024 * 1024);
+	prov = bench_provider("syscall");
+
+	for (c = 0; c < 2; c++) {
+		/*
+		 * The second time around, predicates are created as they
+		 * are once the cache IDs have run out.
+		 */
+		if (c == 1) {
+			cacheid = dtrace_predcache_id;
+			dtrace_predcache_id = DTRACE_CACHEIDNONE;
+		}
+
+		for (p = preds; p->p_name != NULL; p++) {
+			char func[DTRACE_FUNCNAMELEN];
+			char spec[DTRACE_FULLNAMELEN];
+
+			(void) snprintf(func, sizeof (func), "Nt%s%d",
+			    p->p_name, c);
+			p->p_entry[c] = bench_probe(prov, "", func, "entry");
+			p->p_return[c] = bench_probe(prov, "", func, "return");
+
+			(void) snprintf(spec, sizeof (spec), "syscall::%s:",
+			    func);
+			(void) bench_enable(spec, p->p_difo, NULL, 0);
+		}
+	}
+
+	dtrace_predcache_id = cacheid;
+
+	if (bench_go() != 0) {
+		(void) fprintf(stderr, "failed to start tracing\n");
+		return (1);
+	}
+
+	(void) printf("%-10s %12s %12s %12s\n", "PREDICATE", "FIRINGS",
+	    "CACHED", "UNCACHED");
+
+	for (p = preds; p->p_name != NULL; p++) {
+		uint64_t bytes[2] = { 0, 0 };
+		double ns[2];
+
+		for (c = 0; c < 2; c++)
+			ns[c] = run(p->p_entry[c], p->p_return[c], n,
+			    &bytes[c]);
+
+		(void) printf("%-10s %12llu %12.1f %12.1f\n", p->p_name,
+		    (u_longlong_t)(2 * n), ns[0], ns[1]);
+
+		if (bytes[0] != bytes[1]) {
+			(void) fprintf(stderr, "%s: %llu bytes traced with "
+			    "the cache, %llu without\n", p->p_name,
+			    (u_longlong_t)bytes[0], (u_longlong_t)bytes[1]);
+			return (1);
+		}
+	}
+
+	bench_fini();
+
+	return (0);
+}
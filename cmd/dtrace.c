@@ -90,6 +90,8 @@ static int g_pslive;
 static char *g_pname;
 static int g_quiet;
 static int g_flowindent;
+static int g_json;
+static int g_ecbprof;
 static int g_intr;
 static int g_impatient;
 static int g_newline;
@@ -106,6 +108,8 @@ static int g_status = E_SUCCESS;
 static int g_grabanon = 0;
 static const char *g_ofile = NULL;
 static FILE *g_ofp;
+static const char *g_capfile = NULL;
+static FILE *g_capfp;
 static dtrace_hdl_t *g_dtp;
 #ifdef illumos
 static char *g_etcfile = "/etc/system";
@@ -125,17 +129,17 @@ NULL };
 #endif
 
 static const char DTRACE_OPTSTR[] =
-	"3:6:aAb:Bc:CD:ef:FGhHi:I:lL:m:n:o:p:P:qs:SU:vVwx:X:Yy:Z";
+	"3:6:aAb:Bc:CD:ef:FGhHi:I:lL:m:n:o:p:P:qs:STU:vVwW:x:X:Yy:Z";
 
 static int
 usage(FILE *fp)
 {
 	static const char predact[] = "[[ predicate ] action ]";
 
-	(void) fprintf(fp, "Usage: %s [-32|-64] [-aACeFGhHlqSvVwZ] "
+	(void) fprintf(fp, "Usage: %s [-32|-64] [-aACeFGhHlqSTvVwZ] "
 	    "[-b bufsz] [-c cmd] [-D name[=def]]\n\t[-I path] [-L path] "
 	    "[-o output] [-p pid] [-s script] [-U name]\n\t"
-	    "[-x opt[=val]] [-X a|c|s|t]\n\n"
+	    "[-W capture] [-x opt[=val]] [-X a|c|s|t]\n\n"
 	    "\t[-P provider %s]\n"
 	    "\t[-m [ provider: ] module %s]\n"
 	    "\t[-f [[ provider: ] module: ] func %s]\n"
@@ -179,10 +183,12 @@ usage(FILE *fp)
 	    "\t-q  set quiet mode (only output explicitly traced data)\n"
 	    "\t-s  enable or list probes according to the specified D script\n"
 	    "\t-S  print D compiler intermediate code\n"
+	    "\t-T  report the probe-context cost of each enabled probe\n"
 	    "\t-U  undefine symbol when invoking preprocessor\n"
 	    "\t-v  set verbose mode (report stability attributes, arguments)\n"
 	    "\t-V  report DTrace API version\n"
 	    "\t-w  permit destructive actions\n"
+	    "\t-W  write binary capture of trace data to specified file\n"
 	    "\t-x  enable or modify compiler and tracing options\n"
 	    "\t-X  specify ISO C conformance settings for preprocessor\n"
 #ifdef _WIN32
@@ -966,6 +972,9 @@ setopthandler(const dtrace_setoptdata_t *data, void *arg)
 	if (strcmp(data->dtsda_option, "flowindent") == 0)
 		g_flowindent = data->dtsda_newval != DTRACEOPT_UNSET;
 
+	if (strcmp(data->dtsda_option, "oformat") == 0)
+		g_json = data->dtsda_newval == DTRACEOPT_OFORMAT_JSON;
+
 	return (DTRACE_HANDLE_OK);
 }
 
@@ -1126,9 +1135,10 @@ chewrec(const dtrace_probedata_t *data, const dtrace_recdesc_t *rec, void *arg)
 	if (rec == NULL) {
 		/*
 		 * We have processed the final record; output the newline if
-		 * we're not in quiet mode.
+		 * we're not in quiet mode.  (In JSON mode, each probe firing
+		 * is already a line of its own.)
 		 */
-		if (!g_quiet)
+		if (!g_quiet && !g_json)
 			oprintf("\n");
 
 		return (DTRACE_CONSUME_NEXT);
@@ -1158,6 +1168,12 @@ chew(const dtrace_probedata_t *data, void *arg)
 		return (DTRACE_CONSUME_ABORT);
 	}
 
+	/*
+	 * In JSON mode, the CPU and probe are members of the record itself.
+	 */
+	if (g_json)
+		return (DTRACE_CONSUME_THIS);
+
 	if (heading == 0) {
 		if (!g_flowindent) {
 			if (!g_quiet) {
@@ -1203,6 +1219,102 @@ chew(const dtrace_probedata_t *data, void *arg)
 	return (DTRACE_CONSUME_THIS);
 }
 
+typedef struct ecbprof_ent {
+	dtrace_ecbprof_t epe_prof;		/* profile of EPID */
+	const dtrace_probedesc_t *epe_pdesc;	/* probe description */
+} ecbprof_ent_t;
+
+typedef struct ecbprof_list {
+	ecbprof_ent_t *epl_ents;		/* array of entries */
+	size_t epl_nents;			/* number of entries */
+	size_t epl_size;			/* size of array */
+} ecbprof_list_t;
+
+static uint64_t
+ecbprof_total(const dtrace_ecbprof_t *ep)
+{
+	return (ep->dtep_reserve + ep->dtep_pred + ep->dtep_action);
+}
+
+static int
+ecbprof_add(const dtrace_ecbprof_t *ep, const dtrace_probedesc_t *pd,
+    void *arg)
+{
+	ecbprof_list_t *list = arg;
+	ecbprof_ent_t *ents;
+
+	if (ep->dtep_nfired == 0)
+		return (0);
+
+	if (list->epl_nents == list->epl_size) {
+		size_t size = list->epl_size ? list->epl_size << 1 : 64;
+
+		if ((ents = realloc(list->epl_ents,
+		    size * sizeof (ecbprof_ent_t))) == NULL)
+			fatal("failed to allocate ECB profile");
+
+		list->epl_ents = ents;
+		list->epl_size = size;
+	}
+
+	list->epl_ents[list->epl_nents].epe_prof = *ep;
+	list->epl_ents[list->epl_nents++].epe_pdesc = pd;
+
+	return (0);
+}
+
+static int
+ecbprof_cmp(const void *l, const void *r)
+{
+	uint64_t lt = ecbprof_total(&((const ecbprof_ent_t *)l)->epe_prof);
+	uint64_t rt = ecbprof_total(&((const ecbprof_ent_t *)r)->epe_prof);
+
+	if (lt != rt)
+		return (lt > rt ? -1 : 1);
+
+	return (0);
+}
+
+/*
+ * Print the profile of each enabled probe that fired, most expensive first.
+ * All times are the total nanoseconds spent in probe context across CPUs.
+ */
+static void
+print_ecbprof(void)
+{
+	ecbprof_list_t list;
+	size_t i;
+
+	bzero(&list, sizeof (list));
+
+	if (dtrace_ecbprof_iter(g_dtp, ecbprof_add, &list) != 0)
+		dfatal("failed to retrieve ECB profile");
+
+	qsort(list.epl_ents, list.epl_nents, sizeof (ecbprof_ent_t),
+	    ecbprof_cmp);
+
+	oprintf("%5s %12s %12s %14s %12s %12s %12s  %s\n", "EPID",
+	    "FIRED", "MATCHED", "DIFOPS", "RESERVE", "PREDICATE", "ACTIONS",
+	    "PROBE");
+
+	for (i = 0; i < list.epl_nents; i++) {
+		const dtrace_ecbprof_t *ep = &list.epl_ents[i].epe_prof;
+		const dtrace_probedesc_t *pd = list.epl_ents[i].epe_pdesc;
+
+		oprintf("%5u %12llu %12llu %14llu %12llu %12llu %12llu  "
+		    "%s:%s:%s:%s\n", ep->dtep_epid,
+		    (u_longlong_t)ep->dtep_nfired,
+		    (u_longlong_t)ep->dtep_nmatched,
+		    (u_longlong_t)ep->dtep_difops,
+		    (u_longlong_t)ep->dtep_reserve,
+		    (u_longlong_t)ep->dtep_pred,
+		    (u_longlong_t)ep->dtep_action, pd->dtpd_provider,
+		    pd->dtpd_mod, pd->dtpd_func, pd->dtpd_name);
+	}
+
+	free(list.epl_ents);
+}
+
 static void
 go(void)
 {
@@ -1840,6 +1952,11 @@ main(int argc, char *argv[])
 				g_cflags |= DTRACE_C_DIFV;
 				break;
 
+			case 'T':
+				if (dtrace_setopt(g_dtp, "ecbprof", 0) != 0)
+					dfatal("failed to set -T");
+				break;
+
 			case 'U':
 				if (dtrace_setopt(g_dtp, "undef", optarg) != 0)
 					dfatal("failed to set -U %s", optarg);
@@ -1854,6 +1971,10 @@ main(int argc, char *argv[])
 					dfatal("failed to set -w");
 				break;
 
+			case 'W':
+				g_capfile = optarg;
+				break;
+
 			case 'x':
 				if ((p = strchr(optarg, '=')) != NULL)
 					*p++ = '\0';
@@ -1976,6 +2097,9 @@ main(int argc, char *argv[])
 	(void) dtrace_getopt(g_dtp, "quiet", &opt);
 	g_quiet = opt != DTRACEOPT_UNSET;
 
+	(void) dtrace_getopt(g_dtp, "oformat", &opt);
+	g_json = opt == DTRACEOPT_OFORMAT_JSON;
+
 	/*
 	 * Now make a fifth and final pass over the options that have been
 	 * turned into programs and saved in g_cmdv[], performing any mode-
@@ -1988,6 +2112,16 @@ main(int argc, char *argv[])
 		if (g_ofile != NULL && (g_ofp = fopen(g_ofile, "a")) == NULL)
 			fatal("failed to open output file '%s'", g_ofile);
 
+		if (g_capfile != NULL) {
+			if ((g_capfp = fopen(g_capfile, "wb")) == NULL)
+				fatal("failed to open capture file '%s'",
+				    g_capfile);
+
+			if (dtrace_capture(g_dtp, g_capfp) == -1)
+				dfatal("failed to write capture file '%s'",
+				    g_capfile);
+		}
+
 		for (i = 0; i < g_cmdc; i++)
 			exec_prog(&g_cmdv[i]);
 
@@ -2168,10 +2302,16 @@ main(int argc, char *argv[])
 	(void) dtrace_getopt(g_dtp, "quiet", &opt);
 	g_quiet = opt != DTRACEOPT_UNSET;
 
+	(void) dtrace_getopt(g_dtp, "oformat", &opt);
+	g_json = opt == DTRACEOPT_OFORMAT_JSON;
+
 	(void) dtrace_getopt(g_dtp, "destructive", &opt);
 	if (opt != DTRACEOPT_UNSET)
 		notice("allowing destructive actions\n");
 
+	(void) dtrace_getopt(g_dtp, "ecbprof", &opt);
+	g_ecbprof = opt != DTRACEOPT_UNSET;
+
 	installsighands();
 
 	/*
@@ -2199,9 +2339,11 @@ main(int argc, char *argv[])
 			/*
 			 * Output a newline just to make the output look
 			 * slightly cleaner.  Note that we do this even in
-			 * "quiet" mode...
+			 * "quiet" mode -- but not in JSON mode, where it would
+			 * just be noise.
 			 */
-			oprintf("\n");
+			if (!g_json)
+				oprintf("\n");
 			g_newline = 0;
 		}
 
@@ -2226,7 +2368,8 @@ main(int argc, char *argv[])
 			clearerr(g_ofp);
 	} while (!done);
 
-	oprintf("\n");
+	if (!g_json)
+		oprintf("\n");
 
 	if (!g_impatient) {
 		if (dtrace_aggregate_print(g_dtp, g_ofp, NULL) == -1 &&
@@ -2234,6 +2377,17 @@ main(int argc, char *argv[])
 			dfatal("failed to print aggregations");
 	}
 
+	if (g_ecbprof)
+		print_ecbprof();
+
+	if (g_capfp != NULL) {
+		if (dtrace_capture(g_dtp, NULL) == -1)
+			dfatal("failed to write capture file '%s'", g_capfile);
+
+		if (fclose(g_capfp) == EOF)
+			fatal("failed to close capture file '%s'", g_capfile);
+	}
+
 	dtrace_close(g_dtp);
 	return (g_status);
 }
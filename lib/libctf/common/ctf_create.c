@@ -469,6 +469,230 @@ ctf_update(ctf_file_t *fp)
 	return (0);
 }
 
+static ushort_t
+ctf_flatten_id(ulong_t base, ushort_t id)
+{
+	return (CTF_TYPE_ISCHILD(id) ? base + CTF_TYPE_TO_INDEX(id) : id);
+}
+
+static uint_t
+ctf_flatten_name(uint_t off, uint_t name)
+{
+	return (name != 0 ? name + off : 0);
+}
+
+/*
+ * Return a new, read-only container that holds the types of the specified
+ * child container's parent followed by those of the child itself, so that
+ * the two can be saved with ctf_write() as a single container.  The parent's
+ * types keep their identifiers; child type t becomes *basep plus
+ * CTF_TYPE_TO_INDEX(t).  This is done by copying the type and string
+ * sections of both and relocating the child's type references and names;
+ * no type is looked up or re-added.  Only the type and string sections can
+ * be merged, so neither container may have labels, data objects, functions
+ * or an external string table.  As with ctf_write(), a dynamic child must be
+ * committed with ctf_update() first.
+ */
+ctf_file_t *
+ctf_flatten(ctf_file_t *fp, ctf_id_t *basep, int *errp)
+{
+	ctf_file_t *pfp = fp->ctf_parent, *nfp;
+	const ctf_header_t *php, *chp;
+	ctf_header_t hdr;
+	ctf_type_t *tp, *tend;
+	ctf_sect_t cts;
+	uchar_t *buf, *t;
+	size_t psize, csize, size;
+	ulong_t base;
+	int err;
+
+	if (pfp == NULL)
+		return (ctf_set_open_errno(errp, ECTF_NOPARENT));
+
+	if (fp->ctf_version != CTF_VERSION_2 ||
+	    pfp->ctf_version != CTF_VERSION_2 ||
+	    (pfp->ctf_flags & LCTF_CHILD) ||
+	    fp->ctf_strtab.cts_data != NULL ||
+	    pfp->ctf_strtab.cts_data != NULL)
+		return (ctf_set_open_errno(errp, ECTF_NOTSUP));
+
+	/* LINTED - pointer alignment */
+	php = (const ctf_header_t *)pfp->ctf_base;
+	/* LINTED - pointer alignment */
+	chp = (const ctf_header_t *)fp->ctf_base;
+
+	if (php->cth_lbloff != php->cth_typeoff ||
+	    chp->cth_lbloff != chp->cth_typeoff)
+		return (ctf_set_open_errno(errp, ECTF_NOTSUP));
+
+	if ((base = pfp->ctf_typemax) + fp->ctf_typemax > CTF_MAX_TYPE >> 1)
+		return (ctf_set_open_errno(errp, ECTF_FULL));
+
+	psize = php->cth_stroff - php->cth_typeoff;
+	csize = chp->cth_stroff - chp->cth_typeoff;
+
+	bzero(&hdr, sizeof (hdr));
+	hdr.cth_magic = CTF_MAGIC;
+	hdr.cth_version = CTF_VERSION_2;
+	hdr.cth_stroff = (uint_t)(psize + csize);
+	hdr.cth_strlen = php->cth_strlen + chp->cth_strlen;
+
+	if (hdr.cth_strlen > CTF_MAX_NAME)
+		return (ctf_set_open_errno(errp, ECTF_FULL));
+
+	size = sizeof (ctf_header_t) + hdr.cth_stroff + hdr.cth_strlen;
+
+	if ((buf = ctf_data_alloc(size)) == MAP_FAILED)
+		return (ctf_set_open_errno(errp, EAGAIN));
+
+	bcopy(&hdr, buf, sizeof (ctf_header_t));
+	t = buf + sizeof (ctf_header_t);
+
+	bcopy(pfp->ctf_buf + php->cth_typeoff, t, psize);
+	bcopy(fp->ctf_buf + chp->cth_typeoff, t + psize, csize);
+	bcopy(pfp->ctf_buf + php->cth_stroff, t + hdr.cth_stroff,
+	    php->cth_strlen);
+	bcopy(fp->ctf_buf + chp->cth_stroff,
+	    t + hdr.cth_stroff + php->cth_strlen, chp->cth_strlen);
+
+	/*
+	 * Now relocate the child's types in place.  Every reference to a
+	 * child type becomes a reference past the parent's last type, and
+	 * every name becomes an offset past the parent's strings.
+	 */
+	/* LINTED - pointer alignment */
+	tp = (ctf_type_t *)(t + psize);
+	/* LINTED - pointer alignment */
+	tend = (ctf_type_t *)(t + psize + csize);
+
+	while (tp < tend) {
+		ushort_t kind = LCTF_INFO_KIND(fp, tp->ctt_info);
+		ulong_t vlen = LCTF_INFO_VLEN(fp, tp->ctt_info);
+		ssize_t tsize, increment;
+		uchar_t *vp;
+		ulong_t i;
+
+		(void) ctf_get_ctt_size(fp, tp, &tsize, &increment);
+		vp = (uchar_t *)tp + increment;
+
+		tp->ctt_name = ctf_flatten_name(php->cth_strlen, tp->ctt_name);
+
+		switch (kind) {
+		case CTF_K_INTEGER:
+		case CTF_K_FLOAT:
+			vp += sizeof (uint_t);
+			break;
+
+		case CTF_K_ARRAY: {
+			/* LINTED - pointer alignment */
+			ctf_array_t *ap = (ctf_array_t *)vp;
+
+			ap->cta_contents = ctf_flatten_id(base,
+			    ap->cta_contents);
+			ap->cta_index = ctf_flatten_id(base, ap->cta_index);
+			vp += sizeof (ctf_array_t);
+			break;
+		}
+
+		case CTF_K_FUNCTION: {
+			/* LINTED - pointer alignment */
+			ushort_t *argv = (ushort_t *)vp;
+
+			tp->ctt_type = ctf_flatten_id(base, tp->ctt_type);
+
+			for (i = 0; i < vlen; i++)
+				argv[i] = ctf_flatten_id(base, argv[i]);
+
+			vp += sizeof (ushort_t) * (vlen + (vlen & 1));
+			break;
+		}
+
+		case CTF_K_STRUCT:
+		case CTF_K_UNION:
+			if (tsize < CTF_LSTRUCT_THRESH) {
+				/* LINTED - pointer alignment */
+				ctf_member_t *mp = (ctf_member_t *)vp;
+
+				for (i = 0; i < vlen; i++, mp++) {
+					mp->ctm_name = ctf_flatten_name(
+					    php->cth_strlen, mp->ctm_name);
+					mp->ctm_type = ctf_flatten_id(base,
+					    mp->ctm_type);
+				}
+
+				vp = (uchar_t *)mp;
+			} else {
+				/* LINTED - pointer alignment */
+				ctf_lmember_t *lmp = (ctf_lmember_t *)vp;
+
+				for (i = 0; i < vlen; i++, lmp++) {
+					lmp->ctlm_name = ctf_flatten_name(
+					    php->cth_strlen, lmp->ctlm_name);
+					lmp->ctlm_type = ctf_flatten_id(base,
+					    lmp->ctlm_type);
+				}
+
+				vp = (uchar_t *)lmp;
+			}
+			break;
+
+		case CTF_K_ENUM: {
+			/* LINTED - pointer alignment */
+			ctf_enum_t *ep = (ctf_enum_t *)vp;
+
+			for (i = 0; i < vlen; i++, ep++) {
+				ep->cte_name = ctf_flatten_name(
+				    php->cth_strlen, ep->cte_name);
+			}
+
+			vp = (uchar_t *)ep;
+			break;
+		}
+
+		case CTF_K_POINTER:
+		case CTF_K_TYPEDEF:
+		case CTF_K_VOLATILE:
+		case CTF_K_CONST:
+		case CTF_K_RESTRICT:
+			tp->ctt_type = ctf_flatten_id(base, tp->ctt_type);
+			break;
+
+		case CTF_K_FORWARD:
+		case CTF_K_UNKNOWN:
+			break;
+
+		default:
+			ctf_data_free(buf, size);
+			return (ctf_set_open_errno(errp, ECTF_CORRUPT));
+		}
+
+		/* LINTED - pointer alignment */
+		tp = (ctf_type_t *)vp;
+	}
+
+	ctf_data_protect(buf, size);
+	cts.cts_name = _CTF_SECTION;
+	cts.cts_type = SHT_PROGBITS;
+	cts.cts_flags = 0;
+	cts.cts_data = buf;
+	cts.cts_size = size;
+	cts.cts_entsize = 1;
+	cts.cts_offset = 0;
+
+	if ((nfp = ctf_bufopen(&cts, NULL, NULL, &err)) == NULL) {
+		ctf_data_free(buf, size);
+		return (ctf_set_open_errno(errp, err));
+	}
+
+	(void) ctf_setmodel(nfp, ctf_getmodel(fp));
+	nfp->ctf_data.cts_data = NULL; /* force ctf_data_free() on close */
+
+	if (basep != NULL)
+		*basep = (ctf_id_t)base;
+
+	return (nfp);
+}
+
 void
 ctf_dtd_insert(ctf_file_t *fp, ctf_dtdef_t *dtd)
 {
@@ -29,39 +29,44 @@
 
 #include <ctf_impl.h>
 
-static const ushort_t _CTF_EMPTY[1] = { 0 };
+/*
+ * The hash tables used for type name lookups are open-addressed arrays of
+ * ctf_helem_t, whose size is a power of two, probed linearly from the slot
+ * selected by the low-order bits of the name's hash value.  Each element
+ * records the full hash value of its name, so a probe compares strings only
+ * if the hash values match, and an element whose type is zero is free.  The
+ * table is at most half full so that probe sequences stay short, and an empty
+ * table refers to a single static free element rather than allocating any.
+ */
+static const ctf_helem_t _CTF_EMPTY[1] = { { 0, 0, 0, 0 } };
 
 int
 ctf_hash_create(ctf_hash_t *hp, ulong_t nelems)
 {
-	if (nelems > USHRT_MAX)
+	uint_t nslots;
+
+	if (nelems > (UINT_MAX >> 2))
 		return (EOVERFLOW);
 
+	bzero(hp, sizeof (ctf_hash_t));
+
 	/*
 	 * If the hash table is going to be empty, don't bother allocating any
-	 * memory and make the only bucket point to a zero so lookups fail.
+	 * memory and make the only slot a free element so lookups fail.
 	 */
 	if (nelems == 0) {
-		bzero(hp, sizeof (ctf_hash_t));
-		hp->h_buckets = (ushort_t *)_CTF_EMPTY;
-		hp->h_nbuckets = 1;
+		hp->h_table = (ctf_helem_t *)_CTF_EMPTY;
 		return (0);
 	}
 
-	hp->h_nbuckets = 211;		/* use a prime number of hash buckets */
-	hp->h_nelems = nelems + 1;	/* we use index zero as a sentinel */
-	hp->h_free = 1;			/* first free element is index 1 */
-
-	hp->h_buckets = ctf_alloc(sizeof (ushort_t) * hp->h_nbuckets);
-	hp->h_chains = ctf_alloc(sizeof (ctf_helem_t) * hp->h_nelems);
+	for (nslots = 2; nslots < nelems * 2; nslots <<= 1)
+		continue;
 
-	if (hp->h_buckets == NULL || hp->h_chains == NULL) {
-		ctf_hash_destroy(hp);
+	if ((hp->h_table = ctf_alloc(sizeof (ctf_helem_t) * nslots)) == NULL)
 		return (EAGAIN);
-	}
 
-	bzero(hp->h_buckets, sizeof (ushort_t) * hp->h_nbuckets);
-	bzero(hp->h_chains, sizeof (ctf_helem_t) * hp->h_nelems);
+	bzero(hp->h_table, sizeof (ctf_helem_t) * nslots);
+	hp->h_mask = nslots - 1;
 
 	return (0);
 }
@@ -69,42 +74,76 @@ ctf_hash_create(ctf_hash_t *hp, ulong_t nelems)
 uint_t
 ctf_hash_size(const ctf_hash_t *hp)
 {
-	return (hp->h_nelems ? hp->h_nelems - 1 : 0);
+	return (hp->h_nelems);
 }
 
-static ulong_t
+/*
+ * Compute the 32-bit FNV-1a hash of the specified string.
+ */
+static uint_t
 ctf_hash_compute(const char *key, size_t len)
 {
-	ulong_t g, h = 0;
-	const char *p, *q = key + len;
-	size_t n = 0;
-
-	for (p = key; p < q; p++, n++) {
-		h = (h << 4) + *p;
+	const uchar_t *p = (const uchar_t *)key, *q = p + len;
+	uint_t h = 2166136261U;
 
-		if ((g = (h & 0xf0000000)) != 0) {
-			h ^= (g >> 24);
-			h ^= g;
-		}
+	for (; p < q; p++) {
+		h ^= *p;
+		h *= 16777619U;
 	}
 
 	return (h);
 }
 
+/*
+ * Return the element of the hash table for the specified name with hash value
+ * h, or the free element at which such a name would be inserted.  If the
+ * table is full and the name is not present, NULL is returned.
+ */
+static ctf_helem_t *
+ctf_hash_probe(const ctf_hash_t *hp, ctf_file_t *fp, const char *key,
+    size_t len, uint_t h)
+{
+	ctf_helem_t *hep;
+	ctf_strs_t *ctsp;
+	const char *str;
+	uint_t i, n;
+
+	for (i = h, n = 0; n <= hp->h_mask; i++, n++) {
+		hep = &hp->h_table[i & hp->h_mask];
+
+		if (hep->h_type == 0)
+			return (hep);
+
+		if (hep->h_hash != h)
+			continue;
+
+		ctsp = &fp->ctf_str[CTF_NAME_STID(hep->h_name)];
+		str = ctsp->cts_strs + CTF_NAME_OFFSET(hep->h_name);
+
+		if (strncmp(key, str, len) == 0 && str[len] == '\0')
+			return (hep);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Insert the specified type under the specified name.  If the name is already
+ * in the hash, the new type replaces the previous one, so that as before the
+ * most recent definition of a name is the one that is found by lookups.
+ */
 int
 ctf_hash_insert(ctf_hash_t *hp, ctf_file_t *fp, ushort_t type, uint_t name)
 {
 	ctf_strs_t *ctsp = &fp->ctf_str[CTF_NAME_STID(name)];
 	const char *str = ctsp->cts_strs + CTF_NAME_OFFSET(name);
-	ctf_helem_t *hep = &hp->h_chains[hp->h_free];
-	ulong_t h;
+	ctf_helem_t *hep;
+	size_t len;
+	uint_t h;
 
 	if (type == 0)
 		return (EINVAL);
 
-	if (hp->h_free >= hp->h_nelems)
-		return (EOVERFLOW);
-
 	if (ctsp->cts_strs == NULL)
 		return (ECTF_STRTAB);
 
@@ -114,65 +153,150 @@ ctf_hash_insert(ctf_hash_t *hp, ctf_file_t *fp, ushort_t type, uint_t name)
 	if (str[0] == '\0')
 		return (0); /* just ignore empty strings on behalf of caller */
 
-	hep->h_name = name;
-	hep->h_type = type;
-	h = ctf_hash_compute(str, strlen(str)) % hp->h_nbuckets;
-	hep->h_next = hp->h_buckets[h];
-	hp->h_buckets[h] = hp->h_free++;
+	len = strlen(str);
+	h = ctf_hash_compute(str, len);
+
+	if ((hep = ctf_hash_probe(hp, fp, str, len, h)) == NULL)
+		return (EOVERFLOW);
+
+	if (hep->h_type == 0) {
+		if (hp->h_nelems >= (hp->h_mask + 1) / 2)
+			return (EOVERFLOW);
 
+		hep->h_hash = h;
+		hep->h_name = name;
+		hp->h_nelems++;
+	}
+
+	hep->h_type = type;
 	return (0);
 }
 
 /*
- * Wrapper for ctf_hash_lookup/ctf_hash_insert: if the key is already in the
- * hash, override the previous definition with this new official definition.
- * If the key is not present, then call ctf_hash_insert() and hash it in.
+ * Wrapper for ctf_hash_insert: if the key is already in the hash, override
+ * the previous definition with this new official definition.  Since the
+ * open-addressed table holds a single element per name, ctf_hash_insert()
+ * already does exactly that.
  */
 int
 ctf_hash_define(ctf_hash_t *hp, ctf_file_t *fp, ushort_t type, uint_t name)
 {
-	const char *str = ctf_strptr(fp, name);
-	ctf_helem_t *hep = ctf_hash_lookup(hp, fp, str, strlen(str));
-
-	if (hep == NULL)
-		return (ctf_hash_insert(hp, fp, type, name));
-
-	hep->h_type = type;
-	return (0);
+	return (ctf_hash_insert(hp, fp, type, name));
 }
 
 ctf_helem_t *
 ctf_hash_lookup(ctf_hash_t *hp, ctf_file_t *fp, const char *key, size_t len)
 {
 	ctf_helem_t *hep;
-	ctf_strs_t *ctsp;
-	const char *str;
-	ushort_t i;
 
-	ulong_t h = ctf_hash_compute(key, len) % hp->h_nbuckets;
-
-	for (i = hp->h_buckets[h]; i != 0; i = hep->h_next) {
-		hep = &hp->h_chains[i];
-		ctsp = &fp->ctf_str[CTF_NAME_STID(hep->h_name)];
-		str = ctsp->cts_strs + CTF_NAME_OFFSET(hep->h_name);
+	hep = ctf_hash_probe(hp, fp, key, len, ctf_hash_compute(key, len));
 
-		if (strncmp(key, str, len) == 0 && str[len] == '\0')
-			return (hep);
-	}
-
-	return (NULL);
+	return (hep != NULL && hep->h_type != 0 ? hep : NULL);
 }
 
 void
 ctf_hash_destroy(ctf_hash_t *hp)
 {
-	if (hp->h_buckets != NULL && hp->h_nbuckets != 1) {
-		ctf_free(hp->h_buckets, sizeof (ushort_t) * hp->h_nbuckets);
-		hp->h_buckets = NULL;
+	if (hp->h_table != NULL && hp->h_table != _CTF_EMPTY) {
+		ctf_free(hp->h_table, sizeof (ctf_helem_t) * (hp->h_mask + 1));
+		hp->h_table = NULL;
 	}
+}
+
+/*
+ * A hash table can be saved in a container's type index (see <sys/ctf.h>) and
+ * used in place from the container's data when the container is opened.  The
+ * saved form is a pair of uint_t counts of slots and elements, followed by the
+ * table itself.  If buf is NULL, ctf_hash_export() just returns the size of
+ * the saved form.
+ */
+size_t
+ctf_hash_export(const ctf_hash_t *hp, uchar_t *buf)
+{
+	uint_t cnt[2];
+
+	cnt[0] = hp->h_mask + 1;
+	cnt[1] = hp->h_nelems;
+
+	if (buf != NULL) {
+		bcopy(cnt, buf, sizeof (cnt));
+		bcopy(hp->h_table, buf + sizeof (cnt),
+		    sizeof (ctf_helem_t) * cnt[0]);
+	}
+
+	return (sizeof (cnt) + sizeof (ctf_helem_t) * cnt[0]);
+}
+
+/*
+ * Initialize the specified hash table to refer to a saved hash at buf, and
+ * return a pointer to the data following it, or NULL if the saved hash does
+ * not fit before end.  The resulting hash table must not be modified or
+ * passed to ctf_hash_destroy().
+ */
+const uchar_t *
+ctf_hash_import(ctf_hash_t *hp, const uchar_t *buf, const uchar_t *end)
+{
+	uint_t cnt[2];
+
+	if ((size_t)(end - buf) < sizeof (cnt))
+		return (NULL);
+
+	bcopy(buf, cnt, sizeof (cnt));
+	buf += sizeof (cnt);
+
+	if (cnt[0] == 0 || (cnt[0] & (cnt[0] - 1)) != 0 ||
+	    cnt[0] > (UINT_MAX >> 1) || cnt[1] >= cnt[0])
+		return (NULL);
+
+	if ((size_t)(end - buf) < sizeof (ctf_helem_t) * cnt[0])
+		return (NULL);
+
+	/* LINTED - pointer alignment */
+	hp->h_table = (ctf_helem_t *)buf;
+	hp->h_mask = cnt[0] - 1;
+	hp->h_nelems = cnt[1];
+
+	return (buf + sizeof (ctf_helem_t) * cnt[0]);
+}
+
+/*
+ * Check that every element of an imported hash table is one that could have
+ * been built by ctf_hash_insert() for the container fp, whose types are
+ * numbered from 1 to typemax:  that each element names a string in one of its
+ * string tables and that its type is one of the container's own.  Also check
+ * that the count of elements is correct, as probing relies on the table never
+ * being full.  The strings themselves are not read, so that opening a
+ * container does not page in its string table:  the caller checks that each
+ * string table is terminated, and an element whose hash value is not that of
+ * its name is merely never found.
+ */
+int
+ctf_hash_verify(const ctf_hash_t *hp, ctf_file_t *fp, ulong_t typemax,
+    int child)
+{
+	const ctf_helem_t *hep;
+	const ctf_strs_t *ctsp;
+	uint_t i, n = 0;
+
+	for (i = 0; i <= hp->h_mask; i++) {
+		hep = &hp->h_table[i];
+
+		if (hep->h_type == 0)
+			continue;
 
-	if (hp->h_chains != NULL) {
-		ctf_free(hp->h_chains, sizeof (ctf_helem_t) * hp->h_nelems);
-		hp->h_chains = NULL;
+		if (CTF_TYPE_ISCHILD(hep->h_type) != child ||
+		    CTF_TYPE_TO_INDEX(hep->h_type) == 0 ||
+		    CTF_TYPE_TO_INDEX(hep->h_type) > typemax)
+			return (ECTF_CORRUPT);
+
+		ctsp = &fp->ctf_str[CTF_NAME_STID(hep->h_name)];
+
+		if (ctsp->cts_strs == NULL ||
+		    CTF_NAME_OFFSET(hep->h_name) >= ctsp->cts_len)
+			return (ECTF_CORRUPT);
+
+		n++;
 	}
+
+	return (n == hp->h_nelems ? 0 : ECTF_CORRUPT);
 }
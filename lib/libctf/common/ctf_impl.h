@@ -64,17 +64,16 @@ extern "C" {
 #endif
 
 typedef struct ctf_helem {
+	uint_t h_hash;		/* hash value of name */
 	uint_t h_name;		/* reference to name in string table */
-	ushort_t h_type;	/* corresponding type ID number */
-	ushort_t h_next;	/* index of next element in hash chain */
+	ushort_t h_type;	/* corresponding type ID number (0 if free) */
+	ushort_t h_pad;		/* padding (unused) */
 } ctf_helem_t;
 
 typedef struct ctf_hash {
-	ushort_t *h_buckets;	/* hash bucket array (chain indices) */
-	ctf_helem_t *h_chains;	/* hash chains buffer */
-	ushort_t h_nbuckets;	/* number of elements in bucket array */
-	ushort_t h_nelems;	/* number of elements in hash table */
-	uint_t h_free;		/* index of next free hash element */
+	ctf_helem_t *h_table;	/* open-addressed element array */
+	uint_t h_mask;		/* number of slots in h_table, minus one */
+	uint_t h_nelems;	/* number of elements in hash table */
 } ctf_hash_t;
 
 typedef struct ctf_strs {
@@ -224,6 +223,7 @@ struct ctf_file {
 #define	LCTF_CHILD	0x0002	/* CTF container is a child */
 #define	LCTF_RDWR	0x0004	/* CTF container is writable */
 #define	LCTF_DIRTY	0x0008	/* CTF container has been modified */
+#define	LCTF_INDEX	0x0010	/* type tables are in place in CTF data */
 
 #define	ECTF_BASE	1000	/* base value for libctf errnos */
 
@@ -288,6 +288,10 @@ extern ctf_helem_t *ctf_hash_lookup(ctf_hash_t *, ctf_file_t *,
     const char *, size_t);
 extern uint_t ctf_hash_size(const ctf_hash_t *);
 extern void ctf_hash_destroy(ctf_hash_t *);
+extern size_t ctf_hash_export(const ctf_hash_t *, uchar_t *);
+extern const uchar_t *ctf_hash_import(ctf_hash_t *, const uchar_t *,
+    const uchar_t *);
+extern int ctf_hash_verify(const ctf_hash_t *, ctf_file_t *, ulong_t, int);
 
 #define	ctf_list_prev(elem)	((void *)(((ctf_list_t *)(elem))->l_prev))
 #define	ctf_list_next(elem)	((void *)(((ctf_list_t *)(elem))->l_next))
@@ -523,6 +523,68 @@ ctf_write(ctf_file_t *fp, int fd)
 	return (0);
 }
 
+/*
+ * Write the uncompressed CTF data stream to the specified file descriptor,
+ * followed by the type index described in <sys/ctf.h>.  A container opened
+ * from the result can be used without scanning its type section.  As with
+ * ctf_write(), a dynamic container must be committed with ctf_update() first.
+ */
+int
+ctf_write_indexed(ctf_file_t *fp, int fd)
+{
+	const ctf_hash_t *hashes[4];
+	size_t n = fp->ctf_typemax + 1;
+	size_t dsize = P2ROUNDUP(fp->ctf_size, 4);
+	size_t size;
+	ctf_index_t cti;
+	uchar_t *buf, *p;
+	ssize_t resid, len;
+	int i, err = 0;
+
+	hashes[0] = &fp->ctf_structs;
+	hashes[1] = &fp->ctf_unions;
+	hashes[2] = &fp->ctf_enums;
+	hashes[3] = &fp->ctf_names;
+
+	size = dsize + sizeof (cti) + sizeof (uint_t) * n +
+	    P2ROUNDUP(sizeof (ushort_t) * n, 4);
+
+	for (i = 0; i < 4; i++)
+		size += ctf_hash_export(hashes[i], NULL);
+
+	if ((buf = ctf_alloc(size)) == NULL)
+		return (ctf_set_errno(fp, EAGAIN));
+
+	bzero(buf, size);
+	bcopy(fp->ctf_base, buf, fp->ctf_size);
+	((ctf_preamble_t *)buf)->ctp_flags |= CTF_F_INDEX;
+	p = buf + dsize;
+
+	cti.cti_version = CTF_INDEX_VERSION;
+	cti.cti_typemax = (uint_t)fp->ctf_typemax;
+	cti.cti_child = (fp->ctf_flags & LCTF_CHILD) != 0;
+	bcopy(&cti, p, sizeof (cti));
+	p += sizeof (cti);
+
+	bcopy(fp->ctf_txlate, p, sizeof (uint_t) * n);
+	p += sizeof (uint_t) * n;
+	bcopy(fp->ctf_ptrtab, p, sizeof (ushort_t) * n);
+	p += P2ROUNDUP(sizeof (ushort_t) * n, 4);
+
+	for (i = 0; i < 4; i++)
+		p += ctf_hash_export(hashes[i], p);
+
+	for (p = buf, resid = size; resid != 0; resid -= len, p += len) {
+		if ((len = write(fd, p, resid)) <= 0) {
+			err = errno;
+			break;
+		}
+	}
+
+	ctf_free(buf, size);
+	return (err != 0 ? ctf_set_errno(fp, err) : 0);
+}
+
 /*
  * Set the CTF library client version to the specified version.  If version is
  * zero, we just return the default library version number.
@@ -242,24 +242,40 @@ ctf_lookup_by_id(ctf_file_t **fpp, ctf_id_t type)
 	return (NULL);
 }
 
+#ifdef _WIN32
 /*
- * Given a symbol table index, return the info for the function described
- * by the corresponding entry in the symbol table.
+ * On Windows, the symbol table index that is passed to ctf_func_info() and
+ * ctf_func_args() is actually the identifier of a function type.  A dynamic
+ * type is described by its ctf_dtdef_t; a type that was read from a container
+ * (such as the parent that libdtrace's CTF cache supplies) has only its
+ * ctf_type_t, which its argument types follow.  Return the function's info,
+ * and up to argc of its argument types in argv.
  */
-int
-ctf_func_info(ctf_file_t *fp, ulong_t symidx, ctf_funcinfo_t *fip)
+static int
+ctf_func_type(ctf_file_t *fp, ulong_t type, ctf_funcinfo_t *fip,
+    uint_t argc, ctf_id_t *argv)
 {
-#ifdef _WIN32
-	/* Win32 symix is actually a type index. */
-	ctf_dtdef_t *dtd = ctf_dtd_lookup(fp, symidx);
-	if (NULL == dtd)
+	ctf_dtdef_t *dtd = ctf_dtd_lookup(fp, type);
+	const ctf_type_t *tp;
+	const ushort_t *dp = NULL;
+	ctf_file_t *tfp = fp;
+	ssize_t size, increment;
+	ushort_t info, kind, n, i;
+
+	if (dtd != NULL) {
+		info = dtd->dtd_data.ctt_info;
+		fip->ctc_return = dtd->dtd_data.ctt_type;
+	} else if ((tp = ctf_lookup_by_id(&tfp, type)) != NULL) {
+		(void) ctf_get_ctt_size(tfp, tp, &size, &increment);
+		info = tp->ctt_info;
+		fip->ctc_return = tp->ctt_type;
+		dp = (const ushort_t *)((uintptr_t)tp + increment);
+	} else {
 		return (ctf_set_errno(fp, EINVAL));
+	}
 
-	const ctf_id_t *dp;
-	ushort_t info, kind, n;
-
-	kind = LCTF_INFO_KIND(fp, dtd->dtd_data.ctt_info);
-	n = LCTF_INFO_VLEN(fp, dtd->dtd_data.ctt_info);
+	kind = LCTF_INFO_KIND(tfp, info);
+	n = LCTF_INFO_VLEN(tfp, info);
 
 	if (kind == CTF_K_UNKNOWN && n == 0)
 		return (ctf_set_errno(fp, ECTF_NOFUNCDAT));
@@ -267,17 +283,31 @@ ctf_func_info(ctf_file_t *fp, ulong_t symidx, ctf_funcinfo_t *fip)
 	if (kind != CTF_K_FUNCTION)
 		return (ctf_set_errno(fp, ECTF_CORRUPT));
 
-	dp = dtd->dtd_u.dtu_argv;
-	fip->ctc_return = dtd->dtd_data.ctt_type;
 	fip->ctc_argc = n;
 	fip->ctc_flags = 0;
 
-	if (n != 0 && dp[n - 1] == 0) {
+	if (n != 0 &&
+	    (dtd != NULL ? dtd->dtd_u.dtu_argv[n - 1] : dp[n - 1]) == 0) {
 		fip->ctc_flags |= CTF_FUNC_VARARG;
 		fip->ctc_argc--;
 	}
 
+	for (i = 0; i < MIN(argc, fip->ctc_argc); i++)
+		argv[i] = dtd != NULL ? dtd->dtd_u.dtu_argv[i] : dp[i];
+
 	return (0);
+}
+#endif
+
+/*
+ * Given a symbol table index, return the info for the function described
+ * by the corresponding entry in the symbol table.
+ */
+int
+ctf_func_info(ctf_file_t *fp, ulong_t symidx, ctf_funcinfo_t *fip)
+{
+#ifdef _WIN32
+	return (ctf_func_type(fp, symidx, fip, 0, NULL));
 #else
 
 	const ctf_sect_t *sp = &fp->ctf_symtab;
@@ -336,32 +366,9 @@ int
 ctf_func_args(ctf_file_t *fp, ulong_t symidx, uint_t argc, ctf_id_t *argv)
 {
 #ifdef _WIN32
-	/* Win32 symix is actually a type index. */
-	ctf_dtdef_t *dtd = ctf_dtd_lookup(fp, symidx);
-	if (NULL == dtd)
-		return (ctf_set_errno(fp, EINVAL));
-
-	const ctf_id_t *dp;
-	ushort_t info, kind, n;
-
-	kind = LCTF_INFO_KIND(fp, dtd->dtd_data.ctt_info);
-	n = LCTF_INFO_VLEN(fp, dtd->dtd_data.ctt_info);
-
-	if (kind == CTF_K_UNKNOWN && n == 0)
-		return (ctf_set_errno(fp, ECTF_NOFUNCDAT));
-
-	if (kind != CTF_K_FUNCTION)
-		return (ctf_set_errno(fp, ECTF_CORRUPT));
-
-	dp = dtd->dtd_u.dtu_argv;
-	if (n != 0 && dp[n - 1] == 0) {
-		n--;
-	}
-
-	for (argc = MIN(argc, n); argc != 0; argc--)
-		*argv++ = *dp++;
+	ctf_funcinfo_t f;
 
-	return (0);
+	return (ctf_func_type(fp, symidx, &f, argc, argv));
 #else
 	const ushort_t *dp;
 	ctf_funcinfo_t f;
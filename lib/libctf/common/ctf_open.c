@@ -545,6 +545,115 @@ init_types(ctf_file_t *fp, const ctf_header_t *cth)
 	return (0);
 }
 
+/*
+ * Initialize the type ID translation table, the pointer table and the hash
+ * tables of each named type from the type index of a CTF_F_INDEX container
+ * (see <sys/ctf.h>).  The tables refer directly to the CTF data, so the type
+ * section itself is not read here at all.  As the index is only a cache of
+ * what init_types() would compute, every entry is checked against the type
+ * section's bounds, the string tables and the number of types before it is
+ * used; if any entry is out of range, the caller falls back to init_types().
+ */
+static int
+init_index(ctf_file_t *fp, const ctf_header_t *cth)
+{
+	const uchar_t *end = (const uchar_t *)fp->ctf_data.cts_data +
+	    fp->ctf_data.cts_size;
+	const uchar_t *p = fp->ctf_buf +
+	    P2ROUNDUP((size_t)cth->cth_stroff + cth->cth_strlen, 4);
+
+	ctf_hash_t hash[4];
+	ctf_index_t cti;
+	uint_t *xlate;
+	ushort_t *ptrtab;
+	uint_t off, prev;
+	size_t n, id;
+	int i, child;
+
+	if (p > end || (size_t)(end - p) < sizeof (ctf_index_t))
+		return (ECTF_CORRUPT);
+
+	bcopy(p, &cti, sizeof (cti));
+	p += sizeof (cti);
+
+	if (cti.cti_version != CTF_INDEX_VERSION ||
+	    cti.cti_typemax > CTF_MAX_TYPE)
+		return (ECTF_CORRUPT);
+
+	n = cti.cti_typemax + 1;
+
+	if ((size_t)(end - p) <
+	    sizeof (uint_t) * n + P2ROUNDUP(sizeof (ushort_t) * n, 4))
+		return (ECTF_CORRUPT);
+
+	/* LINTED - pointer alignment */
+	xlate = (uint_t *)p;
+	p += sizeof (uint_t) * n;
+	/* LINTED - pointer alignment */
+	ptrtab = (ushort_t *)p;
+	p += P2ROUNDUP(sizeof (ushort_t) * n, 4);
+
+	/*
+	 * Each type's offset must lie within the type section, leave room for
+	 * at least a ctf_stype_t before the string section, be aligned as the
+	 * types are, and follow the offset of the type before it (the first
+	 * type may lie at offset zero).  Pointer table entries are type
+	 * indices.
+	 */
+	for (id = 1, prev = 0; id < n; id++, prev = off) {
+		off = xlate[id];
+
+		if (off < cth->cth_typeoff || (id > 1 && off <= prev) ||
+		    (off & (sizeof (uint_t) - 1)) != 0 ||
+		    off > cth->cth_stroff ||
+		    cth->cth_stroff - off < sizeof (ctf_stype_t))
+			return (ECTF_CORRUPT);
+	}
+
+	for (id = 0; id < n; id++) {
+		if (ptrtab[id] > cti.cti_typemax)
+			return (ECTF_CORRUPT);
+	}
+
+	/*
+	 * The names in the hash tables are not read until they are looked up,
+	 * and so each string table must be terminated for those reads to stay
+	 * within it.
+	 */
+	for (i = CTF_STRTAB_0; i <= CTF_STRTAB_1; i++) {
+		const ctf_strs_t *ctsp = &fp->ctf_str[i];
+
+		if (ctsp->cts_len != 0 &&
+		    ctsp->cts_strs[ctsp->cts_len - 1] != '\0')
+			return (ECTF_CORRUPT);
+	}
+
+	child = cti.cti_child || cth->cth_parname != 0;
+
+	for (i = 0; i < 4; i++) {
+		if ((p = ctf_hash_import(&hash[i], p, end)) == NULL ||
+		    ctf_hash_verify(&hash[i], fp, cti.cti_typemax, child) != 0)
+			return (ECTF_CORRUPT);
+	}
+
+	if (child)
+		fp->ctf_flags |= LCTF_CHILD;
+
+	fp->ctf_flags |= LCTF_INDEX;
+	fp->ctf_typemax = cti.cti_typemax;
+	fp->ctf_txlate = xlate;
+	fp->ctf_ptrtab = ptrtab;
+	fp->ctf_structs = hash[0];
+	fp->ctf_unions = hash[1];
+	fp->ctf_enums = hash[2];
+	fp->ctf_names = hash[3];
+
+	ctf_dprintf("CTF container %p: %lu types indexed\n",
+	    (void *)fp, fp->ctf_typemax);
+
+	return (0);
+}
+
 /*
  * Decode the specified CTF buffer and optional symbol table and create a new
  * CTF container representing the symbolic debugging information.  This code
@@ -761,7 +870,18 @@ ctf_bufopen(const ctf_sect_t *ctfsect, const ctf_sect_t *symsect,
 	}
 #endif
 
-	if ((err = init_types(fp, &hp)) != 0) {
+	/*
+	 * If the container carries a type index, use it in place of scanning
+	 * the type section.  An index that fails to validate is ignored, as
+	 * the type section itself is always complete.
+	 */
+	if ((hp.cth_flags & (CTF_F_COMPRESS | CTF_F_INDEX)) == CTF_F_INDEX &&
+	    init_index(fp, &hp) == 0)
+		err = 0;
+	else
+		err = init_types(fp, &hp);
+
+	if (err != 0) {
 		(void) ctf_set_open_errno(errp, err);
 		goto bad;
 	}
@@ -959,20 +1079,25 @@ ctf_close(ctf_file_t *fp)
 	if (fp->ctf_sxlate != NULL)
 		ctf_free(fp->ctf_sxlate, sizeof (uint_t) * fp->ctf_nsyms);
 
-	if (fp->ctf_txlate != NULL) {
-		ctf_free(fp->ctf_txlate,
-		    sizeof (uint_t) * (fp->ctf_typemax + 1));
-	}
+	/*
+	 * The type tables of an indexed container belong to its CTF data.
+	 */
+	if (!(fp->ctf_flags & LCTF_INDEX)) {
+		if (fp->ctf_txlate != NULL) {
+			ctf_free(fp->ctf_txlate,
+			    sizeof (uint_t) * (fp->ctf_typemax + 1));
+		}
 
-	if (fp->ctf_ptrtab != NULL) {
-		ctf_free(fp->ctf_ptrtab,
-		    sizeof (ushort_t) * (fp->ctf_typemax + 1));
-	}
+		if (fp->ctf_ptrtab != NULL) {
+			ctf_free(fp->ctf_ptrtab,
+			    sizeof (ushort_t) * (fp->ctf_typemax + 1));
+		}
 
-	ctf_hash_destroy(&fp->ctf_structs);
-	ctf_hash_destroy(&fp->ctf_unions);
-	ctf_hash_destroy(&fp->ctf_enums);
-	ctf_hash_destroy(&fp->ctf_names);
+		ctf_hash_destroy(&fp->ctf_structs);
+		ctf_hash_destroy(&fp->ctf_unions);
+		ctf_hash_destroy(&fp->ctf_enums);
+		ctf_hash_destroy(&fp->ctf_names);
+	}
 
 	ctf_free(fp, sizeof (ctf_file_t));
 }
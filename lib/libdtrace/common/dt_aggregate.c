@@ -46,7 +46,14 @@
 #endif
 #include <limits.h>
 
-#define	DTRACE_AHASHSIZE	32779		/* big 'ol prime */
+#define	DTRACE_AHASHSIZE	4096		/* initial size; power of 2 */
+#define	DTRACE_AHASHLOAD	2		/* max. mean chain length */
+#define	DTRACE_AHASHSTEP	8		/* buckets moved per record */
+
+#define	DT_AHASH_SEED		0x9e3779b97f4a7c15ULL
+#define	DT_AHASH_MUL1		0x87c37b91114253d5ULL
+#define	DT_AHASH_MUL2		0x4cf5ad432745937fULL
+#define	DT_AHASH_ROTL(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
 
 /*
  * Because qsort(3C) does not allow an argument to be passed to a comparison
@@ -62,6 +69,20 @@ static int dt_keypos;
 #define	DT_LESSTHAN	(dt_revsort == 0 ? -1 : 1)
 #define	DT_GREATERTHAN	(dt_revsort == 0 ? 1 : -1)
 
+/*
+ * Large aggregations may optionally be sorted by multiple threads (see
+ * dt_aggregate_sort(), below); we only bother when each thread will have at
+ * least this many entries to sort.
+ */
+#define	DTRACE_AGGSORT_MINPER	16384
+#define	DTRACE_AGGSORT_MAXTHR	64
+
+typedef int (
+#ifdef _MSC_VER
+	__cdecl
+#endif
+	*dt_aggcmp_f)(const void *, const void *);
+
 static void
 dt_aggregate_count(int64_t *existing, int64_t *new, size_t size)
 {
@@ -451,24 +472,151 @@ dt_aggregate_aggvarid(dt_ahashent_t *ent)
 	return (agg->dtagd_varid);
 }
 
+/*
+ * Aggregation keys are frequently made up of nearly identical records (user
+ * stacks that share all but a frame or two, thread IDs that differ in their
+ * low bits), so a hash that merely sums the bytes of the key collapses them
+ * onto a handful of chains.  We instead mix the key a word at a time in the
+ * style of MurmurHash3, and finalize with its 64-bit avalanche function.
+ */
+static uint64_t
+dt_aggregate_hashbytes(uint64_t hashval, const char *addr, size_t size)
+{
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i + sizeof (uint64_t) <= size; i += sizeof (uint64_t)) {
+		bcopy(addr + i, &word, sizeof (uint64_t));
+		word *= DT_AHASH_MUL1;
+		word = DT_AHASH_ROTL(word, 31);
+		word *= DT_AHASH_MUL2;
+
+		hashval ^= word;
+		hashval = DT_AHASH_ROTL(hashval, 27) * 5 + 0x52dce729;
+	}
+
+	if (i < size) {
+		word = 0;
+		bcopy(addr + i, &word, size - i);
+		word *= DT_AHASH_MUL1;
+		word = DT_AHASH_ROTL(word, 31);
+		word *= DT_AHASH_MUL2;
+		hashval ^= word;
+	}
+
+	return (hashval ^ size);
+}
+
+static uint64_t
+dt_aggregate_hashfinal(uint64_t hashval)
+{
+	hashval ^= hashval >> 33;
+	hashval *= 0xff51afd7ed558ccdULL;
+	hashval ^= hashval >> 33;
+	hashval *= 0xc4ceb9fe1a85ec53ULL;
+	hashval ^= hashval >> 33;
+
+	return (hashval);
+}
+
+/*
+ * The aggregate hash table is grown by doubling whenever its load exceeds
+ * DTRACE_AHASHLOAD.  To keep any one snapshot from paying for rehashing the
+ * entire table, the old table is retained and its buckets are migrated to
+ * the new table DTRACE_AHASHSTEP at a time as records are processed.  Old
+ * buckets are migrated in index order, so an entry lives in the old table if
+ * and only if its old bucket index has not yet been reached.
+ */
+static dt_ahashent_t **
+dt_ahash_bucket(dt_ahash_t *hash, uint64_t hashval)
+{
+	if (hash->dtah_oldhash != NULL) {
+		size_t ndx = hashval & (hash->dtah_oldsize - 1);
+
+		if (ndx >= hash->dtah_rehash)
+			return (&hash->dtah_oldhash[ndx]);
+	}
+
+	return (&hash->dtah_hash[hashval & (hash->dtah_size - 1)]);
+}
+
+static void
+dt_ahash_rehash(dt_ahash_t *hash, size_t nbuckets)
+{
+	dt_ahashent_t *h, *next, **bucket;
+
+	if (hash->dtah_oldhash == NULL)
+		return;
+
+	while (nbuckets-- > 0 && hash->dtah_rehash < hash->dtah_oldsize) {
+		h = hash->dtah_oldhash[hash->dtah_rehash];
+
+		for (; h != NULL; h = next) {
+			next = h->dtahe_next;
+			bucket = &hash->dtah_hash[h->dtahe_hashval &
+			    (hash->dtah_size - 1)];
+
+			if (*bucket != NULL)
+				(*bucket)->dtahe_prev = h;
+
+			h->dtahe_prev = NULL;
+			h->dtahe_next = *bucket;
+			*bucket = h;
+		}
+
+		hash->dtah_oldhash[hash->dtah_rehash++] = NULL;
+	}
+
+	if (hash->dtah_rehash == hash->dtah_oldsize) {
+		free(hash->dtah_oldhash);
+		hash->dtah_oldhash = NULL;
+		hash->dtah_oldsize = 0;
+		hash->dtah_rehash = 0;
+	}
+}
+
+static void
+dt_ahash_grow(dt_ahash_t *hash)
+{
+	size_t size = hash->dtah_size << 1;
+	dt_ahashent_t **table;
+
+	if (hash->dtah_oldhash != NULL)
+		return;
+
+	/*
+	 * If we can't allocate a larger table, we'll simply continue with
+	 * longer chains; we'll try again on the next insertion.
+	 */
+	if ((table = calloc(size, sizeof (dt_ahashent_t *))) == NULL)
+		return;
+
+	hash->dtah_oldhash = hash->dtah_hash;
+	hash->dtah_oldsize = hash->dtah_size;
+	hash->dtah_rehash = 0;
+	hash->dtah_hash = table;
+	hash->dtah_size = size;
+}
 
 static int
 dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 {
 	dtrace_epid_t id;
 	uint64_t hashval;
-	size_t offs, roffs, size, ndx;
+	size_t offs, roffs, size;
 	int i, j, rval;
 	caddr_t addr, data;
 	dtrace_recdesc_t *rec;
 	dt_aggregate_t *agp = &dtp->dt_aggregate;
 	dtrace_aggdesc_t *agg;
 	dt_ahash_t *hash = &agp->dtat_hash;
-	dt_ahashent_t *h;
+	dt_ahashent_t *h, **bucket;
 	dtrace_bufdesc_t b = agp->dtat_buf, *buf = &b;
 	dtrace_aggdata_t *aggdata;
 	int flags = agp->dtat_flags;
 
+again:
+	b = agp->dtat_buf;
 	buf->dtbd_cpu = cpu;
 
 #if defined(illumos) || defined(_WIN32)
@@ -530,7 +678,7 @@ dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 
 		addr = buf->dtbd_data + offs;
 		size = agg->dtagd_size;
-		hashval = 0;
+		hashval = DT_AHASH_SEED;
 
 		for (j = 0; j < agg->dtagd_nrecs - 1; j++) {
 			rec = &agg->dtagd_rec[j];
@@ -563,13 +711,15 @@ dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 				break;
 			}
 
-			for (i = 0; i < rec->dtrd_size; i++)
-				hashval += addr[roffs + i];
+			hashval = dt_aggregate_hashbytes(hashval,
+			    &addr[roffs], rec->dtrd_size);
 		}
 
-		ndx = hashval % hash->dtah_size;
+		hashval = dt_aggregate_hashfinal(hashval);
+		dt_ahash_rehash(hash, DTRACE_AHASHSTEP);
+		bucket = dt_ahash_bucket(hash, hashval);
 
-		for (h = hash->dtah_hash[ndx]; h != NULL; h = h->dtahe_next) {
+		for (h = *bucket; h != NULL; h = h->dtahe_next) {
 			if (h->dtahe_hashval != hashval)
 				continue;
 
@@ -706,21 +856,34 @@ hashnext:
 			return (dt_set_errno(dtp, EDT_BADAGG));
 		}
 
-		if (hash->dtah_hash[ndx] != NULL)
-			hash->dtah_hash[ndx]->dtahe_prev = h;
+		if (*bucket != NULL)
+			(*bucket)->dtahe_prev = h;
 
-		h->dtahe_next = hash->dtah_hash[ndx];
-		hash->dtah_hash[ndx] = h;
+		h->dtahe_next = *bucket;
+		*bucket = h;
 
 		if (hash->dtah_all != NULL)
 			hash->dtah_all->dtahe_prevall = h;
 
 		h->dtahe_nextall = hash->dtah_all;
 		hash->dtah_all = h;
+
+		if (++hash->dtah_nelems > hash->dtah_size * DTRACE_AHASHLOAD)
+			dt_ahash_grow(hash);
 bufnext:
 		offs += agg->dtagd_size;
 	}
 
+	/*
+	 * If the kernel handed us a generation that it spilled when its
+	 * aggregation buffer filled, there is more to be had on this CPU:
+	 * the data aggregated since the spill.  Having merged the spilled
+	 * generation, we go back for it now -- both so that a snapshot is
+	 * complete and so that the kernel has somewhere to spill again.
+	 */
+	if (buf->dtbd_flags & DTRACEBD_SPILLED)
+		goto again;
+
 	return (0);
 }
 
@@ -1247,10 +1410,11 @@ dt_aggwalk_rval(dtrace_hdl_t *dtp, dt_ahashent_t *h, int rval)
 			h->dtahe_prev->dtahe_next = h->dtahe_next;
 		} else {
 			dt_ahash_t *hash = &agp->dtat_hash;
-			size_t ndx = h->dtahe_hashval % hash->dtah_size;
+			dt_ahashent_t **bucket;
 
-			assert(hash->dtah_hash[ndx] == h);
-			hash->dtah_hash[ndx] = h->dtahe_next;
+			bucket = dt_ahash_bucket(hash, h->dtahe_hashval);
+			assert(*bucket == h);
+			*bucket = h->dtahe_next;
 		}
 
 		if (h->dtahe_next != NULL)
@@ -1271,6 +1435,8 @@ dt_aggwalk_rval(dtrace_hdl_t *dtp, dt_ahashent_t *h, int rval)
 		if (h->dtahe_nextall != NULL)
 			h->dtahe_nextall->dtahe_prevall = h->dtahe_prevall;
 
+		agp->dtat_hash.dtah_nelems--;
+
 		/*
 		 * We're unlinked.  We can safely destroy the data.
 		 */
@@ -1293,6 +1459,190 @@ dt_aggwalk_rval(dtrace_hdl_t *dtp, dt_ahashent_t *h, int rval)
 	return (0);
 }
 
+/*
+ * Parallel sorting.  When the "aggsortthreads" option is set and there are
+ * enough entries to make it worthwhile, the array is divided into one run per
+ * thread; each run is sorted with qsort(3C), and adjacent runs are then merged
+ * pairwise (again in parallel) until a single run remains.  The merge is
+ * stable, and every comparison function used to order aggregations imposes a
+ * total order on distinct entries, so the result is identical to that of
+ * sorting the whole array with qsort(3C).  The comparison functions consult
+ * the dt_revsort, dt_keysort and dt_keypos globals:  the caller must hold
+ * dt_qsort_lock across the sort, and the worker threads only read them.
+ */
+typedef struct dt_aggsort {
+	char *dtas_src;			/* source array */
+	char *dtas_dst;			/* destination array (merge only) */
+	size_t dtas_lo;			/* start of first run */
+	size_t dtas_mid;		/* start of second run (merge only) */
+	size_t dtas_hi;			/* end of last run */
+	size_t dtas_width;		/* size of each element */
+	dt_aggcmp_f dtas_cmp;		/* comparison function */
+} dt_aggsort_t;
+
+#ifdef _WIN32
+static DWORD WINAPI
+#else
+static void *
+#endif
+dt_aggregate_sort_run(void *arg)
+{
+	dt_aggsort_t *as = arg;
+
+	qsort(as->dtas_src + as->dtas_lo * as->dtas_width,
+	    as->dtas_hi - as->dtas_lo, as->dtas_width, as->dtas_cmp);
+
+	return (0);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI
+#else
+static void *
+#endif
+dt_aggregate_sort_merge(void *arg)
+{
+	dt_aggsort_t *as = arg;
+	size_t width = as->dtas_width;
+	char *l = as->dtas_src + as->dtas_lo * width;
+	char *lend = as->dtas_src + as->dtas_mid * width;
+	char *r = lend;
+	char *rend = as->dtas_src + as->dtas_hi * width;
+	char *dst = as->dtas_dst + as->dtas_lo * width;
+
+	while (l < lend && r < rend) {
+		if (as->dtas_cmp(l, r) <= 0) {
+			bcopy(l, dst, width);
+			l += width;
+		} else {
+			bcopy(r, dst, width);
+			r += width;
+		}
+
+		dst += width;
+	}
+
+	if (l < lend)
+		bcopy(l, dst, lend - l);
+
+	if (r < rend)
+		bcopy(r, dst + (lend - l), rend - r);
+
+	return (0);
+}
+
+/*
+ * Runs the specified function over each of the ntasks tasks, one thread per
+ * task; any task for which a thread cannot be created is run in the calling
+ * thread.
+ */
+static void
+dt_aggregate_sort_tasks(dt_aggsort_t *tasks, pthread_t *tids, int ntasks,
+    dt_thread_f *func)
+{
+	int i, started[DTRACE_AGGSORT_MAXTHR];
+
+	for (i = 0; i < ntasks; i++) {
+		started[i] = (i != 0 &&
+		    dt_thread_create(&tids[i], func, &tasks[i]) == 0);
+	}
+
+	(void) func(&tasks[0]);
+
+	for (i = 1; i < ntasks; i++) {
+		if (started[i])
+			dt_thread_join(tids[i]);
+		else
+			(void) func(&tasks[i]);
+	}
+}
+
+static void
+dt_aggregate_sort(dtrace_hdl_t *dtp, void *base, size_t nel, size_t width,
+    dt_aggcmp_f compar)
+{
+	dtrace_optval_t nthreads = dtp->dt_options[DTRACEOPT_AGGSORTTHREADS];
+	size_t bounds[DTRACE_AGGSORT_MAXTHR + 1];
+	size_t nbounds[DTRACE_AGGSORT_MAXTHR + 1];
+	dt_aggsort_t tasks[DTRACE_AGGSORT_MAXTHR];
+	pthread_t tids[DTRACE_AGGSORT_MAXTHR];
+	char *src = base, *dst, *tmp;
+	int i, nruns, ntasks;
+
+	if (nthreads == DTRACEOPT_UNSET || nthreads <= 1)
+		nthreads = 1;
+
+	if (nthreads > DTRACE_AGGSORT_MAXTHR)
+		nthreads = DTRACE_AGGSORT_MAXTHR;
+
+	if ((size_t)nthreads > nel / DTRACE_AGGSORT_MINPER)
+		nthreads = nel / DTRACE_AGGSORT_MINPER;
+
+	if (nthreads <= 1 || (tmp = malloc(nel * width)) == NULL) {
+		qsort(base, nel, width, compar);
+		return;
+	}
+
+	nruns = (int)nthreads;
+
+	for (i = 0; i <= nruns; i++)
+		bounds[i] = (nel * i) / nruns;
+
+	for (i = 0; i < nruns; i++) {
+		tasks[i].dtas_src = src;
+		tasks[i].dtas_lo = bounds[i];
+		tasks[i].dtas_hi = bounds[i + 1];
+		tasks[i].dtas_width = width;
+		tasks[i].dtas_cmp = compar;
+	}
+
+	dt_aggregate_sort_tasks(tasks, tids, nruns, dt_aggregate_sort_run);
+
+	dst = tmp;
+
+	while (nruns > 1) {
+		ntasks = 0;
+
+		for (i = 0; i + 1 < nruns; i += 2) {
+			tasks[ntasks].dtas_src = src;
+			tasks[ntasks].dtas_dst = dst;
+			tasks[ntasks].dtas_lo = bounds[i];
+			tasks[ntasks].dtas_mid = bounds[i + 1];
+			tasks[ntasks].dtas_hi = bounds[i + 2];
+			tasks[ntasks].dtas_width = width;
+			tasks[ntasks].dtas_cmp = compar;
+			nbounds[ntasks++] = bounds[i];
+		}
+
+		/*
+		 * With an odd number of runs, the last run has no partner at
+		 * this level; it is simply carried over to the destination.
+		 */
+		if (i < nruns) {
+			bcopy(src + bounds[i] * width, dst + bounds[i] * width,
+			    (bounds[i + 1] - bounds[i]) * width);
+			nbounds[ntasks] = bounds[i];
+			nruns = ntasks + 1;
+		} else {
+			nruns = ntasks;
+		}
+
+		nbounds[nruns] = nel;
+		bcopy(nbounds, bounds, (nruns + 1) * sizeof (size_t));
+
+		dt_aggregate_sort_tasks(tasks, tids, ntasks,
+		    dt_aggregate_sort_merge);
+
+		dst = src;
+		src = (src == base) ? tmp : base;
+	}
+
+	if (src != base)
+		bcopy(src, base, nel * width);
+
+	free(tmp);
+}
+
 void
 dt_aggregate_qsort(dtrace_hdl_t *dtp, void *base, size_t nel, size_t width,
     int (
@@ -1321,7 +1671,7 @@ dt_aggregate_qsort(dtrace_hdl_t *dtp, void *base, size_t nel, size_t width,
 		}
 	}
 
-	qsort(base, nel, width, compar);
+	dt_aggregate_sort(dtp, base, nel, width, compar);
 
 	dt_revsort = rev;
 	dt_keysort = key;
@@ -1627,7 +1977,8 @@ __cdecl
 		 * we'll use that -- ignoring the values of the "aggsortrev",
 		 * "aggsortkey" and "aggsortkeypos" options.
 		 */
-		qsort(sorted, nentries, sizeof (dt_ahashent_t *), sfunc);
+		dt_aggregate_sort(dtp, sorted, nentries,
+		    sizeof (dt_ahashent_t *), sfunc);
 	}
 
 	(void) pthread_mutex_unlock(&dt_qsort_lock);
@@ -1722,6 +2073,172 @@ dtrace_aggregate_walk_valvarrevsorted(dtrace_hdl_t *dtp,
 	    arg, dt_aggregate_valvarrevcmp));
 }
 
+typedef struct dt_trunc {
+	dtrace_aggvarid_t dttd_id;
+	uint64_t dttd_remaining;
+} dt_trunc_t;
+
+static int
+dt_trunc_agg(const dtrace_aggdata_t *aggdata, void *arg)
+{
+	dt_trunc_t *trunc = arg;
+	dtrace_aggdesc_t *agg = aggdata->dtada_desc;
+	dtrace_aggvarid_t id = trunc->dttd_id;
+
+	if (agg->dtagd_nrecs == 0)
+		return (DTRACE_AGGWALK_NEXT);
+
+	if (agg->dtagd_varid != id)
+		return (DTRACE_AGGWALK_NEXT);
+
+	if (trunc->dttd_remaining == 0)
+		return (DTRACE_AGGWALK_REMOVE);
+
+	trunc->dttd_remaining--;
+	return (DTRACE_AGGWALK_NEXT);
+}
+
+static int
+dt_aggregate_trunc_sorted(dtrace_hdl_t *dtp, dtrace_aggvarid_t id,
+    uint64_t n, boolean_t top)
+{
+	dt_trunc_t trunc;
+
+	trunc.dttd_id = id;
+	trunc.dttd_remaining = n;
+
+	return (dt_aggregate_walk_sorted(dtp, dt_trunc_agg, &trunc,
+	    top ? dt_aggregate_varvalrevcmp : dt_aggregate_varvalcmp));
+}
+
+/*
+ * Truncation to the top (or bottom) N entries.  trunc() with a small N on an
+ * aggregation with many entries is common ("show me the top 20 stacks"); the
+ * obvious implementation -- a walk sorted by value that removes every entry
+ * past the Nth -- sorts the entire aggregation only to discard nearly all of
+ * it.  Instead, we select the N entries to be retained with a bounded heap
+ * whose head is the worst retained entry, making the selection O(n log N).
+ * The retained entries are then sorted, and every other entry for the
+ * aggregation variable is removed after a binary search for it among them.
+ * The entries retained are precisely those that the sorted walk would have
+ * retained, as the comparison functions impose a total order.
+ */
+static int
+dt_aggregate_trunc_match(dt_ahashent_t *h, dtrace_aggvarid_t id)
+{
+	dtrace_aggdesc_t *agg = h->dtahe_data.dtada_desc;
+
+	return (agg->dtagd_nrecs != 0 && agg->dtagd_varid == id);
+}
+
+static int
+dt_aggregate_trunc_cmp(void *lhs, void *rhs, void *arg)
+{
+	dt_aggcmp_f *cmp = arg;
+
+	/*
+	 * The head of the heap must be the entry that sorts last, so we
+	 * reverse the sense of the comparison.
+	 */
+	return ((*cmp)(&rhs, &lhs));
+}
+
+int
+dt_aggregate_trunc(dtrace_hdl_t *dtp, dtrace_aggvarid_t id, uint64_t n,
+    boolean_t top)
+{
+	dt_ahash_t *hash = &dtp->dt_aggregate.dtat_hash;
+	dt_ahashent_t *h, *next, **kept = NULL;
+	dt_aggcmp_f cmp;
+	dt_pq_t *pq = NULL;
+	uint64_t nentries = 0;
+	uint_t i, cookie = 0;
+	int rval = 0;
+
+	cmp = top ? dt_aggregate_varvalrevcmp : dt_aggregate_varvalcmp;
+
+	for (h = hash->dtah_all; h != NULL; h = h->dtahe_nextall) {
+		if (dt_aggregate_trunc_match(h, id))
+			nentries++;
+	}
+
+	if (nentries <= n)
+		return (0);
+
+	if (n != 0) {
+		if (n >= UINT_MAX ||
+		    (pq = dt_pq_init_cmp(dtp, (uint_t)n + 1,
+		    dt_aggregate_trunc_cmp, &cmp)) == NULL ||
+		    (kept = dt_alloc(dtp, n * sizeof (dt_ahashent_t *))) == NULL)
+			goto err;
+	}
+
+	/*
+	 * As with sorting, the comparison functions depend on global state
+	 * and we must therefore hold dt_qsort_lock for the duration.
+	 */
+	(void) pthread_mutex_lock(&dt_qsort_lock);
+
+	if (n != 0) {
+		for (h = hash->dtah_all; h != NULL; h = h->dtahe_nextall) {
+			dt_ahashent_t *worst;
+
+			if (!dt_aggregate_trunc_match(h, id))
+				continue;
+
+			if (dt_pq_count(pq) < n) {
+				dt_pq_insert(pq, h);
+				continue;
+			}
+
+			worst = dt_pq_peek(pq);
+
+			if (cmp(&h, &worst) < 0)
+				(void) dt_pq_replace(pq, h);
+		}
+
+		for (i = 0; (h = dt_pq_walk(pq, &cookie)) != NULL; i++)
+			kept[i] = h;
+
+		assert(i == n);
+		qsort(kept, (size_t)n, sizeof (dt_ahashent_t *), cmp);
+	}
+
+	for (h = hash->dtah_all; h != NULL; h = next) {
+		next = h->dtahe_nextall;
+
+		if (!dt_aggregate_trunc_match(h, id))
+			continue;
+
+		if (n != 0 && bsearch(&h, kept, (size_t)n,
+		    sizeof (dt_ahashent_t *), cmp) != NULL)
+			continue;
+
+		if ((rval = dt_aggwalk_rval(dtp, h,
+		    DTRACE_AGGWALK_REMOVE)) != 0)
+			break;
+	}
+
+	(void) pthread_mutex_unlock(&dt_qsort_lock);
+
+	if (pq != NULL) {
+		dt_free(dtp, kept);
+		dt_pq_fini(pq);
+	}
+
+	return (rval);
+
+err:
+	/*
+	 * If we can't allocate what we need for the heap, we fall back to
+	 * removing everything past the Nth entry of a sorted walk.
+	 */
+	if (pq != NULL)
+		dt_pq_fini(pq);
+
+	return (dt_aggregate_trunc_sorted(dtp, id, n, top));
+}
+
 int
 dtrace_aggregate_walk_joined(dtrace_hdl_t *dtp, dtrace_aggvarid_t *aggvars,
     int naggvars, dtrace_aggregate_walk_joined_f *func, void *arg)
@@ -2033,7 +2550,7 @@ dtrace_aggregate_walk_joined(dtrace_hdl_t *dtp, dtrace_aggvarid_t *aggvars,
 	 */
 	(void) pthread_mutex_lock(&dt_qsort_lock);
 
-	qsort(sorted, nentries, sizeof (dt_ahashent_t *),
+	dt_aggregate_sort(dtp, sorted, nentries, sizeof (dt_ahashent_t *),
 	    dt_aggregate_keyvarcmp);
 
 	/*
@@ -2180,8 +2697,15 @@ dtrace_aggregate_print(dtrace_hdl_t *dtp, FILE *fp,
 	if (func == NULL)
 		func = dtrace_aggregate_walk_sorted;
 
-	if ((*func)(dtp, dt_print_agg, &pd) == -1)
+	dt_obuf_enter(dtp);
+
+	if ((*func)(dtp, dt_print_agg, &pd) == -1) {
+		(void) dt_obuf_exit(dtp);
 		return (dt_set_errno(dtp, dtp->dt_errno));
+	}
+
+	if (dt_obuf_exit(dtp) != 0)
+		return (dt_set_errno(dtp, errno));
 
 	return (0);
 }
@@ -2225,6 +2749,7 @@ dt_aggregate_destroy(dtrace_hdl_t *dtp)
 		assert(hash->dtah_all == NULL);
 	} else {
 		free(hash->dtah_hash);
+		free(hash->dtah_oldhash);
 
 		for (h = hash->dtah_all; h != NULL; h = next) {
 			next = h->dtahe_nextall;
@@ -2244,6 +2769,10 @@ dt_aggregate_destroy(dtrace_hdl_t *dtp)
 		hash->dtah_hash = NULL;
 		hash->dtah_all = NULL;
 		hash->dtah_size = 0;
+		hash->dtah_nelems = 0;
+		hash->dtah_oldhash = NULL;
+		hash->dtah_oldsize = 0;
+		hash->dtah_rehash = 0;
 	}
 
 	free(agp->dtat_buf.dtbd_data);
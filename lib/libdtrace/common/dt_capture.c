@@ -0,0 +1,647 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * DTrace Captures
+ *
+ * A capture records the principal buffer data retrieved by dtrace_consume()
+ * in its raw form, along with the enabled probe descriptions and strings
+ * needed to decode it, so that trace data may be stored cheaply and decoded
+ * later -- possibly on another system, and without the DTrace driver.  The
+ * writer hangs off of the DTrace handle; the reader (dtrace_capture_open()
+ * and friends) is entirely independent of it.  The format itself is
+ * described in <dt_capture.h>.
+ */
+
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <dt_impl.h>
+#include <dt_printf.h>
+#include <dt_capture.h>
+
+typedef struct dt_capprobe {
+	dtrace_probedesc_t *dtcp_pdesc;	/* probe description */
+	dtrace_eprobedesc_t *dtcp_edesc; /* enabled probe description */
+} dt_capprobe_t;
+
+struct dtrace_capture {
+	FILE *dtc_fp;			/* capture stream */
+	int dtc_errno;			/* last error */
+	char *dtc_buf;			/* payload of current buffer frame */
+	uint64_t dtc_bufsize;		/* size of dtc_buf */
+	dt_capprobe_t *dtc_probes;	/* probe descriptions, by EPID */
+	uint_t dtc_maxepid;		/* size of dtc_probes */
+	char **dtc_formats;		/* format strings, by format ID */
+	uint_t dtc_maxformat;		/* size of format array */
+	char **dtc_strdata;		/* string data, by strdata ID */
+	uint_t dtc_maxstrdata;		/* size of strdata array */
+};
+
+static int
+dt_capture_write(dtrace_hdl_t *dtp, uint32_t type, uint32_t id, uint64_t arg,
+    const void *p0, size_t s0, const void *p1, size_t s1)
+{
+	dt_capframe_t frame;
+	FILE *fp = dtp->dt_capfp;
+
+	frame.dtcf_type = type;
+	frame.dtcf_id = id;
+	frame.dtcf_size = s0 + s1;
+	frame.dtcf_arg = arg;
+
+	if (fwrite(&frame, sizeof (frame), 1, fp) != 1 ||
+	    (s0 != 0 && fwrite(p0, s0, 1, fp) != 1) ||
+	    (s1 != 0 && fwrite(p1, s1, 1, fp) != 1))
+		return (dt_set_errno(dtp, errno));
+
+	return (0);
+}
+
+/*
+ * Marks the specified ID as having been described in the capture.  Returns 1
+ * if it had not been described before, 0 if it had, and -1 on failure.
+ */
+static int
+dt_capture_mark(dtrace_hdl_t *dtp, dt_capmap_t *map, uint_t id)
+{
+	if (id >= DT_CAP_MAXID)
+		return (dt_set_errno(dtp, EOVERFLOW));
+
+	if (id >= map->dtcm_size) {
+		uint_t nsize = map->dtcm_size != 0 ? map->dtcm_size : 64;
+		uchar_t *nmap;
+
+		while (nsize <= id)
+			nsize <<= 1;
+
+		if ((nmap = dt_zalloc(dtp, nsize)) == NULL)
+			return (-1);
+
+		if (map->dtcm_map != NULL)
+			bcopy(map->dtcm_map, nmap, map->dtcm_size);
+
+		dt_free(dtp, map->dtcm_map);
+		map->dtcm_map = nmap;
+		map->dtcm_size = nsize;
+	}
+
+	if (map->dtcm_map[id])
+		return (0);
+
+	map->dtcm_map[id] = 1;
+	return (1);
+}
+
+static int
+dt_capture_string(dtrace_hdl_t *dtp, dt_capmap_t *map, uint32_t type,
+    uint_t id, uint64_t arg, const char *str)
+{
+	int rval;
+
+	if (str == NULL || (rval = dt_capture_mark(dtp, map, id)) == 0)
+		return (0);
+
+	if (rval == -1)
+		return (-1);
+
+	return (dt_capture_write(dtp, type, id, arg, str, strlen(str) + 1,
+	    NULL, 0));
+}
+
+static int
+dt_capture_eprobe(dtrace_hdl_t *dtp, dtrace_epid_t epid,
+    const dtrace_eprobedesc_t *epd, const dtrace_probedesc_t *pd)
+{
+	int i, rval;
+
+	if ((rval = dt_capture_mark(dtp, &dtp->dt_capepids, epid)) != 1)
+		return (rval);
+
+	if (dt_capture_write(dtp, DT_CAP_EPROBE, epid, 0, pd, sizeof (*pd),
+	    epd, DTRACE_SIZEOF_EPROBEDESC(epd)) != 0)
+		return (-1);
+
+	for (i = 0; i < epd->dtepd_nrecs; i++) {
+		const dtrace_recdesc_t *rec = &epd->dtepd_rec[i];
+		dt_pfargv_t *pfv;
+
+		if (rec->dtrd_format == 0)
+			continue;
+
+		if (DTRACEACT_ISPRINTFLIKE(rec->dtrd_action)) {
+			pfv = dt_format_lookup(dtp, rec->dtrd_format);
+
+			if (dt_capture_string(dtp, &dtp->dt_capformats,
+			    DT_CAP_FORMAT, rec->dtrd_format, rec->dtrd_action,
+			    pfv != NULL ? pfv->pfv_format : NULL) != 0)
+				return (-1);
+		} else if (rec->dtrd_action == DTRACEACT_DIFEXPR) {
+			if (dt_capture_string(dtp, &dtp->dt_capstrdata,
+			    DT_CAP_STRDATA, rec->dtrd_format, 0,
+			    dt_strdata_lookup(dtp, rec->dtrd_format)) != 0)
+				return (-1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Writes a principal buffer snapshot to the capture, preceded by the
+ * descriptions of any enabled probes that have not yet been described.
+ */
+int
+dt_capture_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
+{
+	static const uint64_t filler = DTRACE_EPIDNONE;
+	dtrace_eprobedesc_t *epd;
+	dtrace_probedesc_t *pd;
+	dtrace_epid_t id;
+	size_t offs;
+
+	if (dtp->dt_capfp == NULL || buf->dtbd_oldest >= buf->dtbd_size)
+		return (0);
+
+	for (offs = buf->dtbd_oldest; offs < buf->dtbd_size; ) {
+		id = *(uint32_t *)((uintptr_t)buf->dtbd_data + offs);
+
+		if (id == DTRACE_EPIDNONE) {
+			offs += sizeof (id);
+			continue;
+		}
+
+		if (dt_epid_lookup(dtp, id, &epd, &pd) != 0 ||
+		    dt_capture_eprobe(dtp, id, epd, pd) != 0)
+			return (-1);
+
+		offs += epd->dtepd_size;
+	}
+
+	/*
+	 * If we are writing from a record that isn't 8-byte aligned, we
+	 * precede it with filler so that the record's data retains its
+	 * alignment with respect to the start of the frame.
+	 */
+	offs = buf->dtbd_oldest & (sizeof (uint64_t) - 1);
+
+	if (offs + buf->dtbd_size - buf->dtbd_oldest > DT_CAP_MAXFRAME)
+		return (dt_set_errno(dtp, EOVERFLOW));
+
+	return (dt_capture_write(dtp, DT_CAP_BUFFER, buf->dtbd_cpu,
+	    buf->dtbd_timestamp, &filler, offs,
+	    buf->dtbd_data + buf->dtbd_oldest,
+	    buf->dtbd_size - buf->dtbd_oldest));
+}
+
+static void
+dt_capture_reset(dtrace_hdl_t *dtp)
+{
+	dt_free(dtp, dtp->dt_capepids.dtcm_map);
+	dt_free(dtp, dtp->dt_capformats.dtcm_map);
+	dt_free(dtp, dtp->dt_capstrdata.dtcm_map);
+
+	bzero(&dtp->dt_capepids, sizeof (dt_capmap_t));
+	bzero(&dtp->dt_capformats, sizeof (dt_capmap_t));
+	bzero(&dtp->dt_capstrdata, sizeof (dt_capmap_t));
+}
+
+void
+dt_capture_destroy(dtrace_hdl_t *dtp)
+{
+	if (dtp->dt_capfp != NULL)
+		(void) fflush(dtp->dt_capfp);
+
+	dtp->dt_capfp = NULL;
+	dt_capture_reset(dtp);
+}
+
+/*
+ * Begins writing a capture of all subsequently consumed principal buffer
+ * data to the specified stream, which must have been opened in binary mode.
+ * Specifying a NULL stream flushes and ends the current capture, if any; the
+ * stream itself remains the caller's to close.
+ */
+int
+dtrace_capture(dtrace_hdl_t *dtp, FILE *fp)
+{
+	dt_caphdr_t hdr;
+
+	if (dtp->dt_capfp != NULL && fflush(dtp->dt_capfp) == EOF) {
+		int error = errno;
+
+		dt_capture_destroy(dtp);
+		return (dt_set_errno(dtp, error));
+	}
+
+	dt_capture_destroy(dtp);
+
+	if (fp == NULL)
+		return (0);
+
+	bzero(&hdr, sizeof (hdr));
+	hdr.dtch_magic = DT_CAP_MAGIC;
+	hdr.dtch_version = DT_CAP_VERSION;
+	hdr.dtch_model = sizeof (void *) * NBBY;
+
+	if (fwrite(&hdr, sizeof (hdr), 1, fp) != 1)
+		return (dt_set_errno(dtp, errno));
+
+	dtp->dt_capfp = fp;
+	return (0);
+}
+
+static int
+dt_capture_error(dtrace_capture_t *cap, int error)
+{
+	cap->dtc_errno = error;
+	return (-1);
+}
+
+/*
+ * Grows the specified array of elements of the specified size to hold at
+ * least id + 1 elements.
+ */
+static int
+dt_capture_grow(dtrace_capture_t *cap, void **arrayp, uint_t *maxp, uint_t id,
+    size_t size)
+{
+	uint_t nmax = *maxp != 0 ? *maxp : 64;
+	void *narray;
+
+	if (id < *maxp)
+		return (0);
+
+	if (id >= DT_CAP_MAXID)
+		return (dt_capture_error(cap, EDT_BADCAPTURE));
+
+	while (nmax <= id)
+		nmax <<= 1;
+
+	if ((narray = calloc(nmax, size)) == NULL)
+		return (dt_capture_error(cap, EDT_NOMEM));
+
+	if (*arrayp != NULL)
+		bcopy(*arrayp, narray, *maxp * size);
+
+	free(*arrayp);
+	*arrayp = narray;
+	*maxp = nmax;
+
+	return (0);
+}
+
+static int
+dt_capture_read(dtrace_capture_t *cap, void *buf, uint64_t size)
+{
+	if (size != 0 && fread(buf, size, 1, cap->dtc_fp) != 1) {
+		return (dt_capture_error(cap,
+		    ferror(cap->dtc_fp) ? EDT_FIO : EDT_BADCAPTURE));
+	}
+
+	return (0);
+}
+
+/*
+ * Reads the payload of the current frame into the capture's frame buffer.
+ * The payload is read (and the buffer grown) in increments of DT_CAP_CHUNK,
+ * so a corrupt frame size cannot make us allocate much more memory than the
+ * capture actually contains.
+ */
+static int
+dt_capture_read_payload(dtrace_capture_t *cap, const dt_capframe_t *frame)
+{
+	uint64_t nsize, done, len;
+	char *nbuf;
+
+	if (frame->dtcf_size > DT_CAP_MAXFRAME ||
+	    frame->dtcf_size > SIZE_MAX)
+		return (dt_capture_error(cap, EDT_BADCAPTURE));
+
+	for (done = 0; done < frame->dtcf_size; done += len) {
+		len = MIN(frame->dtcf_size - done, DT_CAP_CHUNK);
+
+		if (done + len > cap->dtc_bufsize) {
+			nsize = cap->dtc_bufsize != 0 ?
+			    cap->dtc_bufsize : 4096;
+
+			while (nsize < done + len)
+				nsize <<= 1;
+
+			if ((nbuf = realloc(cap->dtc_buf, nsize)) == NULL)
+				return (dt_capture_error(cap, EDT_NOMEM));
+
+			cap->dtc_buf = nbuf;
+			cap->dtc_bufsize = nsize;
+		}
+
+		if (dt_capture_read(cap, cap->dtc_buf + done, len) != 0)
+			return (-1);
+	}
+
+	return (0);
+}
+
+static int
+dt_capture_read_eprobe(dtrace_capture_t *cap, const dt_capframe_t *frame)
+{
+	dtrace_probedesc_t *pd;
+	dtrace_eprobedesc_t *epd;
+	dt_capprobe_t *probe;
+	uint64_t size;
+	int i;
+
+	if (frame->dtcf_size < sizeof (*pd) + sizeof (*epd) ||
+	    frame->dtcf_id == DTRACE_EPIDNONE)
+		return (dt_capture_error(cap, EDT_BADCAPTURE));
+
+	if (dt_capture_read_payload(cap, frame) != 0)
+		return (-1);
+
+	size = frame->dtcf_size - sizeof (*pd);
+
+	if ((pd = malloc(sizeof (*pd))) == NULL)
+		return (dt_capture_error(cap, EDT_NOMEM));
+
+	if ((epd = malloc(size)) == NULL) {
+		free(pd);
+		return (dt_capture_error(cap, EDT_NOMEM));
+	}
+
+	bcopy(cap->dtc_buf, pd, sizeof (*pd));
+	bcopy(cap->dtc_buf + sizeof (*pd), epd, size);
+
+	if (DTRACE_SIZEOF_EPROBEDESC(epd) != size || epd->dtepd_size == 0) {
+		(void) dt_capture_error(cap, EDT_BADCAPTURE);
+		goto err;
+	}
+
+	for (i = 0; i < epd->dtepd_nrecs; i++) {
+		dtrace_recdesc_t *rec = &epd->dtepd_rec[i];
+
+		if (rec->dtrd_offset > epd->dtepd_size ||
+		    rec->dtrd_size > epd->dtepd_size - rec->dtrd_offset) {
+			(void) dt_capture_error(cap, EDT_BADCAPTURE);
+			goto err;
+		}
+	}
+
+	if (dt_capture_grow(cap, (void **)&cap->dtc_probes, &cap->dtc_maxepid,
+	    frame->dtcf_id, sizeof (dt_capprobe_t)) != 0)
+		goto err;
+
+	probe = &cap->dtc_probes[frame->dtcf_id];
+	free(probe->dtcp_pdesc);
+	free(probe->dtcp_edesc);
+	probe->dtcp_pdesc = pd;
+	probe->dtcp_edesc = epd;
+
+	return (0);
+
+err:
+	free(pd);
+	free(epd);
+	return (-1);
+}
+
+static int
+dt_capture_read_string(dtrace_capture_t *cap, const dt_capframe_t *frame,
+    char ***arrayp, uint_t *maxp)
+{
+	uint_t id = frame->dtcf_id;
+	char *str;
+
+	if (frame->dtcf_size == 0)
+		return (dt_capture_error(cap, EDT_BADCAPTURE));
+
+	if (dt_capture_read_payload(cap, frame) != 0)
+		return (-1);
+
+	if (cap->dtc_buf[frame->dtcf_size - 1] != '\0')
+		return (dt_capture_error(cap, EDT_BADCAPTURE));
+
+	if ((str = strdup(cap->dtc_buf)) == NULL)
+		return (dt_capture_error(cap, EDT_NOMEM));
+
+	if (dt_capture_grow(cap, (void **)arrayp, maxp, id,
+	    sizeof (char *)) != 0) {
+		free(str);
+		return (-1);
+	}
+
+	free((*arrayp)[id]);
+	(*arrayp)[id] = str;
+
+	return (0);
+}
+
+static int
+dt_capture_read_buf(dtrace_capture_t *cap, const dt_capframe_t *frame,
+    dtrace_capture_f *func, void *arg)
+{
+	dtrace_capdata_t data;
+	dt_capprobe_t *probe;
+	dtrace_epid_t id;
+	uint64_t offs;
+
+	if (dt_capture_read_payload(cap, frame) != 0)
+		return (-1);
+
+	bzero(&data, sizeof (data));
+	data.dtcd_cpu = frame->dtcf_id;
+	data.dtcd_timestamp = frame->dtcf_arg;
+
+	for (offs = 0; offs < frame->dtcf_size; ) {
+		if (frame->dtcf_size - offs < sizeof (id))
+			return (dt_capture_error(cap, EDT_BADCAPTURE));
+
+		id = *(uint32_t *)((uintptr_t)cap->dtc_buf + offs);
+
+		if (id == DTRACE_EPIDNONE) {
+			offs += sizeof (id);
+			continue;
+		}
+
+		if (id >= cap->dtc_maxepid ||
+		    (probe = &cap->dtc_probes[id])->dtcp_edesc == NULL ||
+		    frame->dtcf_size - offs < probe->dtcp_edesc->dtepd_size)
+			return (dt_capture_error(cap, EDT_BADCAPTURE));
+
+		data.dtcd_epid = id;
+		data.dtcd_pdesc = probe->dtcp_pdesc;
+		data.dtcd_edesc = probe->dtcp_edesc;
+		data.dtcd_data = cap->dtc_buf + offs;
+
+		switch (func(&data, arg)) {
+		case DTRACE_CONSUME_NEXT:
+			break;
+		case DTRACE_CONSUME_ABORT:
+			return (dt_capture_error(cap, EDT_DIRABORT));
+		default:
+			return (dt_capture_error(cap, EDT_BADRVAL));
+		}
+
+		offs += probe->dtcp_edesc->dtepd_size;
+	}
+
+	return (0);
+}
+
+/*
+ * Opens a capture for reading from the specified stream, which must have
+ * been opened in binary mode.  On failure, NULL is returned and *errp is set
+ * to an error that may be passed to dtrace_errmsg() with a NULL handle.
+ */
+dtrace_capture_t *
+dtrace_capture_open(FILE *fp, int *errp)
+{
+	dtrace_capture_t *cap;
+	dt_caphdr_t hdr;
+
+	if (fread(&hdr, sizeof (hdr), 1, fp) != 1) {
+		*errp = ferror(fp) ? EDT_FIO : EDT_BADCAPTURE;
+		return (NULL);
+	}
+
+	/*
+	 * A capture written in the other byte order can be recognized, but
+	 * not read.
+	 */
+	if (hdr.dtch_magic == DT_CAP_CIGAM) {
+		*errp = EDT_DATAMODEL;
+		return (NULL);
+	}
+
+	if (hdr.dtch_magic != DT_CAP_MAGIC) {
+		*errp = EDT_BADCAPTURE;
+		return (NULL);
+	}
+
+	if (hdr.dtch_version > DT_CAP_VERSION) {
+		*errp = EDT_VERSION;
+		return (NULL);
+	}
+
+	if (hdr.dtch_model != sizeof (void *) * NBBY) {
+		*errp = EDT_DATAMODEL;
+		return (NULL);
+	}
+
+	if ((cap = calloc(1, sizeof (dtrace_capture_t))) == NULL) {
+		*errp = EDT_NOMEM;
+		return (NULL);
+	}
+
+	cap->dtc_fp = fp;
+	return (cap);
+}
+
+/*
+ * Iterates over every enabled probe firing in the capture, in the order in
+ * which the data was retrieved.  The callback returns DTRACE_CONSUME_NEXT to
+ * continue or DTRACE_CONSUME_ABORT to stop.  Returns 0 upon reaching the end
+ * of the capture, or -1 on error or abort; dtrace_capture_errno() returns
+ * the reason.
+ */
+int
+dtrace_capture_iter(dtrace_capture_t *cap, dtrace_capture_f *func, void *arg)
+{
+	dt_capframe_t frame;
+	int rval;
+
+	while (fread(&frame, sizeof (frame), 1, cap->dtc_fp) == 1) {
+		switch (frame.dtcf_type) {
+		case DT_CAP_EPROBE:
+			rval = dt_capture_read_eprobe(cap, &frame);
+			break;
+		case DT_CAP_FORMAT:
+			rval = dt_capture_read_string(cap, &frame,
+			    &cap->dtc_formats, &cap->dtc_maxformat);
+			break;
+		case DT_CAP_STRDATA:
+			rval = dt_capture_read_string(cap, &frame,
+			    &cap->dtc_strdata, &cap->dtc_maxstrdata);
+			break;
+		case DT_CAP_BUFFER:
+			rval = dt_capture_read_buf(cap, &frame, func, arg);
+			break;
+		default:
+			/*
+			 * Frames of types that we don't know about were
+			 * written by a newer writer; skip them.
+			 */
+			rval = dt_capture_read_payload(cap, &frame);
+			break;
+		}
+
+		if (rval != 0)
+			return (rval);
+	}
+
+	if (ferror(cap->dtc_fp))
+		return (dt_capture_error(cap, EDT_FIO));
+
+	return (0);
+}
+
+const char *
+dtrace_capture_format(dtrace_capture_t *cap, int format)
+{
+	if (format <= 0 || (uint_t)format >= cap->dtc_maxformat)
+		return (NULL);
+
+	return (cap->dtc_formats[format]);
+}
+
+const char *
+dtrace_capture_strdata(dtrace_capture_t *cap, int idx)
+{
+	if (idx <= 0 || (uint_t)idx >= cap->dtc_maxstrdata)
+		return (NULL);
+
+	return (cap->dtc_strdata[idx]);
+}
+
+int
+dtrace_capture_errno(dtrace_capture_t *cap)
+{
+	return (cap->dtc_errno);
+}
+
+void
+dtrace_capture_close(dtrace_capture_t *cap)
+{
+	uint_t i;
+
+	for (i = 0; i < cap->dtc_maxepid; i++) {
+		free(cap->dtc_probes[i].dtcp_pdesc);
+		free(cap->dtc_probes[i].dtcp_edesc);
+	}
+
+	for (i = 0; i < cap->dtc_maxformat; i++)
+		free(cap->dtc_formats[i]);
+
+	for (i = 0; i < cap->dtc_maxstrdata; i++)
+		free(cap->dtc_strdata[i]);
+
+	free(cap->dtc_probes);
+	free(cap->dtc_formats);
+	free(cap->dtc_strdata);
+	free(cap->dtc_buf);
+	free(cap);
+}
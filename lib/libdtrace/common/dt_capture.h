@@ -0,0 +1,70 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_DT_CAPTURE_H
+#define	_DT_CAPTURE_H
+
+#include <dtrace.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A capture begins with a dt_caphdr_t and is followed by a sequence of
+ * frames, each consisting of a dt_capframe_t and dtcf_size bytes of payload.
+ * Buffer frames contain raw principal buffer data exactly as retrieved from
+ * the kernel; the metadata frames needed to decode a buffer frame always
+ * precede it.  All values are in the byte order of the writer, and the
+ * descriptions are in its data model:  a capture may only be read by a
+ * consumer with the same byte order and pointer size.
+ */
+#define	DT_CAP_MAGIC	0x50434454	/* "DTCP" in little-endian order */
+#define	DT_CAP_CIGAM	0x54444350	/* DT_CAP_MAGIC in the other order */
+#define	DT_CAP_VERSION	1		/* current capture format version */
+
+typedef struct dt_caphdr {
+	uint32_t dtch_magic;		/* DT_CAP_MAGIC */
+	uint16_t dtch_version;		/* DT_CAP_VERSION */
+	uint16_t dtch_model;		/* pointer size of writer, in bits */
+} dt_caphdr_t;
+
+#define	DT_CAP_EPROBE	1	/* dtrace_probedesc_t + dtrace_eprobedesc_t */
+#define	DT_CAP_FORMAT	2	/* printf()-like format string */
+#define	DT_CAP_STRDATA	3	/* string data (e.g., print() type name) */
+#define	DT_CAP_BUFFER	4	/* principal buffer data */
+
+typedef struct dt_capframe {
+	uint32_t dtcf_type;		/* frame type (DT_CAP_*) */
+	uint32_t dtcf_id;		/* EPID, format ID, strdata ID or CPU */
+	uint64_t dtcf_size;		/* size of payload following frame */
+	uint64_t dtcf_arg;		/* action for FORMAT, time for BUFFER */
+} dt_capframe_t;
+
+/*
+ * Limits on the contents of a capture, so that a reader need not trust the
+ * IDs and sizes that it finds in a corrupt one:  the largest EPID, format ID
+ * or strdata ID, and the largest payload of a single frame.  The reader also
+ * only grows its buffers as payload is actually read.
+ */
+#define	DT_CAP_MAXID	(1U << 24)
+#define	DT_CAP_MAXFRAME	(1ULL << 32)
+#define	DT_CAP_CHUNK	(1U << 20)	/* payload read increment */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _DT_CAPTURE_H */
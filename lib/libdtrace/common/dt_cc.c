@@ -1668,12 +1668,121 @@ dt_compile_agg(dtrace_hdl_t *dtp, dt_node_t *dnp, dtrace_stmtdesc_t *sdp)
 	}
 }
 
+/*
+ * Determine if a clause may be fused with adjacent clauses on the same probe
+ * description (see dt_compile_one_clause(), below).  A fused clause must not
+ * have any action that affects the processing of the actions that follow it
+ * in the ECB, and it must have at least one action:  the default action of an
+ * empty clause records nothing, and relies on the clause having an EPID of
+ * its own.  Its predicate, if any, is checked by dt_pred_fusable().
+ */
+static int
+dt_clause_fusable(const dt_node_t *cnp)
+{
+	const dt_node_t *dnp;
+
+	if (cnp->dn_acts == NULL)
+		return (0);
+
+	for (dnp = cnp->dn_acts; dnp != NULL; dnp = dnp->dn_list) {
+		if (dnp->dn_kind != DT_NODE_DFUNC)
+			continue;
+
+		switch (dnp->dn_expr->dn_ident->di_id) {
+		case DT_ACT_COMMIT:
+		case DT_ACT_DISCARD:
+		case DT_ACT_EXIT:
+		case DT_ACT_SPECULATE:
+			return (0);
+		}
+	}
+
+	return (1);
+}
+
+/*
+ * Determine if a predicate may be shared by fused clauses.  A fused predicate
+ * is evaluated once, before the actions of any of the clauses, rather than
+ * once before each clause's actions; it must therefore give the same answer
+ * whatever the actions of the clauses before it have done.  We require that
+ * it read no variable but the built-in ones, which no action can modify, and
+ * that it call no subroutine, as a subroutine may read what an action wrote
+ * (copyin() after copyout()) or give a different answer each time (rand()).
+ */
+static int
+dt_pred_fusable(const dtrace_difo_t *dp)
+{
+	uint_t i;
+
+	if (dp->dtdo_destructive)
+		return (0);
+
+	for (i = 0; i < dp->dtdo_varlen; i++) {
+		if (dp->dtdo_vartab[i].dtdv_id >= DIF_VAR_OTHER_UBASE)
+			return (0);
+	}
+
+	for (i = 0; i < dp->dtdo_len; i++) {
+		if (DIF_INSTR_OP(dp->dtdo_buf[i]) == DIF_OP_CALL)
+			return (0);
+	}
+
+	return (1);
+}
+
+/*
+ * Determine if two predicates compiled to the same DIF object.  The compiler
+ * is deterministic, so identical predicates produce identical tables.
+ */
+static int
+dt_pred_equal(const dtrace_difo_t *p1, const dtrace_difo_t *p2)
+{
+	if (p1 == NULL || p2 == NULL)
+		return (p1 == p2);
+
+	return (p1->dtdo_len == p2->dtdo_len &&
+	    p1->dtdo_intlen == p2->dtdo_intlen &&
+	    p1->dtdo_strlen == p2->dtdo_strlen &&
+	    p1->dtdo_varlen == p2->dtdo_varlen &&
+	    p1->dtdo_krelen == p2->dtdo_krelen &&
+	    p1->dtdo_urelen == p2->dtdo_urelen &&
+	    p1->dtdo_xlmlen == p2->dtdo_xlmlen &&
+	    bcmp(&p1->dtdo_rtype, &p2->dtdo_rtype,
+	    sizeof (dtrace_diftype_t)) == 0 &&
+	    bcmp(p1->dtdo_buf, p2->dtdo_buf,
+	    p1->dtdo_len * sizeof (dif_instr_t)) == 0 &&
+	    bcmp(p1->dtdo_inttab, p2->dtdo_inttab,
+	    p1->dtdo_intlen * sizeof (uint64_t)) == 0 &&
+	    bcmp(p1->dtdo_strtab, p2->dtdo_strtab, p1->dtdo_strlen) == 0 &&
+	    bcmp(p1->dtdo_vartab, p2->dtdo_vartab,
+	    p1->dtdo_varlen * sizeof (dtrace_difv_t)) == 0 &&
+	    bcmp(p1->dtdo_kreltab, p2->dtdo_kreltab,
+	    p1->dtdo_krelen * sizeof (dof_relodesc_t)) == 0 &&
+	    bcmp(p1->dtdo_ureltab, p2->dtdo_ureltab,
+	    p1->dtdo_urelen * sizeof (dof_relodesc_t)) == 0 &&
+	    bcmp(p1->dtdo_xlmtab, p2->dtdo_xlmtab,
+	    p1->dtdo_xlmlen * sizeof (dt_node_t *)) == 0);
+}
+
+static int
+dt_probedesc_equal(const dtrace_probedesc_t *p1, const dtrace_probedesc_t *p2)
+{
+	return (p1->dtpd_id == p2->dtpd_id &&
+	    strcmp(p1->dtpd_provider, p2->dtpd_provider) == 0 &&
+	    strcmp(p1->dtpd_mod, p2->dtpd_mod) == 0 &&
+	    strcmp(p1->dtpd_func, p2->dtpd_func) == 0 &&
+	    strcmp(p1->dtpd_name, p2->dtpd_name) == 0);
+}
+
 static void
 dt_compile_one_clause(dtrace_hdl_t *dtp, dt_node_t *cnp, dt_node_t *pnp)
 {
-	dtrace_ecbdesc_t *edp;
+	dtrace_ecbdesc_t *edp, *fdp = yypcb->pcb_fusedesc;
 	dtrace_stmtdesc_t *sdp;
+	dtrace_difo_t *pred = NULL;
 	dt_node_t *dnp;
+	int fuse = (yypcb->pcb_cflags & DTRACE_C_FUSE) &&
+	    dt_clause_fusable(cnp);
 
 	yylineno = pnp->dn_line;
 	dt_setcontext(dtp, pnp->dn_desc);
@@ -1682,17 +1791,50 @@ dt_compile_one_clause(dtrace_hdl_t *dtp, dt_node_t *cnp, dt_node_t *pnp)
 	if (DT_TREEDUMP_PASS(dtp, 2))
 		dt_node_printr(cnp, stderr, 0);
 
-	if ((edp = dt_ecbdesc_create(dtp, pnp->dn_desc)) == NULL)
-		longjmp(yypcb->pcb_jmpbuf, EDT_NOMEM);
-
-	assert(yypcb->pcb_ecbdesc == NULL);
-	yypcb->pcb_ecbdesc = edp;
-
 	if (cnp->dn_pred != NULL) {
 		dt_cg(yypcb, cnp->dn_pred);
-		edp->dted_pred.dtpdd_difo = dt_as(yypcb);
+		pred = dt_as(yypcb);
+		fuse = fuse && dt_pred_fusable(pred);
 	}
 
+	/*
+	 * If clause fusion is enabled and this clause immediately follows a
+	 * fusable clause on an identical probe description with an identical
+	 * predicate (or none), we append our actions to the preceding
+	 * clause's ECB description rather than creating one of our own.  The
+	 * statements then share an ECB -- and with it, a single evaluation of
+	 * the predicate, a single buffer reservation and a single EPID per
+	 * probe firing.  Otherwise, any ECB description that was left open
+	 * for fusion is closed.
+	 *
+	 * Note that the kernel commits an ECB's data only once all of its
+	 * actions have been processed:  if any action faults, dtrace_probe()
+	 * discards the ECB's entire record for that firing.  Once fused, a
+	 * fault in a later clause therefore also loses the data traced by the
+	 * clauses before it, which is why fusion must be asked for.
+	 */
+	yypcb->pcb_fusedesc = NULL;
+
+	if (fdp != NULL && fuse &&
+	    dt_probedesc_equal(&fdp->dted_probe, pnp->dn_desc) &&
+	    dt_pred_equal(fdp->dted_pred.dtpdd_difo, pred)) {
+		dt_difo_free(dtp, pred);
+		edp = fdp;
+	} else {
+		if (fdp != NULL)
+			dt_ecbdesc_release(dtp, fdp);
+
+		if ((edp = dt_ecbdesc_create(dtp, pnp->dn_desc)) == NULL) {
+			dt_difo_free(dtp, pred);
+			longjmp(yypcb->pcb_jmpbuf, EDT_NOMEM);
+		}
+
+		edp->dted_pred.dtpdd_difo = pred;
+	}
+
+	assert(yypcb->pcb_ecbdesc == NULL);
+	yypcb->pcb_ecbdesc = edp;
+
 	if (cnp->dn_acts == NULL) {
 		dt_stmt_append(dt_stmt_create(dtp, edp,
 			cnp->dn_ctxattr, _dtrace_defattr), cnp);
@@ -1725,7 +1867,13 @@ dt_compile_one_clause(dtrace_hdl_t *dtp, dt_node_t *cnp, dt_node_t *pnp)
 	}
 
 	assert(yypcb->pcb_ecbdesc == edp);
-	dt_ecbdesc_release(dtp, edp);
+
+	if (fuse) {
+		yypcb->pcb_fusedesc = edp;
+	} else {
+		dt_ecbdesc_release(dtp, edp);
+	}
+
 	dt_endcontext(dtp);
 	yypcb->pcb_ecbdesc = NULL;
 }
@@ -2621,6 +2769,11 @@ dt_compile(dtrace_hdl_t *dtp, int context, int acheck, dtrace_probespec_t pspec,
 			}
 		}
 
+		if (yypcb->pcb_fusedesc != NULL) {
+			dt_ecbdesc_release(dtp, yypcb->pcb_fusedesc);
+			yypcb->pcb_fusedesc = NULL;
+		}
+
 		yypcb->pcb_prog->dp_xrefs = yypcb->pcb_asxrefs;
 		yypcb->pcb_prog->dp_xrefslen = yypcb->pcb_asxreflen;
 		yypcb->pcb_asxrefs = NULL;
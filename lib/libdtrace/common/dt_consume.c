@@ -1108,6 +1108,19 @@ dt_print_llquantize(dtrace_hdl_t *dtp, FILE *fp, const void *addr,
 	    total, positives, negatives));
 }
 
+/*
+ * Prints an integer as " %*lld" would -- or, if width is zero, as "%lld"
+ * would -- without the expense of dt_printf().
+ */
+static int
+dt_print_int(dtrace_hdl_t *dtp, FILE *fp, int64_t val, int width)
+{
+	if (width != 0 && dt_putstr(dtp, fp, " ", 0) != 0)
+		return (-1);
+
+	return (dt_putint(dtp, fp, val, width));
+}
+
 /*ARGSUSED*/
 static int
 dt_print_average(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr,
@@ -1116,8 +1129,8 @@ dt_print_average(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr,
 	/* LINTED - alignment */
 	int64_t *data = (int64_t *)addr;
 
-	return (dt_printf(dtp, fp, " %16lld", data[0] ?
-	    (long long)(data[1] / (int64_t)normal / data[0]) : 0));
+	return (dt_print_int(dtp, fp, data[0] ?
+	    (long long)(data[1] / (int64_t)normal / data[0]) : 0, 16));
 }
 
 /*ARGSUSED*/
@@ -1132,27 +1145,16 @@ dt_print_stddev(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr,
 	    (unsigned long long) dt_stddev(data, normal) : 0));
 }
 
-/*ARGSUSED*/
-static int
-dt_print_bytes(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr,
-    size_t nbytes, int width, int quiet, int forceraw)
+/*
+ * If the byte stream is a series of printable characters, optionally followed
+ * by terminating nul bytes, returns the length of the string that it contains.
+ * Otherwise, returns -1 to indicate that the bytes should be treated as raw
+ * data.
+ */
+ssize_t
+dt_bytes_strlen(const char *c, size_t nbytes)
 {
-	/*
-	 * If the byte stream is a series of printable characters, followed by
-	 * a terminating byte, we print it out as a string.  Otherwise, we
-	 * assume that it's something else and just print the bytes.
-	 */
-	int i, j, margin = 5;
-	char *c = (char *)addr;
-
-	if (nbytes == 0)
-		return (0);
-
-	if (forceraw)
-		goto raw;
-
-	if (dtp->dt_options[DTRACEOPT_RAWBYTES] != DTRACEOPT_UNSET)
-		goto raw;
+	size_t i, j;
 
 	for (i = 0; i < nbytes; i++) {
 		/*
@@ -1186,27 +1188,65 @@ dt_print_bytes(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr,
 			if (j != nbytes)
 				break;
 
-			if (quiet) {
-				return (dt_printf(dtp, fp, "%s", c));
-			} else {
-				return (dt_printf(dtp, fp, " %s%*s",
-				    width < 0 ? " " : "", width, c));
-			}
+			return ((ssize_t)i);
 		}
 
 		break;
 	}
 
-	if (i == nbytes) {
+	/*
+	 * If the byte range is all printable characters but there is no
+	 * trailing nul byte, we'll assume that it's a string.
+	 */
+	return (i == nbytes ? (ssize_t)nbytes : -1);
+}
+
+/*ARGSUSED*/
+static int
+dt_print_bytes(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr,
+    size_t nbytes, int width, int quiet, int forceraw)
+{
+	/*
+	 * If the byte stream is a series of printable characters, followed by
+	 * a terminating byte, we print it out as a string.  Otherwise, we
+	 * assume that it's something else and just print the bytes.
+	 */
+	static const char hex[] = "0123456789abcdef";
+	int i, j, margin = 5;
+	char *c = (char *)addr;
+	ssize_t len;
+
+	if (nbytes == 0)
+		return (0);
+
+	if (forceraw)
+		goto raw;
+
+	if (dtp->dt_options[DTRACEOPT_RAWBYTES] != DTRACEOPT_UNSET)
+		goto raw;
+
+	if ((len = dt_bytes_strlen(c, nbytes)) == (ssize_t)nbytes) {
 		/*
 		 * The byte range is all printable characters, but there is
-		 * no trailing nul byte.  We'll assume that it's a string and
-		 * print it as such.
+		 * no trailing nul byte.  We'll print it as a string.
 		 */
 		char *s = alloca(nbytes + 1);
 		bcopy(c, s, nbytes);
 		s[nbytes] = '\0';
-		return (dt_printf(dtp, fp, "  %-*s", width, s));
+
+		if (dt_putstr(dtp, fp, "  ", 0) != 0)
+			return (-1);
+
+		return (dt_putstr(dtp, fp, s, width < 0 ? width : -width));
+	}
+
+	if (len >= 0) {
+		if (quiet) {
+			return (dt_putstr(dtp, fp, c, 0));
+		} else {
+			return (dt_printf(dtp, fp, " %s%*s",
+			    width < 0 ? " " : "", width, c));
+		}
 	}
 
 raw:
@@ -1214,59 +1254,142 @@ raw:
 		return (-1);
 
 	for (i = 0; i < 16; i++)
-		if (dt_printf(dtp, fp, "  %c", "0123456789abcdef"[i]) < 0)
+		if (dt_printf(dtp, fp, "  %c", hex[i]) < 0)
 			return (-1);
 
 	if (dt_printf(dtp, fp, "  0123456789abcdef\n") < 0)
 		return (-1);
 
 
+	/*
+	 * Each line of the dump is assembled by hand and output at once.
+	 */
 	for (i = 0; i < nbytes; i += 16) {
-		if (dt_printf(dtp, fp, "%*s%5x:", margin, "", i) < 0)
-			return (-1);
+		char line[128], digits[8], *p = line;
+		uint_t offs = i;
+		int k = 0, pad;
+
+		do {
+			digits[k++] = hex[offs & 0xf];
+			offs >>= 4;
+		} while (offs != 0);
+
+		for (pad = margin + (k < 5 ? 5 - k : 0); pad > 0; pad--)
+			*p++ = ' ';
+
+		while (k > 0)
+			*p++ = digits[--k];
+
+		*p++ = ':';
 
 		for (j = i; j < i + 16 && j < nbytes; j++) {
-			if (dt_printf(dtp, fp, " %02x", (uchar_t)c[j]) < 0)
-				return (-1);
+			*p++ = ' ';
+			*p++ = hex[(uchar_t)c[j] >> 4];
+			*p++ = hex[(uchar_t)c[j] & 0xf];
 		}
 
 		while (j++ % 16) {
-			if (dt_printf(dtp, fp, "   ") < 0)
-				return (-1);
+			*p++ = ' ';
+			*p++ = ' ';
+			*p++ = ' ';
 		}
 
-		if (dt_printf(dtp, fp, "  ") < 0)
-			return (-1);
+		*p++ = ' ';
+		*p++ = ' ';
 
-		for (j = i; j < i + 16 && j < nbytes; j++) {
-			if (dt_printf(dtp, fp, "%c",
-			    c[j] < ' ' || c[j] > '~' ? '.' : c[j]) < 0)
-				return (-1);
-		}
+		for (j = i; j < i + 16 && j < nbytes; j++)
+			*p++ = c[j] < ' ' || c[j] > '~' ? '.' : c[j];
 
-		if (dt_printf(dtp, fp, "\n") < 0)
+		*p++ = '\n';
+
+		if (dt_putbuf(dtp, fp, line, p - line) != 0)
 			return (-1);
 	}
 
 	return (0);
 }
 
+/*
+ * Prints a stack frame in the specified format -- or, absent one, as is.
+ */
+static int
+dt_print_frame(dtrace_hdl_t *dtp, FILE *fp, const char *format, const char *c)
+{
+	if (format != NULL)
+		return (dt_printf(dtp, fp, format, c));
+
+	return (dt_putstr(dtp, fp, c, 0));
+}
+
+/*
+ * Prints a symbol or address in the specified format -- or, absent one, as
+ * "  %-50s" would.
+ */
+static int
+dt_print_symbol(dtrace_hdl_t *dtp, FILE *fp, const char *format,
+    const char *c)
+{
+	if (format != NULL)
+		return (dt_printf(dtp, fp, format, c));
+
+	if (dt_putstr(dtp, fp, "  ", 0) != 0)
+		return (-1);
+
+	return (dt_putstr(dtp, fp, c, -50));
+}
+
+/*
+ * Formats a kernel program counter as it appears in the output of stack().
+ */
+void
+dt_format_stackpc(dtrace_hdl_t *dtp, uint64_t pc, char *c, size_t len)
+{
+	dtrace_syminfo_t dts;
+	GElf_Sym sym;
+
+	if (dtrace_lookup_by_addr(dtp, pc, &sym, &dts) == 0) {
+		if (pc > sym.st_value) {
+			(void) snprintf(c, len, "%s`%s+0x%llx",
+			    dts.dts_object, dts.dts_name,
+			    (u_longlong_t)(pc - sym.st_value));
+		} else {
+			(void) snprintf(c, len, "%s`%s",
+			    dts.dts_object, dts.dts_name);
+		}
+	} else {
+		/*
+		 * We'll repeat the lookup, but this time we'll specify
+		 * a NULL GElf_Sym -- indicating that we're only
+		 * interested in the containing module.
+		 */
+		if (dtrace_lookup_by_addr(dtp, pc, NULL, &dts) == 0) {
+#ifdef _WIN32
+			dtrace_objinfo_t oi;
+			if (dtrace_object_info(dtp, dts.dts_object, &oi) == 0) {
+				(void) snprintf(c, len, "%s`+0x%llx",
+				    dts.dts_object,
+				    (u_longlong_t)(pc - oi.dto_image_base));
+			} else
+#endif
+				(void) snprintf(c, len, "%s`0x%llx",
+				    dts.dts_object, (u_longlong_t)pc);
+		} else {
+			(void) snprintf(c, len, "0x%llx", (u_longlong_t)pc);
+		}
+	}
+}
+
 int
 dt_print_stack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
     caddr_t addr, int depth, int size)
 {
-	dtrace_syminfo_t dts;
-	GElf_Sym sym;
 	int i, indent;
 	char c[PATH_MAX * 2];
 	uint64_t pc;
 
-	if (dt_printf(dtp, fp, "\n") < 0)
+	if (dt_putstr(dtp, fp, "\n", 0) != 0)
 		return (-1);
 
-	if (format == NULL)
-		format = "%s";
-
 	if (dtp->dt_options[DTRACEOPT_STACKINDENT] != DTRACEOPT_UNSET)
 		indent = (int)dtp->dt_options[DTRACEOPT_STACKINDENT];
 	else
@@ -1293,50 +1416,86 @@ dt_print_stack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 
 		addr += size;
 
-		if (dt_printf(dtp, fp, "%*s", indent, "") < 0)
+		if (dt_putstr(dtp, fp, "", indent) != 0)
 			return (-1);
 
-		if (dtrace_lookup_by_addr(dtp, pc, &sym, &dts) == 0) {
-			if (pc > sym.st_value) {
-				(void) snprintf(c, sizeof (c), "%s`%s+0x%llx",
-				    dts.dts_object, dts.dts_name,
-				    (u_longlong_t)(pc - sym.st_value));
-			} else {
-				(void) snprintf(c, sizeof (c), "%s`%s",
-				    dts.dts_object, dts.dts_name);
-			}
-		} else {
-			/*
-			 * We'll repeat the lookup, but this time we'll specify
-			 * a NULL GElf_Sym -- indicating that we're only
-			 * interested in the containing module.
-			 */
-			if (dtrace_lookup_by_addr(dtp, pc, NULL, &dts) == 0) {
-#ifdef _WIN32
-				dtrace_objinfo_t oi;
-				if (dtrace_object_info(dtp, dts.dts_object, &oi) == 0) {
-					(void) snprintf(c, sizeof (c), "%s`+0x%llx",
-					    dts.dts_object, (u_longlong_t)(pc - oi.dto_image_base));
-				} else
-#endif
-					(void) snprintf(c, sizeof (c), "%s`0x%llx",
-					    dts.dts_object, (u_longlong_t)pc);
-			} else {
-				(void) snprintf(c, sizeof (c), "0x%llx",
-				    (u_longlong_t)pc);
-			}
-		}
+		dt_format_stackpc(dtp, pc, c, sizeof (c));
 
-		if (dt_printf(dtp, fp, format, c) < 0)
+		if (dt_print_frame(dtp, fp, format, c) < 0)
 			return (-1);
 
-		if (dt_printf(dtp, fp, "\n") < 0)
+		if (dt_putstr(dtp, fp, "\n", 0) != 0)
 			return (-1);
 	}
 
 	return (0);
 }
 
+/*
+ * Formats a user program counter as it appears in the output of ustack(),
+ * given the process handle (if any) and the frame's string table entry (if
+ * any).
+ */
+void
+dt_format_ustackpc(dtrace_hdl_t *dtp, struct ps_prochandle *P, uint64_t pc,
+    const char *str, char *c, size_t len)
+{
+	char name[PATH_MAX], objname[PATH_MAX];
+	GElf_Sym sym;
+#ifndef _WIN32
+	const prmap_t *map;
+#endif
+
+	if (P != NULL && Plookup_by_addr(P, pc,
+	    name, sizeof (name), &sym) == 0) {
+		(void) Pobjname(P, pc, objname, sizeof (objname));
+
+		if (pc > sym.st_value) {
+			(void) snprintf(c, len,
+			    "%s`%s+0x%llx", dt_basename(objname), name,
+			    (u_longlong_t)(pc - sym.st_value));
+		} else {
+			(void) snprintf(c, len,
+			    "%s`%s", dt_basename(objname), name);
+		}
+#ifndef _WIN32
+	} else if (str != NULL && str[0] != '\0' && str[0] != '@' &&
+	    (P != NULL && ((map = Paddr_to_map(P, pc)) == NULL ||
+	    (map->pr_mflags & MA_WRITE)))) {
+		/*
+		 * If the current string pointer in the string table
+		 * does not point to an empty string _and_ the program
+		 * counter falls in a writable region, we'll use the
+		 * string from the string table instead of the raw
+		 * address.  This last condition is necessary because
+		 * some (broken) ustack helpers will return a string
+		 * even for a program counter that they can't
+		 * identify.  If we have a string for a program
+		 * counter that falls in a segment that isn't
+		 * writable, we assume that we have fallen into this
+		 * case and we refuse to use the string.
+		 */
+		(void) snprintf(c, len, "%s", str);
+#endif
+	} else {
+		if (P != NULL && Pobjname(P, pc, objname,
+		    sizeof (objname)) != 0) {
+#ifdef _WIN32
+			uint64_t base = proc_name2map(P, objname);
+			if (base != 0) {
+				(void) snprintf(c, len, "%s`+0x%llx",
+				    dt_basename(objname),
+				    (u_longlong_t)(pc - base));
+			} else
+#endif
+				(void) snprintf(c, len, "%s`0x%llx",
+				    dt_basename(objname), (u_longlong_t)pc);
+		} else {
+			(void) snprintf(c, len, "0x%llx", (u_longlong_t)pc);
+		}
+	}
+}
+
 int
 dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
     caddr_t addr, uint64_t arg)
@@ -1349,9 +1508,8 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 	const char *str = strsize ? strbase : NULL;
 	int err = 0;
 
-	char name[PATH_MAX], objname[PATH_MAX], c[PATH_MAX * 2];
+	char c[PATH_MAX * 2];
 	struct ps_prochandle *P;
-	GElf_Sym sym;
 	int i, indent;
 	pid_t pid;
 
@@ -1360,12 +1518,9 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 
 	pid = (pid_t)*pc++;
 
-	if (dt_printf(dtp, fp, "\n") < 0)
+	if (dt_putstr(dtp, fp, "\n", 0) != 0)
 		return (-1);
 
-	if (format == NULL)
-		format = "%s";
-
 	if (dtp->dt_options[DTRACEOPT_STACKINDENT] != DTRACEOPT_UNSET)
 		indent = (int)dtp->dt_options[DTRACEOPT_STACKINDENT];
 	else
@@ -1385,66 +1540,15 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 		dt_proc_lock(dtp, P); /* lock handle while we perform lookups */
 
 	for (i = 0; i < depth && pc[i] != 0; i++) {
-#ifndef _WIN32
-		const prmap_t *map;
-#endif
-
-		if ((err = dt_printf(dtp, fp, "%*s", indent, "")) < 0)
+		if ((err = dt_putstr(dtp, fp, "", indent)) != 0)
 			break;
 
-		if (P != NULL && Plookup_by_addr(P, pc[i],
-		    name, sizeof (name), &sym) == 0) {
-			(void) Pobjname(P, pc[i], objname, sizeof (objname));
-
-			if (pc[i] > sym.st_value) {
-				(void) snprintf(c, sizeof (c),
-				    "%s`%s+0x%llx", dt_basename(objname), name,
-				    (u_longlong_t)(pc[i] - sym.st_value));
-			} else {
-				(void) snprintf(c, sizeof (c),
-				    "%s`%s", dt_basename(objname), name);
-			}
-#ifndef _WIN32
-		} else if (str != NULL && str[0] != '\0' && str[0] != '@' &&
-		    (P != NULL && ((map = Paddr_to_map(P, pc[i])) == NULL ||
-		    (map->pr_mflags & MA_WRITE)))) {
-			/*
-			 * If the current string pointer in the string table
-			 * does not point to an empty string _and_ the program
-			 * counter falls in a writable region, we'll use the
-			 * string from the string table instead of the raw
-			 * address.  This last condition is necessary because
-			 * some (broken) ustack helpers will return a string
-			 * even for a program counter that they can't
-			 * identify.  If we have a string for a program
-			 * counter that falls in a segment that isn't
-			 * writable, we assume that we have fallen into this
-			 * case and we refuse to use the string.
-			 */
-			(void) snprintf(c, sizeof (c), "%s", str);
-#endif
-		} else {
-			if (P != NULL && Pobjname(P, pc[i], objname,
-			    sizeof (objname)) != 0) {
-#ifdef _WIN32
-				uint64_t base = proc_name2map(P, objname);
-				if (base != 0) {
-					(void) snprintf(c, sizeof (c), "%s`+0x%llx",
-					    dt_basename(objname), (u_longlong_t)(pc[i] - base));
-				} else
-#endif
-					(void) snprintf(c, sizeof (c), "%s`0x%llx",
-					    dt_basename(objname), (u_longlong_t)pc[i]);
-			} else {
-				(void) snprintf(c, sizeof (c), "0x%llx",
-				    (u_longlong_t)pc[i]);
-			}
-		}
+		dt_format_ustackpc(dtp, P, pc[i], str, c, sizeof (c));
 
-		if ((err = dt_printf(dtp, fp, format, c)) < 0)
+		if ((err = dt_print_frame(dtp, fp, format, c)) < 0)
 			break;
 
-		if ((err = dt_printf(dtp, fp, "\n")) < 0)
+		if ((err = dt_putstr(dtp, fp, "\n", 0)) != 0)
 			break;
 
 		if (str != NULL && str[0] == '@') {
@@ -1459,7 +1563,7 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 
 			(void) snprintf(c, sizeof (c), "  [ %s ]", &str[1]);
 
-			if ((err = dt_printf(dtp, fp, format, c)) < 0)
+			if ((err = dt_print_frame(dtp, fp, format, c)) < 0)
 				break;
 
 			if ((err = dt_printf(dtp, fp, "\n")) < 0)
@@ -1481,17 +1585,14 @@ dt_print_ustack(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 	return (err);
 }
 
-static int
-dt_print_usym(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr, dtrace_actkind_t act)
+/*
+ * Returns the address to be formatted for a usym() or uaddr() record:  for
+ * usym(), this is the address of the containing symbol, if any.
+ */
+uint64_t
+dt_usym_addr(dtrace_hdl_t *dtp, uint64_t pid, uint64_t pc,
+    dtrace_actkind_t act)
 {
-	/* LINTED - alignment */
-	uint64_t pid = ((uint64_t *)addr)[0];
-	/* LINTED - alignment */
-	uint64_t pc = ((uint64_t *)addr)[1];
-	const char *format = "  %-50s";
-	char *s;
-	int n, len = 256;
-
 	if (act == DTRACEACT_USYM && dtp->dt_vector == NULL) {
 		struct ps_prochandle *P;
 
@@ -1509,29 +1610,43 @@ dt_print_usym(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr, dtrace_actkind_t act)
 		}
 	}
 
+	return (pc);
+}
+
+static int
+dt_print_usym(dtrace_hdl_t *dtp, FILE *fp, caddr_t addr, dtrace_actkind_t act)
+{
+	/* LINTED - alignment */
+	uint64_t pid = ((uint64_t *)addr)[0];
+	/* LINTED - alignment */
+	uint64_t pc = ((uint64_t *)addr)[1];
+	char *s;
+	int n, len = 256;
+
+	pc = dt_usym_addr(dtp, pid, pc, act);
+
 	do {
 		n = len;
 		s = alloca(n);
 	} while ((len = dtrace_uaddr2str(dtp, pid, pc, s, n)) > n);
 
-	return (dt_printf(dtp, fp, format, s));
+	return (dt_print_symbol(dtp, fp, NULL, s));
 }
 
-int
-dt_print_umod(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
+/*
+ * Formats the record of a umod() action.
+ */
+void
+dt_format_umod(dtrace_hdl_t *dtp, caddr_t addr, char *c, size_t len)
 {
 	/* LINTED - alignment */
 	uint64_t pid = ((uint64_t *)addr)[0];
 	/* LINTED - alignment */
 	uint64_t pc = ((uint64_t *)addr)[1];
-	int err = 0;
 
-	char objname[PATH_MAX], c[PATH_MAX * 2];
+	char objname[PATH_MAX];
 	struct ps_prochandle *P;
 
-	if (format == NULL)
-		format = "  %-50s";
-
 	/*
 	 * See the comment in dt_print_ustack() for the rationale for
 	 * printing raw addresses in the vectored case.
@@ -1545,35 +1660,40 @@ dt_print_umod(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
 		dt_proc_lock(dtp, P); /* lock handle while we perform lookups */
 
 	if (P != NULL && Pobjname(P, pc, objname, sizeof (objname)) != 0) {
-		(void) snprintf(c, sizeof (c), "%s", dt_basename(objname));
+		(void) snprintf(c, len, "%s", dt_basename(objname));
 	} else {
-		(void) snprintf(c, sizeof (c), "0x%llx", (u_longlong_t)pc);
+		(void) snprintf(c, len, "0x%llx", (u_longlong_t)pc);
 	}
 
-	err = dt_printf(dtp, fp, format, c);
-
 	if (P != NULL) {
 		dt_proc_unlock(dtp, P);
 		dt_proc_release(dtp, P);
 	}
+}
 
-	return (err);
+int
+dt_print_umod(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
+{
+	char c[PATH_MAX * 2];
+
+	dt_format_umod(dtp, addr, c, sizeof (c));
+
+	return (dt_print_symbol(dtp, fp, format, c));
 }
 
-static int
-dt_print_sym(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
+/*
+ * Formats the record of a sym() action.
+ */
+void
+dt_format_sym(dtrace_hdl_t *dtp, caddr_t addr, char *c, size_t len)
 {
 	/* LINTED - alignment */
 	uint64_t pc = *((uint64_t *)addr);
 	dtrace_syminfo_t dts;
 	GElf_Sym sym;
-	char c[PATH_MAX * 2];
-
-	if (format == NULL)
-		format = "  %-50s";
 
 	if (dtrace_lookup_by_addr(dtp, pc, &sym, &dts) == 0) {
-		(void) snprintf(c, sizeof (c), "%s`%s",
+		(void) snprintf(c, len, "%s`%s",
 		    dts.dts_object, dts.dts_name);
 	} else {
 		/*
@@ -1582,38 +1702,53 @@ dt_print_sym(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
 		 * the containing module.
 		 */
 		if (dtrace_lookup_by_addr(dtp, pc, NULL, &dts) == 0) {
-			(void) snprintf(c, sizeof (c), "%s`0x%llx",
+			(void) snprintf(c, len, "%s`0x%llx",
 			    dts.dts_object, (u_longlong_t)pc);
 		} else {
-			(void) snprintf(c, sizeof (c), "0x%llx",
+			(void) snprintf(c, len, "0x%llx",
 			    (u_longlong_t)pc);
 		}
 	}
+}
 
-	if (dt_printf(dtp, fp, format, c) < 0)
+static int
+dt_print_sym(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
+{
+	char c[PATH_MAX * 2];
+
+	dt_format_sym(dtp, addr, c, sizeof (c));
+
+	if (dt_print_symbol(dtp, fp, format, c) < 0)
 		return (-1);
 
 	return (0);
 }
 
-int
-dt_print_mod(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
+/*
+ * Formats the record of a mod() action.
+ */
+void
+dt_format_mod(dtrace_hdl_t *dtp, caddr_t addr, char *c, size_t len)
 {
 	/* LINTED - alignment */
 	uint64_t pc = *((uint64_t *)addr);
 	dtrace_syminfo_t dts;
-	char c[PATH_MAX * 2];
-
-	if (format == NULL)
-		format = "  %-50s";
 
 	if (dtrace_lookup_by_addr(dtp, pc, NULL, &dts) == 0) {
-		(void) snprintf(c, sizeof (c), "%s", dts.dts_object);
+		(void) snprintf(c, len, "%s", dts.dts_object);
 	} else {
-		(void) snprintf(c, sizeof (c), "0x%llx", (u_longlong_t)pc);
+		(void) snprintf(c, len, "0x%llx", (u_longlong_t)pc);
 	}
+}
+
+int
+dt_print_mod(dtrace_hdl_t *dtp, FILE *fp, const char *format, caddr_t addr)
+{
+	char c[PATH_MAX * 2];
 
-	if (dt_printf(dtp, fp, format, c) < 0)
+	dt_format_mod(dtp, addr, c, sizeof (c));
+
+	if (dt_print_symbol(dtp, fp, format, c) < 0)
 		return (-1);
 
 	return (0);
@@ -1733,38 +1868,13 @@ dt_clear_agg(const dtrace_aggdata_t *aggdata, void *arg)
 	return (DTRACE_AGGWALK_CLEAR);
 }
 
-typedef struct dt_trunc {
-	dtrace_aggvarid_t dttd_id;
-	uint64_t dttd_remaining;
-} dt_trunc_t;
-
-static int
-dt_trunc_agg(const dtrace_aggdata_t *aggdata, void *arg)
-{
-	dt_trunc_t *trunc = arg;
-	dtrace_aggdesc_t *agg = aggdata->dtada_desc;
-	dtrace_aggvarid_t id = trunc->dttd_id;
-
-	if (agg->dtagd_nrecs == 0)
-		return (DTRACE_AGGWALK_NEXT);
-
-	if (agg->dtagd_varid != id)
-		return (DTRACE_AGGWALK_NEXT);
-
-	if (trunc->dttd_remaining == 0)
-		return (DTRACE_AGGWALK_REMOVE);
-
-	trunc->dttd_remaining--;
-	return (DTRACE_AGGWALK_NEXT);
-}
-
 static int
 dt_trunc(dtrace_hdl_t *dtp, caddr_t base, dtrace_recdesc_t *rec)
 {
-	dt_trunc_t trunc;
+	dtrace_aggvarid_t id;
 	caddr_t addr;
 	int64_t remaining;
-	int (*func)(dtrace_hdl_t *, dtrace_aggregate_f *, void *);
+	boolean_t top;
 
 	/*
 	 * We (should) have two records:  the aggregation ID followed by the
@@ -1777,7 +1887,7 @@ dt_trunc(dtrace_hdl_t *dtp, caddr_t base, dtrace_recdesc_t *rec)
 		return (dt_set_errno(dtp, EDT_BADTRUNC));
 
 	/* LINTED - alignment */
-	trunc.dttd_id = *((dtrace_aggvarid_t *)addr);
+	id = *((dtrace_aggvarid_t *)addr);
 	rec++;
 
 	if (rec->dtrd_action != DTRACEACT_LIBACT)
@@ -1809,16 +1919,15 @@ dt_trunc(dtrace_hdl_t *dtp, caddr_t base, dtrace_recdesc_t *rec)
 	}
 
 	if (remaining < 0) {
-		func = dtrace_aggregate_walk_valsorted;
+		top = B_FALSE;
 		remaining = -remaining;
 	} else {
-		func = dtrace_aggregate_walk_valrevsorted;
+		top = B_TRUE;
 	}
 
 	assert(remaining >= 0);
-	trunc.dttd_remaining = remaining;
 
-	(void) func(dtp, dt_trunc_agg, &trunc);
+	(void) dt_aggregate_trunc(dtp, id, (uint64_t)remaining, top);
 
 	return (0);
 }
@@ -1951,23 +2060,23 @@ dt_print_datum(dtrace_hdl_t *dtp, FILE *fp, dtrace_recdesc_t *rec,
 
 	switch (size) {
 	case sizeof (uint64_t):
-		err = dt_printf(dtp, fp, " %*lld", width,
+		err = dt_print_int(dtp, fp,
 		    /* LINTED - alignment */
-		    (long long)*((uint64_t *)addr) / normal);
+		    (long long)*((uint64_t *)addr) / normal, width);
 		break;
 	case sizeof (uint32_t):
 		/* LINTED - alignment */
-		err = dt_printf(dtp, fp, " %*d", width, *((uint32_t *)addr) /
-		    (uint32_t)normal);
+		err = dt_print_int(dtp, fp, (int32_t)(*((uint32_t *)addr) /
+		    (uint32_t)normal), width);
 		break;
 	case sizeof (uint16_t):
 		/* LINTED - alignment */
-		err = dt_printf(dtp, fp, " %*d", width, *((uint16_t *)addr) /
-		    (uint32_t)normal);
+		err = dt_print_int(dtp, fp, *((uint16_t *)addr) /
+		    (uint32_t)normal, width);
 		break;
 	case sizeof (uint8_t):
-		err = dt_printf(dtp, fp, " %*d", width, *((uint8_t *)addr) /
-		    (uint32_t)normal);
+		err = dt_print_int(dtp, fp, *((uint8_t *)addr) /
+		    (uint32_t)normal, width);
 		break;
 	default:
 		err = dt_print_bytes(dtp, fp, addr, size, width, 0, 0);
@@ -1991,6 +2100,9 @@ dt_print_aggs(const dtrace_aggdata_t **aggsdata, int naggvars, void *arg)
 	caddr_t addr;
 	size_t size;
 
+	if (dtp->dt_options[DTRACEOPT_OFORMAT] == DTRACEOPT_OFORMAT_JSON)
+		return (dt_json_aggs(aggsdata, naggvars, arg));
+
 	pd->dtpa_agghist = (aggdata->dtada_flags & DTRACE_A_TOTAL);
 	pd->dtpa_aggpack = (aggdata->dtada_flags & DTRACE_A_MINMAXBIN);
 
@@ -2132,7 +2244,7 @@ dt_consume_cpu(dtrace_hdl_t *dtp, FILE *fp, int cpu,
 	size_t offs;
 	int flow = (dtp->dt_options[DTRACEOPT_FLOWINDENT] != DTRACEOPT_UNSET);
 	int quiet = (dtp->dt_options[DTRACEOPT_QUIET] != DTRACEOPT_UNSET);
-	int rval, i, n;
+	int rval, i, n, json;
 	uint64_t tracememsize = 0;
 	dtrace_probedata_t data;
 	uint64_t drops;
@@ -2182,6 +2294,9 @@ dt_consume_cpu(dtrace_hdl_t *dtp, FILE *fp, int cpu,
 			(void) dt_flowindent(dtp, &data, dtp->dt_last_epid,
 			    buf, offs);
 
+		if (dt_obuf_flush(dtp, B_FALSE) != 0)
+			return (-1);
+
 		rval = (*efunc)(&data, arg);
 
 		if (flow) {
@@ -2198,6 +2313,16 @@ dt_consume_cpu(dtrace_hdl_t *dtp, FILE *fp, int cpu,
 		if (rval != DTRACE_CONSUME_THIS)
 			return (dt_set_errno(dtp, EDT_BADRVAL));
 
+		/*
+		 * The output format is fixed for the duration of an EPID:  a
+		 * setopt() of "oformat" takes effect with the next one.
+		 */
+		json = (dtp->dt_options[DTRACEOPT_OFORMAT] ==
+		    DTRACEOPT_OFORMAT_JSON);
+
+		if (json)
+			dt_json_probe(dtp, &data);
+
 		for (i = 0; i < epd->dtepd_nrecs; i++) {
 			caddr_t addr;
 			dtrace_recdesc_t *rec = &epd->dtepd_rec[i];
@@ -2230,6 +2355,7 @@ dt_consume_cpu(dtrace_hdl_t *dtp, FILE *fp, int cpu,
 					if (fp == NULL)
 						continue;
 
+					(void) dt_obuf_flush(dtp, B_TRUE);
 					(void) fflush(fp);
 					(void) ftruncate(fileno(fp), 0);
 					(void) fseeko(fp, 0, SEEK_SET);
@@ -2312,6 +2438,9 @@ dt_consume_cpu(dtrace_hdl_t *dtp, FILE *fp, int cpu,
 				continue;
 			}
 
+			if (dt_obuf_flush(dtp, B_FALSE) != 0)
+				return (-1);
+
 			rval = (*rfunc)(&data, rec, arg);
 
 			if (rval == DTRACE_CONSUME_NEXT)
@@ -2323,6 +2452,31 @@ dt_consume_cpu(dtrace_hdl_t *dtp, FILE *fp, int cpu,
 			if (rval != DTRACE_CONSUME_THIS)
 				return (dt_set_errno(dtp, EDT_BADRVAL));
 
+			/*
+			 * In JSON mode, each record is added to the line for
+			 * this EPID -- except for printa(), which is handled
+			 * below, and those actions that have no JSON
+			 * representation.
+			 */
+			if (json && act == DTRACEACT_PRINTA)
+				goto nofmt;
+
+			if (json) {
+				n = dt_json_record(dtp, fp, &data, rec,
+				    epd->dtepd_nrecs - i,
+				    (uchar_t *)buf->dtbd_data + offs,
+				    buf->dtbd_size - offs, tracememsize);
+
+				if (n < 0)
+					return (-1); /* errno is set for us */
+
+				if (n > 0) {
+					i += n - 1;
+					tracememsize = 0;
+					goto nextrec;
+				}
+			}
+
 			if (act == DTRACEACT_STACK) {
 				int depth = rec->dtrd_arg;
 
@@ -2506,25 +2660,38 @@ nofmt:
 
 				assert(naggvars >= 1);
 
+				/*
+				 * In JSON mode, the aggregation entries are
+				 * an array in the line for this EPID.
+				 */
+				if (json) {
+					dt_json_begin(&dtp->dt_json, '[');
+				} else if (dt_printf(dtp, fp, "\n") < 0) {
+					dt_free(dtp, aggvars);
+					return (-1);
+				}
+
 				if (naggvars == 1) {
 					pd.dtpa_id = aggvars[0];
 					dt_free(dtp, aggvars);
 
-					if (dt_printf(dtp, fp, "\n") < 0 ||
-					    dtrace_aggregate_walk_sorted(dtp,
+					if (dtrace_aggregate_walk_sorted(dtp,
 					    dt_print_agg, &pd) < 0)
 						return (-1);
-					goto nextrec;
-				}
+				} else {
+					if (dtrace_aggregate_walk_joined(dtp,
+					    aggvars, naggvars, dt_print_aggs,
+					    &pd) < 0) {
+						dt_free(dtp, aggvars);
+						return (-1);
+					}
 
-				if (dt_printf(dtp, fp, "\n") < 0 ||
-				    dtrace_aggregate_walk_joined(dtp, aggvars,
-				    naggvars, dt_print_aggs, &pd) < 0) {
 					dt_free(dtp, aggvars);
-					return (-1);
 				}
 
-				dt_free(dtp, aggvars);
+				if (json)
+					dt_json_end(&dtp->dt_json, ']');
+
 				goto nextrec;
 			}
 
@@ -2547,24 +2714,23 @@ nofmt:
 
 			switch (rec->dtrd_size) {
 			case sizeof (uint64_t):
-				n = dt_printf(dtp, fp,
-				    quiet ? "%lld" : " %16lld",
+				n = dt_print_int(dtp, fp,
 				    /* LINTED - alignment */
-				    *((unsigned long long *)addr));
+				    *((int64_t *)addr), quiet ? 0 : 16);
 				break;
 			case sizeof (uint32_t):
-				n = dt_printf(dtp, fp, quiet ? "%d" : " %8d",
+				n = dt_print_int(dtp, fp,
 				    /* LINTED - alignment */
-				    *((uint32_t *)addr));
+				    *((int32_t *)addr), quiet ? 0 : 8);
 				break;
 			case sizeof (uint16_t):
-				n = dt_printf(dtp, fp, quiet ? "%d" : " %5d",
+				n = dt_print_int(dtp, fp,
 				    /* LINTED - alignment */
-				    *((uint16_t *)addr));
+				    *((uint16_t *)addr), quiet ? 0 : 5);
 				break;
 			case sizeof (uint8_t):
-				n = dt_printf(dtp, fp, quiet ? "%d" : " %3d",
-				    *((uint8_t *)addr));
+				n = dt_print_int(dtp, fp,
+				    *((uint8_t *)addr), quiet ? 0 : 3);
 				break;
 			default:
 				n = dt_print_bytes(dtp, fp, addr,
@@ -2580,10 +2746,16 @@ nextrec:
 				return (-1); /* errno is set for us */
 		}
 
+		if (json && dt_json_probe_end(dtp, fp, &data) != 0)
+			return (-1); /* errno is set for us */
+
 		/*
 		 * Call the record callback with a NULL record to indicate
 		 * that we're done processing this EPID.
 		 */
+		if (dt_obuf_flush(dtp, B_FALSE) != 0)
+			return (-1);
+
 		rval = (*rfunc)(&data, NULL, arg);
 nextepid:
 		offs += epd->dtepd_size;
@@ -2620,7 +2792,7 @@ dt_realloc_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf, int cursize)
 	uint64_t used = buf->dtbd_size - buf->dtbd_oldest;
 	if (used < cursize / 2) {
 		int misalign = buf->dtbd_oldest & (sizeof (uint64_t) - 1);
-		char *newdata = dt_alloc(dtp, used + misalign);
+		char *newdata = malloc(used + misalign);
 		if (newdata == NULL)
 			return;
 		bzero(newdata, misalign);
@@ -2636,7 +2808,9 @@ dt_realloc_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf, int cursize)
 /*
  * If the ring buffer has wrapped, the data is not in order.  Rearrange it
  * so that it is.  Note, we need to preserve the alignment of the data at
- * dtbd_oldest, which is only 4-byte aligned.
+ * dtbd_oldest, which is only 4-byte aligned.  Like dt_realloc_buf(), this
+ * may be called from a buffer retrieval thread, and therefore must not
+ * modify the handle (e.g., by setting dt_errno).
  */
 static int
 dt_unring_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
@@ -2648,10 +2822,10 @@ dt_unring_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
 		return (0);
 
 	misalign = buf->dtbd_oldest & (sizeof (uint64_t) - 1);
-	newdata = ndp = dt_alloc(dtp, buf->dtbd_size + misalign);
+	newdata = ndp = malloc(buf->dtbd_size + misalign);
 
 	if (newdata == NULL)
-		return (-1);
+		return (EDT_NOMEM);
 
 	assert(0 == (buf->dtbd_size & (sizeof (uint64_t) - 1)));
 
@@ -2680,25 +2854,179 @@ dt_put_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
 }
 
 /*
- * Returns 0 on success, in which case *cbp will be filled in if we retrieved
- * data, or NULL if there is no data for this CPU.
- * Returns -1 on failure and sets dt_errno.
+ * Buffers retrieved by dt_snap_buf() carry the size of their data allocation,
+ * which neither dtbd_size (set by the kernel to the size of the snapshot) nor
+ * the requested size necessarily reflects.
+ */
+typedef struct dt_snapbuf {
+	dtrace_bufdesc_t dtsb_buf;	/* buffer descriptor (must be first) */
+	uint64_t dtsb_alloc;		/* allocated size of dtbd_data */
+} dt_snapbuf_t;
+
+/*
+ * Principal buffers are often very large, and unless output is temporally
+ * ordered, each snapshot is consumed and discarded right after it has been
+ * taken.  Rather than allocating (and faulting in) fresh memory for every
+ * snapshot, we retain the data of discarded snapshots for reuse by later
+ * ones.  The cache holds no more buffers than can be retrieved at once --
+ * one, or one per "consumethreads" worker -- so it never retains more memory
+ * than retrieval itself requires.
+ */
+static char *
+dt_bufcache_get(dtrace_hdl_t *dtp, uint64_t size, uint64_t *allocp)
+{
+	dt_bufcache_t *bc, tmp;
+	char *data = NULL;
+	uint64_t alloc = 0;
+	int i;
+
+	if (dtp->dt_bufcache != NULL) {
+		(void) pthread_mutex_lock(&dtp->dt_bufcache_lock);
+
+		/*
+		 * Take the first cached buffer that is large enough, or failing
+		 * that any cached buffer (which we then replace).  A buffer that
+		 * we took but then passed over is put back in the slot we took
+		 * its successor from.
+		 */
+		for (i = 0; i < dtp->dt_bufcache_max; i++) {
+			bc = &dtp->dt_bufcache[i];
+
+			if (bc->dtbc_data == NULL)
+				continue;
+
+			if (data == NULL || bc->dtbc_size >= size) {
+				tmp = *bc;
+				bc->dtbc_data = data;
+				bc->dtbc_size = alloc;
+				data = tmp.dtbc_data;
+				alloc = tmp.dtbc_size;
+			}
+
+			if (alloc >= size)
+				break;
+		}
+
+		(void) pthread_mutex_unlock(&dtp->dt_bufcache_lock);
+	}
+
+	if (data != NULL && alloc >= size) {
+		*allocp = alloc;
+		return (data);
+	}
+
+	free(data);
+	*allocp = size;
+	return (malloc(size));
+}
+
+/*
+ * Releases a buffer retrieved by dt_snap_buf(), retaining its data for a later
+ * snapshot if there is room in the cache.  The buffer's data must not have
+ * been shrunk by dt_realloc_buf().
+ */
+static void
+dt_recycle_buf(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
+{
+	dt_snapbuf_t *sb = (dt_snapbuf_t *)buf;
+	dt_bufcache_t *bc;
+	int i;
+
+	if (dtp->dt_bufcache != NULL) {
+		(void) pthread_mutex_lock(&dtp->dt_bufcache_lock);
+
+		for (i = 0; i < dtp->dt_bufcache_max; i++) {
+			bc = &dtp->dt_bufcache[i];
+
+			if (bc->dtbc_data == NULL) {
+				bc->dtbc_data = buf->dtbd_data;
+				bc->dtbc_size = sb->dtsb_alloc;
+				buf->dtbd_data = NULL;
+				break;
+			}
+		}
+
+		(void) pthread_mutex_unlock(&dtp->dt_bufcache_lock);
+	}
+
+	dt_put_buf(dtp, buf);
+}
+
+static void
+dt_bufcache_init(dtrace_hdl_t *dtp, int ncpus)
+{
+	dtrace_optval_t nthreads = dtp->dt_options[DTRACEOPT_CONSUMETHREADS];
+	int max = 1;
+
+	if (dtp->dt_bufcache != NULL)
+		return;
+
+	if (nthreads != DTRACEOPT_UNSET && nthreads > 1)
+		max = (int)MIN(nthreads, ncpus);
+
+	/*
+	 * If we can't allocate the cache, we simply won't cache.
+	 */
+	if ((dtp->dt_bufcache = malloc(max * sizeof (dt_bufcache_t))) == NULL)
+		return;
+
+	bzero(dtp->dt_bufcache, max * sizeof (dt_bufcache_t));
+	(void) pthread_mutex_init(&dtp->dt_bufcache_lock, NULL);
+	dtp->dt_bufcache_max = max;
+}
+
+void
+dt_consume_destroy(dtrace_hdl_t *dtp)
+{
+	dtrace_bufdesc_t *buf;
+	int i;
+
+	if (dtp->dt_bufq != NULL) {
+		while ((buf = dt_pq_pop(dtp->dt_bufq)) != NULL)
+			dt_put_buf(dtp, buf);
+
+		dt_pq_fini(dtp->dt_bufq);
+		dtp->dt_bufq = NULL;
+	}
+
+	if (dtp->dt_bufcache != NULL) {
+		for (i = 0; i < dtp->dt_bufcache_max; i++)
+			free(dtp->dt_bufcache[i].dtbc_data);
+
+		(void) pthread_mutex_destroy(&dtp->dt_bufcache_lock);
+		free(dtp->dt_bufcache);
+		dtp->dt_bufcache = NULL;
+		dtp->dt_bufcache_max = 0;
+	}
+}
+
+/*
+ * Retrieves the principal buffer for the specified CPU.  This does not modify
+ * the handle, and may therefore be called from a buffer retrieval thread.
+ * If shrink is set, the buffer is reallocated to fit its data; this should
+ * only be done for buffers that will be retained beyond the current pass.
+ * Returns 0 on success, in which case *bufp will be filled in if we retrieved
+ * data, or NULL if there is no data for this CPU.  Returns an error number on
+ * failure.
  */
 static int
-dt_get_buf(dtrace_hdl_t *dtp, int cpu, dtrace_bufdesc_t **bufp)
+dt_snap_buf(dtrace_hdl_t *dtp, int cpu, dtrace_optval_t size,
+    boolean_t shrink, dtrace_bufdesc_t **bufp)
 {
-	dtrace_optval_t size;
-	dtrace_bufdesc_t *buf = dt_zalloc(dtp, sizeof (*buf));
-	int error, rval;
+	dt_snapbuf_t *sb = malloc(sizeof (*sb));
+	dtrace_bufdesc_t *buf;
+	char *data;
+	int error;
 
-	if (buf == NULL)
-		return (-1);
+	if (sb == NULL)
+		return (EDT_NOMEM);
 
-	(void) dtrace_getopt(dtp, "bufsize", &size);
-	buf->dtbd_data = dt_alloc(dtp, size);
+	bzero(sb, sizeof (*sb));
+	buf = &sb->dtsb_buf;
+	buf->dtbd_data = data = dt_bufcache_get(dtp, size, &sb->dtsb_alloc);
 	if (buf->dtbd_data == NULL) {
 		dt_free(dtp, buf);
-		return (-1);
+		return (EDT_NOMEM);
 	}
 	buf->dtbd_size = size;
 	buf->dtbd_cpu = cpu;
@@ -2713,14 +3041,15 @@ dt_get_buf(dtrace_hdl_t *dtp, int cpu, dtrace_bufdesc_t **bufp)
 		 * CPU was unconfigured -- this is okay.  Any other
 		 * error, however, is unexpected.
 		 */
-		if (errno == ENOENT) {
+		error = errno;
+		dt_recycle_buf(dtp, buf);
+
+		if (error == ENOENT) {
 			*bufp = NULL;
-			rval = 0;
-		} else
-			rval = dt_set_errno(dtp, errno);
+			return (0);
+		}
 
-		dt_put_buf(dtp, buf);
-		return (rval);
+		return (error);
 	}
 
 	error = dt_unring_buf(dtp, buf);
@@ -2728,12 +3057,236 @@ dt_get_buf(dtrace_hdl_t *dtp, int cpu, dtrace_bufdesc_t **bufp)
 		dt_put_buf(dtp, buf);
 		return (error);
 	}
-	dt_realloc_buf(dtp, buf, size);
+
+	/*
+	 * If dt_unring_buf() had to rearrange the data, it did so into a new
+	 * allocation of exactly dtbd_size bytes.
+	 */
+	if (buf->dtbd_data != data)
+		sb->dtsb_alloc = buf->dtbd_size;
+
+	if (shrink)
+		dt_realloc_buf(dtp, buf, size);
 
 	*bufp = buf;
 	return (0);
 }
 
+/*
+ * Returns 0 on success, in which case *bufp will be filled in if we retrieved
+ * data, or NULL if there is no data for this CPU.
+ * Returns -1 on failure and sets dt_errno.
+ */
+static int
+dt_get_buf(dtrace_hdl_t *dtp, int cpu, boolean_t shrink,
+    dtrace_bufdesc_t **bufp)
+{
+	dtrace_optval_t size;
+	int error;
+
+	size = dt_adapt_snapsize(dtp);
+
+	if ((error = dt_snap_buf(dtp, cpu, size, shrink, bufp)) != 0)
+		return (dt_set_errno(dtp, error));
+
+	return (0);
+}
+
+/*
+ * Parallel buffer retrieval.  When the "consumethreads" option is set, the
+ * per-CPU principal buffers are retrieved (and, for ring buffers, unwrapped)
+ * by a pool of worker threads rather than one at a time.  Only retrieval is
+ * performed in parallel:  records are still processed -- and the consumer's
+ * callbacks are still called -- from the calling thread, and in exactly the
+ * order in which they would have been without worker threads.  Because each
+ * CPU's buffer may be processed as soon as it has been retrieved, processing
+ * overlaps with the retrieval of the remaining buffers.
+ */
+typedef struct dt_bufslot {
+	dtrace_bufdesc_t *dtbs_buf;	/* retrieved buffer, if any */
+	int dtbs_error;			/* error number, if retrieval failed */
+	int dtbs_done;			/* boolean: retrieval complete */
+} dt_bufslot_t;
+
+typedef struct dt_bufwork {
+	dtrace_hdl_t *dtbw_dtp;		/* libdtrace handle */
+	dtrace_optval_t dtbw_size;	/* principal buffer size */
+	boolean_t dtbw_shrink;		/* shrink buffers to fit data */
+	pthread_mutex_t dtbw_lock;	/* lock protecting members below */
+	pthread_cond_t dtbw_cv;		/* broadcast as retrievals complete */
+	int dtbw_ncpus;			/* number of CPUs to retrieve */
+	int dtbw_next;			/* next CPU to retrieve */
+	int dtbw_abort;			/* boolean: consumer has finished */
+	dt_bufslot_t *dtbw_slots;	/* per-CPU retrieval results */
+	int dtbw_nthreads;		/* number of worker threads */
+	pthread_t *dtbw_threads;	/* worker threads */
+} dt_bufwork_t;
+
+#ifdef _WIN32
+static DWORD WINAPI
+#else
+static void *
+#endif
+dt_bufwork_thread(void *arg)
+{
+	dt_bufwork_t *bw = arg;
+	dtrace_bufdesc_t *buf;
+	int cpu, error;
+
+	(void) pthread_mutex_lock(&bw->dtbw_lock);
+
+	while (!bw->dtbw_abort && bw->dtbw_next < bw->dtbw_ncpus) {
+		cpu = bw->dtbw_next++;
+		(void) pthread_mutex_unlock(&bw->dtbw_lock);
+
+		error = dt_snap_buf(bw->dtbw_dtp, cpu, bw->dtbw_size,
+		    bw->dtbw_shrink, &buf);
+
+		(void) pthread_mutex_lock(&bw->dtbw_lock);
+		bw->dtbw_slots[cpu].dtbs_buf = error == 0 ? buf : NULL;
+		bw->dtbw_slots[cpu].dtbs_error = error;
+		bw->dtbw_slots[cpu].dtbs_done = 1;
+		(void) pthread_cond_broadcast(&bw->dtbw_cv);
+	}
+
+	(void) pthread_mutex_unlock(&bw->dtbw_lock);
+
+	return (0);
+}
+
+static void
+dt_bufwork_fini(dt_bufwork_t *bw)
+{
+	dtrace_hdl_t *dtp;
+	int i;
+
+	if (bw == NULL)
+		return;
+
+	dtp = bw->dtbw_dtp;
+
+	(void) pthread_mutex_lock(&bw->dtbw_lock);
+	bw->dtbw_abort = 1;
+	(void) pthread_mutex_unlock(&bw->dtbw_lock);
+
+	for (i = 0; i < bw->dtbw_nthreads; i++)
+		dt_thread_join(bw->dtbw_threads[i]);
+
+	/*
+	 * Any buffers that were retrieved but not consumed (because the
+	 * consumer bailed out early) are simply discarded.
+	 */
+	for (i = 0; i < bw->dtbw_ncpus; i++) {
+		if (bw->dtbw_slots[i].dtbs_buf != NULL)
+			dt_put_buf(dtp, bw->dtbw_slots[i].dtbs_buf);
+	}
+
+	(void) pthread_cond_destroy(&bw->dtbw_cv);
+	(void) pthread_mutex_destroy(&bw->dtbw_lock);
+	dt_free(dtp, bw->dtbw_threads);
+	dt_free(dtp, bw->dtbw_slots);
+	dt_free(dtp, bw);
+}
+
+/*
+ * Starts retrieving the buffers for CPUs [0, ncpus) in parallel.  Returns
+ * NULL if parallel retrieval has not been requested or is not possible, in
+ * which case the caller should fall back to dt_get_buf().
+ */
+static dt_bufwork_t *
+dt_bufwork_start(dtrace_hdl_t *dtp, int ncpus, boolean_t shrink)
+{
+	dtrace_optval_t nthreads = dtp->dt_options[DTRACEOPT_CONSUMETHREADS];
+	dt_bufwork_t *bw;
+	int i;
+
+	if (nthreads == DTRACEOPT_UNSET || nthreads <= 1)
+		return (NULL);
+
+	if (nthreads > ncpus)
+		nthreads = ncpus;
+
+	if ((bw = dt_zalloc(dtp, sizeof (dt_bufwork_t))) == NULL)
+		return (NULL);
+
+	bw->dtbw_slots = dt_zalloc(dtp, ncpus * sizeof (dt_bufslot_t));
+	bw->dtbw_threads = dt_zalloc(dtp, nthreads * sizeof (pthread_t));
+
+	if (bw->dtbw_slots == NULL || bw->dtbw_threads == NULL) {
+		dt_free(dtp, bw->dtbw_slots);
+		dt_free(dtp, bw->dtbw_threads);
+		dt_free(dtp, bw);
+		return (NULL);
+	}
+
+	bw->dtbw_dtp = dtp;
+	bw->dtbw_ncpus = ncpus;
+	bw->dtbw_shrink = shrink;
+	bw->dtbw_size = dt_adapt_snapsize(dtp);
+	(void) pthread_mutex_init(&bw->dtbw_lock, NULL);
+	(void) pthread_cond_init(&bw->dtbw_cv, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		if (dt_thread_create(&bw->dtbw_threads[i],
+		    dt_bufwork_thread, bw) != 0)
+			break;
+
+		bw->dtbw_nthreads++;
+	}
+
+	if (bw->dtbw_nthreads == 0) {
+		dt_bufwork_fini(bw);
+		return (NULL);
+	}
+
+	return (bw);
+}
+
+/*
+ * Waits for the buffer for the specified CPU, and transfers ownership of it
+ * to the caller.  This has the same semantics as dt_get_buf(), but also
+ * writes the buffer to the capture, if any.
+ */
+static int
+dt_bufwork_get(dtrace_hdl_t *dtp, dt_bufwork_t *bw, int cpu,
+    boolean_t shrink, dtrace_bufdesc_t **bufp)
+{
+	dt_bufslot_t *slot;
+	int error;
+
+	if (bw == NULL) {
+		if (dt_get_buf(dtp, cpu, shrink, bufp) != 0)
+			return (-1);
+	} else {
+		assert(shrink == bw->dtbw_shrink);
+
+		assert(cpu < bw->dtbw_ncpus);
+		slot = &bw->dtbw_slots[cpu];
+
+		(void) pthread_mutex_lock(&bw->dtbw_lock);
+
+		while (!slot->dtbs_done)
+			(void) pthread_cond_wait(&bw->dtbw_cv, &bw->dtbw_lock);
+
+		*bufp = slot->dtbs_buf;
+		error = slot->dtbs_error;
+		slot->dtbs_buf = NULL;
+
+		(void) pthread_mutex_unlock(&bw->dtbw_lock);
+
+		if (error != 0)
+			return (dt_set_errno(dtp, error));
+	}
+
+	if (*bufp != NULL && dt_capture_buf(dtp, *bufp) != 0) {
+		dt_put_buf(dtp, *bufp);
+		*bufp = NULL;
+		return (-1);
+	}
+
+	return (0);
+}
+
 typedef struct dt_begin {
 	dtrace_consume_probe_f *dtbgn_probefunc;
 	dtrace_consume_rec_f *dtbgn_recfunc;
@@ -2830,7 +3383,7 @@ dt_consume_begin(dtrace_hdl_t *dtp, FILE *fp,
 
 	dtp->dt_beganon = -1;
 
-	if (dt_get_buf(dtp, cpu, &buf) != 0)
+	if (dt_bufwork_get(dtp, NULL, cpu, B_FALSE, &buf) != 0)
 		return (-1);
 	if (buf == NULL)
 		return (0);
@@ -2843,7 +3396,7 @@ dt_consume_begin(dtrace_hdl_t *dtp, FILE *fp,
 		 */
 		rval = dt_consume_cpu(dtp, fp, cpu, buf, B_FALSE,
 		    pf, rf, arg);
-		dt_put_buf(dtp, buf);
+		dt_recycle_buf(dtp, buf);
 		return (rval);
 	}
 
@@ -2880,7 +3433,7 @@ dt_consume_begin(dtrace_hdl_t *dtp, FILE *fp,
 		if (i == cpu)
 			continue;
 
-		if (dt_get_buf(dtp, i, &nbuf) != 0) {
+		if (dt_bufwork_get(dtp, NULL, i, B_FALSE, &nbuf) != 0) {
 			dt_put_buf(dtp, buf);
 			return (-1);
 		}
@@ -2889,7 +3442,7 @@ dt_consume_begin(dtrace_hdl_t *dtp, FILE *fp,
 
 		rval = dt_consume_cpu(dtp, fp, i, nbuf, B_FALSE,
 		    pf, rf, arg);
-		dt_put_buf(dtp, nbuf);
+		dt_recycle_buf(dtp, nbuf);
 		if (rval != 0) {
 			dt_put_buf(dtp, buf);
 			return (rval);
@@ -2941,11 +3494,10 @@ dt_buf_oldest(void *elem, void *arg)
 	return (buf->dtbd_timestamp);
 }
 
-int
-dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
+static int
+dt_consume(dtrace_hdl_t *dtp, FILE *fp,
     dtrace_consume_probe_f *pf, dtrace_consume_rec_f *rf, void *arg)
 {
-	dtrace_optval_t size;
 	static int max_ncpus;
 	int i, rval;
 	dtrace_optval_t interval = dtp->dt_options[DTRACEOPT_SWITCHRATE];
@@ -2966,6 +3518,9 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 	if (max_ncpus == 0)
 		max_ncpus = dt_sysconf(dtp, _SC_CPUID_MAX) + 1;
 
+	dt_bufcache_init(dtp, max_ncpus);
+	dtp->dt_adapt.dta_passes++;
+
 	if (pf == NULL)
 		pf = (dtrace_consume_probe_f *)dt_nullprobe;
 
@@ -2983,10 +3538,15 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 		 * If we have just begun, we want to first process the CPU that
 		 * executed the BEGIN probe (if any).
 		 */
+		dt_bufwork_t *bw;
+
 		if (dtp->dt_active && dtp->dt_beganon != -1 &&
 		    (rval = dt_consume_begin(dtp, fp, pf, rf, arg)) != 0)
 			return (rval);
 
+		bw = dt_bufwork_start(dtp, max_ncpus, B_FALSE);
+		rval = 0;
+
 		for (i = 0; i < max_ncpus; i++) {
 			dtrace_bufdesc_t *buf;
 
@@ -2998,33 +3558,38 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 			if (dtp->dt_stopped && (i == dtp->dt_endedon))
 				continue;
 
-			if (dt_get_buf(dtp, i, &buf) != 0)
-				return (-1);
+			if (dt_bufwork_get(dtp, bw, i, B_FALSE, &buf) != 0) {
+				rval = -1;
+				break;
+			}
 			if (buf == NULL)
 				continue;
 
+			dt_adapt_note(dtp, buf);
 			dtp->dt_flow = 0;
 			dtp->dt_indent = 0;
 			dtp->dt_prefix = NULL;
 			rval = dt_consume_cpu(dtp, fp, i,
 			    buf, B_FALSE, pf, rf, arg);
-			dt_put_buf(dtp, buf);
+			dt_recycle_buf(dtp, buf);
 			if (rval != 0)
-				return (rval);
+				break;
 		}
-		if (dtp->dt_stopped) {
+		if (rval == 0 && dtp->dt_stopped) {
 			dtrace_bufdesc_t *buf;
 
-			if (dt_get_buf(dtp, dtp->dt_endedon, &buf) != 0)
-				return (-1);
-			if (buf == NULL)
-				return (0);
-
-			rval = dt_consume_cpu(dtp, fp, dtp->dt_endedon,
-			    buf, B_FALSE, pf, rf, arg);
-			dt_put_buf(dtp, buf);
-			return (rval);
+			if (dt_bufwork_get(dtp, bw,
+			    dtp->dt_endedon, B_FALSE, &buf) != 0) {
+				rval = -1;
+			} else if (buf != NULL) {
+				rval = dt_consume_cpu(dtp, fp, dtp->dt_endedon,
+				    buf, B_FALSE, pf, rf, arg);
+				dt_recycle_buf(dtp, buf);
+			}
 		}
+
+		dt_bufwork_fini(bw);
+		return (rval);
 	} else {
 		/*
 		 * The output will be in the order it was traced (or for
@@ -3038,15 +3603,17 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 		 * we reach the end of the time covered by these buffers,
 		 * we need to stop and retrieve more records on the next pass.
 		 * The kernel tells us the time covered by each buffer, in
-		 * dtbd_timestamp.  The first buffer's timestamp tells us the
-		 * time covered by all buffers, as subsequently retrieved
-		 * buffers will cover to a more recent time.
+		 * dtbd_timestamp.  The oldest of these timestamps tells us
+		 * the time covered by all buffers.  (The buffers may be
+		 * retrieved concurrently, so the first CPU's buffer is not
+		 * necessarily the oldest.)
 		 */
 
 		uint64_t *drops = alloca(max_ncpus * sizeof (uint64_t));
 		uint64_t first_timestamp = 0;
 		uint_t cookie = 0;
 		dtrace_bufdesc_t *buf;
+		dt_bufwork_t *bw;
 
 		bzero(drops, max_ncpus * sizeof (uint64_t));
 
@@ -3057,23 +3624,30 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 				return (-1);
 		}
 
-		/* Retrieve data from each CPU. */
-		(void) dtrace_getopt(dtp, "bufsize", &size);
+		/*
+		 * Retrieve data from each CPU.  These buffers are retained in
+		 * the queue across passes, so we shrink them to fit.
+		 */
+		bw = dt_bufwork_start(dtp, max_ncpus, B_TRUE);
 		for (i = 0; i < max_ncpus; i++) {
 			dtrace_bufdesc_t *buf;
 
-			if (dt_get_buf(dtp, i, &buf) != 0)
+			if (dt_bufwork_get(dtp, bw, i, B_TRUE, &buf) != 0) {
+				dt_bufwork_fini(bw);
 				return (-1);
+			}
 			if (buf != NULL) {
-				if (first_timestamp == 0)
+				if (first_timestamp == 0 ||
+				    buf->dtbd_timestamp < first_timestamp)
 					first_timestamp = buf->dtbd_timestamp;
-				assert(buf->dtbd_timestamp >= first_timestamp);
 
+				dt_adapt_note(dtp, buf);
 				dt_pq_insert(dtp->dt_bufq, buf);
 				drops[i] = buf->dtbd_drops;
 				buf->dtbd_drops = 0;
 			}
 		}
+		dt_bufwork_fini(bw);
 
 		/* Consume records. */
 		for (;;) {
@@ -3127,3 +3701,22 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 
 	return (0);
 }
+
+int
+dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
+    dtrace_consume_probe_f *pf, dtrace_consume_rec_f *rf, void *arg)
+{
+	int rval;
+
+	/*
+	 * All output generated while consuming is collected in the output
+	 * buffer, and written out in bulk; see dt_printf().
+	 */
+	dt_obuf_enter(dtp);
+	rval = dt_consume(dtp, fp, pf, rf, arg);
+
+	if (dt_obuf_exit(dtp) != 0 && rval == 0)
+		rval = -1;
+
+	return (rval);
+}
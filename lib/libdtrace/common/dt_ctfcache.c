@@ -0,0 +1,175 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The format of the CTF cache (see <dt_ctfcache.h>):  how the identity of a
+ * build of a module becomes a cache key and a file name, and how a cache file
+ * is written and checked against a key.  Finding a module's identity,
+ * mapping its cache file and managing the cache directory are left to
+ * dt_module.c, which is the only part that knows the host.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <dt_ctfcache.h>
+
+void
+dt_ctfcache_key(dt_ctfcache_hdr_t *key, uint32_t timestamp,
+    uint32_t checksum, uint32_t imagesize, const void *pdbsig,
+    uint32_t pdbage)
+{
+	bzero(key, sizeof (dt_ctfcache_hdr_t));
+	key->dch_magic = DT_CTFCACHE_MAGIC;
+	key->dch_version = DT_CTFCACHE_VERSION;
+	key->dch_model = CTF_MODEL_NATIVE;
+	key->dch_timestamp = timestamp;
+	key->dch_checksum = checksum;
+	key->dch_imagesize = imagesize;
+	bcopy(pdbsig, key->dch_pdbsig, sizeof (key->dch_pdbsig));
+	key->dch_pdbage = pdbage;
+}
+
+/*
+ * Form the name of the cache file of the named module for key, returning
+ * its length as snprintf() does.  The name is the module's followed by the
+ * key's PDB signature and age and image timestamp, checksum and size.
+ */
+int
+dt_ctfcache_name(const char *module, const dt_ctfcache_hdr_t *key,
+    char *buf, size_t len)
+{
+	uint32_t sig[4];
+
+	bcopy(key->dch_pdbsig, sig, sizeof (sig));
+
+	return (snprintf(buf, len, "%s-%08x%08x%08x%08x-%x-%08x%08x%08x.ctf",
+	    module, sig[0], sig[1], sig[2], sig[3], key->dch_pdbage,
+	    key->dch_timestamp, key->dch_checksum, key->dch_imagesize));
+}
+
+/*
+ * Return non-zero if file is the name of a cache file of the named module, as
+ * formed by dt_ctfcache_name().  The files of a module whose name is this
+ * one's followed by a hyphen (as with the api-ms-win-* modules) match the same
+ * wildcard, so the rest of the name is checked as well.  Module names are not
+ * case-sensitive.
+ */
+int
+dt_ctfcache_match(const char *module, const char *file)
+{
+	static const char hex[] = "0123456789abcdefABCDEF";
+	size_t len = strlen(module), n;
+
+	if (strncasecmp(file, module, len) != 0 || file[len] != '-')
+		return (0);
+
+	file += len + 1;
+
+	if (strspn(file, hex) != 32 || file[32] != '-')
+		return (0);
+
+	file += 33;
+
+	if ((n = strspn(file, hex)) == 0 || n > 8 || file[n] != '-')
+		return (0);
+
+	file += n + 1;
+
+	return (strspn(file, hex) == 24 && strcasecmp(file + 24, ".ctf") == 0);
+}
+
+/*
+ * Write a cache file for key to fp:  the header, the nids entries of the
+ * type index map at ids, and the container ctfp, which must have been
+ * committed with ctf_update().  Returns 0 on success and -1 on failure.
+ */
+int
+dt_ctfcache_write(FILE *fp, const dt_ctfcache_hdr_t *key,
+    const dt_ctfcache_id_t *ids, uint32_t nids, ctf_file_t *ctfp)
+{
+	dt_ctfcache_hdr_t hdr;
+
+	bcopy(key, &hdr, sizeof (hdr));
+	hdr.dch_nids = nids;
+
+	if (fwrite(&hdr, sizeof (hdr), 1, fp) != 1 ||
+	    fwrite(ids, sizeof (dt_ctfcache_id_t), nids, fp) != nids ||
+	    fflush(fp) != 0)
+		return (-1);
+
+	return (ctf_write_indexed(ctfp, fileno(fp)) != 0 ? -1 : 0);
+}
+
+/*
+ * Check the size bytes of a cache file at data against key.  If it is a cache
+ * file for key, set *idsp and *nidsp to its type index map and fill in *sectp
+ * with its container, and return 0; otherwise return the reason for which it
+ * was rejected.  Nothing is copied:  the map and the container point into
+ * data.
+ */
+int
+dt_ctfcache_check(const void *data, size_t size, const dt_ctfcache_hdr_t *key,
+    const dt_ctfcache_id_t **idsp, uint32_t *nidsp, ctf_sect_t *sectp)
+{
+	const dt_ctfcache_hdr_t *hdr = data;
+	size_t nids;
+
+	if (size < sizeof (dt_ctfcache_hdr_t) ||
+	    hdr->dch_magic != DT_CTFCACHE_MAGIC)
+		return (DT_CTFCACHE_EFORMAT);
+
+	if (hdr->dch_version != DT_CTFCACHE_VERSION)
+		return (DT_CTFCACHE_EVERSION);
+
+	if (memcmp(hdr, key, offsetof(dt_ctfcache_hdr_t, dch_nids)) != 0)
+		return (DT_CTFCACHE_ESTALE);
+
+	/*
+	 * There must be at least one map entry, and something beyond them.
+	 */
+	nids = (size - sizeof (dt_ctfcache_hdr_t)) / sizeof (dt_ctfcache_id_t);
+
+	if (hdr->dch_nids == 0 || hdr->dch_nids >= nids)
+		return (DT_CTFCACHE_EFORMAT);
+
+	/* LINTED - pointer alignment */
+	*idsp = (const dt_ctfcache_id_t *)(hdr + 1);
+	*nidsp = hdr->dch_nids;
+
+	bzero(sectp, sizeof (ctf_sect_t));
+	sectp->cts_data = (void *)(*idsp + hdr->dch_nids);
+	sectp->cts_size = size - sizeof (dt_ctfcache_hdr_t) -
+	    hdr->dch_nids * sizeof (dt_ctfcache_id_t);
+
+	return (0);
+}
+
+const char *
+dt_ctfcache_errmsg(int err)
+{
+	switch (err) {
+	case DT_CTFCACHE_EFORMAT:
+		return ("not a CTF cache file");
+	case DT_CTFCACHE_EVERSION:
+		return ("CTF cache file of another version");
+	case DT_CTFCACHE_ESTALE:
+		return ("CTF cache file of another build");
+	default:
+		return ("unknown error");
+	}
+}
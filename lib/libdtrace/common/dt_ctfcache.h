@@ -0,0 +1,79 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_DT_CTFCACHE_H
+#define	_DT_CTFCACHE_H
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <libctf.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A CTF cache file holds the CTF container that was built for one build of a
+ * module from its PDB, and the map from PDB type indices to the container's
+ * type identifiers.  It is laid out as a dt_ctfcache_hdr_t, dch_nids
+ * dt_ctfcache_id_t, and the container as written by ctf_write_indexed().
+ * Everything in the header but dch_nids is the cache key:  the identity of
+ * the build (its image timestamp, checksum and size, and its PDB signature
+ * and age) along with the version of the format and the data model of the
+ * container.  A file whose key differs from the module's is ignored.
+ */
+#define	DT_CTFCACHE_MAGIC	0x43435444	/* "DTCC" */
+#define	DT_CTFCACHE_VERSION	1
+
+typedef struct dt_ctfcache_hdr {
+	uint32_t dch_magic;	/* DT_CTFCACHE_MAGIC */
+	uint32_t dch_version;	/* DT_CTFCACHE_VERSION */
+	uint32_t dch_model;	/* CTF data model of container */
+	uint32_t dch_timestamp;	/* image time/date stamp */
+	uint32_t dch_checksum;	/* image checksum */
+	uint32_t dch_imagesize;	/* image size in bytes */
+	uint8_t dch_pdbsig[16];	/* PDB signature (a GUID) */
+	uint32_t dch_pdbage;	/* PDB age */
+	uint32_t dch_nids;	/* number of dt_ctfcache_id_t that follow */
+} dt_ctfcache_hdr_t;
+
+typedef struct dt_ctfcache_id {
+	uint32_t dci_pdbidx;	/* PDB type index */
+	uint32_t dci_ctfid;	/* corresponding CTF type identifier */
+} dt_ctfcache_id_t;
+
+/*
+ * Reasons for which dt_ctfcache_check() rejects a cache file.
+ */
+#define	DT_CTFCACHE_EFORMAT	1	/* not a cache file, or truncated */
+#define	DT_CTFCACHE_EVERSION	2	/* written by another version */
+#define	DT_CTFCACHE_ESTALE	3	/* written for another build */
+
+extern void dt_ctfcache_key(dt_ctfcache_hdr_t *, uint32_t, uint32_t,
+    uint32_t, const void *, uint32_t);
+extern int dt_ctfcache_name(const char *, const dt_ctfcache_hdr_t *,
+    char *, size_t);
+extern int dt_ctfcache_match(const char *, const char *);
+extern int dt_ctfcache_write(FILE *, const dt_ctfcache_hdr_t *,
+    const dt_ctfcache_id_t *, uint32_t, ctf_file_t *);
+extern int dt_ctfcache_check(const void *, size_t, const dt_ctfcache_hdr_t *,
+    const dt_ctfcache_id_t **, uint32_t *, ctf_sect_t *);
+extern const char *dt_ctfcache_errmsg(int);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _DT_CTFCACHE_H */
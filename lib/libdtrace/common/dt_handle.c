@@ -227,6 +227,8 @@ dt_handle_err(dtrace_hdl_t *dtp, dtrace_probedata_t *data)
 	if (dtp->dt_errhdlr == NULL)
 		return (dt_set_errno(dtp, EDT_ERRABORT));
 
+	(void) dt_obuf_flush(dtp, B_TRUE);
+
 	if ((*dtp->dt_errhdlr)(&err, dtp->dt_errarg) == DTRACE_HANDLE_ABORT)
 		return (dt_set_errno(dtp, EDT_ERRABORT));
 
@@ -270,6 +272,8 @@ dt_handle_liberr(dtrace_hdl_t *dtp, const dtrace_probedata_t *data,
 	if (dtp->dt_errhdlr == NULL)
 		return (dt_set_errno(dtp, EDT_ERRABORT));
 
+	(void) dt_obuf_flush(dtp, B_TRUE);
+
 	if ((*dtp->dt_errhdlr)(&err, dtp->dt_errarg) == DTRACE_HANDLE_ABORT)
 		return (dt_set_errno(dtp, EDT_ERRABORT));
 
@@ -342,6 +346,8 @@ dt_handle_cpudrop(dtrace_hdl_t *dtp, processorid_t cpu,
 	if (dtp->dt_drophdlr == NULL)
 		return (dt_set_errno(dtp, EDT_DROPABORT));
 
+	(void) dt_obuf_flush(dtp, B_TRUE);
+
 	if ((*dtp->dt_drophdlr)(&drop, dtp->dt_droparg) == DTRACE_HANDLE_ABORT)
 		return (dt_set_errno(dtp, EDT_DROPABORT));
 
@@ -441,6 +447,8 @@ dt_handle_status(dtrace_hdl_t *dtp, dtrace_status_t *old, dtrace_status_t *new)
 		if (dtp->dt_drophdlr == NULL)
 			return (dt_set_errno(dtp, EDT_DROPABORT));
 
+		(void) dt_obuf_flush(dtp, B_TRUE);
+
 		if ((*dtp->dt_drophdlr)(&drop,
 		    dtp->dt_droparg) == DTRACE_HANDLE_ABORT)
 			return (dt_set_errno(dtp, EDT_DROPABORT));
@@ -457,6 +465,8 @@ dt_handle_setopt(dtrace_hdl_t *dtp, dtrace_setoptdata_t *data)
 	if (dtp->dt_setopthdlr == NULL)
 		return (0);
 
+	(void) dt_obuf_flush(dtp, B_TRUE);
+
 	if ((*dtp->dt_setopthdlr)(data, arg) == DTRACE_HANDLE_ABORT)
 		return (dt_set_errno(dtp, EDT_DIRABORT));
 
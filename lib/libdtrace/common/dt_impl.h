@@ -69,6 +69,7 @@ extern "C" {
 #include <dt_dof.h>
 #include <dt_pcb.h>
 #include <dt_pq.h>
+#include <dt_json.h>
 
 struct dt_module;		/* see below */
 struct dt_pfdict;		/* see <dt_printf.h> */
@@ -149,6 +150,11 @@ typedef struct dt_module {
 	uint64_t dm_symbol_base;/* symbol image base address */
 	void *dm_strmap;	/* string data */
 	void *dm_idmap;		/* map of ctf to PDB IDs */
+	char *dm_ctfdir;	/* directory of on-disk CTF cache */
+	void *dm_ctfkey;	/* identity of module in CTF cache */
+	void *dm_ctfdata;	/* mapping of CTF cache (parent of dm_ctfp) */
+	size_t dm_ctfsize;	/* size of CTF cache mapping in bytes */
+	uint_t dm_ctfnids;	/* number of PDB types read from cache */
 #else
 	GElf_Addr dm_text_va;	/* virtual address of text section */
 	GElf_Xword dm_text_size; /* size in bytes of text section */
@@ -178,6 +184,7 @@ typedef struct dt_module {
 #define	DT_DM_LOADED	0x1	/* module symbol and type data is loaded */
 #define	DT_DM_KERNEL	0x2	/* module is associated with a kernel object */
 #define	DT_DM_PRIMARY	0x4	/* module is a krtld primary kernel object */
+#define	DT_DM_CTFCACHE	0x8	/* on-disk CTF cache has been consulted */
 
 #ifdef __FreeBSD__
 /*
@@ -214,8 +221,34 @@ typedef struct dt_ahash {
 	dt_ahashent_t	**dtah_hash;		/* hash table */
 	dt_ahashent_t	*dtah_all;		/* list of all elements */
 	size_t		dtah_size;		/* size of hash table */
+	size_t		dtah_nelems;		/* number of elements */
+	dt_ahashent_t	**dtah_oldhash;		/* table being rehashed */
+	size_t		dtah_oldsize;		/* size of old table */
+	size_t		dtah_rehash;		/* next old bucket to move */
 } dt_ahash_t;
 
+typedef struct dt_bufcache {
+	char *dtbc_data;		/* cached principal buffer data */
+	uint64_t dtbc_size;		/* size of cached data */
+} dt_bufcache_t;
+
+typedef struct dt_adapt {
+	dtrace_optval_t dta_minsize;	/* smallest principal buffer size */
+	dtrace_optval_t dta_maxsize;	/* largest principal buffer size */
+	dtrace_optval_t dta_oldsize;	/* size before shrinking, if any */
+	dtrace_optval_t dta_rate;	/* switchrate, as configured */
+	dtrace_optval_t dta_minrate;	/* shortest switchrate */
+	uint64_t dta_fill;		/* largest snapshot this period */
+	uint64_t dta_drops;		/* principal drops this period */
+	uint_t dta_passes;		/* consumption passes this period */
+	uint_t dta_quiet;		/* consecutive mostly empty passes */
+} dt_adapt_t;
+
+typedef struct dt_capmap {
+	uchar_t *dtcm_map;		/* flags, set once ID is described */
+	uint_t dtcm_size;		/* number of IDs in map */
+} dt_capmap_t;
+
 typedef struct dt_aggregate {
 	dtrace_bufdesc_t dtat_buf; 	/* buf aggregation snapshot */
 	int dtat_flags;			/* aggregate flags */
@@ -312,6 +345,15 @@ struct dtrace_hdl {
 #endif
 	dt_aggregate_t dt_aggregate; /* aggregate */
 	dt_pq_t *dt_bufq;	/* CPU-specific data queue */
+	dt_bufcache_t *dt_bufcache; /* principal buffer data cache */
+	int dt_bufcache_max;	/* number of entries in dt_bufcache */
+	pthread_mutex_t dt_bufcache_lock; /* lock for dt_bufcache */
+	dt_adapt_t dt_adapt;	/* adaptive buffer sizing state */
+	FILE *dt_capfp;		/* stream for capture of buffer data */
+	dt_capmap_t dt_capepids; /* EPIDs described in capture */
+	dt_capmap_t dt_capformats; /* formats described in capture */
+	dt_capmap_t dt_capstrdata; /* string data described in capture */
+	dt_json_t dt_json;	/* line buffer for JSON output */
 	struct dt_pfdict *dt_pfdict; /* dictionary of printf conversions */
 	dt_version_t dt_vmax;	/* optional ceiling on program API binding */
 	dtrace_attribute_t dt_amin; /* optional floor on program attributes */
@@ -322,6 +364,9 @@ struct dtrace_hdl {
 	char *dt_ld_path;	/* pathname of ld(1) to invoke if needed */
 #ifdef __FreeBSD__
 	char *dt_objcopy_path;	/* pathname of objcopy(1) to invoke if needed */
+#endif
+#ifdef _WIN32
+	char *dt_ctfcache_path;	/* directory of on-disk CTF cache, if any */
 #endif
 	dt_list_t dt_lib_path;	/* linked-list forming library search path */
 	uint_t dt_lazyload;	/* boolean:  set via -xlazyload */
@@ -377,10 +422,17 @@ struct dtrace_hdl {
 	hrtime_t dt_lastagg;	/* last snapshot of aggregation data */
 	char *dt_sprintf_buf;	/* buffer for dtrace_sprintf() */
 	int dt_sprintf_buflen;	/* length of dtrace_sprintf() buffer */
+	size_t dt_sprintf_bufsize; /* allocated size of dtrace_sprintf() buffer */
+	size_t dt_sprintf_len;	/* length of dtrace_sprintf() result */
 	const char *dt_filetag;	/* default filetag for dt_set_errmsg() */
 	char *dt_buffered_buf;	/* buffer for buffered output */
 	size_t dt_buffered_offs; /* current offset into buffered buffer */
 	size_t dt_buffered_size; /* size of buffered buffer */
+	char *dt_obuf;		/* output buffer for stdio streams */
+	size_t dt_obuf_len;	/* length of output in output buffer */
+	size_t dt_obuf_size;	/* size of output buffer */
+	FILE *dt_obuf_fp;	/* stream for output in output buffer */
+	int dt_obuf_depth;	/* depth of output buffer activation */
 	dtrace_handle_buffered_f *dt_bufhdlr; /* buffered handler, if any */
 	void *dt_bufarg;	/* buffered handler argument */
 	dt_dof_t dt_dof;	/* DOF generation buffers (see dt_dof.c) */
@@ -609,6 +661,7 @@ enum {
 	EDT_ENABLING_ERR,	/* failed to enable probe */
 	EDT_NOPROBES,		/* no probes sites for declared provider */
 	EDT_CANTLOAD,		/* failed to load a module */
+	EDT_BADCAPTURE,		/* capture is corrupt or unrecognized */
 #ifdef _WIN32
 	EDT_BADETWTRACE,	/* invalid etw trace */
 	EDT_ETWTRACEFAIL,	/* failure on etw trace */
@@ -682,12 +735,30 @@ extern int dt_status(dtrace_hdl_t *, processorid_t);
 extern long dt_sysconf(dtrace_hdl_t *, int);
 extern ssize_t dt_write(dtrace_hdl_t *, int, const void *, size_t);
 extern int dt_printf(dtrace_hdl_t *, FILE *, const char *, ...);
+extern int dt_putbuf(dtrace_hdl_t *, FILE *, const char *, size_t);
+extern int dt_putfield(dtrace_hdl_t *, FILE *, const char *, size_t, int);
+extern int dt_putstr(dtrace_hdl_t *, FILE *, const char *, int);
+extern int dt_putint(dtrace_hdl_t *, FILE *, int64_t, int);
+
+extern void dt_obuf_enter(dtrace_hdl_t *);
+extern int dt_obuf_exit(dtrace_hdl_t *);
+extern int dt_obuf_flush(dtrace_hdl_t *, boolean_t);
+extern void dt_obuf_destroy(dtrace_hdl_t *);
 
 extern void *dt_zalloc(dtrace_hdl_t *, size_t);
 extern void *dt_alloc(dtrace_hdl_t *, size_t);
 extern void dt_free(dtrace_hdl_t *, void *);
 extern void dt_difo_free(dtrace_hdl_t *, dtrace_difo_t *);
 
+#ifdef _WIN32
+typedef DWORD (WINAPI dt_thread_f)(void *);
+#else
+typedef void *(dt_thread_f)(void *);
+#endif
+
+extern int dt_thread_create(pthread_t *, dt_thread_f *, void *);
+extern void dt_thread_join(pthread_t);
+
 extern int dt_gmatch(const char *, const char *);
 extern char *dt_basename(char *);
 
@@ -726,6 +797,21 @@ extern void dt_dis(const dtrace_difo_t *, FILE *);
 extern int dt_aggregate_go(dtrace_hdl_t *);
 extern int dt_aggregate_init(dtrace_hdl_t *);
 extern void dt_aggregate_destroy(dtrace_hdl_t *);
+extern int dt_aggregate_trunc(dtrace_hdl_t *, dtrace_aggvarid_t, uint64_t,
+    boolean_t);
+extern void dt_consume_destroy(dtrace_hdl_t *);
+
+extern void dt_adapt_note(dtrace_hdl_t *, const dtrace_bufdesc_t *);
+extern dtrace_optval_t dt_adapt_snapsize(dtrace_hdl_t *);
+
+extern int dt_capture_buf(dtrace_hdl_t *, dtrace_bufdesc_t *);
+extern void dt_capture_destroy(dtrace_hdl_t *);
+
+extern void dt_json_probe(dtrace_hdl_t *, const dtrace_probedata_t *);
+extern int dt_json_probe_end(dtrace_hdl_t *, FILE *, dtrace_probedata_t *);
+extern int dt_json_record(dtrace_hdl_t *, FILE *, const dtrace_probedata_t *,
+    const dtrace_recdesc_t *, uint_t, const void *, size_t, uint64_t);
+extern int dt_json_aggs(const dtrace_aggdata_t **, int, void *);
 
 extern int dt_epid_lookup(dtrace_hdl_t *, dtrace_epid_t,
 	dtrace_eprobedesc_t **, dtrace_probedesc_t **);
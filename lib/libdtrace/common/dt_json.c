@@ -0,0 +1,911 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * DTrace JSON Output
+ *
+ * When the "oformat" option is set to "json", dtrace_consume() emits each
+ * enabled probe firing as a single line containing a JSON object:
+ *
+ *	{"cpu":0,"id":3,"probe":"syscall::read:entry","records":[...]}
+ *
+ * and dtrace_aggregate_print() emits one such line per aggregation entry:
+ *
+ *	{"aggregation":"a","keys":["dtrace"],"value":42}
+ *
+ * Integers are numbers; strings are strings; stacks are arrays of frames;
+ * symbols and addresses are formatted exactly as they would be in the text
+ * output; printf() records are the formatted string; quantizations are an
+ * object containing the non-zero buckets; and anything else is an object
+ * containing its bytes in hexadecimal.  Each line is built in the handle's
+ * dt_json_t buffer with the digit and escape routines below, and written
+ * with a single call to dt_putbuf() -- there is no per-field stdio.
+ */
+
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <dt_impl.h>
+#include <dt_printf.h>
+#include <dt_json.h>
+#ifndef illumos
+#include <libproc_compat.h>
+#endif
+
+#define	DT_JSON_BUFSIZE	512		/* initial size of line buffer */
+#define	DT_JSON_STRSIZE	8192		/* minimum size of printf() result */
+
+static const char dt_json_xdigits[] = "0123456789abcdef";
+
+/*
+ * Return a pointer to n free bytes at the end of the line, or NULL if the
+ * line could not be grown; the caller adds what it writes to dtj_len.
+ */
+static char *
+dt_json_reserve(dt_json_t *j, size_t n)
+{
+	if (j->dtj_err != 0)
+		return (NULL);
+
+	/*
+	 * We always leave room for the newline that dt_json_flush() appends.
+	 */
+	if (j->dtj_len + n + 1 > j->dtj_size) {
+		size_t size = j->dtj_size != 0 ? j->dtj_size : DT_JSON_BUFSIZE;
+		char *buf;
+
+		while (j->dtj_len + n + 1 > size)
+			size <<= 1;
+
+		if ((buf = realloc(j->dtj_buf, size)) == NULL) {
+			j->dtj_err = EDT_NOMEM;
+			return (NULL);
+		}
+
+		j->dtj_buf = buf;
+		j->dtj_size = size;
+	}
+
+	return (j->dtj_buf + j->dtj_len);
+}
+
+static void
+dt_json_put(dt_json_t *j, const char *s, size_t n)
+{
+	char *buf;
+
+	if ((buf = dt_json_reserve(j, n)) == NULL)
+		return;
+
+	bcopy(s, buf, n);
+	j->dtj_len += n;
+}
+
+/*
+ * Emit the separator, if any, that must precede a value or a key.
+ */
+static void
+dt_json_sep(dt_json_t *j)
+{
+	uint64_t bit;
+
+	if (j->dtj_key) {
+		j->dtj_key = B_FALSE;
+		return;
+	}
+
+	if (j->dtj_depth == 0)
+		return;
+
+	bit = 1ULL << (j->dtj_depth - 1);
+
+	if (j->dtj_first & bit) {
+		j->dtj_first &= ~bit;
+	} else {
+		dt_json_put(j, ",", 1);
+	}
+}
+
+void
+dt_json_begin(dt_json_t *j, char c)
+{
+	assert(c == '{' || c == '[');
+	assert(j->dtj_depth < DT_JSON_MAXDEPTH);
+
+	dt_json_sep(j);
+	dt_json_put(j, &c, 1);
+	j->dtj_first |= 1ULL << j->dtj_depth++;
+}
+
+void
+dt_json_end(dt_json_t *j, char c)
+{
+	assert(c == '}' || c == ']');
+	assert(j->dtj_depth > 0 && !j->dtj_key);
+
+	j->dtj_depth--;
+	dt_json_put(j, &c, 1);
+}
+
+/*
+ * Keys are names chosen by the library, and are never escaped.
+ */
+void
+dt_json_key(dt_json_t *j, const char *key)
+{
+	dt_json_sep(j);
+	dt_json_put(j, "\"", 1);
+	dt_json_put(j, key, strlen(key));
+	dt_json_put(j, "\":", 2);
+	j->dtj_key = B_TRUE;
+}
+
+/*
+ * Emit the contents of a string of at most len bytes, stopping at the first
+ * nul byte.  Room is made for the string as if every byte were escaped, so
+ * that it can be copied in a single pass.  Bytes with the high bit set are
+ * passed through as is.
+ */
+static void
+dt_json_esc(dt_json_t *j, const char *s, size_t len)
+{
+	const char *p, *end;
+	char *buf, *q;
+
+	if ((p = memchr(s, '\0', len)) != NULL)
+		len = p - s;
+
+	if ((buf = dt_json_reserve(j, len * 6)) == NULL)
+		return;
+
+	for (p = s, end = s + len, q = buf; p < end; p++) {
+		uchar_t c = (uchar_t)*p;
+
+		if (c >= ' ' && c != '"' && c != '\\') {
+			*q++ = c;
+			continue;
+		}
+
+		*q++ = '\\';
+
+		switch (c) {
+		case '"':
+		case '\\':
+			*q++ = c;
+			break;
+		case '\b':
+			*q++ = 'b';
+			break;
+		case '\f':
+			*q++ = 'f';
+			break;
+		case '\n':
+			*q++ = 'n';
+			break;
+		case '\r':
+			*q++ = 'r';
+			break;
+		case '\t':
+			*q++ = 't';
+			break;
+		default:
+			*q++ = 'u';
+			*q++ = '0';
+			*q++ = '0';
+			*q++ = dt_json_xdigits[c >> 4];
+			*q++ = dt_json_xdigits[c & 0xf];
+			break;
+		}
+	}
+
+	j->dtj_len += q - buf;
+}
+
+void
+dt_json_str(dt_json_t *j, const char *s, size_t len)
+{
+	dt_json_sep(j);
+	dt_json_put(j, "\"", 1);
+	dt_json_esc(j, s, len);
+	dt_json_put(j, "\"", 1);
+}
+
+static void
+dt_json_digits(dt_json_t *j, uint64_t val, boolean_t neg)
+{
+	char digits[21], *p = &digits[sizeof (digits)];
+
+	do {
+		*--p = '0' + (val % 10);
+		val /= 10;
+	} while (val != 0);
+
+	if (neg)
+		*--p = '-';
+
+	dt_json_sep(j);
+	dt_json_put(j, p, &digits[sizeof (digits)] - p);
+}
+
+void
+dt_json_int(dt_json_t *j, int64_t val)
+{
+	if (val < 0) {
+		dt_json_digits(j, -(uint64_t)val, B_TRUE);
+	} else {
+		dt_json_digits(j, (uint64_t)val, B_FALSE);
+	}
+}
+
+void
+dt_json_uint(dt_json_t *j, uint64_t val)
+{
+	dt_json_digits(j, val, B_FALSE);
+}
+
+/*
+ * Emit a string containing the specified bytes in hexadecimal.
+ */
+void
+dt_json_hex(dt_json_t *j, const void *addr, size_t nbytes)
+{
+	const uchar_t *c = addr;
+	char hex[128];
+	size_t i, n = 0;
+
+	dt_json_sep(j);
+	dt_json_put(j, "\"", 1);
+
+	for (i = 0; i < nbytes; i++) {
+		hex[n++] = dt_json_xdigits[c[i] >> 4];
+		hex[n++] = dt_json_xdigits[c[i] & 0xf];
+
+		if (n == sizeof (hex)) {
+			dt_json_put(j, hex, n);
+			n = 0;
+		}
+	}
+
+	dt_json_put(j, hex, n);
+	dt_json_put(j, "\"", 1);
+}
+
+void
+dt_json_reset(dt_json_t *j)
+{
+	j->dtj_len = 0;
+	j->dtj_depth = 0;
+	j->dtj_first = 0;
+	j->dtj_key = B_FALSE;
+	j->dtj_err = 0;
+}
+
+/*
+ * Write out the accumulated line, and reset the buffer for the next one.
+ */
+int
+dt_json_flush(dtrace_hdl_t *dtp, dt_json_t *j, FILE *fp)
+{
+	int err, rval;
+
+	assert(j->dtj_depth == 0);
+	dt_json_put(j, "\n", 1);
+
+	if ((err = j->dtj_err) != 0) {
+		dt_json_reset(j);
+		return (dt_set_errno(dtp, err));
+	}
+
+	rval = dt_putbuf(dtp, fp, j->dtj_buf, j->dtj_len);
+	dt_json_reset(j);
+
+	return (rval);
+}
+
+void
+dt_json_destroy(dt_json_t *j)
+{
+	free(j->dtj_buf);
+	bzero(j, sizeof (dt_json_t));
+}
+
+static void
+dt_json_bytes(dt_json_t *j, const void *addr, size_t nbytes)
+{
+	dt_json_begin(j, '{');
+	dt_json_key(j, "bytes");
+	dt_json_hex(j, addr, nbytes);
+	dt_json_end(j, '}');
+}
+
+static int
+dt_json_stack(dtrace_hdl_t *dtp, caddr_t addr, int depth, int size)
+{
+	dt_json_t *j = &dtp->dt_json;
+	char c[PATH_MAX * 2];
+	uint64_t pc;
+	int i;
+
+	dt_json_begin(j, '[');
+
+	for (i = 0; i < depth; i++) {
+		switch (size) {
+		case sizeof (uint32_t):
+			/* LINTED - alignment */
+			pc = *((uint32_t *)addr);
+			break;
+
+		case sizeof (uint64_t):
+			/* LINTED - alignment */
+			pc = *((uint64_t *)addr);
+			break;
+
+		default:
+			dt_json_reset(j);
+			return (dt_set_errno(dtp, EDT_BADSTACKPC));
+		}
+
+		if (pc == 0)
+			break;
+
+		addr += size;
+
+		dt_format_stackpc(dtp, pc, c, sizeof (c));
+		dt_json_str(j, c, sizeof (c));
+	}
+
+	dt_json_end(j, ']');
+
+	return (0);
+}
+
+static int
+dt_json_ustack(dtrace_hdl_t *dtp, caddr_t addr, uint64_t arg)
+{
+	dt_json_t *j = &dtp->dt_json;
+	/* LINTED - alignment */
+	uint64_t *pc = (uint64_t *)addr;
+	uint32_t depth = DTRACE_USTACK_NFRAMES(arg);
+	uint32_t strsize = DTRACE_USTACK_STRSIZE(arg);
+	const char *strbase = addr + (depth + 1) * sizeof (uint64_t);
+	const char *str = strsize ? strbase : NULL;
+	char c[PATH_MAX * 2];
+	struct ps_prochandle *P = NULL;
+	uint32_t i;
+
+	dt_json_begin(j, '[');
+
+	if (depth == 0) {
+		dt_json_end(j, ']');
+		return (0);
+	}
+
+	/*
+	 * As in dt_print_ustack(), we can only symbolize frames for a
+	 * non-vectored open.
+	 */
+	if (dtp->dt_vector == NULL) {
+		P = dt_proc_grab(dtp, (pid_t)*pc,
+		    PGRAB_RDONLY | PGRAB_FORCE, 0);
+	}
+
+	pc++;
+
+	if (P != NULL)
+		dt_proc_lock(dtp, P);
+
+	for (i = 0; i < depth && pc[i] != 0; i++) {
+		dt_format_ustackpc(dtp, P, pc[i], str, c, sizeof (c));
+		dt_json_str(j, c, sizeof (c));
+
+		if (str != NULL) {
+			str += strlen(str) + 1;
+			if (str - strbase >= strsize)
+				str = NULL;
+		}
+	}
+
+	if (P != NULL) {
+		dt_proc_unlock(dtp, P);
+		dt_proc_release(dtp, P);
+	}
+
+	dt_json_end(j, ']');
+
+	return (0);
+}
+
+static void
+dt_json_bucket(dt_json_t *j, const char *key, int64_t value, int64_t count,
+    uint64_t normal)
+{
+	dt_json_begin(j, '{');
+	dt_json_key(j, key);
+	dt_json_int(j, value);
+	dt_json_key(j, "count");
+	dt_json_int(j, count / (int64_t)normal);
+	dt_json_end(j, '}');
+}
+
+static int
+dt_json_quantize(dtrace_hdl_t *dtp, const void *addr, size_t size,
+    uint64_t normal)
+{
+	dt_json_t *j = &dtp->dt_json;
+	const int64_t *data = addr;
+	int i;
+
+	if (size != DTRACE_QUANTIZE_NBUCKETS * sizeof (uint64_t))
+		return (dt_set_errno(dtp, EDT_DMISMATCH));
+
+	for (i = 0; i < DTRACE_QUANTIZE_NBUCKETS; i++) {
+		if (data[i] != 0) {
+			dt_json_bucket(j, "value",
+			    DTRACE_QUANTIZE_BUCKETVAL(i), data[i], normal);
+		}
+	}
+
+	return (0);
+}
+
+static int
+dt_json_lquantize(dtrace_hdl_t *dtp, const void *addr, size_t size,
+    uint64_t normal)
+{
+	dt_json_t *j = &dtp->dt_json;
+	const int64_t *data = addr;
+	int i, base;
+	uint16_t step, levels;
+	uint64_t arg;
+
+	if (size < sizeof (uint64_t))
+		return (dt_set_errno(dtp, EDT_DMISMATCH));
+
+	arg = *data++;
+	size -= sizeof (uint64_t);
+
+	base = DTRACE_LQUANTIZE_BASE(arg);
+	step = DTRACE_LQUANTIZE_STEP(arg);
+	levels = DTRACE_LQUANTIZE_LEVELS(arg);
+
+	if (size != sizeof (uint64_t) * (levels + 2))
+		return (dt_set_errno(dtp, EDT_DMISMATCH));
+
+	for (i = 0; i <= levels + 1; i++) {
+		if (data[i] == 0)
+			continue;
+
+		if (i == 0) {
+			dt_json_bucket(j, "lt", base, data[i], normal);
+		} else if (i == levels + 1) {
+			dt_json_bucket(j, "ge", base + (levels * step),
+			    data[i], normal);
+		} else {
+			dt_json_bucket(j, "value", base + (i - 1) * step,
+			    data[i], normal);
+		}
+	}
+
+	return (0);
+}
+
+static int
+dt_json_llquantize(dtrace_hdl_t *dtp, const void *addr, size_t size,
+    uint64_t normal)
+{
+	dt_json_t *j = &dtp->dt_json;
+	int bin = 1, order, levels;
+	uint16_t factor, low, high, nsteps;
+	const int64_t *data = addr;
+	int64_t value = 1, next, step;
+	uint64_t arg;
+
+	if (size < sizeof (uint64_t))
+		return (dt_set_errno(dtp, EDT_DMISMATCH));
+
+	arg = *data++;
+	size -= sizeof (uint64_t);
+
+	factor = DTRACE_LLQUANTIZE_FACTOR(arg);
+	low = DTRACE_LLQUANTIZE_LOW(arg);
+	high = DTRACE_LLQUANTIZE_HIGH(arg);
+	nsteps = DTRACE_LLQUANTIZE_NSTEP(arg);
+
+	if (size > INT32_MAX || factor < 2 || low >= high ||
+	    nsteps == 0 || factor > nsteps)
+		return (dt_set_errno(dtp, EDT_DMISMATCH));
+
+	levels = (int)size / sizeof (uint64_t);
+
+	for (order = 0; order < low; order++)
+		value *= factor;
+
+	if (data[0] != 0)
+		dt_json_bucket(j, "lt", value, data[0], normal);
+
+	next = value * factor;
+	step = next > nsteps ? next / nsteps : 1;
+
+	while (order <= high && bin < levels) {
+		if (data[bin] != 0)
+			dt_json_bucket(j, "value", value, data[bin], normal);
+
+		bin++;
+
+		if ((value += step) != next)
+			continue;
+
+		next = value * factor;
+		step = next > nsteps ? next / nsteps : 1;
+		order++;
+	}
+
+	if (bin < levels && data[bin] != 0)
+		dt_json_bucket(j, "ge", value, data[bin], normal);
+
+	return (0);
+}
+
+/*
+ * Emit a single datum, which is either a record of an enabled probe or a
+ * key or value of an aggregation, divided by normal where that applies.
+ */
+static int
+dt_json_datum(dtrace_hdl_t *dtp, const dtrace_recdesc_t *rec, caddr_t addr,
+    size_t size, uint64_t normal)
+{
+	dt_json_t *j = &dtp->dt_json;
+	dtrace_actkind_t act = rec->dtrd_action;
+	char c[PATH_MAX * 2];
+	uint64_t pid, pc;
+	ssize_t len;
+	int err;
+
+	switch (act) {
+	case DTRACEACT_STACK:
+		return (dt_json_stack(dtp, addr, rec->dtrd_arg,
+		    rec->dtrd_size / rec->dtrd_arg));
+
+	case DTRACEACT_USTACK:
+	case DTRACEACT_JSTACK:
+		return (dt_json_ustack(dtp, addr, rec->dtrd_arg));
+
+	case DTRACEACT_USYM:
+	case DTRACEACT_UADDR:
+		/* LINTED - alignment */
+		pid = ((uint64_t *)addr)[0];
+		/* LINTED - alignment */
+		pc = dt_usym_addr(dtp, pid, ((uint64_t *)addr)[1], act);
+		(void) dtrace_uaddr2str(dtp, pid, pc, c, sizeof (c));
+		dt_json_str(j, c, sizeof (c));
+		return (0);
+
+	case DTRACEACT_UMOD:
+		dt_format_umod(dtp, addr, c, sizeof (c));
+		dt_json_str(j, c, sizeof (c));
+		return (0);
+
+	case DTRACEACT_SYM:
+		dt_format_sym(dtp, addr, c, sizeof (c));
+		dt_json_str(j, c, sizeof (c));
+		return (0);
+
+	case DTRACEACT_MOD:
+		dt_format_mod(dtp, addr, c, sizeof (c));
+		dt_json_str(j, c, sizeof (c));
+		return (0);
+
+	case DTRACEAGG_QUANTIZE:
+	case DTRACEAGG_LQUANTIZE:
+	case DTRACEAGG_LLQUANTIZE:
+		dt_json_begin(j, '{');
+		dt_json_key(j, "buckets");
+		dt_json_begin(j, '[');
+
+		if (act == DTRACEAGG_QUANTIZE) {
+			err = dt_json_quantize(dtp, addr, size, normal);
+		} else if (act == DTRACEAGG_LQUANTIZE) {
+			err = dt_json_lquantize(dtp, addr, size, normal);
+		} else {
+			err = dt_json_llquantize(dtp, addr, size, normal);
+		}
+
+		dt_json_end(j, ']');
+		dt_json_end(j, '}');
+		return (err);
+
+	case DTRACEAGG_AVG: {
+		/* LINTED - alignment */
+		int64_t *data = (int64_t *)addr;
+
+		dt_json_int(j, data[0] ?
+		    data[1] / (int64_t)normal / data[0] : 0);
+		return (0);
+	}
+
+	case DTRACEAGG_STDDEV:
+		/* LINTED - alignment */
+		dt_json_uint(j, dt_stddev((uint64_t *)addr, normal));
+		return (0);
+
+	default:
+		break;
+	}
+
+	switch (size) {
+	case sizeof (uint64_t):
+		/* LINTED - alignment */
+		dt_json_int(j, *((int64_t *)addr) / (int64_t)normal);
+		break;
+	case sizeof (uint32_t):
+		/* LINTED - alignment */
+		dt_json_int(j, (int32_t)(*((uint32_t *)addr) /
+		    (uint32_t)normal));
+		break;
+	case sizeof (uint16_t):
+		/* LINTED - alignment */
+		dt_json_int(j, *((uint16_t *)addr) / (uint32_t)normal);
+		break;
+	case sizeof (uint8_t):
+		dt_json_int(j, *((uint8_t *)addr) / (uint32_t)normal);
+		break;
+	default:
+		if (dtp->dt_options[DTRACEOPT_RAWBYTES] == DTRACEOPT_UNSET &&
+		    (len = dt_bytes_strlen(addr, size)) >= 0) {
+			dt_json_str(j, addr, len);
+		} else {
+			dt_json_bytes(j, addr, size);
+		}
+		break;
+	}
+
+	return (0);
+}
+
+/*
+ * Begin the line for an enabled probe firing; its records are added by
+ * dt_json_record() and the line is completed by dt_json_probe_end().
+ */
+void
+dt_json_probe(dtrace_hdl_t *dtp, const dtrace_probedata_t *data)
+{
+	dtrace_probedesc_t *pd = data->dtpda_pdesc;
+	dt_json_t *j = &dtp->dt_json;
+
+	dt_json_reset(j);
+	dt_json_begin(j, '{');
+	dt_json_key(j, "cpu");
+	dt_json_int(j, data->dtpda_cpu);
+	dt_json_key(j, "id");
+	dt_json_uint(j, data->dtpda_edesc->dtepd_epid);
+	dt_json_key(j, "probe");
+
+	/*
+	 * The probe is named as it is in text:  "provider:module:func:name".
+	 * The parts are emitted in place rather than formatted first, as this
+	 * is done for every record.
+	 */
+	dt_json_sep(j);
+	dt_json_put(j, "\"", 1);
+	dt_json_esc(j, pd->dtpd_provider, sizeof (pd->dtpd_provider));
+	dt_json_put(j, ":", 1);
+	dt_json_esc(j, pd->dtpd_mod, sizeof (pd->dtpd_mod));
+	dt_json_put(j, ":", 1);
+	dt_json_esc(j, pd->dtpd_func, sizeof (pd->dtpd_func));
+	dt_json_put(j, ":", 1);
+	dt_json_esc(j, pd->dtpd_name, sizeof (pd->dtpd_name));
+	dt_json_put(j, "\"", 1);
+
+	dt_json_key(j, "records");
+	dt_json_begin(j, '[');
+}
+
+int
+dt_json_probe_end(dtrace_hdl_t *dtp, FILE *fp, dtrace_probedata_t *data)
+{
+	dt_json_t *j = &dtp->dt_json;
+
+	dt_json_end(j, ']');
+	dt_json_end(j, '}');
+
+	if (dt_json_flush(dtp, j, fp) != 0)
+		return (-1);
+
+	return (dt_buffered_flush(dtp, data, NULL, NULL, 0));
+}
+
+/*
+ * Emit the record at rec, returning the number of records consumed.  A
+ * return value of 0 indicates that the record has no JSON representation
+ * and should be processed as in the text output mode.
+ */
+int
+dt_json_record(dtrace_hdl_t *dtp, FILE *fp, const dtrace_probedata_t *data,
+    const dtrace_recdesc_t *rec, uint_t nrecs, const void *buf, size_t len,
+    uint64_t tracememsize)
+{
+	dt_json_t *j = &dtp->dt_json;
+	dtrace_actkind_t act = rec->dtrd_action;
+	caddr_t addr = data->dtpda_data;
+	dtrace_optval_t strsize = dtp->dt_options[DTRACEOPT_STRSIZE];
+	const char *strdata;
+	void *fmtdata;
+	size_t size;
+	int n;
+
+	switch (act) {
+	case DTRACEACT_SYSTEM:
+	case DTRACEACT_FREOPEN:
+#ifdef _WIN32
+	case DTRACEACT_ETWTRACE:
+#endif
+		return (0);
+
+	case DTRACEACT_PRINTF:
+		if ((fmtdata = dt_format_lookup(dtp,
+		    rec->dtrd_format)) == NULL)
+			break;
+
+		/*
+		 * The formatted result is collected in the handle's sprintf()
+		 * buffer.  As printf() output is not limited by strsize, we
+		 * allow for rather more than that.
+		 */
+		size = strsize > DT_JSON_STRSIZE ? strsize : DT_JSON_STRSIZE;
+
+		if ((n = dt_sprintf(dtp, fp, fmtdata, rec, nrecs,
+		    buf, len, size)) < 0) {
+			dt_json_reset(j);
+			return (-1);
+		}
+
+		dt_json_str(j, dtp->dt_sprintf_buf, dtp->dt_sprintf_len);
+		return (n > 0 ? n : 1);
+
+	case DTRACEACT_PRINTM:
+		dt_json_bytes(j, addr + sizeof (uintptr_t),
+		    /* LINTED - alignment */
+		    *((uintptr_t *)addr));
+		return (1);
+
+	case DTRACEACT_TRACEMEM:
+		if (tracememsize == 0 || tracememsize > rec->dtrd_size)
+			tracememsize = rec->dtrd_size;
+
+		dt_json_bytes(j, addr, tracememsize);
+		return (1);
+
+	case DTRACEACT_DIFEXPR:
+		if ((strdata = dt_strdata_lookup(dtp,
+		    rec->dtrd_format)) == NULL)
+			break;
+
+		dt_json_begin(j, '{');
+		dt_json_key(j, "type");
+		dt_json_str(j, strdata, strlen(strdata));
+		dt_json_key(j, "bytes");
+		dt_json_hex(j, addr, rec->dtrd_size);
+		dt_json_end(j, '}');
+		return (1);
+
+	default:
+		break;
+	}
+
+	if (dt_json_datum(dtp, rec, addr, rec->dtrd_size, 1) != 0) {
+		dt_json_reset(j);
+		return (-1);
+	}
+
+	return (1);
+}
+
+/*
+ * The JSON counterpart of dt_print_aggs():  emits an aggregation entry as a
+ * line of its own, or -- for printa() -- as a member of the probe's line.
+ */
+int
+dt_json_aggs(const dtrace_aggdata_t **aggsdata, int naggvars, void *arg)
+{
+	dt_print_aggdata_t *pd = arg;
+	dtrace_hdl_t *dtp = pd->dtpa_dtp;
+	dt_json_t *j = &dtp->dt_json;
+	const dtrace_aggdata_t *aggdata = aggsdata[0];
+	dtrace_aggdesc_t *agg = aggdata->dtada_desc;
+	boolean_t line = (j->dtj_depth == 0);
+	dtrace_recdesc_t *rec;
+	int i, aggact = 0;
+
+	if (line)
+		dt_json_reset(j);
+
+	dt_json_begin(j, '{');
+
+	if (agg->dtagd_name != NULL) {
+		dt_json_key(j, "aggregation");
+		dt_json_str(j, agg->dtagd_name, strlen(agg->dtagd_name));
+	}
+
+	dt_json_key(j, "keys");
+	dt_json_begin(j, '[');
+
+	/*
+	 * As in dt_print_aggs(), we skip the first datum (the tuple member
+	 * created by the compiler).
+	 */
+	for (i = 1; i < agg->dtagd_nrecs; i++) {
+		rec = &agg->dtagd_rec[i];
+
+		if (DTRACEACT_ISAGG(rec->dtrd_action)) {
+			aggact = i;
+			break;
+		}
+
+		if (dt_json_datum(dtp, rec, aggdata->dtada_data +
+		    rec->dtrd_offset, rec->dtrd_size, 1) != 0)
+			goto err;
+	}
+
+	dt_json_end(j, ']');
+	assert(aggact != 0);
+
+	if (naggvars == 1) {
+		dt_json_key(j, "value");
+	} else {
+		dt_json_key(j, "values");
+		dt_json_begin(j, '[');
+	}
+
+	for (i = (naggvars == 1 ? 0 : 1); i < naggvars; i++) {
+		aggdata = aggsdata[i];
+		agg = aggdata->dtada_desc;
+		rec = &agg->dtagd_rec[aggact];
+
+		assert(DTRACEACT_ISAGG(rec->dtrd_action));
+
+		if (dt_json_datum(dtp, rec, aggdata->dtada_data +
+		    rec->dtrd_offset, rec->dtrd_size,
+		    aggdata->dtada_normal) != 0)
+			goto err;
+
+		if (!pd->dtpa_allunprint)
+			agg->dtagd_flags |= DTRACE_AGD_PRINTED;
+	}
+
+	if (naggvars != 1)
+		dt_json_end(j, ']');
+
+	dt_json_end(j, '}');
+
+	if (!line)
+		return (0);
+
+	if (dt_json_flush(dtp, j, pd->dtpa_fp) != 0)
+		return (-1);
+
+	return (dt_buffered_flush(dtp, NULL, NULL, aggdata,
+	    DTRACE_BUFDATA_AGGFORMAT | DTRACE_BUFDATA_AGGLAST));
+
+err:
+	/*
+	 * Discard the partial line (or, for printa(), the probe's line) so
+	 * that a later line doesn't find itself nested within it.
+	 */
+	dt_json_reset(j);
+	return (-1);
+}
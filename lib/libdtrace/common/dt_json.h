@@ -0,0 +1,60 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_DT_JSON_H
+#define	_DT_JSON_H
+
+#include <stdio.h>
+#include <dtrace.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A dt_json_t accumulates a single line of JSON output.  Members are
+ * separated automatically:  dtj_first has a bit set for each open container
+ * (up to DT_JSON_MAXDEPTH deep) that does not yet have a member, and dtj_key
+ * is set once a key has been emitted and its value has not.  Allocation
+ * failures are latched in dtj_err and reported by dt_json_flush().
+ */
+#define	DT_JSON_MAXDEPTH	64
+
+typedef struct dt_json {
+	char *dtj_buf;			/* line buffer */
+	size_t dtj_len;			/* length of line in buffer */
+	size_t dtj_size;		/* size of line buffer */
+	int dtj_depth;			/* depth of open containers */
+	uint64_t dtj_first;		/* bitmap of empty open containers */
+	boolean_t dtj_key;		/* key emitted without its value */
+	int dtj_err;			/* latched allocation failure */
+} dt_json_t;
+
+extern void dt_json_begin(dt_json_t *, char);
+extern void dt_json_end(dt_json_t *, char);
+extern void dt_json_key(dt_json_t *, const char *);
+extern void dt_json_str(dt_json_t *, const char *, size_t);
+extern void dt_json_int(dt_json_t *, int64_t);
+extern void dt_json_uint(dt_json_t *, uint64_t);
+extern void dt_json_hex(dt_json_t *, const void *, size_t);
+extern void dt_json_reset(dt_json_t *);
+extern int dt_json_flush(dtrace_hdl_t *, dt_json_t *, FILE *);
+extern void dt_json_destroy(dt_json_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _DT_JSON_H */
@@ -371,6 +371,63 @@ dt_epid_destroy(dtrace_hdl_t *dtp)
 	dtp->dt_maxprobe = 0;
 }
 
+/*
+ * Retrieve the profile of each EPID that was kept by the kernel as a result
+ * of the "ecbprof" option, and call the specified function on the profile of
+ * each EPID that still has an enabled probe description.
+ */
+int
+dtrace_ecbprof_iter(dtrace_hdl_t *dtp, dtrace_ecbprof_f *func, void *arg)
+{
+	dtrace_ecbprofdesc_t desc;
+	dtrace_ecbprof_t *prof = NULL;
+	dtrace_eprobedesc_t *epd;
+	dtrace_probedesc_t *pd;
+	uint64_t i, n = 0;
+	int rval = 0;
+
+	if (dtp->dt_options[DTRACEOPT_ECBPROF] == DTRACEOPT_UNSET)
+		return (dt_set_errno(dtp, EINVAL));
+
+	bzero(&desc, sizeof (desc));
+
+	/*
+	 * The kernel tells us how many EPIDs there are if our array is too
+	 * small for them; as more may be created between calls, we loop
+	 * until our array is large enough.
+	 */
+	for (;;) {
+		if (dt_ioctl(dtp, DTRACEIOC_ECBPROF, &desc) == -1) {
+			rval = dt_set_errno(dtp, errno);
+			goto out;
+		}
+
+		if (desc.dtepd_necbs == 0 ||
+		    (prof != NULL && desc.dtepd_necbs <= n))
+			break;
+
+		dt_free(dtp, prof);
+		n = desc.dtepd_necbs;
+
+		if ((prof = dt_zalloc(dtp, n * sizeof (*prof))) == NULL)
+			return (dt_set_errno(dtp, EDT_NOMEM));
+
+		desc.dtepd_prof = prof;
+	}
+
+	for (i = 0; i < desc.dtepd_necbs; i++) {
+		if (dt_epid_lookup(dtp, prof[i].dtep_epid, &epd, &pd) != 0)
+			continue;
+
+		if ((rval = (*func)(&prof[i], pd, arg)) != 0)
+			break;
+	}
+
+out:
+	dt_free(dtp, prof);
+	return (rval);
+}
+
 void *
 dt_format_lookup(dtrace_hdl_t *dtp, int format)
 {
@@ -65,6 +65,7 @@
 #include <dt_strtab.h>
 #include <dt_module.h>
 #include <dt_impl.h>
+#include <dt_ctfcache.h>
 
 #ifdef _WIN32
 
@@ -1082,6 +1083,334 @@ exit:
 	return symIdx;
 }
 
+/*
+ * Converting types from a PDB is expensive, so the CTF container and PDB type
+ * index map that we build for a module are cached on disk in the directory
+ * named by the "ctfcache" option and reused by later invocations.  A cache
+ * file is named after the module and its identity, and its header repeats
+ * that identity (the image timestamp, checksum and size, and the PDB signature
+ * and age) so that a stale or foreign file is simply ignored; the format is
+ * that of dt_ctfcache.c, and what follows handles the directory.  The cache is
+ * consulted when the first type is imported for a module:  the cache file
+ * is mapped read-only and its container, which is written with a type index
+ * (see ctf_write_indexed()) so that opening it does not scan the types, becomes
+ * the parent of the module's (still empty) dynamic container.  Types that are
+ * not in the cache continue to be imported from the PDB on demand.  If any
+ * were, the cache file is rewritten when the module is unloaded, and the
+ * cache files of other builds of the module that have not been written for
+ * the longest are removed.
+ */
+#define	DT_CTFCACHE_NKEEP	3	/* other builds kept per module */
+
+static dt_ctfcache_hdr_t *
+dt_module_ctfcache_key(dt_module_t *dmp)
+{
+	IMAGEHLP_MODULE64 ihm = {0};
+	dt_ctfcache_hdr_t *key;
+
+	ihm.SizeOfStruct = sizeof (ihm);
+
+	if (!SymGetModuleInfo64(dmp->dm_prochandle, dmp->dm_symbol_base, &ihm))
+		return (NULL);
+
+	if ((key = malloc(sizeof (dt_ctfcache_hdr_t))) == NULL)
+		return (NULL);
+
+	dt_ctfcache_key(key, ihm.TimeDateStamp, ihm.CheckSum, ihm.ImageSize,
+	    &ihm.PdbSig70, ihm.PdbAge);
+
+	return (key);
+}
+
+static void
+dt_module_ctfcache_path(dt_module_t *dmp, const dt_ctfcache_hdr_t *key,
+    char *buf, size_t len)
+{
+	int n = snprintf(buf, len, "%s\\", dmp->dm_ctfdir);
+
+	if (n >= 0 && (size_t)n < len)
+		(void) dt_ctfcache_name(dmp->dm_name, key, buf + n, len - n);
+}
+
+static int
+dt_module_ctfcache_mkdir(const char *dir)
+{
+	char path[PATH_MAX], *p, c;
+
+	if (strlcpy(path, dir, sizeof (path)) >= sizeof (path))
+		return (-1);
+
+	for (p = path + 1; *p != '\0'; p++) {
+		if ((*p != '\\' && *p != '/') || p[-1] == ':')
+			continue;
+
+		c = *p;
+		*p = '\0';
+		(void) CreateDirectoryA(path, NULL);
+		*p = c;
+	}
+
+	if (!CreateDirectoryA(path, NULL) &&
+	    GetLastError() != ERROR_ALREADY_EXISTS)
+		return (-1);
+
+	return (0);
+}
+
+static void
+dt_module_ctfcache_load(dt_module_t *dmp)
+{
+	dt_ctfcache_hdr_t *key;
+	const dt_ctfcache_id_t *ids;
+	ctf_sect_t sect;
+	ctf_file_t *pfp;
+	char path[PATH_MAX];
+	void *data = MAP_FAILED;
+	long size;
+	FILE *fp;
+	uint32_t i, nids;
+	int err;
+
+	if (dmp->dm_flags & DT_DM_CTFCACHE)
+		return;
+
+	dmp->dm_flags |= DT_DM_CTFCACHE;
+
+	if (dmp->dm_ctfdir == NULL || dmp->dm_ctfp == NULL ||
+	    (key = dt_module_ctfcache_key(dmp)) == NULL)
+		return;
+
+	dmp->dm_ctfkey = key;
+	dt_module_ctfcache_path(dmp, key, path, sizeof (path));
+
+	if ((fp = fopen(path, "rb")) == NULL)
+		return;
+
+	/*
+	 * We map the whole file rather than reading it, so that only the parts
+	 * of the container that are actually used are ever paged in.
+	 */
+	if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) <= 0)
+		goto out;
+
+	if ((data = mmap64(NULL, size, PROT_READ, MAP_PRIVATE,
+	    fileno(fp), 0)) == MAP_FAILED)
+		goto out;
+
+	if ((err = dt_ctfcache_check(data, size, key,
+	    &ids, &nids, &sect)) != 0) {
+		dt_dprintf("ignoring %s: %s\n", path, dt_ctfcache_errmsg(err));
+		goto out;
+	}
+
+	if ((pfp = ctf_bufopen(&sect, NULL, NULL, &err)) == NULL) {
+		dt_dprintf("failed to open CTF cache %s: %s\n",
+		    path, ctf_errmsg(err));
+		goto out;
+	}
+
+	(void) ctf_setmodel(pfp, CTF_MODEL_NATIVE);
+
+	if (ctf_import(dmp->dm_ctfp, pfp) == CTF_ERR) {
+		ctf_close(pfp);
+		goto out;
+	}
+
+	ctf_close(pfp); /* dm_ctfp now holds the only reference */
+	dmp->dm_ctfdata = data;
+	dmp->dm_ctfsize = size;
+
+	for (i = 0; i < nids; i++) {
+		if (dt_idmap_add(dmp->dm_idmap,
+		    ids[i].dci_pdbidx, ids[i].dci_ctfid) != 0)
+			break;
+	}
+
+	dmp->dm_ctfnids = i;
+
+	dt_dprintf("loaded %u cached CTF types for %s from %s\n",
+	    dmp->dm_ctfnids, dmp->dm_name, path);
+out:
+	if (data != MAP_FAILED && dmp->dm_ctfdata != data)
+		(void) munmap(data, size);
+
+	(void) fclose(fp);
+}
+
+typedef struct dt_ctfcache_file {
+	FILETIME dcf_time;		/* time last written */
+	char dcf_name[MAX_PATH];	/* file name within cache directory */
+} dt_ctfcache_file_t;
+
+static int
+dt_module_ctfcache_cmp(const void *lp, const void *rp)
+{
+	const dt_ctfcache_file_t *lhs = lp, *rhs = rp;
+
+	return (CompareFileTime(&rhs->dcf_time, &lhs->dcf_time));
+}
+
+/*
+ * Each build of a module has a cache file of its own, so the files of builds
+ * that are no longer installed would otherwise accumulate without bound.
+ * Once the cache file at path has been written, we keep the most recently
+ * written DT_CTFCACHE_NKEEP of the module's other cache files -- more than one
+ * build of a module can be in use at once, such as the native and the WOW64
+ * ntdll -- and remove the rest.  A file that another process has mapped
+ * cannot be removed and is simply left for next time.
+ */
+static void
+dt_module_ctfcache_prune(dt_module_t *dmp, const char *path)
+{
+	const char *base = strrchr(path, '\\') + 1;
+	dt_ctfcache_file_t *files = NULL, *nfiles;
+	char pattern[PATH_MAX], file[PATH_MAX];
+	WIN32_FIND_DATAA fd;
+	HANDLE h;
+	uint32_t i, n = 0;
+
+	(void) snprintf(pattern, sizeof (pattern), "%s\\%s-*.ctf",
+	    dmp->dm_ctfdir, dmp->dm_name);
+
+	if ((h = FindFirstFileA(pattern, &fd)) == INVALID_HANDLE_VALUE)
+		return;
+
+	do {
+		if (_stricmp(fd.cFileName, base) == 0 ||
+		    !dt_ctfcache_match(dmp->dm_name, fd.cFileName))
+			continue;
+
+		nfiles = realloc(files, (n + 1) * sizeof (*files));
+
+		if (nfiles == NULL)
+			break;
+
+		files = nfiles;
+		files[n].dcf_time = fd.ftLastWriteTime;
+		(void) strlcpy(files[n].dcf_name, fd.cFileName,
+		    sizeof (files[n].dcf_name));
+		n++;
+	} while (FindNextFileA(h, &fd));
+
+	(void) FindClose(h);
+
+	if (n > DT_CTFCACHE_NKEEP)
+		qsort(files, n, sizeof (*files), dt_module_ctfcache_cmp);
+
+	for (i = DT_CTFCACHE_NKEEP; i < n; i++) {
+		(void) snprintf(file, sizeof (file), "%s\\%s",
+		    dmp->dm_ctfdir, files[i].dcf_name);
+
+		if (DeleteFileA(file))
+			dt_dprintf("removed stale CTF cache %s\n", file);
+	}
+
+	free(files);
+}
+
+static void
+dt_module_ctfcache_save(dt_module_t *dmp)
+{
+	struct dt_idmap *map = dmp->dm_idmap;
+	ctf_file_t *ctfp = dmp->dm_ctfp, *octfp = dmp->dm_ctfp;
+	dt_ctfcache_id_t *ids = NULL;
+	char path[PATH_MAX], tmp[PATH_MAX];
+	ctf_id_t base = 0;
+	FILE *fp;
+	uint32_t i, n = 0;
+	int err, rv = -1;
+
+	if (dmp->dm_ctfkey == NULL || ctfp == NULL || map == NULL)
+		return;
+
+	for (i = 0; i < map->size; i++) {
+		if (map->p2c[i] != CTF_ERR)
+			n++;
+	}
+
+	if (n <= dmp->dm_ctfnids)
+		return; /* nothing has been imported since the cache was read */
+
+	if (ctf_update(octfp) == CTF_ERR ||
+	    dt_module_ctfcache_mkdir(dmp->dm_ctfdir) != 0)
+		goto out;
+
+	/*
+	 * If the cache supplied a parent container, the newly imported types
+	 * are in its child, but a cache file holds a single container.  In
+	 * that case we write a copy of the parent with the child's types
+	 * appended, in which child type t has the identifier base plus the
+	 * index of t; the parent's types keep theirs.  Only the new types are
+	 * copied and renumbered -- nothing is imported from the PDB again.
+	 */
+	if (dmp->dm_ctfdata != NULL &&
+	    (ctfp = ctf_flatten(octfp, &base, &err)) == NULL) {
+		dt_dprintf("failed to merge CTF for %s: %s\n",
+		    dmp->dm_name, ctf_errmsg(err));
+		goto out;
+	}
+
+	if ((ids = malloc(n * sizeof (dt_ctfcache_id_t))) == NULL)
+		goto out;
+
+	for (i = 0, n = 0; i < map->size; i++) {
+		if (map->p2c[i] == CTF_ERR)
+			continue;
+
+		ids[n].dci_pdbidx = i;
+		ids[n].dci_ctfid = map->p2c[i];
+
+		if (ctfp != octfp && CTF_TYPE_ISCHILD(ids[n].dci_ctfid))
+			ids[n].dci_ctfid = base +
+			    CTF_TYPE_TO_INDEX(ids[n].dci_ctfid);
+
+		n++;
+	}
+
+	dt_module_ctfcache_path(dmp, dmp->dm_ctfkey, path, sizeof (path));
+	(void) snprintf(tmp, sizeof (tmp), "%s.%lu", path,
+	    (ulong_t)GetCurrentProcessId());
+
+	if ((fp = fopen(tmp, "wb")) == NULL)
+		goto out;
+
+	rv = dt_ctfcache_write(fp, dmp->dm_ctfkey, ids, n, ctfp);
+
+	if (fclose(fp) != 0)
+		rv = -1;
+
+	/*
+	 * Windows will not replace a file that is mapped, so we release the
+	 * old cache file (and the container that uses it) before renaming the
+	 * new one over it.  We are only called as the module is unloaded.
+	 */
+	if (dmp->dm_ctfdata != NULL) {
+		ctf_close(octfp);
+		dmp->dm_ctfp = NULL;
+		(void) munmap(dmp->dm_ctfdata, dmp->dm_ctfsize);
+		dmp->dm_ctfdata = NULL;
+		dmp->dm_ctfsize = 0;
+	}
+
+	if (rv != 0 || !MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING)) {
+		(void) DeleteFileA(tmp);
+		rv = -1;
+		goto out;
+	}
+
+	dt_dprintf("saved %u CTF types for %s to %s\n",
+	    n, dmp->dm_name, path);
+	dt_module_ctfcache_prune(dmp, path);
+out:
+	if (rv != 0)
+		dt_dprintf("failed to save CTF cache for %s\n", dmp->dm_name);
+
+	if (ctfp != octfp && ctfp != NULL)
+		ctf_close(ctfp);
+
+	free(ids);
+}
+
 static BOOL CALLBACK
 dt_module_type_enum_callback(PSYMBOL_INFO SymInfo, ULONG Size,
 			     PVOID UserContext)
@@ -1106,6 +1435,18 @@ dt_module_import_type(dt_module_t *dmp, const char *name, ULONG typeIdx)
 		goto exit;
 	}
 
+	dt_module_ctfcache_load(dmp);
+
+	/*
+	 * Our caller only looked in the module's container before the cache
+	 * could supply it with a parent, so look there again before we resort
+	 * to the PDB.
+	 */
+	if (NULL != name && NULL != dmp->dm_ctfdata &&
+	    CTF_ERR != (symIdx = ctf_lookup_by_name(dmp->dm_ctfp, name))) {
+		goto exit;
+	}
+
 	if (NULL != name) {
 		typeIdx = 0;
 		if (!SymEnumTypesByName(dmp->dm_prochandle, dmp->dm_symbol_base,
@@ -2284,6 +2625,9 @@ dt_module_getctf(dtrace_hdl_t *dtp, dt_module_t *dmp)
 		return (NULL);
 	}
 
+	if (dtp->dt_ctfcache_path != NULL && dmp->dm_ctfdir == NULL)
+		dmp->dm_ctfdir = strdup(dtp->dt_ctfcache_path);
+
 	/* Too expensice - types will be imported as needed */
 	/*dt_module_import_types(dmp);*/
 
@@ -2356,9 +2700,25 @@ dt_module_unload(dtrace_hdl_t *dtp, dt_module_t *dmp)
 {
 	int i;
 
+#ifdef _WIN32
+	dt_module_ctfcache_save(dmp);
+#endif
+
 	ctf_close(dmp->dm_ctfp);
 	dmp->dm_ctfp = NULL;
 
+#ifdef _WIN32
+	if (dmp->dm_ctfdata != NULL)
+		(void) munmap(dmp->dm_ctfdata, dmp->dm_ctfsize);
+	dmp->dm_ctfdata = NULL;
+	dmp->dm_ctfsize = 0;
+	free(dmp->dm_ctfkey);
+	dmp->dm_ctfkey = NULL;
+	free(dmp->dm_ctfdir);
+	dmp->dm_ctfdir = NULL;
+	dmp->dm_ctfnids = 0;
+#endif
+
 #if !defined(illumos) && !defined(_WIN32)
 	if (dmp->dm_ctdata.cts_data != NULL) {
 		free(dmp->dm_ctdata.cts_data);
@@ -2471,7 +2831,7 @@ dt_module_unload(dtrace_hdl_t *dtp, dt_module_t *dmp)
 
 	dmp->dm_pid = 0;
 
-	dmp->dm_flags &= ~DT_DM_LOADED;
+	dmp->dm_flags &= ~(DT_DM_LOADED | DT_DM_CTFCACHE);
 }
 
 void
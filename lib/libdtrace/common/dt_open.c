@@ -1145,6 +1145,8 @@ dt_vopen(int version, int flags, int *errp,
 	int i, err;
 #ifndef _WIN32
 	struct rlimit rl;
+#else
+	const char *appdata;
 #endif
 
 	const dt_intrinsic_t *dinp;
@@ -1325,6 +1327,17 @@ alloc:
 	dtp->dt_ld_path = strdup(_dtrace_defld);
 #ifdef __FreeBSD__
 	dtp->dt_objcopy_path = strdup(_dtrace_defobjcopy);
+#endif
+#ifdef _WIN32
+	/*
+	 * By default, CTF converted from PDBs is cached per-user; this may be
+	 * changed or disabled with the "ctfcache" option.
+	 */
+	if ((appdata = getenv("LOCALAPPDATA")) != NULL &&
+	    (dtp->dt_ctfcache_path = malloc(strlen(appdata) + 16)) != NULL) {
+		(void) sprintf(dtp->dt_ctfcache_path,
+		    "%s\\dtrace\\ctf", appdata);
+	}
 #endif
 	dtp->dt_provmod = provmod;
 	dtp->dt_vector = vector;
@@ -1846,6 +1859,11 @@ dtrace_close(dtrace_hdl_t *dtp)
 	dt_etw_destroy(dtp);
 #endif
 	dt_buffered_destroy(dtp);
+	dt_obuf_destroy(dtp);
+	dt_json_destroy(&dtp->dt_json);
+	free(dtp->dt_sprintf_buf);
+	dt_consume_destroy(dtp);
+	dt_capture_destroy(dtp);
 	dt_aggregate_destroy(dtp);
 	dt_pfdict_destroy(dtp);
 	dt_provmod_destroy(&dtp->dt_provmod);
@@ -1866,6 +1884,9 @@ dtrace_close(dtrace_hdl_t *dtp)
 #ifdef __FreeBSD__
 	free(dtp->dt_objcopy_path);
 #endif
+#ifdef _WIN32
+	free(dtp->dt_ctfcache_path);
+#endif
 
 	free(dtp->dt_mods);
 #ifdef __FreeBSD__
@@ -313,6 +313,29 @@ dt_opt_objcopy_path(dtrace_hdl_t *dtp, const char *arg, uintptr_t option)
 }
 #endif
 
+#ifdef _WIN32
+/*ARGSUSED*/
+static int
+dt_opt_ctfcache(dtrace_hdl_t *dtp, const char *arg, uintptr_t option)
+{
+	char *dir = NULL;
+
+	if (arg == NULL)
+		return (dt_set_errno(dtp, EDT_BADOPTVAL));
+
+	/*
+	 * An empty directory disables the on-disk cache of PDB-derived CTF.
+	 */
+	if (*arg != '\0' && (dir = strdup(arg)) == NULL)
+		return (dt_set_errno(dtp, EDT_NOMEM));
+
+	free(dtp->dt_ctfcache_path);
+	dtp->dt_ctfcache_path = dir;
+
+	return (0);
+}
+#endif
+
 /*ARGSUSED*/
 static int
 dt_opt_libdir(dtrace_hdl_t *dtp, const char *arg, uintptr_t option)
@@ -873,10 +896,45 @@ dt_opt_bufpolicy(dtrace_hdl_t *dtp, const char *arg, uintptr_t option)
 	return (0);
 }
 
+static const struct {
+	const char *dtof_name;
+	int dtof_format;
+} _dtrace_oformats[] = {
+	{ "json", DTRACEOPT_OFORMAT_JSON },
+	{ "text", DTRACEOPT_OFORMAT_TEXT },
+	{ NULL, 0 }
+};
+
+/*ARGSUSED*/
+static int
+dt_opt_oformat(dtrace_hdl_t *dtp, const char *arg, uintptr_t option)
+{
+	dtrace_optval_t format = DTRACEOPT_UNSET;
+	int i;
+
+	if (arg == NULL)
+		return (dt_set_errno(dtp, EDT_BADOPTVAL));
+
+	for (i = 0; _dtrace_oformats[i].dtof_name != NULL; i++) {
+		if (strcmp(_dtrace_oformats[i].dtof_name, arg) == 0) {
+			format = _dtrace_oformats[i].dtof_format;
+			break;
+		}
+	}
+
+	if (format == DTRACEOPT_UNSET)
+		return (dt_set_errno(dtp, EDT_BADOPTVAL));
+
+	dtp->dt_options[DTRACEOPT_OFORMAT] = format;
+
+	return (0);
+}
+
 static const struct {
 	const char *dtbr_name;
 	int dtbr_policy;
 } _dtrace_bufresize[] = {
+	{ "adaptive", DTRACEOPT_BUFRESIZE_ADAPTIVE },
 	{ "auto", DTRACEOPT_BUFRESIZE_AUTO },
 	{ "manual", DTRACEOPT_BUFRESIZE_MANUAL },
 	{ NULL, 0 }
@@ -986,10 +1044,14 @@ static const dt_option_t _dtrace_ctoptions[] = {
 	{ "aggpercpu", dt_opt_agg, DTRACE_A_PERCPU },
 	{ "amin", dt_opt_amin },
 	{ "argref", dt_opt_cflags, DTRACE_C_ARGREF },
+	{ "clausefuse", dt_opt_cflags, DTRACE_C_FUSE },
 	{ "core", dt_opt_core },
 	{ "cpp", dt_opt_cflags, DTRACE_C_CPP },
 	{ "cpphdrs", dt_opt_cpp_hdrs },
 	{ "cpppath", dt_opt_cpp_path },
+#ifdef _WIN32
+	{ "ctfcache", dt_opt_ctfcache },
+#endif
 	{ "ctypes", dt_opt_ctypes },
 	{ "defaultargs", dt_opt_cflags, DTRACE_C_DEFARG },
 	{ "dtypes", dt_opt_dtypes },
@@ -1037,13 +1099,16 @@ static const dt_option_t _dtrace_ctoptions[] = {
  */
 static const dt_option_t _dtrace_rtoptions[] = {
 	{ "aggsize", dt_opt_size, DTRACEOPT_AGGSIZE },
+	{ "aggspill", dt_opt_runtime, DTRACEOPT_AGGSPILL },
 	{ "bufsize", dt_opt_size, DTRACEOPT_BUFSIZE },
 	{ "bufpolicy", dt_opt_bufpolicy, DTRACEOPT_BUFPOLICY },
 	{ "bufresize", dt_opt_bufresize, DTRACEOPT_BUFRESIZE },
 	{ "cleanrate", dt_opt_rate, DTRACEOPT_CLEANRATE },
+	{ "consumethreads", dt_opt_runtime, DTRACEOPT_CONSUMETHREADS },
 	{ "cpu", dt_opt_runtime, DTRACEOPT_CPU },
 	{ "destructive", dt_opt_runtime, DTRACEOPT_DESTRUCTIVE },
 	{ "dynvarsize", dt_opt_size, DTRACEOPT_DYNVARSIZE },
+	{ "ecbprof", dt_opt_runtime, DTRACEOPT_ECBPROF },
 	{ "grabanon", dt_opt_runtime, DTRACEOPT_GRABANON },
 	{ "jstackframes", dt_opt_runtime, DTRACEOPT_JSTACKFRAMES },
 	{ "jstackstrsize", dt_opt_size, DTRACEOPT_JSTACKSTRSIZE },
@@ -1069,8 +1134,10 @@ static const dt_option_t _dtrace_drtoptions[] = {
 	{ "aggsortkeypos", dt_opt_runtime, DTRACEOPT_AGGSORTKEYPOS },
 	{ "aggsortpos", dt_opt_runtime, DTRACEOPT_AGGSORTPOS },
 	{ "aggsortrev", dt_opt_runtime, DTRACEOPT_AGGSORTREV },
+	{ "aggsortthreads", dt_opt_runtime, DTRACEOPT_AGGSORTTHREADS },
 	{ "aggzoom", dt_opt_runtime, DTRACEOPT_AGGZOOM },
 	{ "flowindent", dt_opt_runtime, DTRACEOPT_FLOWINDENT },
+	{ "oformat", dt_opt_oformat, DTRACEOPT_OFORMAT },
 	{ "quiet", dt_opt_runtime, DTRACEOPT_QUIET },
 	{ "rawbytes", dt_opt_runtime, DTRACEOPT_RAWBYTES },
 	{ "stackindent", dt_opt_runtime, DTRACEOPT_STACKINDENT },
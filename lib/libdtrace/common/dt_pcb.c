@@ -133,6 +133,8 @@ dt_pcb_pop(dtrace_hdl_t *dtp, int err)
 			dtrace_stmt_destroy(dtp, pcb->pcb_stmt);
 		if (pcb->pcb_ecbdesc != NULL)
 			dt_ecbdesc_release(dtp, pcb->pcb_ecbdesc);
+		if (pcb->pcb_fusedesc != NULL)
+			dt_ecbdesc_release(dtp, pcb->pcb_fusedesc);
 
 		for (dxp = dt_list_next(&dtp->dt_xlators); dxp; dxp = nxp) {
 			nxp = dt_list_next(dxp);
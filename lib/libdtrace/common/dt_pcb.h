@@ -79,6 +79,7 @@ typedef struct dt_pcb {
 	dtrace_prog_t *pcb_prog; /* intermediate program made by compiler */
 	dtrace_stmtdesc_t *pcb_stmt; /* intermediate stmt made by compiler */
 	dtrace_ecbdesc_t *pcb_ecbdesc; /* intermediate ecbdesc made by cmplr */
+	dtrace_ecbdesc_t *pcb_fusedesc; /* ecbdesc open for clause fusion */
 	jmp_buf pcb_jmpbuf;	/* setjmp(3C) buffer for error return */
 	const char *pcb_region;	/* optional region name for yyerror() suffix */
 	dtrace_probespec_t pcb_pspec; /* probe description evaluation context */
@@ -26,7 +26,8 @@
  * Create a new priority queue.
  *
  * size is the maximum number of items that will be stored in the priority
- * queue at one time.
+ * queue at one time.  Items are ordered by the uint64_t value returned by
+ * value_cb, smallest first.
  */
 dt_pq_t *
 dt_pq_init(dtrace_hdl_t *dtp, uint_t size, dt_pq_value_f value_cb, void *cb_arg)
@@ -52,6 +53,28 @@ dt_pq_init(dtrace_hdl_t *dtp, uint_t size, dt_pq_value_f value_cb, void *cb_arg)
 	return (p);
 }
 
+/*
+ * Create a new priority queue whose items are ordered by a comparison
+ * function rather than by a scalar value.  cmp_cb returns a negative value,
+ * zero or a positive value as its first item is to be ordered before, with,
+ * or after its second item; the item ordered first is at the head of the
+ * queue.  Coupled with dt_pq_peek() and dt_pq_replace(), this allows for a
+ * bounded heap that retains the best N of an arbitrary number of items.
+ */
+dt_pq_t *
+dt_pq_init_cmp(dtrace_hdl_t *dtp, uint_t size, dt_pq_cmp_f cmp_cb,
+    void *cb_arg)
+{
+	dt_pq_t *p;
+
+	if ((p = dt_pq_init(dtp, size, NULL, cb_arg)) == NULL)
+		return (NULL);
+
+	p->dtpq_cmp = cmp_cb;
+
+	return (p);
+}
+
 void
 dt_pq_fini(dt_pq_t *p)
 {
@@ -68,6 +91,50 @@ dt_pq_getvalue(dt_pq_t *p, uint_t index)
 	return (p->dtpq_value(item, p->dtpq_arg));
 }
 
+/*
+ * Returns non-zero if the item at index l is to be ordered strictly before
+ * the item at index r.
+ */
+static int
+dt_pq_less(dt_pq_t *p, uint_t l, uint_t r)
+{
+	if (p->dtpq_cmp != NULL) {
+		return (p->dtpq_cmp(p->dtpq_items[l],
+		    p->dtpq_items[r], p->dtpq_arg) < 0);
+	}
+
+	return (dt_pq_getvalue(p, l) < dt_pq_getvalue(p, r));
+}
+
+static void
+dt_pq_siftdown(dt_pq_t *p, uint_t i)
+{
+	for (;;) {
+		uint_t lc = i * 2;
+		uint_t rc = i * 2 + 1;
+		uint_t c;
+		void *tmp;
+
+		if (lc >= p->dtpq_last)
+			break;
+
+		if (rc >= p->dtpq_last || dt_pq_less(p, lc, rc)) {
+			c = lc;
+		} else {
+			c = rc;
+		}
+
+		if (!dt_pq_less(p, c, i))
+			break;
+
+		tmp = p->dtpq_items[i];
+		p->dtpq_items[i] = p->dtpq_items[c];
+		p->dtpq_items[c] = tmp;
+
+		i = c;
+	}
+}
+
 void
 dt_pq_insert(dt_pq_t *p, void *item)
 {
@@ -78,7 +145,7 @@ dt_pq_insert(dt_pq_t *p, void *item)
 	i = p->dtpq_last++;
 	p->dtpq_items[i] = item;
 
-	while (i > 1 && dt_pq_getvalue(p, i) < dt_pq_getvalue(p, i / 2)) {
+	while (i > 1 && dt_pq_less(p, i, i / 2)) {
 		void *tmp = p->dtpq_items[i];
 		p->dtpq_items[i] = p->dtpq_items[i / 2];
 		p->dtpq_items[i / 2] = tmp;
@@ -103,7 +170,6 @@ dt_pq_walk(dt_pq_t *p, uint_t *cookie)
 void *
 dt_pq_pop(dt_pq_t *p)
 {
-	uint_t i = 1;
 	void *ret;
 
 	assert(p->dtpq_last > 0);
@@ -117,41 +183,48 @@ dt_pq_pop(dt_pq_t *p)
 	p->dtpq_items[1] = p->dtpq_items[p->dtpq_last];
 	p->dtpq_items[p->dtpq_last] = NULL;
 
-	for (;;) {
-		uint_t lc = i * 2;
-		uint_t rc = i * 2 + 1;
-		uint_t c;
-		uint64_t v;
-		void *tmp;
+	dt_pq_siftdown(p, 1);
 
-		if (lc >= p->dtpq_last)
-			break;
+	return (ret);
+}
 
-		if (rc >= p->dtpq_last) {
-			c = lc;
-			v = dt_pq_getvalue(p, lc);
-		} else {
-			uint64_t lv = dt_pq_getvalue(p, lc);
-			uint64_t rv = dt_pq_getvalue(p, rc);
-
-			if (lv < rv) {
-				c = lc;
-				v = lv;
-			} else {
-				c = rc;
-				v = rv;
-			}
-		}
+/*
+ * Return the item at the head of the priority queue without removing it, or
+ * NULL if the queue is empty.
+ */
+void *
+dt_pq_peek(dt_pq_t *p)
+{
+	assert(p->dtpq_last > 0);
 
-		if (v >= dt_pq_getvalue(p, i))
-			break;
+	if (p->dtpq_last == 1)
+		return (NULL);
 
-		tmp = p->dtpq_items[i];
-		p->dtpq_items[i] = p->dtpq_items[c];
-		p->dtpq_items[c] = tmp;
+	return (p->dtpq_items[1]);
+}
 
-		i = c;
-	}
+/*
+ * Replace the item at the head of the priority queue with the specified
+ * item, returning the item that was replaced.  This is equivalent to (but
+ * cheaper than) a dt_pq_pop() followed by a dt_pq_insert().
+ */
+void *
+dt_pq_replace(dt_pq_t *p, void *item)
+{
+	void *ret;
+
+	assert(p->dtpq_last > 1);
+
+	ret = p->dtpq_items[1];
+	p->dtpq_items[1] = item;
+
+	dt_pq_siftdown(p, 1);
 
 	return (ret);
 }
+
+uint_t
+dt_pq_count(dt_pq_t *p)
+{
+	return (p->dtpq_last - 1);
+}
@@ -27,6 +27,7 @@ extern "C" {
 #endif
 
 typedef uint64_t (*dt_pq_value_f)(void *, void *);
+typedef int (*dt_pq_cmp_f)(void *, void *, void *);
 
 typedef struct dt_pq {
 	dtrace_hdl_t *dtpq_hdl;		/* dtrace handle */
@@ -34,14 +35,20 @@ typedef struct dt_pq {
 	uint_t dtpq_size;		/* count of allocated elements */
 	uint_t dtpq_last;		/* next free slot */
 	dt_pq_value_f dtpq_value;	/* callback to get the value */
+	dt_pq_cmp_f dtpq_cmp;		/* callback to compare elements */
 	void *dtpq_arg;			/* callback argument */
 } dt_pq_t;
 
 extern dt_pq_t *dt_pq_init(dtrace_hdl_t *, uint_t size, dt_pq_value_f, void *);
+extern dt_pq_t *dt_pq_init_cmp(dtrace_hdl_t *, uint_t size, dt_pq_cmp_f,
+    void *);
 extern void dt_pq_fini(dt_pq_t *);
 
 extern void dt_pq_insert(dt_pq_t *, void *);
 extern void *dt_pq_pop(dt_pq_t *);
+extern void *dt_pq_peek(dt_pq_t *);
+extern void *dt_pq_replace(dt_pq_t *, void *);
+extern uint_t dt_pq_count(dt_pq_t *);
 extern void *dt_pq_walk(dt_pq_t *, uint_t *);
 
 #ifdef	__cplusplus
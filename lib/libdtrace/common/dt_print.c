@@ -707,6 +707,12 @@ dtrace_print(dtrace_hdl_t *dtp, FILE *fp, const char *typename,
 	pa.pa_nest = 0;
 	pa.pa_depth = 0;
 	pa.pa_file = fp;
+
+	/*
+	 * The members are written to fp directly; anything already buffered
+	 * for fp must precede them.
+	 */
+	(void) dt_obuf_flush(dtp, B_TRUE);
 	(void) ctf_type_visit(pa.pa_ctfp, id, dt_print_member, &pa);
 
 	dt_print_trailing_braces(&pa, 0);
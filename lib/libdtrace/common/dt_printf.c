@@ -30,7 +30,7 @@
 
 #ifdef illumos
 #include <sys/sysmacros.h>
-#else
+#elif !defined(_WIN32)		/* <ntcompat.h> defines ABS() */
 #define	ABS(a)		((a) < 0 ? -(a) : (a))
 #endif
 #include <string.h>
@@ -899,9 +899,13 @@ dt_printf_create(dtrace_hdl_t *dtp, const char *s)
 		switch (c = *++p) {
 		case '0': case '1': case '2': case '3': case '4':
 		case '5': case '6': case '7': case '8': case '9':
+			/*
+			 * As in printf(3C), the '0' flag is ignored when the
+			 * '-' flag is also present, in either order.
+			 */
 			if (dot == 0 && digits == 0 && c == '0') {
-				pfd->pfd_flags |= DT_PFCONV_ZPAD;
-				pfd->pfd_flags &= ~DT_PFCONV_LEFT;
+				if (!(pfd->pfd_flags & DT_PFCONV_LEFT))
+					pfd->pfd_flags |= DT_PFCONV_ZPAD;
 				goto fmt_switch;
 			}
 
@@ -1058,6 +1062,138 @@ dt_printf_destroy(dt_pfargv_t *pfv)
 	free(pfv);
 }
 
+/*
+ * Build the printf(3C) format for a conversion with the specified width and
+ * precision, returning -1 if it will not fit in the buffer.
+ */
+static int
+dt_printf_fmtstr(const dt_pfargd_t *pfd, int width, int prec,
+    char *buf, size_t size)
+{
+	char flags[8], *f = flags;
+	int n;
+
+	if (pfd->pfd_flags & DT_PFCONV_ALT)
+		*f++ = '#';
+	if (pfd->pfd_flags & DT_PFCONV_ZPAD)
+		*f++ = '0';
+	if (width < 0 || (pfd->pfd_flags & DT_PFCONV_LEFT))
+		*f++ = '-';
+	if (pfd->pfd_flags & DT_PFCONV_SPOS)
+		*f++ = '+';
+	if (pfd->pfd_flags & DT_PFCONV_GROUP)
+		*f++ = '\'';
+	if (pfd->pfd_flags & DT_PFCONV_SPACE)
+		*f++ = ' ';
+	*f = '\0';
+
+	if (width != 0 && prec > 0) {
+		n = snprintf(buf, size, "%%%s%d.%d%s",
+		    flags, ABS(width), prec, pfd->pfd_fmt);
+	} else if (width != 0) {
+		n = snprintf(buf, size, "%%%s%d%s",
+		    flags, ABS(width), pfd->pfd_fmt);
+	} else if (prec > 0) {
+		n = snprintf(buf, size, "%%%s.%d%s", flags, prec, pfd->pfd_fmt);
+	} else {
+		n = snprintf(buf, size, "%%%s%s", flags, pfd->pfd_fmt);
+	}
+
+	return (n < 0 || (size_t)n >= size ? -1 : 0);
+}
+
+/*
+ * Compile each conversion of a format whose output formats (pfd_fmt) have
+ * been determined.  Conversions with a static width and precision have their
+ * printf(3C) format built once here rather than for every record, and the
+ * most common conversions are given an operation that formats them without
+ * printf(3C) at all:  integers and strings with no flags other than '-' or
+ * '0', a width, and no precision.  Anything else is printed as before.
+ */
+static void
+dt_printf_compile(dt_pfargv_t *pfv)
+{
+	const uint_t fast = DT_PFCONV_LEFT | DT_PFCONV_ZPAD;
+	const uint_t dyn = DT_PFCONV_DYNWIDTH | DT_PFCONV_DYNPREC;
+	dt_pfargd_t *pfd;
+
+	for (pfd = pfv->pfv_argv; pfd != NULL; pfd = pfd->pfd_next) {
+		const dt_pfconv_t *pfc = pfd->pfd_conv;
+		dt_pfprint_f *func;
+		const char *f;
+		size_t len;
+
+		pfd->pfd_op = DT_PFOP_FORMAT;
+		pfd->pfd_isize = 0;
+		pfd->pfd_cfmt[0] = '\0';
+
+		if (pfc == NULL)
+			continue;
+
+		func = pfc->pfc_print;
+
+		if (func == &pfprint_pct || (pfd->pfd_flags & dyn))
+			continue;
+
+		/*
+		 * A left-aligned stack is formatted without its width (see
+		 * dt_printf_format()), but only when printed as a stack.
+		 */
+		if ((func != &pfprint_stack ||
+		    !(pfd->pfd_flags & DT_PFCONV_LEFT)) &&
+		    dt_printf_fmtstr(pfd, pfd->pfd_width, pfd->pfd_prec,
+		    pfd->pfd_cfmt, sizeof (pfd->pfd_cfmt)) != 0)
+			pfd->pfd_cfmt[0] = '\0';
+
+		if ((pfd->pfd_flags & ~fast) != 0 || pfd->pfd_prec != 0)
+			continue;
+
+		if (func == &pfprint_cstr) {
+			if (!(pfd->pfd_flags & DT_PFCONV_ZPAD))
+				pfd->pfd_op = DT_PFOP_STR;
+			continue;
+		}
+
+		if (func == &pfprint_addr) {
+			if (!(pfd->pfd_flags & DT_PFCONV_ZPAD))
+				pfd->pfd_op = DT_PFOP_ADDR;
+			continue;
+		}
+
+		if (func != &pfprint_sint && func != &pfprint_uint &&
+		    func != &pfprint_dint)
+			continue;
+
+		/*
+		 * Zero-padding is done in a fixed-size buffer; anything wider
+		 * than that is left to printf(3C).
+		 */
+		if ((pfd->pfd_flags & DT_PFCONV_ZPAD) && pfd->pfd_width > 64)
+			continue;
+
+		f = pfd->pfd_fmt;
+		len = strlen(f);
+
+		if (len == 0 || strchr("diouxX", f[len - 1]) == NULL)
+			continue;
+
+		if (len == 1) {
+			pfd->pfd_isize = sizeof (int);
+		} else if (len == 2 && f[0] == 'h') {
+			pfd->pfd_isize = sizeof (short);
+		} else if (len == 2 && f[0] == 'l') {
+			pfd->pfd_isize = sizeof (long);
+		} else if (len == 3 && f[0] == 'l' && f[1] == 'l') {
+			pfd->pfd_isize = sizeof (long long);
+		} else {
+			continue;
+		}
+
+		pfd->pfd_oconv = f[len - 1];
+		pfd->pfd_op = DT_PFOP_INT;
+	}
+}
+
 void
 dt_printf_validate(dt_pfargv_t *pfv, uint_t flags,
     dt_ident_t *idp, int foff, dtrace_actkind_t kind, dt_node_t *dnp)
@@ -1206,6 +1342,8 @@ dt_printf_validate(dt_pfargv_t *pfv, uint_t flags,
 		    "%s( ) prototype mismatch: only %d arguments "
 		    "required by this format string\n", func, j);
 	}
+
+	dt_printf_compile(pfv);
 }
 
 void
@@ -1354,6 +1492,162 @@ pfprint_llquantize(dtrace_hdl_t *dtp, FILE *fp, const char *format,
 	return (dt_print_llquantize(dtp, fp, addr, size, normal));
 }
 
+/*
+ * Print a DT_PFOP_INT conversion.  The value is computed exactly as
+ * pfprint_sint() or pfprint_uint() would compute it, and then converted to
+ * the type that printf(3C) would have read for the conversion.
+ */
+static int
+dt_printf_int(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargd_t *pfd,
+    const void *addr, size_t size, uint64_t normal)
+{
+	static const char lower[] = "0123456789abcdef";
+	static const char upper[] = "0123456789ABCDEF";
+	const char *digits = pfd->pfd_oconv == 'X' ? upper : lower;
+	dt_pfprint_f *func = pfd->pfd_conv->pfc_print;
+	int width = pfd->pfd_width;
+	char buf[88], *end = &buf[sizeof (buf)], *p = end;
+	uint64_t val, base;
+	int neg = 0;
+
+	if (func == &pfprint_dint) {
+		func = (pfd->pfd_flags & DT_PFCONV_SIGNED) ?
+		    &pfprint_sint : &pfprint_uint;
+	}
+
+	if (func == &pfprint_sint) {
+		int32_t n = (int32_t)(int64_t)normal;
+
+		switch (size) {
+		case sizeof (int8_t):
+			val = (int64_t)((int32_t)*((int8_t *)addr) / n);
+			break;
+		case sizeof (int16_t):
+			val = (int64_t)((int32_t)*((int16_t *)addr) / n);
+			break;
+		case sizeof (int32_t):
+			val = (int64_t)(*((int32_t *)addr) / n);
+			break;
+		case sizeof (int64_t):
+			val = *((int64_t *)addr) / (int64_t)normal;
+			break;
+		default:
+			return (dt_set_errno(dtp, EDT_DMISMATCH));
+		}
+	} else {
+		uint32_t n = (uint32_t)normal;
+
+		switch (size) {
+		case sizeof (uint8_t):
+			val = (uint32_t)*((uint8_t *)addr) / n;
+			break;
+		case sizeof (uint16_t):
+			val = (uint32_t)*((uint16_t *)addr) / n;
+			break;
+		case sizeof (uint32_t):
+			val = *((uint32_t *)addr) / n;
+			break;
+		case sizeof (uint64_t):
+			val = *((uint64_t *)addr) / normal;
+			break;
+		default:
+			return (dt_set_errno(dtp, EDT_DMISMATCH));
+		}
+	}
+
+	switch (pfd->pfd_oconv) {
+	case 'd':
+	case 'i':
+		base = 10;
+
+		switch (pfd->pfd_isize) {
+		case sizeof (int16_t):
+			val = (int64_t)(int16_t)val;
+			break;
+		case sizeof (int32_t):
+			val = (int64_t)(int32_t)val;
+			break;
+		}
+
+		if ((int64_t)val < 0) {
+			val = -val;
+			neg = 1;
+		}
+		break;
+	default:
+		base = pfd->pfd_oconv == 'o' ? 8 : pfd->pfd_oconv == 'u' ?
+		    10 : 16;
+
+		switch (pfd->pfd_isize) {
+		case sizeof (uint16_t):
+			val = (uint16_t)val;
+			break;
+		case sizeof (uint32_t):
+			val = (uint32_t)val;
+			break;
+		}
+		break;
+	}
+
+	do {
+		*--p = digits[val % base];
+		val /= base;
+	} while (val != 0);
+
+	if ((pfd->pfd_flags & (DT_PFCONV_ZPAD | DT_PFCONV_LEFT)) ==
+	    DT_PFCONV_ZPAD) {
+		while (end - p < width - neg)
+			*--p = '0';
+	}
+
+	if (neg)
+		*--p = '-';
+
+	return (dt_putfield(dtp, fp, p, end - p,
+	    (pfd->pfd_flags & DT_PFCONV_LEFT) ? -width : width));
+}
+
+/*
+ * Print a DT_PFOP_STR or DT_PFOP_ADDR conversion; these are equivalent to
+ * pfprint_cstr() and pfprint_addr() with a format of "%*s".
+ */
+static int
+dt_printf_str(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargd_t *pfd,
+    const void *addr, size_t size)
+{
+	int width = (pfd->pfd_flags & DT_PFCONV_LEFT) ?
+	    -pfd->pfd_width : pfd->pfd_width;
+	const char *s = addr, *end;
+	int n, len = 256;
+	uint64_t val;
+	char *buf;
+
+	if (pfd->pfd_op == DT_PFOP_STR) {
+		if ((end = memchr(s, '\0', size)) != NULL)
+			size = (size_t)(end - s);
+
+		return (dt_putfield(dtp, fp, s, size, width));
+	}
+
+	switch (size) {
+	case sizeof (uint32_t):
+		val = *((uint32_t *)addr);
+		break;
+	case sizeof (uint64_t):
+		val = *((uint64_t *)addr);
+		break;
+	default:
+		return (dt_set_errno(dtp, EDT_DMISMATCH));
+	}
+
+	do {
+		n = len;
+		buf = alloca(n);
+	} while ((len = dtrace_addr2str(dtp, val, buf, n)) > n);
+
+	return (dt_putstr(dtp, fp, buf, width));
+}
+
 static int
 dt_printf_format(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargv_t *pfv,
     const dtrace_recdesc_t *recs, uint_t nrecs, const void *buf,
@@ -1364,8 +1658,7 @@ dt_printf_format(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargv_t *pfv,
 	const dtrace_aggdata_t *aggdata;
 	dtrace_aggdesc_t *agg;
 	caddr_t lim = (caddr_t)buf + len, limit;
-	char format[64] = "%";
-	size_t ret;
+	char format[64];
 	int i, aggrec, curagg = -1;
 	uint64_t normal;
 
@@ -1397,22 +1690,16 @@ dt_printf_format(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargv_t *pfv,
 		int prec = pfd->pfd_prec;
 		int rval;
 
-		const char *start;
-		char *f = format + 1; /* skip initial '%' */
-		size_t fmtsz = sizeof(format) - 1;
 		const dtrace_recdesc_t *rec;
+		const char *fmt;
 		dt_pfprint_f *func;
 		caddr_t addr;
 		size_t size;
 		uint32_t flags;
 
 		if (pfd->pfd_preflen != 0) {
-			char *tmp = alloca(pfd->pfd_preflen + 1);
-
-			bcopy(pfd->pfd_prefix, tmp, pfd->pfd_preflen);
-			tmp[pfd->pfd_preflen] = '\0';
-
-			if ((rval = dt_printf(dtp, fp, tmp)) < 0)
+			if ((rval = dt_putbuf(dtp, fp,
+			    pfd->pfd_prefix, pfd->pfd_preflen)) < 0)
 				return (rval);
 
 			if (pfv->pfv_flags & DT_PRINTF_AGGREGATION) {
@@ -1443,7 +1730,7 @@ dt_printf_format(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargv_t *pfv,
 		 * with no data record and continue; it consumes no record.
 		 */
 		if (pfc->pfc_print == &pfprint_pct) {
-			if (pfc->pfc_print(dtp, fp, NULL, pfd, NULL, 0, 1) >= 0)
+			if (dt_putbuf(dtp, fp, "%", 1) >= 0)
 				continue;
 			return (-1); /* errno is set for us */
 		}
@@ -1556,20 +1843,26 @@ dt_printf_format(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargv_t *pfv,
 			break;
 		}
 
-		start = f;
-		if (pfd->pfd_flags & DT_PFCONV_ALT)
-			*f++ = '#';
-		if (pfd->pfd_flags & DT_PFCONV_ZPAD)
-			*f++ = '0';
-		if (width < 0 || (pfd->pfd_flags & DT_PFCONV_LEFT))
-			*f++ = '-';
-		if (pfd->pfd_flags & DT_PFCONV_SPOS)
-			*f++ = '+';
-		if (pfd->pfd_flags & DT_PFCONV_GROUP)
-			*f++ = '\'';
-		if (pfd->pfd_flags & DT_PFCONV_SPACE)
-			*f++ = ' ';
-		fmtsz -= f - start;
+		/*
+		 * Conversions compiled to a dedicated operation are printed
+		 * without a format -- unless the record calls for a different
+		 * function, or has a narrower type than the conversion expects.
+		 */
+		if (pfd->pfd_op != DT_PFOP_FORMAT && func == pfc->pfc_print &&
+		    (size == sizeof (uint64_t) ||
+		    pfd->pfd_isize <= sizeof (int))) {
+			if (pfd->pfd_op == DT_PFOP_INT) {
+				rval = dt_printf_int(dtp, fp, pfd,
+				    addr, size, normal);
+			} else {
+				rval = dt_printf_str(dtp, fp, pfd, addr, size);
+			}
+
+			if (rval < 0)
+				return (-1); /* errno is set for us */
+
+			goto next;
+		}
 
 		/*
 		 * If we're printing a stack and DT_PFCONV_LEFT is set, we
@@ -1580,25 +1873,21 @@ dt_printf_format(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargv_t *pfv,
 		if (func == pfprint_stack && (pfd->pfd_flags & DT_PFCONV_LEFT))
 			width = 0;
 
-		if (width != 0) {
-			ret = snprintf(f, fmtsz, "%d", ABS(width));
-			f += ret;
-			fmtsz = MAX(0, (int)(fmtsz - ret));
-		}
-
-		if (prec > 0) {
-			ret = snprintf(f, fmtsz, ".%d", prec);
-			f += ret;
-			fmtsz = MAX(0, (int)(fmtsz - ret));
+		if (pfd->pfd_cfmt[0] != '\0') {
+			fmt = pfd->pfd_cfmt;
+		} else if (dt_printf_fmtstr(pfd, width, prec,
+		    format, sizeof (format)) == 0) {
+			fmt = format;
+		} else {
+			return (dt_set_errno(dtp, EDT_COMPILER));
 		}
 
-		if (strlcpy(f, pfd->pfd_fmt, fmtsz) >= fmtsz)
-			return (dt_set_errno(dtp, EDT_COMPILER));
 		pfd->pfd_rec = rec;
 
-		if (func(dtp, fp, format, pfd, addr, size, normal) < 0)
+		if (func(dtp, fp, fmt, pfd, addr, size, normal) < 0)
 			return (-1); /* errno is set for us */
 
+next:
 		if (pfv->pfv_flags & DT_PRINTF_AGGREGATION) {
 			/*
 			 * For printa(), we flush the buffer after each tuple
@@ -1617,35 +1906,54 @@ dt_printf_format(dtrace_hdl_t *dtp, FILE *fp, const dt_pfargv_t *pfv,
 	return ((int)(recp - recs));
 }
 
+/*
+ * Formats a printf()-like record into dt_sprintf_buf, which is grown as
+ * needed to hold at least size bytes.  The buffer is retained for reuse by
+ * subsequent calls.  The length of the result is kept in dt_sprintf_len, so
+ * that neither the formatting nor the caller need search for its end.
+ */
 int
-dtrace_sprintf(dtrace_hdl_t *dtp, FILE *fp, void *fmtdata,
-    const dtrace_recdesc_t *recp, uint_t nrecs, const void *buf, size_t len)
+dt_sprintf(dtrace_hdl_t *dtp, FILE *fp, void *fmtdata,
+    const dtrace_recdesc_t *recp, uint_t nrecs, const void *buf, size_t len,
+    size_t size)
 {
-	dtrace_optval_t size;
 	int rval;
 
-	rval = dtrace_getopt(dtp, "strsize", &size);
-	assert(rval == 0);
 	assert(dtp->dt_sprintf_buflen == 0);
 
-	if (dtp->dt_sprintf_buf != NULL)
+	if (size > dtp->dt_sprintf_bufsize) {
 		free(dtp->dt_sprintf_buf);
+		dtp->dt_sprintf_bufsize = 0;
 
-	if ((dtp->dt_sprintf_buf = malloc(size)) == NULL)
-		return (dt_set_errno(dtp, EDT_NOMEM));
+		if ((dtp->dt_sprintf_buf = malloc(size)) == NULL)
+			return (dt_set_errno(dtp, EDT_NOMEM));
+
+		dtp->dt_sprintf_bufsize = size;
+	}
 
-	bzero(dtp->dt_sprintf_buf, size);
+	dtp->dt_sprintf_buf[0] = '\0';
+	dtp->dt_sprintf_len = 0;
 	dtp->dt_sprintf_buflen = size;
 	rval = dt_printf_format(dtp, fp, fmtdata, recp, nrecs, buf, len,
 	    NULL, 0);
 	dtp->dt_sprintf_buflen = 0;
 
-	if (rval == -1)
-		free(dtp->dt_sprintf_buf);
-
 	return (rval);
 }
 
+int
+dtrace_sprintf(dtrace_hdl_t *dtp, FILE *fp, void *fmtdata,
+    const dtrace_recdesc_t *recp, uint_t nrecs, const void *buf, size_t len)
+{
+	dtrace_optval_t size;
+	int rval;
+
+	rval = dtrace_getopt(dtp, "strsize", &size);
+	assert(rval == 0);
+
+	return (dt_sprintf(dtp, fp, fmtdata, recp, nrecs, buf, len, size));
+}
+
 /*ARGSUSED*/
 int
 dtrace_system(dtrace_hdl_t *dtp, FILE *fp, void *fmtdata,
@@ -1658,10 +1966,11 @@ dtrace_system(dtrace_hdl_t *dtp, FILE *fp, void *fmtdata,
 		return (rval);
 
 	/*
-	 * Before we execute the specified command, flush fp to assure that
-	 * any prior dt_printf()'s appear before the output of the command
-	 * not after it.
+	 * Before we execute the specified command, flush any buffered output
+	 * and fp to assure that any prior dt_printf()'s appear before the
+	 * output of the command not after it.
 	 */
+	(void) dt_obuf_flush(dtp, B_TRUE);
 	(void) fflush(fp);
 
 	if (system(dtp->dt_sprintf_buf) == -1)
@@ -1686,6 +1995,12 @@ dtrace_freopen(dtrace_hdl_t *dtp, FILE *fp, void *fmtdata,
 	if (rval == -1 || fp == NULL)
 		return (rval);
 
+	/*
+	 * Output buffered for the current file must be written out before
+	 * that file is redirected or closed beneath us.
+	 */
+	(void) dt_obuf_flush(dtp, B_TRUE);
+
 #ifdef illumos
 	if (pfd->pfd_preflen != 0 &&
 	    strcmp(pfd->pfd_prefix, DT_FREOPEN_RESTORE) == 0) {
@@ -1890,6 +2205,8 @@ dtrace_printf_create(dtrace_hdl_t *dtp, const char *s)
 			(void) strcat(pfd->pfd_fmt, pfc->pfc_ofmt);
 	}
 
+	dt_printf_compile(pfv);
+
 	return (pfv);
 }
 
@@ -40,6 +40,7 @@ extern "C" {
 
 struct dt_node;
 struct dt_ident;
+struct ps_prochandle;
 
 struct dt_pfconv;
 struct dt_pfargv;
@@ -68,6 +69,19 @@ typedef struct dt_pfdict {
 	uint_t pdi_nbuckets;		/* size of hash bucket array */
 } dt_pfdict_t;
 
+/*
+ * Once its output format is known, each conversion is compiled into the
+ * operation used to print it (see dt_printf_compile()).  DT_PFOP_FORMAT
+ * builds a printf(3C) format and calls the conversion's pfc_print function;
+ * the others format the common cases directly.
+ */
+typedef enum dt_pfop {
+	DT_PFOP_FORMAT = 0,		/* format and call pfc_print */
+	DT_PFOP_INT,			/* %d, %i, %o, %u, %x or %X */
+	DT_PFOP_STR,			/* %s */
+	DT_PFOP_ADDR			/* %a */
+} dt_pfop_t;
+
 typedef struct dt_pfargd {
 	const char *pfd_prefix;		/* prefix string pointer (or NULL) */
 	size_t pfd_preflen;		/* length of prefix in bytes */
@@ -79,6 +93,10 @@ typedef struct dt_pfargd {
 	const dt_pfconv_t *pfd_conv;	/* conversion specification */
 	const dtrace_recdesc_t *pfd_rec; /* pointer to current record */
 	struct dt_pfargd *pfd_next;	/* pointer to next arg descriptor */
+	dt_pfop_t pfd_op;		/* compiled print operation */
+	char pfd_oconv;			/* DT_PFOP_INT conversion character */
+	uint_t pfd_isize;		/* DT_PFOP_INT argument size */
+	char pfd_cfmt[40];		/* compiled printf(3C) format (or "") */
 } dt_pfargd_t;
 
 #define	DT_PFCONV_ALT		0x0001	/* alternate print format (%#) */
@@ -128,6 +146,19 @@ extern int dt_print_ustack(dtrace_hdl_t *, FILE *,
 extern int dt_print_mod(dtrace_hdl_t *, FILE *, const char *, caddr_t);
 extern int dt_print_umod(dtrace_hdl_t *, FILE *, const char *, caddr_t);
 
+extern void dt_format_stackpc(dtrace_hdl_t *, uint64_t, char *, size_t);
+extern void dt_format_ustackpc(dtrace_hdl_t *, struct ps_prochandle *,
+    uint64_t, const char *, char *, size_t);
+extern void dt_format_sym(dtrace_hdl_t *, caddr_t, char *, size_t);
+extern void dt_format_mod(dtrace_hdl_t *, caddr_t, char *, size_t);
+extern void dt_format_umod(dtrace_hdl_t *, caddr_t, char *, size_t);
+extern uint64_t dt_usym_addr(dtrace_hdl_t *, uint64_t, uint64_t,
+    dtrace_actkind_t);
+extern ssize_t dt_bytes_strlen(const char *, size_t);
+
+extern int dt_sprintf(dtrace_hdl_t *, FILE *, void *,
+    const dtrace_recdesc_t *, uint_t, const void *, size_t, size_t);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -840,9 +840,11 @@ dtrace_probe_iter(dtrace_hdl_t *dtp,
 	const char *provider = pdp ? pdp->dtpd_provider : NULL;
 	dtrace_id_t id = DTRACE_IDNONE;
 
-	dtrace_probedesc_t pd;
+	dtrace_probedesc_t pd, *descs;
+	dtrace_probebatch_t pb;
 	dt_probe_iter_t pit;
-	int cmd, rv;
+	int cmd, rv, err;
+	uint32_t i;
 
 	bzero(&pit, sizeof (pit));
 	pit.pit_hdl = dtp;
@@ -867,6 +869,53 @@ dtrace_probe_iter(dtrace_hdl_t *dtp,
 			return (rv);
 	}
 
+	/*
+	 * Ask the kernel for the descriptions of up to DT_PROBEBATCH probes at
+	 * a time rather than issuing one ioctl per probe.  If the driver
+	 * predates DTRACEIOC_PROBEBATCH, we fall back to DTRACEIOC_PROBES and
+	 * DTRACEIOC_PROBEMATCH below.
+	 */
+	if ((descs = dt_alloc(dtp,
+	    DT_PROBEBATCH * sizeof (dtrace_probedesc_t))) == NULL)
+		return (-1); /* errno is set for us */
+
+	bzero(&pb, sizeof (pb));
+
+	if (pdp != NULL) {
+		bcopy(pdp, &pb.dtpb_match, sizeof (pb.dtpb_match));
+		pb.dtpb_flags = DTRACE_PROBEBATCH_MATCH;
+	}
+
+	pb.dtpb_match.dtpd_id = id;
+
+	for (;;) {
+		pb.dtpb_count = DT_PROBEBATCH;
+		pb.dtpb_probes = descs;
+
+		if (dt_ioctl(dtp, DTRACEIOC_PROBEBATCH, &pb) != 0)
+			break;
+
+		if (pb.dtpb_count == 0) {
+			errno = ESRCH;
+			break;
+		}
+
+		for (i = 0; i < pb.dtpb_count; i++) {
+			if ((rv = func(dtp, &descs[i], arg)) != 0) {
+				dt_free(dtp, descs);
+				return (rv);
+			}
+
+			pit.pit_matches++;
+		}
+	}
+
+	err = errno;
+	dt_free(dtp, descs);
+
+	if (err != ENOTTY)
+		goto out;
+
 	if (pdp != NULL)
 		cmd = DTRACEIOC_PROBEMATCH;
 	else
@@ -889,13 +938,15 @@ dtrace_probe_iter(dtrace_hdl_t *dtp,
 		id = pd.dtpd_id + 1;
 	}
 
-	switch (errno) {
+	err = errno;
+out:
+	switch (err) {
 	case ESRCH:
 	case EBADF:
 		return (pit.pit_matches ? 0 : dt_set_errno(dtp, EDT_NOPROBE));
 	case EINVAL:
 		return (dt_set_errno(dtp, EDT_BADPGLOB));
 	default:
-		return (dt_set_errno(dtp, errno));
+		return (dt_set_errno(dtp, err));
 	}
 }
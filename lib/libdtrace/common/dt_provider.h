@@ -53,6 +53,8 @@ typedef struct dt_provider {
 #define	DT_PROVIDER_INTF	0x1	/* provider interface declaration */
 #define	DT_PROVIDER_IMPL	0x2	/* provider implementation is loaded */
 
+#define	DT_PROBEBATCH	DTRACE_PROBEBATCH_MAX	/* descriptions per ioctl */
+
 typedef struct dt_probe_iter {
 	dtrace_probedesc_t pit_desc;	/* description storage */
 	dtrace_hdl_t *pit_hdl;		/* libdtrace handle */
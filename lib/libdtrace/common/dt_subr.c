@@ -588,6 +588,167 @@ dt_write(dtrace_hdl_t *dtp, int fd, const void *buf, size_t n)
 	return (n - resid);
 }
 
+/*
+ * While dtrace_consume() or dtrace_aggregate_print() is active (that is, while
+ * dt_obuf_depth is non-zero), output destined for a stdio stream is collected
+ * in the handle's output buffer and handed to fwrite(3C) in large pieces:
+ * when the buffer fills, when output switches to another stream, before a
+ * consumer callback is invoked (so that anything that it prints appears in
+ * order), and when the outermost such call returns.  At any other time, each
+ * write goes directly to the stream and is flushed.
+ */
+#define	DT_OBUF_SIZE	(64 * 1024)	/* size at which output is written */
+#define	DT_OBUF_MINFREE	256		/* space in which to try formatting */
+
+/*
+ * Hand any output in the output buffer to its stream, and -- if sync is set
+ * -- flush the stream and disassociate it from the buffer.  As with
+ * dt_printf(), we clear any error on the stream so that a failed write (e.g.,
+ * due to EINTR) does not preclude later ones.
+ */
+int
+dt_obuf_flush(dtrace_hdl_t *dtp, boolean_t sync)
+{
+	FILE *fp = dtp->dt_obuf_fp;
+	size_t len = dtp->dt_obuf_len;
+	int err = 0;
+
+	if (fp == NULL)
+		return (0);
+
+	dtp->dt_obuf_len = 0;
+
+	if (len != 0 && fwrite(dtp->dt_obuf, 1, len, fp) != len)
+		err = errno;
+
+	if (sync) {
+		if (fflush(fp) == EOF && err == 0)
+			err = errno;
+
+		dtp->dt_obuf_fp = NULL;
+	}
+
+	if (err != 0) {
+		clearerr(fp);
+		return (dt_set_errno(dtp, err));
+	}
+
+	return (0);
+}
+
+void
+dt_obuf_enter(dtrace_hdl_t *dtp)
+{
+	dtp->dt_obuf_depth++;
+}
+
+int
+dt_obuf_exit(dtrace_hdl_t *dtp)
+{
+	assert(dtp->dt_obuf_depth > 0);
+
+	if (--dtp->dt_obuf_depth != 0)
+		return (0);
+
+	return (dt_obuf_flush(dtp, B_TRUE));
+}
+
+void
+dt_obuf_destroy(dtrace_hdl_t *dtp)
+{
+	free(dtp->dt_obuf);
+	dtp->dt_obuf = NULL;
+	dtp->dt_obuf_len = 0;
+	dtp->dt_obuf_size = 0;
+	dtp->dt_obuf_fp = NULL;
+}
+
+/*
+ * Return a pointer to at least n contiguous free bytes at the end of the
+ * output buffer for fp, writing out or growing the buffer as needed.
+ */
+static char *
+dt_obuf_reserve(dtrace_hdl_t *dtp, FILE *fp, size_t n)
+{
+	if (fp != dtp->dt_obuf_fp) {
+		if (dt_obuf_flush(dtp, B_TRUE) != 0)
+			return (NULL);
+
+		dtp->dt_obuf_fp = fp;
+	}
+
+	if (dtp->dt_obuf_len + n > dtp->dt_obuf_size) {
+		size_t size = MAX(n, DT_OBUF_SIZE);
+		char *buf;
+
+		if (dtp->dt_obuf_len != 0 && dt_obuf_flush(dtp, B_FALSE) != 0)
+			return (NULL);
+
+		if (size > dtp->dt_obuf_size) {
+			if ((buf = realloc(dtp->dt_obuf, size)) == NULL) {
+				(void) dt_set_errno(dtp, EDT_NOMEM);
+				return (NULL);
+			}
+
+			dtp->dt_obuf = buf;
+			dtp->dt_obuf_size = size;
+		}
+	}
+
+	return (dtp->dt_obuf + dtp->dt_obuf_len);
+}
+
+/*
+ * Return a pointer to at least n + 1 free bytes (allowing for a terminating
+ * nul byte) at the end of the buffered output buffer.
+ */
+static char *
+dt_buffered_reserve(dtrace_hdl_t *dtp, size_t n)
+{
+	/*
+	 * Using buffered output is not allowed if a handler has not been
+	 * installed.
+	 */
+	if (dtp->dt_bufhdlr == NULL) {
+		(void) dt_set_errno(dtp, EDT_NOBUFFERED);
+		return (NULL);
+	}
+
+	if (dtp->dt_buffered_buf == NULL) {
+		assert(dtp->dt_buffered_size == 0);
+		dtp->dt_buffered_size = 1;
+		dtp->dt_buffered_buf = malloc(dtp->dt_buffered_size);
+
+		if (dtp->dt_buffered_buf == NULL) {
+			(void) dt_set_errno(dtp, EDT_NOMEM);
+			return (NULL);
+		}
+
+		dtp->dt_buffered_offs = 0;
+		dtp->dt_buffered_buf[0] = '\0';
+	}
+
+	for (;;) {
+		char *newbuf;
+
+		assert(dtp->dt_buffered_offs < dtp->dt_buffered_size);
+
+		if (n + 1 < dtp->dt_buffered_size - dtp->dt_buffered_offs)
+			break;
+
+		if ((newbuf = realloc(dtp->dt_buffered_buf,
+		    dtp->dt_buffered_size << 1)) == NULL) {
+			(void) dt_set_errno(dtp, EDT_NOMEM);
+			return (NULL);
+		}
+
+		dtp->dt_buffered_buf = newbuf;
+		dtp->dt_buffered_size <<= 1;
+	}
+
+	return (&dtp->dt_buffered_buf[dtp->dt_buffered_offs]);
+}
+
 /*
  * This function handles all output from libdtrace, as well as the
  * dtrace_sprintf() case.  If we're here due to dtrace_sprintf(), then
@@ -595,9 +756,10 @@ dt_write(dtrace_hdl_t *dtp, int fd, const void *buf, size_t n)
  * specified buffer and return.  Otherwise, if output is buffered (denoted by
  * a NULL fp), we sprintf the desired output into the buffered buffer
  * (expanding the buffer if required).  If we don't satisfy either of these
- * conditions (that is, if we are to actually generate output), then we call
- * fprintf with the specified fp.  In this case, we need to deal with one of
- * the more annoying peculiarities of libc's printf routines:  any failed
+ * conditions (that is, if we are to actually generate output), then we
+ * sprintf into the output buffer described above or -- if it isn't active --
+ * call fprintf with the specified fp.  In this case, we need to deal with one
+ * of the more annoying peculiarities of libc's printf routines:  any failed
  * write persistently sets an error flag inside the FILE causing every
  * subsequent write to fail, but only the caller that initiated the error gets
  * the errno.  Since libdtrace clients often intercept SIGINT, this case is
@@ -612,6 +774,8 @@ dt_printf(dtrace_hdl_t *dtp, FILE *fp, const char *format, ...)
 {
 	va_list ap;
 	va_list ap2;
+	size_t avail;
+	char *buf;
 	int n;
 
 #ifndef illumos
@@ -628,17 +792,18 @@ dt_printf(dtrace_hdl_t *dtp, FILE *fp, const char *format, ...)
 
 	if (dtp->dt_sprintf_buflen != 0) {
 		size_t len;
-		char *buf;
 
 		assert(dtp->dt_sprintf_buf != NULL);
 
-		buf = &dtp->dt_sprintf_buf[len = strlen(dtp->dt_sprintf_buf)];
+		buf = &dtp->dt_sprintf_buf[len = dtp->dt_sprintf_len];
 		len = dtp->dt_sprintf_buflen - len;
-		assert((int)len >= 0);
+		assert((int)len > 0);
 
 		va_copy(ap2, ap);
 		if ((n = vsnprintf(buf, len, format, ap2)) < 0)
 			n = dt_set_errno(dtp, errno);
+		else
+			dtp->dt_sprintf_len += MIN((size_t)n, len - 1);
 
 		va_end(ap2);
 		va_end(ap);
@@ -648,30 +813,6 @@ dt_printf(dtrace_hdl_t *dtp, FILE *fp, const char *format, ...)
 
 	if (fp == NULL) {
 		int needed, rval;
-		size_t avail;
-
-		/*
-		 * Using buffered output is not allowed if a handler has
-		 * not been installed.
-		 */
-		if (dtp->dt_bufhdlr == NULL) {
-			va_end(ap);
-			return (dt_set_errno(dtp, EDT_NOBUFFERED));
-		}
-
-		if (dtp->dt_buffered_buf == NULL) {
-			assert(dtp->dt_buffered_size == 0);
-			dtp->dt_buffered_size = 1;
-			dtp->dt_buffered_buf = malloc(dtp->dt_buffered_size);
-
-			if (dtp->dt_buffered_buf == NULL) {
-				va_end(ap);
-				return (dt_set_errno(dtp, EDT_NOMEM));
-			}
-
-			dtp->dt_buffered_offs = 0;
-			dtp->dt_buffered_buf[0] = '\0';
-		}
 
 		va_copy(ap2, ap);
 		if ((needed = vsnprintf(NULL, 0, format, ap2)) < 0) {
@@ -687,28 +828,15 @@ dt_printf(dtrace_hdl_t *dtp, FILE *fp, const char *format, ...)
 			return (0);
 		}
 
-		for (;;) {
-			char *newbuf;
-
-			assert(dtp->dt_buffered_offs < dtp->dt_buffered_size);
-			avail = dtp->dt_buffered_size - dtp->dt_buffered_offs;
-
-			if (needed + 1 < avail)
-				break;
-
-			if ((newbuf = realloc(dtp->dt_buffered_buf,
-			    dtp->dt_buffered_size << 1)) == NULL) {
-				va_end(ap);
-				return (dt_set_errno(dtp, EDT_NOMEM));
-			}
-
-			dtp->dt_buffered_buf = newbuf;
-			dtp->dt_buffered_size <<= 1;
+		if ((buf = dt_buffered_reserve(dtp, needed)) == NULL) {
+			va_end(ap);
+			return (-1);
 		}
 
+		avail = dtp->dt_buffered_size - dtp->dt_buffered_offs;
+
 		va_copy(ap2, ap);
-		if (vsnprintf(&dtp->dt_buffered_buf[dtp->dt_buffered_offs],
-		    avail, format, ap2) < 0) {
+		if (vsnprintf(buf, avail, format, ap2) < 0) {
 			rval = dt_set_errno(dtp, errno);
 			va_end(ap2);
 			va_end(ap);
@@ -722,20 +850,182 @@ dt_printf(dtrace_hdl_t *dtp, FILE *fp, const char *format, ...)
 		return (0);
 	}
 
+	if (dtp->dt_obuf_depth == 0) {
+		va_copy(ap2, ap);
+		n = vfprintf(fp, format, ap2);
+		fflush(fp);
+		va_end(ap2);
+		va_end(ap);
+
+		if (n < 0) {
+			clearerr(fp);
+			return (dt_set_errno(dtp, errno));
+		}
+
+		return (n);
+	}
+
+	/*
+	 * Format directly into the output buffer.  Should the result not fit
+	 * in the space that is available, we make room for it and try again.
+	 */
+	if ((buf = dt_obuf_reserve(dtp, fp, DT_OBUF_MINFREE)) == NULL) {
+		va_end(ap);
+		return (-1);
+	}
+
+	avail = dtp->dt_obuf_size - dtp->dt_obuf_len;
+
 	va_copy(ap2, ap);
-	n = vfprintf(fp, format, ap2);
-	fflush(fp);
+	n = vsnprintf(buf, avail, format, ap2);
 	va_end(ap2);
+
+	if (n >= 0 && (size_t)n >= avail) {
+		if ((buf = dt_obuf_reserve(dtp, fp, (size_t)n + 1)) == NULL) {
+			va_end(ap);
+			return (-1);
+		}
+
+		va_copy(ap2, ap);
+		n = vsnprintf(buf, (size_t)n + 1, format, ap2);
+		va_end(ap2);
+	}
+
 	va_end(ap);
 
-	if (n < 0) {
-		clearerr(fp);
+	if (n < 0)
 		return (dt_set_errno(dtp, errno));
-	}
+
+	dtp->dt_obuf_len += n;
 
 	return (n);
 }
 
+/*
+ * Output n bytes of unformatted data:  this is equivalent to (but much cheaper
+ * than) dt_printf() with a format of "%.*s".
+ */
+int
+dt_putbuf(dtrace_hdl_t *dtp, FILE *fp, const char *s, size_t n)
+{
+	char *buf;
+
+#ifndef illumos
+	if (dtp->dt_freopen_fp != NULL)
+		fp = dtp->dt_freopen_fp;
+#endif
+
+	if (n == 0)
+		return (0);
+
+	if (dtp->dt_sprintf_buflen != 0) {
+		size_t len = dtp->dt_sprintf_len;
+		size_t avail = dtp->dt_sprintf_buflen - len;
+
+		if (avail > 1) {
+			if (n > avail - 1)
+				n = avail - 1;
+
+			bcopy(s, &dtp->dt_sprintf_buf[len], n);
+			dtp->dt_sprintf_buf[len + n] = '\0';
+			dtp->dt_sprintf_len += n;
+		}
+
+		return (0);
+	}
+
+	if (fp == NULL) {
+		if ((buf = dt_buffered_reserve(dtp, n)) == NULL)
+			return (-1);
+
+		bcopy(s, buf, n);
+		buf[n] = '\0';
+		dtp->dt_buffered_offs += n;
+		return (0);
+	}
+
+	if (dtp->dt_obuf_depth == 0) {
+		if (fwrite(s, 1, n, fp) != n || fflush(fp) == EOF) {
+			int err = errno;
+
+			clearerr(fp);
+			return (dt_set_errno(dtp, err));
+		}
+
+		return (0);
+	}
+
+	if ((buf = dt_obuf_reserve(dtp, fp, n)) == NULL)
+		return (-1);
+
+	bcopy(s, buf, n);
+	dtp->dt_obuf_len += n;
+
+	return (0);
+}
+
+/*
+ * Output n bytes, padded with spaces on the left to width (if width is
+ * positive) or on the right to -width (if it is negative).
+ */
+int
+dt_putfield(dtrace_hdl_t *dtp, FILE *fp, const char *s, size_t n, int width)
+{
+	static const char spaces[] = "                                ";
+	size_t pad = 0, len;
+
+	if (width > 0 && n < (size_t)width)
+		pad = (size_t)width - n;
+
+	if (width < 0 && n < (size_t)-width)
+		pad = (size_t)-width - n;
+
+	if (width < 0 && dt_putbuf(dtp, fp, s, n) != 0)
+		return (-1);
+
+	for (; pad != 0; pad -= len) {
+		len = MIN(pad, sizeof (spaces) - 1);
+
+		if (dt_putbuf(dtp, fp, spaces, len) != 0)
+			return (-1);
+	}
+
+	if (width >= 0 && dt_putbuf(dtp, fp, s, n) != 0)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Output a string; this is equivalent to dt_printf() with a format of "%*s".
+ */
+int
+dt_putstr(dtrace_hdl_t *dtp, FILE *fp, const char *s, int width)
+{
+	return (dt_putfield(dtp, fp, s, strlen(s), width));
+}
+
+/*
+ * Output a signed decimal integer; this is equivalent to dt_printf() with a
+ * format of "%*lld".
+ */
+int
+dt_putint(dtrace_hdl_t *dtp, FILE *fp, int64_t val, int width)
+{
+	char digits[21], *p = &digits[sizeof (digits)];
+	uint64_t uval = val < 0 ? -(uint64_t)val : (uint64_t)val;
+
+	do {
+		*--p = '0' + (uval % 10);
+		uval /= 10;
+	} while (uval != 0);
+
+	if (val < 0)
+		*--p = '-';
+
+	return (dt_putfield(dtp, fp, p, &digits[sizeof (digits)] - p, width));
+}
+
 int
 dt_buffered_flush(dtrace_hdl_t *dtp, dtrace_probedata_t *pdata,
     const dtrace_recdesc_t *rec, const dtrace_aggdata_t *agg, uint32_t flags)
@@ -801,6 +1091,35 @@ dt_free(dtrace_hdl_t *dtp, void *data)
 	free(data);
 }
 
+/*
+ * Creates a joinable worker thread.  These are used for the internal
+ * parallelism of buffer retrieval and aggregation sorting; the thread
+ * function must not call back into the consumer.  Returns 0 on success.
+ */
+int
+dt_thread_create(pthread_t *tid, dt_thread_f *func, void *arg)
+{
+#ifdef _WIN32
+	if ((*tid = CreateThread(NULL, 0, func, arg, 0, NULL)) == NULL)
+		return (-1);
+
+	return (0);
+#else
+	return (pthread_create(tid, NULL, func, arg) == 0 ? 0 : -1);
+#endif
+}
+
+void
+dt_thread_join(pthread_t tid)
+{
+#ifdef _WIN32
+	(void) WaitForSingleObject(tid, INFINITE);
+	(void) CloseHandle(tid);
+#else
+	(void) pthread_join(tid, NULL);
+#endif
+}
+
 void
 dt_difo_free(dtrace_hdl_t *dtp, dtrace_difo_t *dp)
 {
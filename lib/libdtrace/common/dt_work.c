@@ -43,6 +43,159 @@ static const struct {
 	{ DTRACEOPT_MAX, 0 }
 };
 
+/*
+ * Adaptive buffer sizing.  If the "bufresize" option is set to "adaptive"
+ * and the buffer policy is "switch", we adjust both the switch rate and the
+ * size of the principal buffers while tracing, based on the drops and the
+ * amount of data that we see in each pass through the buffers.  If there are
+ * drops, we first switch more often, and only once we're switching as often
+ * as we're willing to do we grow the buffers.  If, conversely, the buffers
+ * have been mostly empty for a number of consecutive passes, we first switch
+ * less often (but no less often than the switchrate dictates), and only then
+ * shrink the buffers.  Sizes and rates are kept within a factor of
+ * 2^DT_ADAPT_RANGE of their values at the time that tracing began.
+ */
+#define	DT_ADAPT_RANGE		4	/* log2 of maximum adjustment */
+#define	DT_ADAPT_QUIET		8	/* empty passes before relaxing */
+#define	DT_ADAPT_LOWATER	4	/* buffer is "mostly empty" below 1/n */
+
+static void
+dt_adapt_init(dtrace_hdl_t *dtp)
+{
+	dt_adapt_t *dta = &dtp->dt_adapt;
+	dtrace_optval_t size = dtp->dt_options[DTRACEOPT_BUFSIZE];
+	dtrace_optval_t rate = dtp->dt_options[DTRACEOPT_SWITCHRATE];
+
+	bzero(dta, sizeof (dt_adapt_t));
+	dta->dta_minsize = size >> DT_ADAPT_RANGE;
+	dta->dta_maxsize = size << DT_ADAPT_RANGE;
+	dta->dta_rate = rate;
+	dta->dta_minrate = rate >> DT_ADAPT_RANGE;
+}
+
+/*
+ * Called by dt_consume() for each principal buffer snapshot that it takes.
+ */
+void
+dt_adapt_note(dtrace_hdl_t *dtp, const dtrace_bufdesc_t *buf)
+{
+	dt_adapt_t *dta = &dtp->dt_adapt;
+
+	if (buf->dtbd_size > dta->dta_fill)
+		dta->dta_fill = buf->dtbd_size;
+
+	dta->dta_drops += buf->dtbd_drops;
+}
+
+/*
+ * Returns the size of the buffer into which a principal buffer snapshot is
+ * to be taken.  This is the bufsize option -- unless the buffers have just
+ * been shrunk, in which case a CPU's first snapshot after the resize may
+ * yet hold as much data as the old, larger buffer.
+ */
+dtrace_optval_t
+dt_adapt_snapsize(dtrace_hdl_t *dtp)
+{
+	dtrace_optval_t size;
+
+	(void) dtrace_getopt(dtp, "bufsize", &size);
+
+	return (MAX(size, dtp->dt_adapt.dta_oldsize));
+}
+
+static void
+dt_adapt_resize(dtrace_hdl_t *dtp, dtrace_optval_t size)
+{
+	dt_adapt_t *dta = &dtp->dt_adapt;
+	dtrace_optval_t cur = dtp->dt_options[DTRACEOPT_BUFSIZE];
+	uint64_t nsize = size;
+
+	if (dt_ioctl(dtp, DTRACEIOC_BUFRESIZE, &nsize) == -1) {
+		dt_dprintf("failed to resize buffers from %lld to %lld: %s\n",
+		    (long long)cur, (long long)size, strerror(errno));
+
+		switch (errno) {
+		case EBUSY:
+			/*
+			 * The last resize hasn't yet been consumed on every
+			 * CPU; we'll try again later.
+			 */
+			break;
+		case ENOMEM:
+			dta->dta_maxsize = cur;
+			break;
+		case E2BIG:
+			dta->dta_minsize = cur;
+			break;
+		default:
+			dta->dta_minsize = dta->dta_maxsize = cur;
+			break;
+		}
+
+		return;
+	}
+
+	dt_dprintf("resized buffers from %lld to %lld\n",
+	    (long long)cur, (long long)nsize);
+
+	if ((dtrace_optval_t)nsize < cur)
+		dta->dta_oldsize = cur;
+
+	dtp->dt_options[DTRACEOPT_BUFSIZE] = nsize;
+}
+
+/*
+ * Called by dtrace_work() after each successful call to dtrace_consume().
+ */
+static void
+dt_adapt(dtrace_hdl_t *dtp)
+{
+	dt_adapt_t *dta = &dtp->dt_adapt;
+	uint64_t *opt = dtp->dt_options;
+	dtrace_optval_t size = opt[DTRACEOPT_BUFSIZE];
+	dtrace_optval_t rate = opt[DTRACEOPT_SWITCHRATE];
+
+	if (opt[DTRACEOPT_BUFRESIZE] != DTRACEOPT_BUFRESIZE_ADAPTIVE ||
+	    opt[DTRACEOPT_BUFPOLICY] != DTRACEOPT_BUFPOLICY_SWITCH)
+		return;
+
+	if (dta->dta_passes == 0)
+		return;
+
+	/*
+	 * Having completed a pass, we have snapshotted every CPU since any
+	 * shrinking of the buffers:  all snapshots now fit in the bufsize.
+	 */
+	dta->dta_oldsize = 0;
+
+	if (dta->dta_drops != 0) {
+		dta->dta_quiet = 0;
+
+		if (rate > dta->dta_minrate)
+			opt[DTRACEOPT_SWITCHRATE] =
+			    MAX(rate >> 1, dta->dta_minrate);
+		else if (size < dta->dta_maxsize)
+			dt_adapt_resize(dtp, MIN(size << 1, dta->dta_maxsize));
+	} else if (dta->dta_fill < size / DT_ADAPT_LOWATER) {
+		if (++dta->dta_quiet >= DT_ADAPT_QUIET) {
+			dta->dta_quiet = 0;
+
+			if (rate < dta->dta_rate)
+				opt[DTRACEOPT_SWITCHRATE] =
+				    MIN(rate << 1, dta->dta_rate);
+			else if (size > dta->dta_minsize)
+				dt_adapt_resize(dtp,
+				    MAX(size >> 1, dta->dta_minsize));
+		}
+	} else {
+		dta->dta_quiet = 0;
+	}
+
+	dta->dta_fill = 0;
+	dta->dta_drops = 0;
+	dta->dta_passes = 0;
+}
+
 void
 dtrace_sleep(dtrace_hdl_t *dtp)
 {
@@ -237,6 +390,8 @@ dtrace_go(dtrace_hdl_t *dtp)
 	if (dt_options_load(dtp) == -1)
 		return (dt_set_errno(dtp, errno));
 
+	dt_adapt_init(dtp);
+
 	return (dt_aggregate_go(dtp));
 }
 
@@ -316,5 +471,8 @@ dtrace_work(dtrace_hdl_t *dtp, FILE *fp,
 	if (dtrace_consume(dtp, fp, pfunc, rfunc, arg) == -1)
 		return (DTRACE_WORKSTATUS_ERROR);
 
+	if (rval == DTRACE_WORKSTATUS_OKAY)
+		dt_adapt(dtp);
+
 	return (rval);
 }
@@ -125,7 +125,8 @@ typedef struct dtrace_proginfo {
 #define	DTRACE_C_DEFARG	0x0800	/* Use 0/"" as value for unspecified args */
 #define	DTRACE_C_NOLIBS	0x1000	/* Do not process D system libraries */
 #define	DTRACE_C_CTL	0x2000	/* Only process control directives */
-#define	DTRACE_C_MASK	0x3bff	/* mask of all valid flags to dtrace_*compile */
+#define	DTRACE_C_FUSE	0x4000	/* Fuse like clauses into a single ECB */
+#define	DTRACE_C_MASK	0x7bff	/* mask of all valid flags to dtrace_*compile */
 
 extern dtrace_prog_t *dtrace_program_strcompile(dtrace_hdl_t *,
     const char *, dtrace_probespec_t, uint_t, int, char *const []);
@@ -222,6 +223,19 @@ extern int dtrace_consume(dtrace_hdl_t *, FILE *,
 
 extern int dtrace_status(dtrace_hdl_t *);
 
+/*
+ * DTrace ECB Profile Interface
+ *
+ * If the "ecbprof" option has been set, the cost of each enabled probe is
+ * profiled in the kernel (see <sys/dtrace.h>).  dtrace_ecbprof_iter() calls
+ * the specified function with the profile and the probe description of each
+ * EPID; a non-zero return value from the function stops the iteration.
+ */
+typedef int dtrace_ecbprof_f(const dtrace_ecbprof_t *,
+    const dtrace_probedesc_t *, void *);
+
+extern int dtrace_ecbprof_iter(dtrace_hdl_t *, dtrace_ecbprof_f *, void *);
+
 /*
  * DTrace Formatted Output Interfaces
  *
@@ -281,6 +295,41 @@ typedef enum {
 extern dtrace_workstatus_t dtrace_work(dtrace_hdl_t *, FILE *,
     dtrace_consume_probe_f *, dtrace_consume_rec_f *, void *);
 
+/*
+ * DTrace Capture Interface
+ *
+ * A capture is a compact binary record of the principal buffer data consumed
+ * by dtrace_consume(), along with the enabled probe descriptions and strings
+ * required to decode it.  Once dtrace_capture() has been called, all data
+ * subsequently retrieved is written to the specified stream in addition to
+ * being processed as usual.  A capture may later be read with
+ * dtrace_capture_open() and dtrace_capture_iter(), which require neither a
+ * DTrace handle nor the DTrace driver, on any system having the same byte
+ * order and data model as the one on which it was written.  The capture
+ * must be ended (by calling dtrace_capture() with a NULL stream) before its
+ * stream is closed.
+ */
+typedef struct dtrace_capture dtrace_capture_t;
+
+typedef struct dtrace_capdata {
+	processorid_t dtcd_cpu;			/* CPU for data */
+	uint64_t dtcd_timestamp;		/* time buffer was retrieved */
+	dtrace_epid_t dtcd_epid;		/* enabled probe ID */
+	const dtrace_probedesc_t *dtcd_pdesc;	/* probe description */
+	const dtrace_eprobedesc_t *dtcd_edesc;	/* enabled probe description */
+	caddr_t dtcd_data;			/* pointer to raw data */
+} dtrace_capdata_t;
+
+typedef int dtrace_capture_f(const dtrace_capdata_t *, void *);
+
+extern int dtrace_capture(dtrace_hdl_t *, FILE *);
+extern dtrace_capture_t *dtrace_capture_open(FILE *, int *);
+extern int dtrace_capture_iter(dtrace_capture_t *, dtrace_capture_f *, void *);
+extern const char *dtrace_capture_format(dtrace_capture_t *, int);
+extern const char *dtrace_capture_strdata(dtrace_capture_t *, int);
+extern int dtrace_capture_errno(dtrace_capture_t *);
+extern void dtrace_capture_close(dtrace_capture_t *);
+
 /*
  * DTrace Handler Interface
  */
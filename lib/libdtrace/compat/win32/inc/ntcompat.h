@@ -273,6 +273,7 @@ typedef int64_t off64_t;
 #define fstat _fstat
 #define fstat64 _fstat64
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #define strdup _strdup
 #define strlcat(d, s, l) strcat_s((d), (l), (s))
 #define lseek _lseek
@@ -415,6 +416,17 @@ extern void kmem_cache_free(struct kmem_cache * cachep, void * objp);
 extern struct kmem_cache *kmem_cache_create(const char * name, size_t size, size_t offset, unsigned long flags, void (*ctor) (void*, kmem_cache_t *, unsigned long), void (*dtor) (void*, kmem_cache_t *, unsigned long));
 extern void kmem_cache_destroy(struct kmem_cache *cachep);
 
+//
+// Executable memory, for DIF objects compiled to native code. The memory
+// is writable until it is sealed, and executable only once it has been.
+// kmem_text_seal() fails where code cannot be made executable at run time
+// (as under HVCI), in which case the memory must be freed unused.
+//
+
+extern void *kmem_text_alloc(size_t size, void **cookie);
+extern int kmem_text_seal(void *cookie);
+extern void kmem_text_free(void *cookie);
+
 //
 // Error reporting.
 //
@@ -422,8 +434,8 @@ extern void kmem_cache_destroy(struct kmem_cache *cachep);
 #define CE_WARN DPFLTR_WARNING_LEVEL
 #define CE_NOTE DPFLTR_TRACE_LEVEL
 
-#define cmn_err(level, format, ...) \
-        DbgPrintEx(DPFLTR_DEFAULT_ID, level, format, __VA_ARGS__)
+#define cmn_err(level, ...) \
+        DbgPrintEx(DPFLTR_DEFAULT_ID, level, __VA_ARGS__)
 
 extern volatile const char* panicstr;
 
@@ -53,6 +53,11 @@ __inline int pthread_mutex_init(pthread_mutex_t *mutex,
     return 0;
 }
 
+__inline int pthread_mutex_destroy(pthread_mutex_t *mutex)
+{
+    return 0;
+}
+
 __inline int pthread_mutex_lock(pthread_mutex_t *mutex)
 {
     AcquireSRWLockExclusive(mutex);
@@ -78,6 +83,11 @@ __inline int pthread_cond_init(pthread_cond_t *cond,
     return 0;
 }
 
+__inline int pthread_cond_destroy(pthread_cond_t *cond)
+{
+    return 0;
+}
+
 __inline int pthread_cond_reltimedwait_np(pthread_cond_t *cond,
                                           pthread_mutex_t *mutex,
                                           const struct timespec *reltime)
@@ -153,6 +153,27 @@ typedef struct ctf_header_v1 {
 #define	CTF_VERSION	CTF_VERSION_2	/* current version */
 
 #define	CTF_F_COMPRESS	0x1	/* data buffer is compressed */
+#define	CTF_F_INDEX	0x2	/* type index follows string section */
+
+/*
+ * If CTF_F_INDEX is set in an uncompressed container, the string section is
+ * followed (at the next 4-byte boundary) by a ctf_index_t and by the tables
+ * that libctf would otherwise build from the type section when the container
+ * is opened:  the type offset table and the pointer table (cti_typemax + 1
+ * entries of uint_t and ushort_t, respectively, the latter padded to a 4-byte
+ * boundary) and the struct, union, enum and remaining type name hashes, in
+ * that order.  Such a container can be used in place from a read-only mapping
+ * of its file, and a type is not touched until it is looked up.  The index is
+ * in native byte order and is ignored by consumers that do not recognize it,
+ * or whose CTF_INDEX_VERSION differs from its cti_version.
+ */
+#define	CTF_INDEX_VERSION	1	/* current index layout */
+
+typedef struct ctf_index {
+	uint_t cti_version;	/* CTF_INDEX_VERSION */
+	uint_t cti_typemax;	/* maximum valid type ID number */
+	uint_t cti_child;	/* non-zero if container has a parent */
+} ctf_index_t;
 
 typedef struct ctf_lblent {
 	uint_t ctl_label;	/* ref to name of label */
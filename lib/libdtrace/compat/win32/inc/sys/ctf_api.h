@@ -239,6 +239,8 @@ extern int ctf_delete_type(ctf_file_t *, ctf_id_t);
 extern int ctf_update(ctf_file_t *);
 extern int ctf_discard(ctf_file_t *);
 extern int ctf_write(ctf_file_t *, int);
+extern int ctf_write_indexed(ctf_file_t *, int);
+extern ctf_file_t *ctf_flatten(ctf_file_t *, ctf_id_t *, int *);
 
 #ifdef _KERNEL
 
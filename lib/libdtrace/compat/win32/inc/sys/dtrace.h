@@ -920,6 +920,10 @@ typedef struct dtrace_difo {
 	uint_t dtdo_krelen;		/* length of krelo table */
 	uint_t dtdo_urelen;		/* length of urelo table */
 	uint_t dtdo_xlmlen;		/* length of translator table */
+#else
+	struct dtrace_difdop *dtdo_dops; /* decoded text (optional) */
+	void *dtdo_native;		/* native code (optional) */
+	void *dtdo_ntext;		/* native code allocation */
 #endif
 } dtrace_difo_t;
 
@@ -956,6 +960,27 @@ typedef struct dtrace_repldesc {
 	dtrace_probedesc_t dtrpd_create;	/* probe descr. to create */
 } dtrace_repldesc_t;
 
+/*
+ * DTRACEIOC_PROBEBATCH returns the descriptions of up to dtpb_count probes
+ * (or, if DTRACE_PROBEBATCH_MATCH is set, of up to dtpb_count probes that
+ * match dtpb_match) in a single call.  The dtpd_id of dtpb_match is a cursor:
+ * on input it is the probe ID at which to begin (or DTRACE_IDNONE to give
+ * providers the opportunity to provide matching probes and begin at the
+ * first probe), and on output it is the probe ID at which to resume.  On
+ * output, dtpb_count is the number of descriptions returned; zero indicates
+ * that there are no more probes.  The kernel may return fewer descriptions
+ * than requested (see DTRACE_PROBEBATCH_MAX) without being at the end.
+ */
+typedef struct dtrace_probebatch {
+	dtrace_probedesc_t dtpb_match;		/* probe descr. to match */
+	uint32_t dtpb_flags;			/* DTRACE_PROBEBATCH_* flags */
+	uint32_t dtpb_count;			/* number of descriptions */
+	DTRACE_PTR(dtrace_probedesc_t, dtpb_probes); /* descriptions */
+} dtrace_probebatch_t;
+
+#define	DTRACE_PROBEBATCH_MATCH	0x0001		/* match dtpb_match */
+#define	DTRACE_PROBEBATCH_MAX	256		/* max. descriptions per call */
+
 typedef struct dtrace_preddesc {
 	dtrace_difo_t *dtpdd_difo;		/* pointer to DIF object */
 	struct dtrace_predicate *dtpdd_predicate; /* pointer to predicate */
@@ -1098,7 +1123,12 @@ typedef struct dtrace_etwtracedesc {
 #define	DTRACEOPT_AGGZOOM	30	/* zoomed aggregation scaling */
 #define	DTRACEOPT_ZONE		31	/* zone in which to enable probes */
 #define	DTRACEOPT_SYMPATH	32	/* symbol search path */
-#define	DTRACEOPT_MAX		33	/* number of options */
+#define	DTRACEOPT_CONSUMETHREADS 33	/* buffer retrieval threads */
+#define	DTRACEOPT_AGGSORTTHREADS 34	/* aggregation sorting threads */
+#define	DTRACEOPT_OFORMAT	35	/* output format */
+#define	DTRACEOPT_AGGSPILL	36	/* spill full aggregation buffers */
+#define	DTRACEOPT_ECBPROF	37	/* profile the cost of each ECB */
+#define	DTRACEOPT_MAX		38	/* number of options */
 
 #define	DTRACEOPT_UNSET		(dtrace_optval_t)-2	/* unset option */
 
@@ -1108,6 +1138,10 @@ typedef struct dtrace_etwtracedesc {
 
 #define	DTRACEOPT_BUFRESIZE_AUTO	0	/* automatic resizing */
 #define	DTRACEOPT_BUFRESIZE_MANUAL	1	/* manual resizing */
+#define	DTRACEOPT_BUFRESIZE_ADAPTIVE	2	/* auto, then adapt to load */
+
+#define	DTRACEOPT_OFORMAT_TEXT		0	/* human-readable text */
+#define	DTRACEOPT_OFORMAT_JSON		1	/* JSON, one object per line */
 
 /*
  * DTrace Buffer Interface
@@ -1124,7 +1158,11 @@ typedef struct dtrace_etwtracedesc {
  * If the buffer policy is a "switch" policy, taking a snapshot of the
  * principal buffer has the additional effect of switching the active and
  * inactive buffers.  Taking a snapshot of the aggregation buffer _always_ has
- * the additional effect of switching the active and inactive buffers.
+ * the additional effect of switching the active and inactive buffers --
+ * unless the aggregation buffer has spilled (see the "aggspill" option), in
+ * which case the spilled generation is returned without a switch, and
+ * DTRACEBD_SPILLED is set in dtbd_flags to indicate that the consumer should
+ * immediately take another snapshot of the same CPU.
  */
 typedef struct dtrace_bufdesc {
 	uint64_t dtbd_size;			/* size of buffer */
@@ -1134,8 +1172,11 @@ typedef struct dtrace_bufdesc {
 	DTRACE_PTR(char, dtbd_data);		/* data */
 	uint64_t dtbd_oldest;			/* offset of oldest record */
 	uint64_t dtbd_timestamp;		/* hrtime of snapshot */
+	uint64_t dtbd_flags;			/* DTRACEBD_* flags */
 } dtrace_bufdesc_t;
 
+#define	DTRACEBD_SPILLED	0x0001		/* spilled agg. generation */
+
 /*
  * Each record in the buffer (dtbd_data) begins with a header that includes
  * the epid and a timestamp.  The timestamp is split into two 4-byte parts
@@ -1183,11 +1224,41 @@ typedef struct dtrace_status {
 	uint64_t dtst_filled;			/* number of filled bufs */
 	uint64_t dtst_stkstroverflows;		/* stack string tab overflows */
 	uint64_t dtst_dblerrors;		/* errors in ERROR probes */
+	uint64_t dtst_dynsteals;		/* dyn allocs from other CPUs */
+	uint64_t dtst_dyngrows;			/* dyn var space growths */
 	char dtst_killed;			/* non-zero if killed */
 	char dtst_exiting;			/* non-zero if exit() called */
 	char dtst_pad[6];			/* pad out to 64-bit align */
 } dtrace_status_t;
 
+/*
+ * DTrace ECB Profile
+ *
+ * If the "ecbprof" option is set, DTrace keeps track of what each enabled
+ * probe costs in probe context:  the number of times that it fired (and
+ * the number of those firings for which its predicate was true), the number
+ * of DIF instructions that it executed, and the time (in nanoseconds) that
+ * it spent reserving buffer space, evaluating its predicate and performing
+ * its actions.  The profile for each EPID is retrieved by the
+ * DTRACEIOC_ECBPROF ioctl; if dtepd_necbs is less than the number of EPIDs,
+ * it is set to the number of EPIDs and no profile is copied out.
+ */
+typedef struct dtrace_ecbprof {
+	dtrace_epid_t dtep_epid;		/* enabled probe ID */
+	uint32_t dtep_pad;			/* pad out to 64-bit align */
+	uint64_t dtep_nfired;			/* number of firings */
+	uint64_t dtep_nmatched;			/* firings with true predicate */
+	uint64_t dtep_difops;			/* DIF instructions executed */
+	uint64_t dtep_reserve;			/* time spent in reservation */
+	uint64_t dtep_pred;			/* time spent in predicate */
+	uint64_t dtep_action;			/* time spent in actions */
+} dtrace_ecbprof_t;
+
+typedef struct dtrace_ecbprofdesc {
+	DTRACE_PTR(dtrace_ecbprof_t, dtepd_prof); /* profile array */
+	uint64_t dtepd_necbs;			/* number of EPIDs */
+} dtrace_ecbprofdesc_t;
+
 /*
  * DTrace Configuration
  *
@@ -1340,6 +1411,9 @@ typedef struct dtrace_providerdesc {
 #define	DTRACEIOC_FORMAT	(DTRACEIOC | 16)	/* get format str */
 #define	DTRACEIOC_DOFGET	(DTRACEIOC | 17)	/* get DOF */
 #define	DTRACEIOC_REPLICATE	(DTRACEIOC | 18)	/* replicate enab */
+#define	DTRACEIOC_BUFRESIZE	(DTRACEIOC | 20)	/* resize buffers */
+#define	DTRACEIOC_ECBPROF	(DTRACEIOC | 21)	/* get ECB profile */
+#define	DTRACEIOC_PROBEBATCH	(DTRACEIOC | 22)	/* probe batch query */
 #else
 #define	DTRACEIOC_PROVIDER	_IOWR('x',1,dtrace_providerdesc_t)
 							/* provider query */
@@ -1381,6 +1455,12 @@ typedef struct {
 #define DTRACEIOC_ETWTRACE _IOW('x',19,dtrace_etwtracedesc_t)
 							/* get etw trace description */
 #endif
+#define	DTRACEIOC_BUFRESIZE	_IOWR('x',20,uint64_t)
+							/* resize buffers */
+#define	DTRACEIOC_ECBPROF	_IOWR('x',21,dtrace_ecbprofdesc_t)
+							/* get ECB profile */
+#define	DTRACEIOC_PROBEBATCH	_IOWR('x',22,dtrace_probebatch_t)
+							/* probe batch query */
 #endif
 
 /*
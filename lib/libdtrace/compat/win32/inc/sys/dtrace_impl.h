@@ -156,6 +156,12 @@ typedef struct dtrace_hashbucket {
 	int dthb_len;				/* number of probes here */
 } dtrace_hashbucket_t;
 
+typedef struct dtrace_hashsort {
+	uint64_t dths_prefix;			/* leading bytes of string */
+	char *dths_str;				/* string of bucket */
+	dtrace_hashbucket_t *dths_bucket;	/* bucket */
+} dtrace_hashsort_t;
+
 typedef struct dtrace_hash {
 	dtrace_hashbucket_t **dth_tab;		/* hash table */
 	int dth_size;				/* size of hash table */
@@ -164,6 +170,10 @@ typedef struct dtrace_hash {
 	uintptr_t dth_nextoffs;			/* offset of next in probe */
 	uintptr_t dth_prevoffs;			/* offset of prev in probe */
 	uintptr_t dth_stroffs;			/* offset of str in probe */
+	dtrace_hashsort_t *dth_sorted;		/* buckets sorted by string */
+	int *dth_sortcum;			/* cumulative probe counts */
+	int dth_sortsize;			/* allocated size of sorted */
+	int dth_sortvalid;			/* sorted is up to date */
 } dtrace_hash_t;
 
 /*
@@ -242,8 +252,26 @@ struct dtrace_ecb {
 	dtrace_probe_t *dte_probe;		/* pointer to probe */
 	dtrace_action_t *dte_action_last;	/* last action on ECB */
 	uint64_t dte_uarg;			/* library argument */
+	struct dtrace_ecbstat *dte_stat;	/* per-CPU profile, if any */
 };
 
+/*
+ * If the "ecbprof" option is set, each ECB has an array of NCPU
+ * dtrace_ecbstat structures in which dtrace_probe() accumulates the cost of
+ * processing the ECB on that CPU.  The structure is padded out to a cache
+ * line so that CPUs don't contend for it; it is summed over all CPUs to
+ * form the dtrace_ecbprof_t returned by DTRACEIOC_ECBPROF.
+ */
+typedef struct dtrace_ecbstat {
+	uint64_t dtes_nfired;			/* number of firings */
+	uint64_t dtes_nmatched;			/* firings with true predicate */
+	uint64_t dtes_difops;			/* DIF instructions executed */
+	uint64_t dtes_reserve;			/* time spent in reservation */
+	uint64_t dtes_pred;			/* time spent in predicate */
+	uint64_t dtes_action;			/* time spent in actions */
+	uint64_t dtes_pad[2];			/* pad to avoid false sharing */
+} dtrace_ecbstat_t;
+
 struct dtrace_predicate {
 	dtrace_difo_t *dtp_difo;		/* DIF object */
 	dtrace_cacheid_t dtp_cacheid;		/* cache identifier */
@@ -414,6 +442,15 @@ typedef struct dtrace_aggregation {
  * the inactive buffer; in a "ring" buffer policy, it stores the wrapped
  * offset.
  *
+ * Principal buffers with a "switch" buffer policy may be resized while
+ * tracing is active (DTRACEIOC_BUFRESIZE).  Rather than copying data with
+ * interrupts disabled, the resize switches the active buffer with a new,
+ * empty buffer of the new size; the old active buffer becomes the inactive
+ * buffer, with dtb_xamot_pending set to denote that it has yet to be copied
+ * out, and with its size in dtb_xamot_size.  The next snapshot of the CPU
+ * copies it out without a switch, frees it, and installs the (new-sized)
+ * buffer that was set aside for the purpose in dtb_xamot_next.
+ *
  * DTrace Scratch Buffering
  *
  * Some ECBs may wish to allocate dynamically-sized temporary scratch memory.
@@ -436,6 +473,7 @@ typedef struct dtrace_aggregation {
 #define	DTRACEBUF_FULL		0x0040		/* "fill" buffer is full */
 #define	DTRACEBUF_CONSUMED	0x0080		/* buffer has been consumed */
 #define	DTRACEBUF_INACTIVE	0x0100		/* buffer is not yet active */
+#define	DTRACEBUF_SPILL		0x0200		/* spill full agg. buffer */
 
 typedef struct dtrace_buffer {
 	uint64_t dtb_offset;			/* current offset in buffer */
@@ -454,9 +492,22 @@ typedef struct dtrace_buffer {
 #endif
 	uint64_t dtb_switched;			/* time of last switch */
 	uint64_t dtb_interval;			/* observed switch interval */
-	uint64_t dtb_pad2[6];			/* pad to avoid false sharing */
+	uint32_t dtb_xamot_pending;		/* inactive not yet copied out */
+	uint32_t dtb_pad3;			/* pad to 64-bit alignment */
+	uint64_t dtb_xamot_size;		/* inactive size, if resized */
+	caddr_t dtb_xamot_next;			/* inactive after resize */
+#ifndef _LP64
+	uint32_t dtb_pad4;			/* pad to 64-bit alignment */
+#endif
+	uint64_t dtb_pad2[3];			/* pad to avoid false sharing */
 } dtrace_buffer_t;
 
+typedef struct dtrace_bufresize {
+	dtrace_buffer_t *dtbr_buf;		/* buffer to resize */
+	caddr_t dtbr_tomax;			/* new active buffer */
+	size_t dtbr_size;			/* new size */
+} dtrace_bufresize_t;
+
 /*
  * DTrace Aggregation Buffers
  *
@@ -512,6 +563,19 @@ typedef struct dtrace_buffer {
  * Note that the size of the dtrace_aggkey structure must be sizeof (uintptr_t)
  * aligned.  (If this the structure changes such that this becomes false, an
  * assertion will fail in dtrace_aggregate().)
+ *
+ * When an aggregation buffer runs out of room for a new key, the key is
+ * normally dropped.  If the "aggspill" option is set (DTRACEBUF_SPILL), the
+ * full active buffer is instead switched -- in probe context -- with the
+ * inactive buffer, provided that the consumer has already copied the inactive
+ * buffer out.  The full buffer becomes a spilled generation that the consumer
+ * collects on its next snapshot, and aggregation continues in the now-empty
+ * active buffer.  The dtb_xamot_pending member is set whenever the inactive
+ * buffer holds data that has not yet been copied out (whether by a spill or
+ * by the consumer's own switch) and is cleared by the consumer once it has
+ * been; a buffer is thus never reused while it is being copied out.  Because
+ * every aggregating action is commutative, the consumer can merge the
+ * generations in any order without loss.
  */
 typedef struct dtrace_aggkey {
 	uint32_t dtak_hashval;			/* hash value */
@@ -594,8 +658,34 @@ typedef struct dtrace_speculation {
 	dtrace_speculation_state_t dtsp_state;	/* current speculation state */
 	int dtsp_cleaning;			/* non-zero if being cleaned */
 	dtrace_buffer_t *dtsp_buffer;		/* speculative buffer */
+	struct dtrace_speculation *dtsp_next;	/* next on free list */
 } dtrace_speculation_t;
 
+/*
+ * Speculations in the INACTIVE state are kept on per-CPU free lists so that
+ * speculation() need not scan the speculation array.  A CPU's free list is
+ * only pushed to and popped from by that CPU with interrupts disabled; a CPU
+ * that finds its own list empty steals another CPU's list in its entirety by
+ * atomically replacing the list head with NULL.  Because no CPU ever removes
+ * a single element from another CPU's list, the lists are not subject to the
+ * ABA problem.  Each CPU also counts the speculations that it has moved into
+ * (or out of) a busy state, and the speculation() failures that it has
+ * attributed to busy or unavailable speculations; the busy count of any one
+ * CPU may be negative, but the sum over all CPUs is the number of busy
+ * speculations.
+ */
+typedef struct dtrace_specfree {
+	dtrace_speculation_t *dtsf_free;	/* free list for this CPU */
+	int32_t dtsf_nbusy;			/* busy speculations delta */
+	uint32_t dtsf_busy;			/* failures due to busy spec. */
+	uint32_t dtsf_unavail;			/* failures due to no spec. */
+	uint32_t dtsf_pad1;			/* padding */
+#ifndef _LP64
+	uint32_t dtsf_pad2;			/* padding */
+#endif
+	uint64_t dtsf_pad[5];			/* pad to avoid false sharing */
+} dtrace_specfree_t;
+
 /*
  * DTrace Dynamic Variables
  *
@@ -722,7 +812,8 @@ typedef struct dtrace_speculation {
  *
  *   (3)  If the dynamic variable space is in the CLEAN state, look for free
  *        and clean lists on other CPUs by setting the current CPU to the next
- *        CPU, and reattempting (1).  If the next CPU is the current CPU (that
+ *        CPU, and reattempting (1); an allocation so satisfied is counted as
+ *        a steal by the current CPU.  If the next CPU is the current CPU (that
  *        is, if all CPUs have been checked), atomically switch the state of
  *        the dynamic variable space based on the following:
  *
@@ -745,6 +836,25 @@ typedef struct dtrace_speculation {
  * dtrace_sync().  By this point, all CPUs have seen the new clean list; the
  * state of the dynamic variable space can be restored to CLEAN.
  *
+ * If the cleaning cyclic finds the dynamic variable space in the EMPTY state
+ * -- that is, if an allocation has failed with no chunks awaiting cleaning --
+ * it grows the space before restoring the CLEAN state:  it allocates a new
+ * region of chunks as large as the original one, records the region in
+ * dtds_grow[] (so that dtrace_canstore() will accept stores to its chunks),
+ * and divides the chunks among the clean lists of all CPUs.  Regions are
+ * only ever added, and are freed with the space itself, so probe context may
+ * consult dtds_grow[] without synchronization.  So that the hash chains do
+ * not lengthen with each region, the hash table is then grown in proportion
+ * to the space:  a larger table is allocated, and dtrace_dstate_rehash() is
+ * called on all CPUs at once in cross call context.  One CPU moves every
+ * variable to its bucket in the new table and installs it while the others
+ * wait for it to finish; as probe context runs with interrupts disabled, no
+ * CPU can be in probe context while this happens.  Probe context reads the
+ * table and its size once per lookup, so the old table can be freed as soon
+ * as the cross call has returned.  (If the new table can't be allocated, the
+ * region is added nonetheless, and the chains lengthen.)  The space is grown
+ * at most DTRACE_DSTATE_NGROW times.
+ *
  * There exist two final races that merit explanation.  The first is a simple
  * allocation race:
  *
@@ -832,10 +942,9 @@ typedef struct dtrace_dstate_percpu {
 	uint64_t dtdsc_drops;			/* number of capacity drops */
 	uint64_t dtdsc_dirty_drops;		/* number of dirty drops */
 	uint64_t dtdsc_rinsing_drops;		/* number of rinsing drops */
-#ifdef _LP64
+	uint64_t dtdsc_steals;			/* allocations from other CPUs */
+#ifndef _LP64
 	uint64_t dtdsc_pad;			/* pad to avoid false sharing */
-#else
-	uint64_t dtdsc_pad[2];			/* pad to avoid false sharing */
 #endif
 } dtrace_dstate_percpu_t;
 
@@ -846,16 +955,30 @@ typedef enum dtrace_dstate_state {
 	DTRACE_DSTATE_RINSING
 } dtrace_dstate_state_t;
 
+#define	DTRACE_DSTATE_NGROW	7	/* max. regions added to space */
+
 typedef struct dtrace_dstate {
 	void *dtds_base;			/* base of dynamic var. space */
 	size_t dtds_size;			/* size of dynamic var. space */
 	size_t dtds_hashsize;			/* number of buckets in hash */
+	size_t dtds_basehashsize;		/* buckets at base of space */
 	size_t dtds_chunksize;			/* size of each chunk */
 	dtrace_dynhash_t *dtds_hash;		/* pointer to hash table */
 	dtrace_dstate_state_t dtds_state;	/* current dynamic var. state */
 	dtrace_dstate_percpu_t *dtds_percpu;	/* per-CPU dyn. var. state */
+	size_t dtds_growsize;			/* size of each added region */
+	uint_t dtds_ngrow;			/* number of regions added */
+	void *dtds_grow[DTRACE_DSTATE_NGROW];	/* regions added to space */
 } dtrace_dstate_t;
 
+typedef struct dtrace_dstate_rehash {
+	dtrace_dstate_t *dtdr_dstate;		/* space to rehash */
+	dtrace_dynhash_t *dtdr_hash;		/* new (then old) hash table */
+	size_t dtdr_hashsize;			/* new (then old) no. buckets */
+	uint32_t dtdr_owner;			/* nonzero once CPU rehashing */
+	volatile uint32_t dtdr_done;		/* nonzero once rehashed */
+} dtrace_dstate_rehash_t;
+
 /*
  * DTrace Variable State
  *
@@ -906,6 +1029,75 @@ typedef struct dtrace_vstate {
 	dtrace_dstate_t dtvs_dynvars;		/* dynamic variable state */
 } dtrace_vstate_t;
 
+/*
+ * DTrace Decoded DIF
+ *
+ * When a DIF object is initialized, dtrace_difo_init() decodes its text into
+ * an array of dtrace_difdop structures, one for each DIF instruction, and
+ * dtrace_dif_emulate() dispatches on that array rather than on the opcodes
+ * in the text.  Each entry holds either the instruction's own DIF opcode or
+ * one of the decoded operations below, which carry an operand that has been
+ * resolved in advance:  the value of a setx, the address of a sets, the
+ * index of a cached argument.  Some decoded operations also stand for a
+ * whole sequence of instructions that ends in a compare and a branch, such
+ * as the "setx, cmp, ble" that a test like "arg0 > 100" compiles into.  The
+ * entries for the instructions inside such a sequence are decoded in their
+ * own right, so a branch into the middle of a sequence still finds a
+ * decoded instruction.  The branch condition is kept as a mask of the
+ * condition code combinations that take the branch, indexed by
+ * DTRACE_DIFDOP_CC().  Decoded DIF is private to the kernel; it is never
+ * built for a DIF object that has not passed dtrace_difo_validate().
+ */
+#define	DTRACE_DIFDOP_SETX	0x80	/* setx, integer resolved */
+#define	DTRACE_DIFDOP_SETS	0x81	/* sets, string resolved */
+#define	DTRACE_DIFDOP_LDARG	0x82	/* ldgs of a cached argument */
+#define	DTRACE_DIFDOP_CMPBR	0x83	/* cmp, branch */
+#define	DTRACE_DIFDOP_SETXCMPBR	0x84	/* setx, cmp, branch */
+#define	DTRACE_DIFDOP_LDARGCMPBR 0x85	/* ldgs of argument, setx, cmp, br */
+#define	DTRACE_DIFDOP_SCMPBR	0x86	/* scmp, branch */
+#define	DTRACE_DIFDOP_SETSSCMPBR 0x87	/* sets, scmp, branch */
+
+#define	DTRACE_DIFDOP_CC(n, z, v, c)	\
+	(((n) << 3) | ((z) << 2) | ((v) << 1) | (c))
+
+typedef struct dtrace_difdop {
+	uint8_t dtdd_op;			/* DIF or decoded opcode */
+	uint8_t dtdd_len;			/* instructions covered */
+	uint8_t dtdd_rd;			/* fused setx/sets destination */
+	uint8_t dtdd_r1;			/* fused compare: 1st register */
+	uint8_t dtdd_r2;			/* fused compare: 2nd register */
+	uint8_t dtdd_arg;			/* cached argument index */
+	uint16_t dtdd_taken;			/* conditions taking branch */
+	uint_t dtdd_label;			/* fused branch target */
+	uint64_t dtdd_imm;			/* resolved operand */
+} dtrace_difdop_t;
+
+/*
+ * DTrace Native DIF
+ *
+ * If dtrace_dif_native is set, dtrace_difo_init() also compiles the text of
+ * an amd64 DIF object to native code, and dtrace_dif_emulate() runs that code
+ * in place of the emulator whenever DIF instructions are not being counted.
+ * The code keeps the DIF registers and condition codes in a dtrace_difnative
+ * structure on the emulator's stack, and is called with a pointer to it
+ * under the Windows x64 calling convention on every host.  Arithmetic,
+ * compares, branches and the loading of constants and cached arguments are
+ * native; loads, string compares, variable loads and division by zero are
+ * handed to the emulator's own code one instruction at a time, and the
+ * native code returns as soon as one of them faults, leaving the offset of
+ * the faulting instruction in dtdn_pc.  A DIF object with any other
+ * instruction is left to the emulator.  As DIF branches only go forward, so
+ * does the native code, and it runs in time bounded by its length.
+ */
+typedef struct dtrace_difnative {
+	uint64_t dtdn_regs[DIF_DIR_NREGS];	/* DIF registers */
+	uint64_t dtdn_cc;			/* DTRACE_DIFDOP_CC() codes */
+	struct dtrace_mstate *dtdn_mstate;	/* machine state */
+	dtrace_vstate_t *dtdn_vstate;		/* variable state */
+	dtrace_state_t *dtdn_state;		/* consumer state */
+	uint_t dtdn_pc;				/* faulting instruction */
+} dtrace_difnative_t;
+
 /*
  * DTrace Machine State
  *
@@ -926,6 +1118,7 @@ typedef struct dtrace_vstate {
 #define	DTRACE_MSTATE_WALLTIMESTAMP	0x00000100
 #define	DTRACE_MSTATE_USTACKDEPTH	0x00000200
 #define	DTRACE_MSTATE_UCALLER		0x00000400
+#define	DTRACE_MSTATE_DIFOPS		0x00000800
 
 typedef struct dtrace_mstate {
 	uintptr_t dtms_scratch_base;		/* base of scratch space */
@@ -948,6 +1141,7 @@ typedef struct dtrace_mstate {
 	uintptr_t dtms_strtok_limit;		/* upper bound of strtok ptr */
 	uint32_t dtms_access;			/* memory access rights */
 	dtrace_difo_t *dtms_difo;		/* current dif object */
+	uint64_t dtms_difops;			/* DIF instructions executed */
 	file_t *dtms_getf;			/* cached rval of getf() */
 } dtrace_mstate_t;
 
@@ -1152,6 +1346,7 @@ struct dtrace_state {
 	dtrace_buffer_t *dts_aggbuffer;		/* aggregation buffer */
 	dtrace_speculation_t *dts_speculations;	/* speculation array */
 	int dts_nspeculations;			/* number of speculations */
+	dtrace_specfree_t *dts_specfree;	/* per-CPU speculation state */
 	int dts_naggregations;			/* number of aggregations */
 	dtrace_aggregation_t **dts_aggregations; /* aggregation array */
 #ifdef illumos
@@ -1160,8 +1355,6 @@ struct dtrace_state {
 	struct unrhdr *dts_aggid_arena;		/* arena for aggregation IDs */
 #endif
 	uint64_t dts_errors;			/* total number of errors */
-	uint32_t dts_speculations_busy;		/* number of spec. busy */
-	uint32_t dts_speculations_unavail;	/* number of spec unavail */
 	uint32_t dts_stkstroverflows;		/* stack string tab overflows */
 	uint32_t dts_dblerrors;			/* errors in ERROR probes */
 	uint32_t dts_reserve;			/* space reserved for END */
@@ -1172,6 +1365,7 @@ struct dtrace_state {
 #else
 	struct callout dts_cleaner;		/* Cleaning callout. */
 	struct callout dts_deadman;		/* Deadman callout. */
+	dtrace_optval_t dts_cleanrate;		/* current cleaning interval */
 #endif
 	hrtime_t dts_alive;			/* time last alive */
 	char dts_speculates;			/* boolean: has speculations */
@@ -199,6 +199,8 @@ int		dtrace_allow_destructive = 1;
 #endif
 dtrace_optval_t	dtrace_nonroot_maxsize = (16 * 1024 * 1024);
 size_t		dtrace_difo_maxsize = (256 * 1024);
+int		dtrace_dif_predecode = 1;
+int		dtrace_dif_native = 0;
 dtrace_optval_t	dtrace_dof_maxsize = (8 * 1024 * 1024);
 size_t		dtrace_statvar_maxsize = (16 * 1024);
 size_t		dtrace_actions_max = (16 * 1024);
@@ -485,6 +487,9 @@ static kmutex_t dtrace_errlock;
 	(strcmp(*((char **)((uintptr_t)(lhs) + (hash)->dth_stroffs)), \
 	    *((char **)((uintptr_t)(rhs) + (hash)->dth_stroffs))) == 0)
 
+#define	DTRACE_HASHKEY(hash, bucket)	\
+	(*((char **)((uintptr_t)(bucket)->dthb_chain + (hash)->dth_stroffs)))
+
 #define	DTRACE_AGGHASHSIZE_SLEW		17
 
 #define	DTRACE_V4MAPPED_OFFSET		(sizeof (uint32_t) * 3)
@@ -704,6 +709,7 @@ static uint64_t dtrace_helper(int, dtrace_mstate_t *,
 static dtrace_helpers_t *dtrace_helpers_create(proc_t *);
 static dtrace_helpers_t *dtrace_helpers_get(proc_t *);
 static void dtrace_buffer_drop(dtrace_buffer_t *);
+static int dtrace_buffer_spill(dtrace_buffer_t *);
 static int dtrace_buffer_consumed(dtrace_buffer_t *, hrtime_t when);
 static intptr_t dtrace_buffer_reserve(dtrace_buffer_t *, size_t, size_t,
     dtrace_state_t *, dtrace_mstate_t *);
@@ -726,32 +732,89 @@ static int dtrace_canload_remains(uint64_t, size_t, size_t *,
 static int dtrace_canstore_remains(uint64_t, size_t, size_t *,
     dtrace_mstate_t *, dtrace_vstate_t *);
 
-void dtrace_setpredcache(intptr_t value)
+/*
+ * A thread records the cacheable predicates (see dtrace_difo_cacheable()) that
+ * it has found to be false in a single word of thread-private storage.  The
+ * low DTRACE_PREDCACHE_NBITS bits of the word are a bitmask of cache IDs
+ * within a generation of that many consecutive IDs; the remaining bits hold
+ * the generation.  A thread can thus remember several false predicates --
+ * e.g., those of both the entry and return probes of a system call -- and
+ * not merely the last one that it evaluated; evaluating a predicate from
+ * another generation starts the word over.  Cache IDs are never reused (see
+ * dtrace_predicate_create()), so a stale word can never match a new
+ * predicate, and any store to a thread-local variable flushes the word.  The
+ * identity of a thread (its process, image name and zone) is fixed for its
+ * lifetime, and its thread-private storage does not outlive it; no other
+ * invalidation is needed.
+ */
+#ifdef _LP64
+#define	DTRACE_PREDCACHE_SHIFT	5		/* 32 predicates per word */
+#define	DTRACE_PREDCACHE_MAXID	UINT32_MAX
+#else
+#define	DTRACE_PREDCACHE_SHIFT	3		/* 8 predicates per word */
+#define	DTRACE_PREDCACHE_MAXID	((1U << 27) - 1)
+#endif
+
+#define	DTRACE_PREDCACHE_NBITS	(1 << DTRACE_PREDCACHE_SHIFT)
+#define	DTRACE_PREDCACHE_MASK	(((uintptr_t)1 << DTRACE_PREDCACHE_NBITS) - 1)
+#define	DTRACE_PREDCACHE_GEN(cid)					\
+	(((uintptr_t)(cid) >> DTRACE_PREDCACHE_SHIFT) << DTRACE_PREDCACHE_NBITS)
+#define	DTRACE_PREDCACHE_BIT(cid)					\
+	((uintptr_t)1 << ((cid) & (DTRACE_PREDCACHE_NBITS - 1)))
+
+static uintptr_t dtrace_getpredcache(void)
 {
 #ifdef _WIN32
     PULONG_PTR p = dtrace_threadprivate(0);
-    if (NULL != p) {
-        *p = (ULONG_PTR)value;
+    if (NULL == p) {
+        return 0;
+    } else {
+        return (uintptr_t)*p;
     }
 #else
-    curthread->t_predcache = value;
+    return curthread->t_predcache;
 #endif
 }
 
-int dtrace_matchpredcache(intptr_t value)
+static void dtrace_putpredcache(uintptr_t word)
 {
 #ifdef _WIN32
     PULONG_PTR p = dtrace_threadprivate(0);
-    if (NULL == p) {
-        return 0;
-    } else {
-        return (intptr_t)*p == value;
+    if (NULL != p) {
+        *p = (ULONG_PTR)word;
     }
 #else
-    return curthread->t_predcache == value;
+    curthread->t_predcache = word;
 #endif
 }
 
+/*
+ * Record that the predicate with the specified cache ID is false for the
+ * current thread; DTRACE_CACHEIDNONE flushes the thread's predicate cache.
+ */
+void dtrace_setpredcache(dtrace_cacheid_t cid)
+{
+    uintptr_t word = 0;
+
+    if (cid != DTRACE_CACHEIDNONE) {
+        word = dtrace_getpredcache();
+        if ((word & ~DTRACE_PREDCACHE_MASK) != DTRACE_PREDCACHE_GEN(cid)) {
+            word = DTRACE_PREDCACHE_GEN(cid);
+        }
+        word |= DTRACE_PREDCACHE_BIT(cid);
+    }
+
+    dtrace_putpredcache(word);
+}
+
+int dtrace_matchpredcache(dtrace_cacheid_t cid)
+{
+    uintptr_t word = dtrace_getpredcache();
+
+    return (word & ~DTRACE_PREDCACHE_MASK) == DTRACE_PREDCACHE_GEN(cid) &&
+        (word & DTRACE_PREDCACHE_BIT(cid)) != 0;
+}
+
 
 /*
  * DTrace Probe Context Functions
@@ -917,6 +980,31 @@ dtrace_canstore(uint64_t addr, size_t sz, dtrace_mstate_t *mstate,
 	return (dtrace_canstore_remains(addr, sz, NULL, mstate, vstate));
 }
 
+/*
+ * If the specified range lies within the dynamic variable space -- either the
+ * space allocated by dtrace_dstate_init() or a region added to it by
+ * dtrace_dstate_grow() -- returns the address of the first chunk of that part
+ * of the space; otherwise returns 0.
+ */
+static uintptr_t
+dtrace_dstate_chunks(uint64_t addr, size_t sz, dtrace_dstate_t *dstate)
+{
+	uint_t i;
+
+	if (DTRACE_INRANGE(addr, sz, dstate->dtds_base, dstate->dtds_size)) {
+		return ((uintptr_t)dstate->dtds_base +
+		    (dstate->dtds_basehashsize * sizeof (dtrace_dynhash_t)));
+	}
+
+	for (i = 0; i < dstate->dtds_ngrow; i++) {
+		if (DTRACE_INRANGE(addr, sz, dstate->dtds_grow[i],
+		    dstate->dtds_growsize))
+			return ((uintptr_t)dstate->dtds_grow[i]);
+	}
+
+	return (0);
+}
+
 /*
  * Implementation of dtrace_canstore which communicates the upper bound of the
  * allowed memory region.
@@ -925,6 +1013,8 @@ static int
 dtrace_canstore_remains(uint64_t addr, size_t sz, size_t *remain,
     dtrace_mstate_t *mstate, dtrace_vstate_t *vstate)
 {
+	uintptr_t base;
+
 	/*
 	 * First, check to see if the address is in scratch space...
 	 */
@@ -940,11 +1030,9 @@ dtrace_canstore_remains(uint64_t addr, size_t sz, size_t *remain,
 	 * up both thread-local variables and any global dynamically-allocated
 	 * variables.
 	 */
-	if (DTRACE_INRANGE(addr, sz, vstate->dtvs_dynvars.dtds_base,
-	    vstate->dtvs_dynvars.dtds_size)) {
+	if ((base = dtrace_dstate_chunks(addr, sz,
+	    &vstate->dtvs_dynvars)) != 0) {
 		dtrace_dstate_t *dstate = &vstate->dtvs_dynvars;
-		uintptr_t base = (uintptr_t)dstate->dtds_base +
-		    (dstate->dtds_hashsize * sizeof (dtrace_dynhash_t));
 		uintptr_t chunkoffs;
 		dtrace_dynvar_t *dvar;
 
@@ -956,7 +1044,8 @@ dtrace_canstore_remains(uint64_t addr, size_t sz, size_t *remain,
 		 * it must:
 		 *
 		 *	(1) Start above the hash table that is at the base of
-		 *	the dynamic variable space
+		 *	the dynamic variable space (regions added to the space
+		 *	have no hash table)
 		 *
 		 *	(2) Have a starting chunk offset that is beyond the
 		 *	dtrace_dynvar_t that is at the base of every chunk
@@ -1636,7 +1725,7 @@ dtrace_wstr2str(uintptr_t src, uint64_t srcchars, char* dest, uint64_t destsize)
 	char *destend = dest + destsize;
 	uintptr_t srcend;
 
-	if (srcchars != (uint64_t)-1ui64)
+	if (srcchars != (uint64_t)-1)
 		srcend = (uintptr_t)(src + srcchars * sizeof(uint16_t));
 	else
 		srcend = (uintptr_t)-2;
@@ -1997,6 +2086,149 @@ dtrace_priv_probe(dtrace_state_t *state, dtrace_mstate_t *mstate,
 }
 #endif
 
+/*
+ * Note:  called from cross call context, on every CPU at once.  This function
+ * moves the variables of a dynamic variable space to a larger hash table, as
+ * explained in <sys/dtrace_impl.h>.  The first CPU to arrive does the work,
+ * and leaves the old table and its size in the rehash structure for the
+ * caller to free; the others spin until it is done, so that none of them can
+ * enter probe context in the meantime.
+ */
+static void
+dtrace_dstate_rehash(dtrace_dstate_rehash_t *rehash)
+{
+	dtrace_dstate_t *dstate = rehash->dtdr_dstate;
+	dtrace_dynhash_t *hash = rehash->dtdr_hash;
+	size_t hashsize = rehash->dtdr_hashsize, i, bucket;
+	dtrace_dynvar_t *dvar, *next;
+
+	if (dtrace_cas32(&rehash->dtdr_owner, 0, 1) != 0) {
+		while (!rehash->dtdr_done)
+			continue;
+
+		return;
+	}
+
+	for (i = 0; i < dstate->dtds_hashsize; i++) {
+		dvar = dstate->dtds_hash[i].dtdh_chain;
+
+		for (; dvar != &dtrace_dynhash_sink; dvar = next) {
+			ASSERT(dvar->dtdv_hashval != DTRACE_DYNHASH_FREE);
+			next = dvar->dtdv_next;
+			bucket = dvar->dtdv_hashval % hashsize;
+			dvar->dtdv_next = hash[bucket].dtdh_chain;
+			hash[bucket].dtdh_chain = dvar;
+		}
+	}
+
+	rehash->dtdr_hash = dstate->dtds_hash;
+	rehash->dtdr_hashsize = dstate->dtds_hashsize;
+	dstate->dtds_hash = hash;
+	dstate->dtds_hashsize = hashsize;
+	dtrace_membar_producer();
+	rehash->dtdr_done = 1;
+}
+
+/*
+ * Note:  not called from probe context.  This function is called from
+ * dtrace_dynvar_clean() to add a region of chunks to a dynamic variable space
+ * that has been exhausted; growing the space is explained in detail in
+ * <sys/dtrace_impl.h>.
+ */
+static int
+dtrace_dstate_grow(dtrace_dstate_t *dstate)
+{
+	size_t chunksize = dstate->dtds_chunksize;
+	size_t nchunks = dstate->dtds_growsize / chunksize, maxper, n, j;
+	dtrace_dynvar_t *first, *last, *clean;
+	dtrace_dstate_percpu_t *dcpu;
+	dtrace_dstate_rehash_t rehash;
+	uintptr_t base;
+	int i;
+
+	ASSERT(dstate->dtds_ngrow < DTRACE_DSTATE_NGROW);
+	ASSERT(nchunks != 0);
+
+	if ((base = (uintptr_t)kmem_zalloc(dstate->dtds_growsize,
+	    KM_NOSLEEP | KM_NORMALPRI)) == 0)
+		return (ENOMEM);
+
+	/*
+	 * The region must be visible to dtrace_canstore() before any of its
+	 * chunks can be allocated.
+	 */
+	dstate->dtds_grow[dstate->dtds_ngrow] = (void *)base;
+	dtrace_membar_producer();
+	dstate->dtds_ngrow++;
+	dtrace_membar_producer();
+
+	/*
+	 * Divide the chunks evenly among the CPUs (or give them all to the
+	 * first CPU if there are too few to go around), and push each CPU's
+	 * share onto its clean list.  The clean list may concurrently be
+	 * moved to a free list in dtrace_dynvar(), but only the cleaning
+	 * context adds to it.
+	 */
+	if ((maxper = nchunks / NCPU) == 0)
+		maxper = nchunks;
+
+	for (i = 0; i < NCPU && nchunks != 0; i++) {
+		n = i == NCPU - 1 ? nchunks : MIN(maxper, nchunks);
+		first = (dtrace_dynvar_t *)base;
+
+		for (j = 0; j < n - 1; j++, base += chunksize) {
+			((dtrace_dynvar_t *)base)->dtdv_next =
+			    (dtrace_dynvar_t *)(base + chunksize);
+		}
+
+		last = (dtrace_dynvar_t *)base;
+		base += chunksize;
+		nchunks -= n;
+
+		dcpu = &dstate->dtds_percpu[i];
+
+		do {
+			clean = dcpu->dtdsc_clean;
+			last->dtdv_next = clean;
+			dtrace_membar_producer();
+		} while (dtrace_casptr(&dcpu->dtdsc_clean,
+		    clean, first) != clean);
+	}
+
+	/*
+	 * Now grow the hash table with the space, keeping to the original
+	 * number of buckets per region.  The new table is zeroed, so its
+	 * locks are free; its chains are emptied before the cross call, which
+	 * keeps the time that probes are held off to the rehash itself.
+	 */
+	rehash.dtdr_dstate = dstate;
+	rehash.dtdr_hashsize = dstate->dtds_basehashsize *
+	    (dstate->dtds_ngrow + 1);
+	rehash.dtdr_owner = 0;
+	rehash.dtdr_done = 0;
+
+	if (rehash.dtdr_hashsize != 1 && (rehash.dtdr_hashsize & 1))
+		rehash.dtdr_hashsize--;
+
+	if ((rehash.dtdr_hash = kmem_zalloc(rehash.dtdr_hashsize *
+	    sizeof (dtrace_dynhash_t), KM_NOSLEEP | KM_NORMALPRI)) == NULL)
+		return (0);
+
+	for (n = 0; n < rehash.dtdr_hashsize; n++)
+		rehash.dtdr_hash[n].dtdh_chain = &dtrace_dynhash_sink;
+
+	dtrace_xcall(DTRACE_CPUALL,
+	    (dtrace_xcall_t)dtrace_dstate_rehash, &rehash);
+	ASSERT(rehash.dtdr_done);
+
+	if (rehash.dtdr_hash != dstate->dtds_base) {
+		kmem_free(rehash.dtdr_hash,
+		    rehash.dtdr_hashsize * sizeof (dtrace_dynhash_t));
+	}
+
+	return (0);
+}
+
 /*
  * Note:  not called from probe context.  This function is called
  * asynchronously (and at a regular interval) from outside of probe context to
@@ -2009,7 +2241,16 @@ dtrace_dynvar_clean(dtrace_dstate_t *dstate)
 	dtrace_dynvar_t *dirty;
 	dtrace_dstate_percpu_t *dcpu;
 	dtrace_dynvar_t **rinsep;
-	int i, j, work = 0;
+	int i, j, work = 0, grow = 0;
+
+	/*
+	 * If an allocation has found the space to be empty, we will try to
+	 * grow it once we have cleaned it.
+	 */
+	if (dstate->dtds_state == DTRACE_DSTATE_EMPTY &&
+	    dstate->dtds_ngrow < DTRACE_DSTATE_NGROW &&
+	    dstate->dtds_growsize != 0)
+		grow = 1;
 
 	for (i = 0; i < NCPU; i++) {
 		dcpu = &dstate->dtds_percpu[i];
@@ -2099,7 +2340,7 @@ dtrace_dynvar_clean(dtrace_dstate_t *dstate)
 		    dirty, NULL) != dirty);
 	}
 
-	if (!work) {
+	if (!work && !grow) {
 		/*
 		 * We have no work to do; we can simply return.
 		 */
@@ -2123,6 +2364,14 @@ dtrace_dynvar_clean(dtrace_dstate_t *dstate)
 		dcpu->dtdsc_rinsing = NULL;
 	}
 
+	/*
+	 * Now that the rinsing lists have been made clean, we can add to the
+	 * clean lists.  If we have nothing to add and had nothing to clean,
+	 * there is no reason to change the state.
+	 */
+	if (grow && dtrace_dstate_grow(dstate) != 0 && !work)
+		return;
+
 	/*
 	 * Before we actually set the state to be DTRACE_DSTATE_CLEAN, make
 	 * sure that all CPUs have seen all of the dtdsc_clean pointers.
@@ -2547,6 +2796,14 @@ retry:
 		new_free = dvar->dtdv_next;
 	} while (dtrace_casptr(&dcpu->dtdsc_free, free, new_free) != free);
 
+	if (cpu != me) {
+		/*
+		 * We found this chunk on another CPU's free or clean list;
+		 * count the steal against our own CPU.
+		 */
+		dstate->dtds_percpu[me].dtdsc_steals++;
+	}
+
 	/*
 	 * We have now allocated a new chunk.  We copy the tuple keys into the
 	 * tuple array and copy any referenced key data into the data space
@@ -2984,10 +3241,18 @@ next:
 
 	/*
 	 * If we don't have enough room to both allocate a new key _and_
-	 * its associated data, increment the drop count and return.
+	 * its associated data, spill the buffer to the consumer and try again
+	 * in the empty buffer -- or, if we can't spill, increment the drop
+	 * count and return.  (The retry can't recurse further:  having just
+	 * spilled, we can't spill again until the consumer has collected it.)
 	 */
 	if ((uintptr_t)tomax + offs + fsize >
 	    agb->dtagb_free - sizeof (dtrace_aggkey_t)) {
+		if (dtrace_buffer_spill(buf)) {
+			dtrace_aggregate(agg, dbuf, offset, buf, expr, arg);
+			return;
+		}
+
 		dtrace_buffer_drop(buf);
 		return;
 	}
@@ -3053,47 +3318,103 @@ next:
 }
 
 /*
- * Given consumer state, this routine finds a speculation in the INACTIVE
- * state and transitions it into the ACTIVE state.  If there is no speculation
- * in the INACTIVE state, 0 is returned.  In this case, no error counter is
- * incremented -- it is up to the caller to take appropriate action.
+ * Return a speculation that has been transitioned into the INACTIVE state to
+ * the free list of the specified CPU.  This must be called on the specified
+ * CPU with interrupts disabled.
+ */
+static void
+dtrace_speculation_free(dtrace_state_t *state, processorid_t cpu,
+    dtrace_speculation_t *spec)
+{
+	dtrace_specfree_t *sf = &state->dts_specfree[cpu];
+	dtrace_speculation_t *head;
+
+	ASSERT(spec->dtsp_state == DTRACESPEC_INACTIVE);
+
+	do {
+		head = sf->dtsf_free;
+		spec->dtsp_next = head;
+		dtrace_membar_producer();
+	} while (dtrace_casptr(&sf->dtsf_free, head, spec) != head);
+}
+
+/*
+ * Given consumer state, this routine takes a speculation from the free list
+ * of the current CPU (stealing the free list of another CPU if our own is
+ * empty) and transitions it into the ACTIVE state.  If there is no
+ * speculation in the INACTIVE state, 0 is returned.  In this case, no error
+ * counter is incremented -- it is up to the caller to take appropriate action.
  */
 static int
 dtrace_speculation(dtrace_state_t *state)
 {
-	int i = 0;
-	dtrace_speculation_state_t current;
-	uint32_t *stat = &state->dts_speculations_unavail, count;
+	processorid_t cpu = curcpu;
+	dtrace_specfree_t *sf = &state->dts_specfree[cpu];
+	dtrace_speculation_t *spec, *next;
+	int32_t nbusy = 0;
+	uint32_t rval;
+	int i;
 
-	while (i < state->dts_nspeculations) {
-		dtrace_speculation_t *spec = &state->dts_speculations[i];
+	/*
+	 * Our own free list can only be emptied underneath us by another CPU
+	 * stealing it; it can't be pushed to by anyone but us.
+	 */
+	while ((spec = sf->dtsf_free) != NULL) {
+		dtrace_membar_consumer();
+		next = spec->dtsp_next;
 
-		current = spec->dtsp_state;
+		if (dtrace_casptr(&sf->dtsf_free, spec, next) == spec)
+			goto found;
+	}
+
+	for (i = 0; i < NCPU; i++) {
+		dtrace_specfree_t *victim = &state->dts_specfree[i];
 
-		if (current != DTRACESPEC_INACTIVE) {
-			if (current == DTRACESPEC_COMMITTINGMANY ||
-			    current == DTRACESPEC_COMMITTING ||
-			    current == DTRACESPEC_DISCARDING)
-				stat = &state->dts_speculations_busy;
-			i++;
+		if (i == cpu || (spec = victim->dtsf_free) == NULL)
 			continue;
+
+		if (dtrace_casptr(&victim->dtsf_free, spec, NULL) != spec)
+			continue;
+
+		/*
+		 * We have stolen the entire list.  We keep the first
+		 * speculation for ourselves and make the remainder our own
+		 * free list -- which, as we found it empty and only we can
+		 * push to it, must still be empty.
+		 */
+		dtrace_membar_consumer();
+
+		if ((next = spec->dtsp_next) != NULL) {
+			ASSERT(sf->dtsf_free == NULL);
+			sf->dtsf_free = next;
 		}
 
-		if (dtrace_cas32((uint32_t *)&spec->dtsp_state,
-		    current, DTRACESPEC_ACTIVE) == current)
-			return (i + 1);
+		goto found;
 	}
 
 	/*
-	 * We couldn't find a speculation.  If we found as much as a single
-	 * busy speculation buffer, we'll attribute this failure as "busy"
-	 * instead of "unavail".
+	 * We couldn't find a speculation.  If as much as a single speculation
+	 * is busy, we'll attribute this failure as "busy" instead of
+	 * "unavail".
 	 */
-	do {
-		count = *stat;
-	} while (dtrace_cas32(stat, count, count + 1) != count);
+	for (i = 0; i < NCPU; i++)
+		nbusy += state->dts_specfree[i].dtsf_nbusy;
+
+	if (nbusy > 0) {
+		sf->dtsf_busy++;
+	} else {
+		sf->dtsf_unavail++;
+	}
 
 	return (0);
+
+found:
+	spec->dtsp_next = NULL;
+	rval = dtrace_cas32((uint32_t *)&spec->dtsp_state,
+	    DTRACESPEC_INACTIVE, DTRACESPEC_ACTIVE);
+	ASSERT(rval == DTRACESPEC_INACTIVE);
+
+	return ((int)(spec - state->dts_speculations) + 1);
 }
 
 /*
@@ -3108,10 +3429,11 @@ dtrace_speculation_commit(dtrace_state_t *state, processorid_t cpu,
 {
 	dtrace_speculation_t *spec;
 	dtrace_buffer_t *src, *dest;
-	uintptr_t daddr, saddr, dlimit, slimit;
+	uintptr_t daddr, saddr, scopy, slimit;
 	dtrace_speculation_state_t current, new = 0;
 	intptr_t offs;
 	uint64_t timestamp;
+	int reuse = 0;
 
 	if (which == 0)
 		return;
@@ -3175,6 +3497,9 @@ dtrace_speculation_commit(dtrace_state_t *state, processorid_t cpu,
 	} while (dtrace_cas32((uint32_t *)&spec->dtsp_state,
 	    current, new) != current);
 
+	if (current != DTRACESPEC_COMMITTINGMANY)
+		state->dts_specfree[cpu].dtsf_nbusy++;
+
 	/*
 	 * We have set the state to indicate that we are committing this
 	 * speculation.  Now reserve the necessary space in the destination
@@ -3188,14 +3513,20 @@ dtrace_speculation_commit(dtrace_state_t *state, processorid_t cpu,
 
 	/*
 	 * We have sufficient space to copy the speculative buffer into the
-	 * primary buffer.  First, modify the speculative buffer, filling
-	 * in the timestamp of all entries with the current time.  The data
-	 * must have the commit() time rather than the time it was traced,
-	 * so that all entries in the primary buffer are in timestamp order.
+	 * primary buffer.  Each entry must have the commit() time rather than
+	 * the time it was traced, so that all entries in the primary buffer
+	 * are in timestamp order.  We fill in the timestamp of each entry in
+	 * the speculative buffer and copy the buffer across as we go, so that
+	 * the speculative data is only walked once.  The copy is done a
+	 * uint64_t at a time (both buffers are suitably aligned), leaving any
+	 * tail of less than a uint64_t to be copied with the next entry.
 	 */
 	timestamp = dtrace_gethrtime();
+	daddr = (uintptr_t)dest->dtb_tomax + offs;
 	saddr = (uintptr_t)src->dtb_tomax;
+	scopy = saddr;
 	slimit = saddr + src->dtb_offset;
+
 	while (saddr < slimit) {
 		size_t size;
 		dtrace_rechdr_t *dtrh = (dtrace_rechdr_t *)saddr;
@@ -3214,33 +3545,20 @@ dtrace_speculation_commit(dtrace_state_t *state, processorid_t cpu,
 		DTRACE_RECORD_STORE_TIMESTAMP(dtrh, timestamp);
 
 		saddr += size;
-	}
 
-	/*
-	 * Copy the buffer across.  (Note that this is a
-	 * highly subobtimal bcopy(); in the unlikely event that this becomes
-	 * a serious performance issue, a high-performance DTrace-specific
-	 * bcopy() should obviously be invented.)
-	 */
-	daddr = (uintptr_t)dest->dtb_tomax + offs;
-	dlimit = daddr + src->dtb_offset;
-	saddr = (uintptr_t)src->dtb_tomax;
+		while (saddr - scopy >= sizeof (uint64_t)) {
+			*((uint64_t *)daddr) = *((uint64_t *)scopy);
 
-	/*
-	 * First, the aligned portion.
-	 */
-	while (dlimit - daddr >= sizeof (uint64_t)) {
-		*((uint64_t *)daddr) = *((uint64_t *)saddr);
-
-		daddr += sizeof (uint64_t);
-		saddr += sizeof (uint64_t);
+			daddr += sizeof (uint64_t);
+			scopy += sizeof (uint64_t);
+		}
 	}
 
 	/*
 	 * Now any left-over bit...
 	 */
-	while (dlimit - daddr)
-		*((uint8_t *)daddr++) = *((uint8_t *)saddr++);
+	while (slimit - scopy)
+		*((uint8_t *)daddr++) = *((uint8_t *)scopy++);
 
 	/*
 	 * Finally, commit the reserved space in the destination buffer.
@@ -3258,11 +3576,20 @@ out:
 		    DTRACESPEC_COMMITTING, DTRACESPEC_INACTIVE);
 
 		ASSERT(rval == DTRACESPEC_COMMITTING);
+		state->dts_specfree[cpu].dtsf_nbusy--;
+		reuse = 1;
 	}
 
 	src->dtb_offset = 0;
 	src->dtb_xamot_drops += src->dtb_drops;
 	src->dtb_drops = 0;
+
+	/*
+	 * Only now that our speculative buffer is empty can the speculation
+	 * be handed out again.
+	 */
+	if (reuse)
+		dtrace_speculation_free(state, cpu, spec);
 }
 
 /*
@@ -3321,6 +3648,12 @@ dtrace_speculation_discard(dtrace_state_t *state, processorid_t cpu,
 
 	buf->dtb_offset = 0;
 	buf->dtb_drops = 0;
+
+	if (new == DTRACESPEC_DISCARDING) {
+		state->dts_specfree[cpu].dtsf_nbusy++;
+	} else {
+		dtrace_speculation_free(state, cpu, spec);
+	}
 }
 
 /*
@@ -3410,6 +3743,7 @@ dtrace_speculation_clean(dtrace_state_t *state)
 	for (i = 0; i < state->dts_nspeculations; i++) {
 		dtrace_speculation_t *spec = &state->dts_speculations[i];
 		dtrace_speculation_state_t current, new;
+		dtrace_icookie_t cookie;
 
 		if (!spec->dtsp_cleaning)
 			continue;
@@ -3423,6 +3757,15 @@ dtrace_speculation_clean(dtrace_state_t *state)
 		rv = dtrace_cas32((uint32_t *)&spec->dtsp_state, current, new);
 		ASSERT(rv == current);
 		spec->dtsp_cleaning = 0;
+
+		/*
+		 * The free lists and busy counts may only be manipulated
+		 * by their own CPU with interrupts disabled.
+		 */
+		cookie = dtrace_interrupt_disable();
+		state->dts_specfree[curcpu].dtsf_nbusy--;
+		dtrace_speculation_free(state, curcpu, spec);
+		dtrace_interrupt_enable(cookie);
 	}
 }
 
@@ -4897,7 +5240,7 @@ dtrace_dif_subr(uint_t subr, uint_t rd, uint64_t *regs,
     case DIF_SUBR_WSTR2STR: {
 		uintptr_t dest = mstate->dtms_scratch_ptr;
 		uint64_t destsize = state->dts_options[DTRACEOPT_STRSIZE];
-		uint64_t srccount = (uint64_t)-1i64;
+		uint64_t srccount = (uint64_t)-1;
 
 		if (nargs > 1)
 			srccount = tupregs[1].dttk_value;
@@ -6462,6 +6805,20 @@ inetout:	regs[rd] = (uintptr_t)end + 1;
 	}
 }
 
+/*
+ * Native DIF code is called, and calls back into the framework, under the
+ * Windows x64 calling convention wherever it runs, so that the code run by
+ * the user-mode build is the code that the driver runs.
+ */
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define	DTRACE_DIFNATIVE_ABI	__attribute__((ms_abi))
+#else
+#define	DTRACE_DIFNATIVE_ABI
+#endif
+
+typedef uint64_t (DTRACE_DIFNATIVE_ABI *dtrace_difnative_f)(
+    dtrace_difnative_t *);
+
 /*
  * Emulate the execution of DTrace IR instructions specified by the given
  * DIF object.  This function is deliberately void of assertions as all of
@@ -6475,6 +6832,7 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 	const uint_t textlen = difo->dtdo_len;
 	const char *strtab = difo->dtdo_strtab;
 	const uint64_t *inttab = difo->dtdo_inttab;
+	const dtrace_difdop_t *dops = difo->dtdo_dops, *dop = NULL;
 
 	uint64_t rval = 0;
 	dtrace_statvar_t *svar;
@@ -6490,9 +6848,11 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 	uint8_t cc_n = 0, cc_z = 0, cc_v = 0, cc_c = 0;
 	int64_t cc_r;
 	uint_t pc = 0, id, opc = 0;
+	uint_t nops = 0;
+	const int difops = (mstate->dtms_present & DTRACE_MSTATE_DIFOPS);
 	uint8_t ttop = 0;
 	dif_instr_t instr;
-	uint_t r1, r2, rd;
+	uint_t op, r1, r2, rd;
 
 	/*
 	 * We stash the current DIF object into the machine state: we need it
@@ -6502,15 +6862,56 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 
 	regs[DIF_REG_R0] = 0; 		/* %r0 is fixed at zero */
 
+	/*
+	 * If the DIF object has been compiled to native code, run that
+	 * instead -- unless its instructions are being counted, which only
+	 * the emulator does.  See "DTrace Native DIF" in <sys/dtrace_impl.h>.
+	 */
+	if (difo->dtdo_native != NULL && !difops &&
+	    !(*flags & CPU_DTRACE_FAULT)) {
+		dtrace_difnative_t dn;
+
+		dn.dtdn_regs[DIF_REG_R0] = 0;
+		dn.dtdn_cc = 0;
+		dn.dtdn_mstate = mstate;
+		dn.dtdn_vstate = vstate;
+		dn.dtdn_state = state;
+
+		rval = ((dtrace_difnative_f)difo->dtdo_native)(&dn);
+
+		if (!(*flags & CPU_DTRACE_FAULT))
+			return (rval);
+
+		mstate->dtms_fltoffs = dn.dtdn_pc * sizeof (dif_instr_t);
+		mstate->dtms_present |= DTRACE_MSTATE_FLTOFFS;
+
+		return (0);
+	}
+
 	while (pc < textlen && !(*flags & CPU_DTRACE_FAULT)) {
 		opc = pc;
 
+		if (difops)
+			nops++;
+
 		instr = text[pc++];
 		r1 = DIF_INSTR_R1(instr);
 		r2 = DIF_INSTR_R2(instr);
 		rd = DIF_INSTR_RD(instr);
 
-		switch (DIF_INSTR_OP(instr)) {
+		/*
+		 * If the DIF object has been decoded, dispatch on the decoded
+		 * operation; instructions that were not decoded to anything
+		 * else keep their own opcode.
+		 */
+		if (dops != NULL) {
+			dop = &dops[opc];
+			op = dop->dtdd_op;
+		} else {
+			op = DIF_INSTR_OP(instr);
+		}
+
+		switch (op) {
 		case DIF_OP_OR:
 			regs[rd] = regs[r1] | regs[r2];
 			break;
@@ -6741,7 +7142,7 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 			size_t sz = state->dts_options[DTRACEOPT_STRSIZE];
 			uintptr_t s1 = regs[r1];
 			uintptr_t s2 = regs[r2];
-			size_t lim1, lim2;
+			size_t lim1 = sz, lim2 = sz;
 
 			if (s1 != 0 &&
 			    !dtrace_strcanload(s1, sz, &lim1, mstate, vstate))
@@ -7253,9 +7654,94 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 			}
 			*((uint64_t *)(uintptr_t)regs[rd]) = regs[r1];
 			break;
+
+		/*
+		 * The decoded operations; see dtrace_difo_decode().  Each
+		 * must have exactly the effect of the instructions that it
+		 * stands for.
+		 */
+		case DTRACE_DIFDOP_SETX:
+		case DTRACE_DIFDOP_SETS:
+			regs[rd] = dop->dtdd_imm;
+			break;
+		case DTRACE_DIFDOP_LDARG:
+			regs[rd] = mstate->dtms_arg[dop->dtdd_arg];
+			break;
+		case DTRACE_DIFDOP_LDARGCMPBR:
+			regs[rd] = mstate->dtms_arg[dop->dtdd_arg];
+			/*FALLTHROUGH*/
+		case DTRACE_DIFDOP_SETXCMPBR:
+			regs[dop->dtdd_rd] = dop->dtdd_imm;
+			/*FALLTHROUGH*/
+		case DTRACE_DIFDOP_CMPBR:
+			r1 = dop->dtdd_r1;
+			r2 = dop->dtdd_r2;
+			cc_r = regs[r1] - regs[r2];
+			cc_n = cc_r < 0;
+			cc_z = cc_r == 0;
+			cc_v = 0;
+			cc_c = regs[r1] < regs[r2];
+
+			if (difops)
+				nops += dop->dtdd_len - 1;
+
+			if (dop->dtdd_taken &
+			    (1 << DTRACE_DIFDOP_CC(cc_n, cc_z, cc_v, cc_c)))
+				pc = dop->dtdd_label;
+			else
+				pc = opc + dop->dtdd_len;
+			break;
+		case DTRACE_DIFDOP_SETSSCMPBR:
+			regs[dop->dtdd_rd] = dop->dtdd_imm;
+			opc = pc++;
+
+			if (difops)
+				nops++;
+			/*FALLTHROUGH*/
+		case DTRACE_DIFDOP_SCMPBR: {
+			size_t sz = state->dts_options[DTRACEOPT_STRSIZE];
+			uintptr_t s1 = regs[dop->dtdd_r1];
+			uintptr_t s2 = regs[dop->dtdd_r2];
+			size_t lim1 = sz, lim2 = sz;
+
+			/*
+			 * If either string cannot be loaded, we stop short of
+			 * the branch, just as the scmp alone would have.
+			 */
+			if (s1 != 0 &&
+			    !dtrace_strcanload(s1, sz, &lim1, mstate, vstate))
+				break;
+			if (s2 != 0 &&
+			    !dtrace_strcanload(s2, sz, &lim2, mstate, vstate))
+				break;
+
+			cc_r = dtrace_strncmp((char *)s1, (char *)s2,
+			    MIN(lim1, lim2));
+
+			cc_n = cc_r < 0;
+			cc_z = cc_r == 0;
+			cc_v = cc_c = 0;
+
+			if (difops)
+				nops++;
+
+			if (dop->dtdd_taken &
+			    (1 << DTRACE_DIFDOP_CC(cc_n, cc_z, cc_v, cc_c)))
+				pc = dop->dtdd_label;
+			else
+				pc++;
+			break;
+		}
 		}
 	}
 
+	/*
+	 * DIF instructions are only counted for ECBs that are being
+	 * profiled; see dtrace_probe().
+	 */
+	if (difops)
+		mstate->dtms_difops += nops;
+
 	if (!(*flags & CPU_DTRACE_FAULT))
 		return (rval);
 
@@ -7705,6 +8191,20 @@ dtrace_store_by_ref(dtrace_difo_t *dp, caddr_t tomax, size_t size,
 	*valoffsp = valoffs;
 }
 
+/*
+ * Charge the time since *start to the ECB profile counter *phase, and move on
+ * to the specified next phase (if any).  Note:  called from probe context.
+ */
+static void
+dtrace_ecbstat_phase(uint64_t **phase, hrtime_t *start, uint64_t *next)
+{
+	hrtime_t now = dtrace_gethrtime();
+
+	**phase += now - *start;
+	*start = now;
+	*phase = next;
+}
+
 /*
  * If you're looking for the epicenter of DTrace, you just found it.  This
  * is the function called by the provider to fire a probe -- from which all
@@ -7724,7 +8224,9 @@ dtrace_probe(dtrace_id_t id, uintptr_t arg0, uintptr_t arg1,
 	size_t size;
 	int vtime, onintr;
 	volatile uint16_t *flags;
-	hrtime_t now;
+	hrtime_t now, pstart = 0;
+	dtrace_ecbstat_t *stat = NULL;
+	uint64_t *phase = NULL, difops = 0;
 #ifdef _WIN32
 	boolean_t lkd_req = B_FALSE;
 #endif
@@ -7788,6 +8290,7 @@ dtrace_probe(dtrace_id_t id, uintptr_t arg0, uintptr_t arg1,
 #endif
 
 	mstate.dtms_difo = NULL;
+	mstate.dtms_difops = 0;
 	mstate.dtms_probe = probe;
 	mstate.dtms_strtok = 0;
 	mstate.dtms_arg[0] = arg0;
@@ -7821,11 +8324,36 @@ dtrace_probe(dtrace_id_t id, uintptr_t arg0, uintptr_t arg1,
 		 */
 		uint64_t val = 0;
 
+		if (stat != NULL) {
+			/*
+			 * Charge the phase that the previous ECB was in when
+			 * we moved on from it.
+			 */
+			dtrace_ecbstat_phase(&phase, &pstart, NULL);
+			stat->dtes_difops += mstate.dtms_difops - difops;
+			stat = NULL;
+		}
+
 		mstate.dtms_present |= DTRACE_MSTATE_ARGS | DTRACE_MSTATE_PROBE;
+		mstate.dtms_present &= ~DTRACE_MSTATE_DIFOPS;
 		mstate.dtms_getf = NULL;
 
 		*flags &= ~CPU_DTRACE_ERROR;
 
+		if (!onintr && pred != NULL &&
+		    probe->dtpr_predcache == DTRACE_CACHEIDNONE &&
+		    pred->dtp_cacheid != DTRACE_CACHEIDNONE &&
+		    dtrace_matchpredcache(pred->dtp_cacheid)) {
+			/*
+			 * This ECB's predicate is known to be false for the
+			 * current thread; there is no need to evaluate it, or
+			 * even to reserve space for the ECB's data.  (If the
+			 * probe has a predicate cache ID, it has only this
+			 * ECB, and we have already missed in the cache.)
+			 */
+			continue;
+		}
+
 		if (prov == dtrace_provider) {
 			/*
 			 * If dtrace itself is the provider of this probe,
@@ -7953,10 +8481,22 @@ dtrace_probe(dtrace_id_t id, uintptr_t arg0, uintptr_t arg1,
 			}
 		}
 
-		if ((offs = dtrace_buffer_reserve(buf, ecb->dte_needed,
+		if (ecb->dte_stat != NULL) {
+			stat = &ecb->dte_stat[cpuid];
+			stat->dtes_nfired++;
+			difops = mstate.dtms_difops;
+			mstate.dtms_present |= DTRACE_MSTATE_DIFOPS;
+			pstart = dtrace_gethrtime();
+			phase = &stat->dtes_reserve;
+		}
+
+		if ((offs = dtrace_buffer_reserve(buf, ecb->dte_needed,
 		    ecb->dte_alignment, state, &mstate)) < 0)
 			continue;
 
+		if (stat != NULL)
+			dtrace_ecbstat_phase(&phase, &pstart, &stat->dtes_pred);
+
 		tomax = buf->dtb_tomax;
 		ASSERT(tomax != NULL);
 
@@ -7988,13 +8528,12 @@ dtrace_probe(dtrace_id_t id, uintptr_t arg0, uintptr_t arg1,
 			rval = dtrace_dif_emulate(dp, &mstate, vstate, state);
 
 			if (!(*flags & CPU_DTRACE_ERROR) && !rval) {
-				dtrace_cacheid_t cid = probe->dtpr_predcache;
+				dtrace_cacheid_t cid = pred->dtp_cacheid;
 
 				if (cid != DTRACE_CACHEIDNONE && !onintr) {
 					/*
 					 * Update the predicate cache...
 					 */
-					ASSERT(cid == pred->dtp_cacheid);
 					dtrace_setpredcache(cid);
 				}
 
@@ -8002,6 +8541,11 @@ dtrace_probe(dtrace_id_t id, uintptr_t arg0, uintptr_t arg1,
 			}
 		}
 
+		if (stat != NULL) {
+			stat->dtes_nmatched++;
+			dtrace_ecbstat_phase(&phase, &pstart, &stat->dtes_action);
+		}
+
 		for (act = ecb->dte_action; !(*flags & CPU_DTRACE_ERROR) &&
 		    act != NULL; act = act->dta_next) {
 			size_t valoffs;
@@ -8420,6 +8964,11 @@ dtrace_probe(dtrace_id_t id, uintptr_t arg0, uintptr_t arg1,
 			buf->dtb_offset = offs + ecb->dte_size;
 	}
 
+	if (stat != NULL) {
+		dtrace_ecbstat_phase(&phase, &pstart, NULL);
+		stat->dtes_difops += mstate.dtms_difops - difops;
+	}
+
 #ifndef _WIN32
 	if (vtime)
 		curthread->t_dtrace_start = dtrace_gethrtime();
@@ -8494,6 +9043,13 @@ dtrace_hash_destroy(dtrace_hash_t *hash)
 		ASSERT(hash->dth_tab[i] == NULL);
 #endif
 
+	if (hash->dth_sorted != NULL) {
+		kmem_free(hash->dth_sorted,
+		    hash->dth_sortsize * sizeof (dtrace_hashsort_t));
+		kmem_free(hash->dth_sortcum,
+		    (hash->dth_sortsize + 1) * sizeof (int));
+	}
+
 	kmem_free(hash->dth_tab,
 	    hash->dth_size * sizeof (dtrace_hashbucket_t *));
 	kmem_free(hash, sizeof (dtrace_hash_t));
@@ -8538,6 +9094,8 @@ dtrace_hash_add(dtrace_hash_t *hash, dtrace_probe_t *new)
 	dtrace_hashbucket_t *bucket = hash->dth_tab[ndx];
 	dtrace_probe_t **nextp, **prevp;
 
+	hash->dth_sortvalid = 0;
+
 	for (; bucket != NULL; bucket = bucket->dthb_next) {
 		if (DTRACE_HASHEQ(hash, bucket->dthb_chain, new))
 			goto add;
@@ -8608,6 +9166,8 @@ dtrace_hash_remove(dtrace_hash_t *hash, dtrace_probe_t *probe)
 	dtrace_probe_t **prevp = DTRACE_HASHPREV(hash, probe);
 	dtrace_probe_t **nextp = DTRACE_HASHNEXT(hash, probe);
 
+	hash->dth_sortvalid = 0;
+
 	/*
 	 * Find the bucket that we're removing this probe from.
 	 */
@@ -8652,6 +9212,170 @@ dtrace_hash_remove(dtrace_hash_t *hash, dtrace_probe_t *probe)
 		*(DTRACE_HASHPREV(hash, *nextp)) = *prevp;
 }
 
+/*
+ * In addition to being hashed, the buckets of each probe hash are kept in an
+ * array sorted by their string so that a glob pattern that begins with a
+ * literal prefix (e.g., "Io*") can be answered by a range of buckets rather
+ * than by examining every probe.  The array is rebuilt lazily:  adding or
+ * removing a probe merely marks it stale, and it is sorted again (with a
+ * heapsort, which needs neither recursion nor additional memory) the next
+ * time a range is required.  Each entry carries the leading bytes of its
+ * string as an integer, so that most comparisons made by the sort need not
+ * follow the bucket to the probe and the probe to its string.  Along with the
+ * sorted buckets, we keep the cumulative number of probes on them so that
+ * dtrace_match() can compare the size of a range with that of a hash chain.
+ */
+static int
+dtrace_hash_sortcmp(const dtrace_hashsort_t *lhs, const dtrace_hashsort_t *rhs)
+{
+	if (lhs->dths_prefix != rhs->dths_prefix)
+		return (lhs->dths_prefix < rhs->dths_prefix ? -1 : 1);
+
+	return (strcmp(lhs->dths_str, rhs->dths_str));
+}
+
+static void
+dtrace_hash_siftdown(dtrace_hashsort_t *sorted, int root, int n)
+{
+	dtrace_hashsort_t tmp;
+	int child;
+
+	while ((child = 2 * root + 1) < n) {
+		if (child + 1 < n && dtrace_hash_sortcmp(&sorted[child],
+		    &sorted[child + 1]) < 0)
+			child++;
+
+		if (dtrace_hash_sortcmp(&sorted[root], &sorted[child]) >= 0)
+			return;
+
+		tmp = sorted[root];
+		sorted[root] = sorted[child];
+		sorted[child] = tmp;
+		root = child;
+	}
+}
+
+static void
+dtrace_hash_sort(dtrace_hash_t *hash)
+{
+	dtrace_hashsort_t *sorted, tmp;
+	dtrace_hashbucket_t *bucket;
+	int n = hash->dth_nbuckets, i, j = 0, k;
+
+	ASSERT(MUTEX_HELD(&dtrace_lock));
+
+	if (hash->dth_sortvalid)
+		return;
+
+	if (n > hash->dth_sortsize) {
+		if (hash->dth_sorted != NULL) {
+			kmem_free(hash->dth_sorted, hash->dth_sortsize *
+			    sizeof (dtrace_hashsort_t));
+			kmem_free(hash->dth_sortcum,
+			    (hash->dth_sortsize + 1) * sizeof (int));
+		}
+
+		hash->dth_sortsize = n;
+		hash->dth_sorted = kmem_alloc(n * sizeof (dtrace_hashsort_t),
+		    KM_SLEEP);
+		hash->dth_sortcum = kmem_alloc((n + 1) * sizeof (int),
+		    KM_SLEEP);
+	}
+
+	sorted = hash->dth_sorted;
+
+	for (i = 0; i < hash->dth_size; i++) {
+		for (bucket = hash->dth_tab[i]; bucket != NULL;
+		    bucket = bucket->dthb_next, j++) {
+			char *str = DTRACE_HASHKEY(hash, bucket);
+			uint64_t prefix = 0;
+
+			sorted[j].dths_str = str;
+			sorted[j].dths_bucket = bucket;
+
+			for (k = 0; k < sizeof (uint64_t); k++) {
+				prefix = (prefix << NBBY) | (uchar_t)*str;
+
+				if (*str != '\0')
+					str++;
+			}
+
+			sorted[j].dths_prefix = prefix;
+		}
+	}
+
+	ASSERT(j == n);
+
+	for (i = n / 2 - 1; i >= 0; i--)
+		dtrace_hash_siftdown(sorted, i, n);
+
+	for (i = n - 1; i > 0; i--) {
+		tmp = sorted[0];
+		sorted[0] = sorted[i];
+		sorted[i] = tmp;
+		dtrace_hash_siftdown(sorted, 0, i);
+	}
+
+	hash->dth_sortcum[0] = 0;
+
+	for (i = 0; i < n; i++)
+		hash->dth_sortcum[i + 1] = hash->dth_sortcum[i] +
+		    sorted[i].dths_bucket->dthb_len;
+
+	hash->dth_sortvalid = 1;
+}
+
+/*
+ * Find the range [*lo, *hi) of sorted buckets whose strings begin with the
+ * literal prefix of the specified glob pattern, and return the number of
+ * probes on those buckets.  If the pattern has no literal prefix, INT_MAX is
+ * returned and the range is not set.
+ */
+static int
+dtrace_hash_range(dtrace_hash_t *hash, const char *pattern, int *lo, int *hi)
+{
+	dtrace_hashsort_t *sorted;
+	size_t len;
+	int l, h, m;
+
+	for (len = 0; pattern[len] != '\0'; len++) {
+		char c = pattern[len];
+
+		if (c == '[' || c == '?' || c == '*' || c == '\\')
+			break;
+	}
+
+	if (len == 0)
+		return (INT_MAX);
+
+	dtrace_hash_sort(hash);
+	sorted = hash->dth_sorted;
+
+	for (l = 0, h = hash->dth_nbuckets; l < h; ) {
+		m = l + (h - l) / 2;
+
+		if (strncmp(sorted[m].dths_str, pattern, len) < 0)
+			l = m + 1;
+		else
+			h = m;
+	}
+
+	*lo = l;
+
+	for (h = hash->dth_nbuckets; l < h; ) {
+		m = l + (h - l) / 2;
+
+		if (strncmp(sorted[m].dths_str, pattern, len) <= 0)
+			l = m + 1;
+		else
+			h = m;
+	}
+
+	*hi = l;
+
+	return (hash->dth_sortcum[*hi] - hash->dth_sortcum[*lo]);
+}
+
 /*
  * DTrace Utility Functions
  *
@@ -8996,7 +9720,10 @@ dtrace_match(const dtrace_probekey_t *pkp, uint32_t priv, uid_t uid,
 {
 	dtrace_probe_t template, *probe;
 	dtrace_hash_t *hash = NULL;
+	dtrace_hashbucket_t *bucket;
+	const char *pattern = NULL;
 	int len, best = INT_MAX, nmatched = 0;
+	int lo, hi, rlo = 0, rhi = 0;
 	dtrace_id_t i;
 
 	ASSERT(MUTEX_HELD(&dtrace_lock));
@@ -9042,6 +9769,42 @@ dtrace_match(const dtrace_probekey_t *pkp, uint32_t priv, uid_t uid,
 		hash = dtrace_byname;
 	}
 
+	/*
+	 * A glob pattern with a literal prefix can't be looked up in a hash,
+	 * but it can be narrowed to the range of distinct strings that share
+	 * its prefix.  If such a range covers fewer probes than the best hash
+	 * chain, we'll walk the buckets in that range instead.
+	 */
+	if (pkp->dtpk_mmatch == &dtrace_match_glob &&
+	    (len = dtrace_hash_range(dtrace_bymod, pkp->dtpk_mod,
+	    &lo, &hi)) < best) {
+		best = len;
+		hash = dtrace_bymod;
+		pattern = pkp->dtpk_mod;
+		rlo = lo;
+		rhi = hi;
+	}
+
+	if (pkp->dtpk_fmatch == &dtrace_match_glob &&
+	    (len = dtrace_hash_range(dtrace_byfunc, pkp->dtpk_func,
+	    &lo, &hi)) < best) {
+		best = len;
+		hash = dtrace_byfunc;
+		pattern = pkp->dtpk_func;
+		rlo = lo;
+		rhi = hi;
+	}
+
+	if (pkp->dtpk_nmatch == &dtrace_match_glob &&
+	    (len = dtrace_hash_range(dtrace_byname, pkp->dtpk_name,
+	    &lo, &hi)) < best) {
+		best = len;
+		hash = dtrace_byname;
+		pattern = pkp->dtpk_name;
+		rlo = lo;
+		rhi = hi;
+	}
+
 	/*
 	 * If we did not select a hash table, iterate over every probe and
 	 * invoke our callback for each one that matches our input probe key.
@@ -9062,6 +9825,36 @@ dtrace_match(const dtrace_probekey_t *pkp, uint32_t priv, uid_t uid,
 		return (nmatched);
 	}
 
+	/*
+	 * If we selected a range of sorted buckets, check each bucket's string
+	 * against the pattern once, and then check each probe on the buckets
+	 * that match against the other attributes of our input probe key.
+	 */
+	if (pattern != NULL) {
+		for (; rlo < rhi; rlo++) {
+			bucket = hash->dth_sorted[rlo].dths_bucket;
+
+			if (dtrace_match_glob(DTRACE_HASHKEY(hash, bucket),
+			    pattern, 0) <= 0)
+				continue;
+
+			for (probe = bucket->dthb_chain; probe != NULL;
+			    probe = *(DTRACE_HASHNEXT(hash, probe))) {
+				if (dtrace_match_probe(probe, pkp,
+				    priv, uid, zoneid) <= 0)
+					continue;
+
+				nmatched++;
+
+				if ((*matched)(probe, arg) !=
+				    DTRACE_MATCH_NEXT)
+					return (nmatched);
+			}
+		}
+
+		return (nmatched);
+	}
+
 	/*
 	 * If we selected a hash table, iterate over each probe of the same key
 	 * name and invoke the callback for every probe that matches the other
@@ -9755,6 +10548,55 @@ dtrace_probe_description(const dtrace_probe_t *prp, dtrace_probedesc_t *pdp)
 	(void) strncpy(pdp->dtpd_name, prp->dtpr_name, DTRACE_NAMELEN - 1);
 }
 
+/*
+ * Fill in the descriptions of up to dtpb_count probes that are visible with
+ * the specified privileges (and that match dtpb_match, if so requested),
+ * starting at the probe ID in dtpb_match.  On return, the probe ID in
+ * dtpb_match is the ID at which to resume and dtpb_count is the number of
+ * descriptions filled in.
+ */
+static int
+dtrace_probe_batch(dtrace_probebatch_t *pb, dtrace_probedesc_t *descs,
+    uint32_t priv, uid_t uid, zoneid_t zoneid)
+{
+	dtrace_probekey_t pkey;
+	dtrace_probe_t *probe;
+	dtrace_id_t i;
+	uint32_t n = 0;
+	int m;
+
+	ASSERT(MUTEX_HELD(&dtrace_lock));
+
+	if (pb->dtpb_flags & DTRACE_PROBEBATCH_MATCH) {
+		dtrace_probekey(&pb->dtpb_match, &pkey);
+		pkey.dtpk_id = DTRACE_IDNONE;
+	}
+
+	for (i = pb->dtpb_match.dtpd_id;
+	    i <= dtrace_nprobes && n < pb->dtpb_count; i++) {
+		if ((probe = dtrace_probes[i - 1]) == NULL)
+			continue;
+
+		if (pb->dtpb_flags & DTRACE_PROBEBATCH_MATCH) {
+			if ((m = dtrace_match_probe(probe, &pkey,
+			    priv, uid, zoneid)) < 0)
+				return (EINVAL);
+
+			if (m == 0)
+				continue;
+		} else if (!dtrace_match_priv(probe, priv, uid, zoneid)) {
+			continue;
+		}
+
+		dtrace_probe_description(probe, &descs[n++]);
+	}
+
+	pb->dtpb_match.dtpd_id = i;
+	pb->dtpb_count = n;
+
+	return (0);
+}
+
 /*
  * Called to indicate that a probe -- or probes -- should be provided by a
  * specfied provider.  If the specified description is NULL, the provider will
@@ -10881,8 +11723,10 @@ dtrace_difo_cacheable(dtrace_difo_t *dp)
 
 	/*
 	 * This DIF object may be cacheable.  Now we need to look for any
-	 * array loading instructions, any memory loading instructions, or
-	 * any stores to thread-local variables.
+	 * array loading instructions, any memory loading instructions, any
+	 * stores to thread-local variables, or any loads of clause-local
+	 * variables (which may have been set by an earlier clause for the
+	 * same probe firing).
 	 */
 	for (i = 0; i < dp->dtdo_len; i++) {
 		uint_t op = DIF_INSTR_OP(dp->dtdo_buf[i]);
@@ -10890,7 +11734,8 @@ dtrace_difo_cacheable(dtrace_difo_t *dp)
 		if ((op >= DIF_OP_LDSB && op <= DIF_OP_LDX) ||
 		    (op >= DIF_OP_ULDSB && op <= DIF_OP_ULDX) ||
 		    (op >= DIF_OP_RLDSB && op <= DIF_OP_RLDX) ||
-		    op == DIF_OP_LDGA || op == DIF_OP_STTS)
+		    op == DIF_OP_LDGA || op == DIF_OP_STTS ||
+		    op == DIF_OP_LDLS)
 			return (0);
 	}
 
@@ -11017,67 +11862,891 @@ dtrace_difo_chunksize(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 			ttop = 0;
 			break;
 
-		case DIF_OP_POPTS:
-			if (ttop != 0)
-				ttop--;
+		case DIF_OP_POPTS:
+			if (ttop != 0)
+				ttop--;
+			break;
+		}
+
+		sval = 0;
+		srd = 0;
+
+		if (nkeys == 0)
+			continue;
+
+		/*
+		 * We have a dynamic variable allocation; calculate its size.
+		 */
+		for (ksize = 0, i = 0; i < nkeys; i++)
+			ksize += P2ROUNDUP(key[i].dttk_size, sizeof (uint64_t));
+
+		size = sizeof (dtrace_dynvar_t);
+		size += sizeof (dtrace_key_t) * (nkeys - 1);
+		size += ksize;
+
+		/*
+		 * Now we need to determine the size of the stored data.
+		 */
+		id = DIF_INSTR_VAR(instr);
+
+		for (i = 0; i < dp->dtdo_varlen; i++) {
+			dtrace_difv_t *v = &dp->dtdo_vartab[i];
+
+			if (v->dtdv_id == id && v->dtdv_scope == scope) {
+				size += v->dtdv_type.dtdt_size;
+				break;
+			}
+		}
+
+		if (i == dp->dtdo_varlen)
+			return;
+
+		/*
+		 * We have the size.  If this is larger than the chunk size
+		 * for our dynamic variable state, reset the chunk size.
+		 */
+		size = P2ROUNDUP(size, sizeof (uint64_t));
+
+		/*
+		 * Before setting the chunk size, check that we're not going
+		 * to set it to a negative value...
+		 */
+		if (size > LONG_MAX)
+			return;
+
+		/*
+		 * ...and make certain that we didn't badly overflow.
+		 */
+		if (size < ksize || size < sizeof (dtrace_dynvar_t))
+			return;
+
+		if (size > vstate->dtvs_dynvars.dtds_chunksize)
+			vstate->dtvs_dynvars.dtds_chunksize = size;
+	}
+}
+
+/*
+ * Return the mask of condition codes, as indexed by DTRACE_DIFDOP_CC(), for
+ * which the specified branch is taken -- or 0 if the opcode isn't a branch.
+ * The conditions are those of the branches in dtrace_dif_emulate().
+ */
+static uint16_t
+dtrace_difo_decode_taken(uint_t op)
+{
+	uint16_t taken = 0;
+	uint_t cc;
+
+	for (cc = 0; cc < 16; cc++) {
+		uint8_t cc_n = (cc >> 3) & 1, cc_z = (cc >> 2) & 1;
+		uint8_t cc_v = (cc >> 1) & 1, cc_c = cc & 1;
+		int t;
+
+		switch (op) {
+		case DIF_OP_BA:
+			t = 1;
+			break;
+		case DIF_OP_BE:
+			t = cc_z;
+			break;
+		case DIF_OP_BNE:
+			t = cc_z == 0;
+			break;
+		case DIF_OP_BG:
+			t = (cc_z | (cc_n ^ cc_v)) == 0;
+			break;
+		case DIF_OP_BGU:
+			t = (cc_c | cc_z) == 0;
+			break;
+		case DIF_OP_BGE:
+			t = (cc_n ^ cc_v) == 0;
+			break;
+		case DIF_OP_BGEU:
+			t = cc_c == 0;
+			break;
+		case DIF_OP_BL:
+			t = cc_n ^ cc_v;
+			break;
+		case DIF_OP_BLU:
+			t = cc_c;
+			break;
+		case DIF_OP_BLE:
+			t = cc_z | (cc_n ^ cc_v);
+			break;
+		case DIF_OP_BLEU:
+			t = cc_c | cc_z;
+			break;
+		default:
+			return (0);
+		}
+
+		if (t)
+			taken |= (1 << cc);
+	}
+
+	return (taken);
+}
+
+/*
+ * If the instruction at pc is the specified compare, and it is followed by a
+ * branch, record the compare and the branch in the decoded operation.
+ */
+static int
+dtrace_difo_decode_cmpbr(dtrace_difo_t *dp, uint_t pc, uint_t cmp,
+    dtrace_difdop_t *dop)
+{
+	dif_instr_t instr;
+	uint16_t taken;
+
+	if (pc + 1 >= dp->dtdo_len)
+		return (0);
+
+	instr = dp->dtdo_buf[pc];
+
+	if (DIF_INSTR_OP(instr) != cmp)
+		return (0);
+
+	if ((taken = dtrace_difo_decode_taken(
+	    DIF_INSTR_OP(dp->dtdo_buf[pc + 1]))) == 0)
+		return (0);
+
+	dop->dtdd_r1 = DIF_INSTR_R1(instr);
+	dop->dtdd_r2 = DIF_INSTR_R2(instr);
+	dop->dtdd_taken = taken;
+	dop->dtdd_label = DIF_INSTR_LABEL(dp->dtdo_buf[pc + 1]);
+
+	return (1);
+}
+
+/*
+ * Decode the text of a validated DIF object for dtrace_dif_emulate(); see
+ * "DTrace Decoded DIF" in <sys/dtrace_impl.h>.  Decoding can be disabled by
+ * clearing dtrace_dif_predecode, in which case the emulator dispatches on the
+ * text itself.
+ */
+static void
+dtrace_difo_decode(dtrace_difo_t *dp)
+{
+	const dif_instr_t *text = dp->dtdo_buf;
+	uint_t len = dp->dtdo_len, pc, id;
+	dtrace_difdop_t *dops;
+
+	ASSERT(dp->dtdo_dops == NULL);
+
+	if (!dtrace_dif_predecode)
+		return;
+
+	dops = kmem_zalloc(len * sizeof (dtrace_difdop_t), KM_SLEEP);
+
+	for (pc = 0; pc < len; pc++) {
+		dtrace_difdop_t *dop = &dops[pc];
+		dif_instr_t instr = text[pc];
+
+		dop->dtdd_op = DIF_INSTR_OP(instr);
+		dop->dtdd_len = 1;
+		dop->dtdd_rd = DIF_INSTR_RD(instr);
+
+		switch (dop->dtdd_op) {
+		case DIF_OP_SETX:
+			dop->dtdd_op = DTRACE_DIFDOP_SETX;
+			dop->dtdd_imm =
+			    dp->dtdo_inttab[DIF_INSTR_INTEGER(instr)];
+			break;
+
+		case DIF_OP_SETS:
+			dop->dtdd_op = DTRACE_DIFDOP_SETS;
+			dop->dtdd_imm = (uint64_t)(uintptr_t)
+			    (dp->dtdo_strtab + DIF_INSTR_STRING(instr));
+			break;
+
+		case DIF_OP_LDGS:
+			/*
+			 * Only the arguments that dtrace_dif_variable() finds
+			 * in the machine state can be loaded directly.
+			 */
+			id = DIF_INSTR_VAR(instr);
+
+			if (id < DIF_VAR_ARG0 || id > DIF_VAR_ARG9 ||
+			    id - DIF_VAR_ARG0 >= sizeof (((dtrace_mstate_t *)
+			    NULL)->dtms_arg) / sizeof (uint64_t))
+				break;
+
+			dop->dtdd_op = DTRACE_DIFDOP_LDARG;
+			dop->dtdd_arg = id - DIF_VAR_ARG0;
+			break;
+		}
+
+		/*
+		 * Now see whether the instruction begins a sequence that
+		 * ends in a compare and a branch.
+		 */
+		switch (dop->dtdd_op) {
+		case DIF_OP_CMP:
+			if (dtrace_difo_decode_cmpbr(dp, pc, DIF_OP_CMP, dop)) {
+				dop->dtdd_op = DTRACE_DIFDOP_CMPBR;
+				dop->dtdd_len = 2;
+			}
+			break;
+
+		case DIF_OP_SCMP:
+			if (dtrace_difo_decode_cmpbr(dp, pc, DIF_OP_SCMP, dop)) {
+				dop->dtdd_op = DTRACE_DIFDOP_SCMPBR;
+				dop->dtdd_len = 2;
+			}
+			break;
+
+		case DTRACE_DIFDOP_SETX:
+			if (dtrace_difo_decode_cmpbr(dp,
+			    pc + 1, DIF_OP_CMP, dop)) {
+				dop->dtdd_op = DTRACE_DIFDOP_SETXCMPBR;
+				dop->dtdd_len = 3;
+			}
+			break;
+
+		case DTRACE_DIFDOP_SETS:
+			if (dtrace_difo_decode_cmpbr(dp,
+			    pc + 1, DIF_OP_SCMP, dop)) {
+				dop->dtdd_op = DTRACE_DIFDOP_SETSSCMPBR;
+				dop->dtdd_len = 3;
+			}
+			break;
+
+		case DTRACE_DIFDOP_LDARG:
+			if (pc + 1 >= len ||
+			    DIF_INSTR_OP(text[pc + 1]) != DIF_OP_SETX ||
+			    !dtrace_difo_decode_cmpbr(dp,
+			    pc + 2, DIF_OP_CMP, dop))
+				break;
+
+			dop->dtdd_op = DTRACE_DIFDOP_LDARGCMPBR;
+			dop->dtdd_len = 4;
+			dop->dtdd_rd = DIF_INSTR_RD(text[pc + 1]);
+			dop->dtdd_imm =
+			    dp->dtdo_inttab[DIF_INSTR_INTEGER(text[pc + 1])];
+			break;
+		}
+	}
+
+	dp->dtdo_dops = dops;
+}
+
+#ifdef _M_AMD64
+/*
+ * Execute one DIF instruction on behalf of native code, exactly as
+ * dtrace_dif_emulate() would, and return non-zero if it faulted.  These are
+ * the instructions that the native code does not carry out itself; see
+ * dtrace_difo_native().
+ */
+static int DTRACE_DIFNATIVE_ABI
+dtrace_difnative_op(dtrace_difnative_t *dn, dif_instr_t instr)
+{
+	dtrace_mstate_t *mstate = dn->dtdn_mstate;
+	dtrace_vstate_t *vstate = dn->dtdn_vstate;
+	dtrace_state_t *state = dn->dtdn_state;
+	volatile uint16_t *flags = &cpu_core[curcpu].cpuc_dtrace_flags;
+	uint64_t *regs = dn->dtdn_regs;
+	uint_t r1 = DIF_INSTR_R1(instr), r2 = DIF_INSTR_R2(instr);
+	uint_t rd = DIF_INSTR_RD(instr), id;
+	dtrace_statvar_t *svar;
+
+	switch (DIF_INSTR_OP(instr)) {
+	case DIF_OP_SDIV:
+	case DIF_OP_UDIV:
+	case DIF_OP_SREM:
+	case DIF_OP_UREM:
+		/*
+		 * Native code only hands over a division by zero.
+		 */
+		ASSERT(regs[r2] == 0);
+		regs[rd] = 0;
+		*flags |= CPU_DTRACE_DIVZERO;
+		break;
+	case DIF_OP_RLDSB:
+		if (!dtrace_canload(regs[r1], 1, mstate, vstate))
+			break;
+		/*FALLTHROUGH*/
+	case DIF_OP_LDSB:
+		regs[rd] = (int8_t)dtrace_load8(regs[r1]);
+		break;
+	case DIF_OP_RLDSH:
+		if (!dtrace_canload(regs[r1], 2, mstate, vstate))
+			break;
+		/*FALLTHROUGH*/
+	case DIF_OP_LDSH:
+		regs[rd] = (int16_t)dtrace_load16(regs[r1]);
+		break;
+	case DIF_OP_RLDSW:
+		if (!dtrace_canload(regs[r1], 4, mstate, vstate))
+			break;
+		/*FALLTHROUGH*/
+	case DIF_OP_LDSW:
+		regs[rd] = (int32_t)dtrace_load32(regs[r1]);
+		break;
+	case DIF_OP_RLDUB:
+		if (!dtrace_canload(regs[r1], 1, mstate, vstate))
+			break;
+		/*FALLTHROUGH*/
+	case DIF_OP_LDUB:
+		regs[rd] = dtrace_load8(regs[r1]);
+		break;
+	case DIF_OP_RLDUH:
+		if (!dtrace_canload(regs[r1], 2, mstate, vstate))
+			break;
+		/*FALLTHROUGH*/
+	case DIF_OP_LDUH:
+		regs[rd] = dtrace_load16(regs[r1]);
+		break;
+	case DIF_OP_RLDUW:
+		if (!dtrace_canload(regs[r1], 4, mstate, vstate))
+			break;
+		/*FALLTHROUGH*/
+	case DIF_OP_LDUW:
+		regs[rd] = dtrace_load32(regs[r1]);
+		break;
+	case DIF_OP_RLDX:
+		if (!dtrace_canload(regs[r1], 8, mstate, vstate))
+			break;
+		/*FALLTHROUGH*/
+	case DIF_OP_LDX:
+		regs[rd] = dtrace_load64(regs[r1]);
+		break;
+	case DIF_OP_SCMP: {
+		size_t sz = state->dts_options[DTRACEOPT_STRSIZE];
+		uintptr_t s1 = regs[r1];
+		uintptr_t s2 = regs[r2];
+		size_t lim1 = sz, lim2 = sz;
+		int64_t cc_r;
+
+		if (s1 != 0 &&
+		    !dtrace_strcanload(s1, sz, &lim1, mstate, vstate))
+			break;
+		if (s2 != 0 &&
+		    !dtrace_strcanload(s2, sz, &lim2, mstate, vstate))
+			break;
+
+		cc_r = dtrace_strncmp((char *)s1, (char *)s2, MIN(lim1, lim2));
+		dn->dtdn_cc = DTRACE_DIFDOP_CC(cc_r < 0, cc_r == 0, 0, 0);
+		break;
+	}
+	case DIF_OP_LDGA:
+		regs[rd] = dtrace_dif_variable(mstate, state, r1, regs[r2]);
+		break;
+	case DIF_OP_LDGS:
+		id = DIF_INSTR_VAR(instr);
+
+		if (id >= DIF_VAR_OTHER_UBASE) {
+			uintptr_t a;
+
+			id -= DIF_VAR_OTHER_UBASE;
+			svar = vstate->dtvs_globals[id];
+			ASSERT(svar != NULL);
+
+			if (!(svar->dtsv_var.dtdv_type.dtdt_flags &
+			    DIF_TF_BYREF)) {
+				regs[rd] = svar->dtsv_data;
+				break;
+			}
+
+			a = (uintptr_t)svar->dtsv_data;
+			regs[rd] = *(uint8_t *)a == UINT8_MAX ?
+			    0 : a + sizeof (uint64_t);
+			break;
+		}
+
+		regs[rd] = dtrace_dif_variable(mstate, state, id, 0);
+		break;
+	default:
+		ASSERT(0);
+	}
+
+	return ((*flags & CPU_DTRACE_FAULT) != 0);
+}
+
+/*
+ * Code emission for dtrace_difo_native().  The native code keeps the address
+ * of its dtrace_difnative_t in %rbx, and uses %rax, %rcx and %rdx in between
+ * DIF instructions.  Instructions are emitted as byte strings; those that
+ * take a register operand are given it in their ModRM byte.  Emission past
+ * the end of the buffer is counted but not stored, so that one check at the
+ * end finds it.
+ */
+#define	DTRACE_X86_RAX		0
+#define	DTRACE_X86_RCX		1
+#define	DTRACE_X86_RDX		2
+
+#define	DTRACE_DIFNATIVE_REG(r)		\
+	(offsetof(dtrace_difnative_t, dtdn_regs) + (r) * sizeof (uint64_t))
+#define	DTRACE_DIFNATIVE_INSTRSIZE	80	/* bytes per DIF instruction */
+
+typedef struct dtrace_difemit {
+	uint8_t *dde_buf;			/* code */
+	size_t dde_size;			/* size of code buffer */
+	size_t dde_off;				/* offset of next byte */
+	uint_t *dde_fixoff;			/* branch displacements */
+	uint_t *dde_fixpc;			/* ... and their targets */
+	uint_t dde_nfix;			/* number of branches */
+} dtrace_difemit_t;
+
+#define	DTRACE_DIFEMIT(e, s)	dtrace_difemit((e), (s), sizeof (s) - 1)
+
+static void
+dtrace_difemit(dtrace_difemit_t *e, const char *code, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++, e->dde_off++) {
+		if (e->dde_off < e->dde_size)
+			e->dde_buf[e->dde_off] = (uint8_t)code[i];
+	}
+}
+
+static void
+dtrace_difemit_imm(dtrace_difemit_t *e, uint64_t imm, size_t len)
+{
+	for (; len != 0; len--, imm >>= NBBY) {
+		char b = (char)(imm & 0xff);
+
+		dtrace_difemit(e, &b, 1);
+	}
+}
+
+/*
+ * mov reg, [rbx + off] and mov [rbx + off], reg.
+ */
+static void
+dtrace_difemit_ld(dtrace_difemit_t *e, uint_t reg, size_t off)
+{
+	char modrm = (char)(0x83 | (reg << 3));
+
+	DTRACE_DIFEMIT(e, "\x48\x8b");
+	dtrace_difemit(e, &modrm, 1);
+	dtrace_difemit_imm(e, off, 4);
+}
+
+static void
+dtrace_difemit_st(dtrace_difemit_t *e, uint_t reg, size_t off)
+{
+	char modrm = (char)(0x83 | (reg << 3));
+
+	DTRACE_DIFEMIT(e, "\x48\x89");
+	dtrace_difemit(e, &modrm, 1);
+	dtrace_difemit_imm(e, off, 4);
+}
+
+/*
+ * Emit a branch (whose opcode ends in a 32-bit displacement) to the code of
+ * the DIF instruction at pc; the displacement is filled in once the code of
+ * every instruction has been placed.  A pc of the length of the text stands
+ * for the exit of the native code.
+ */
+static void
+dtrace_difemit_branch(dtrace_difemit_t *e, const char *op, size_t len,
+    uint_t pc)
+{
+	dtrace_difemit(e, op, len);
+	e->dde_fixoff[e->dde_nfix] = (uint_t)e->dde_off;
+	e->dde_fixpc[e->dde_nfix++] = pc;
+	dtrace_difemit_imm(e, 0, 4);
+}
+
+/*
+ * Hand the instruction at pc to dtrace_difnative_op(), and leave through the
+ * exit with the instruction's pc if it faults.
+ */
+static void
+dtrace_difemit_op(dtrace_difemit_t *e, dif_instr_t instr, uint_t pc,
+    uint_t len)
+{
+	DTRACE_DIFEMIT(e, "\x48\x89\xd9");		/* mov rcx, rbx */
+	DTRACE_DIFEMIT(e, "\xba");			/* mov edx, instr */
+	dtrace_difemit_imm(e, instr, 4);
+	DTRACE_DIFEMIT(e, "\x48\xb8");			/* mov rax, op */
+	dtrace_difemit_imm(e, (uintptr_t)dtrace_difnative_op, 8);
+	DTRACE_DIFEMIT(e, "\xff\xd0");			/* call rax */
+	DTRACE_DIFEMIT(e, "\x85\xc0");			/* test eax, eax */
+	DTRACE_DIFEMIT(e, "\x74\x0f");			/* jz over exit */
+	DTRACE_DIFEMIT(e, "\xc7\x83");			/* mov [dtdn_pc], pc */
+	dtrace_difemit_imm(e, offsetof(dtrace_difnative_t, dtdn_pc), 4);
+	dtrace_difemit_imm(e, pc, 4);
+	dtrace_difemit_branch(e, "\xe9", 1, len);	/* jmp exit */
+}
+
+/*
+ * Emit the code of a DIF branch.  A branch that directly follows a cmp, and
+ * that is not itself the target of a branch, tests the processor's flags as
+ * the cmp left them; any other branch tests the condition codes against the
+ * mask that the emulator's decoded branches use.  The cmp sets the overflow
+ * code to zero, so the signed conditions depend on the sign flag alone.
+ */
+static void
+dtrace_difemit_bcc(dtrace_difemit_t *e, uint_t op, uint_t label, int flags)
+{
+	if (op == DIF_OP_BA) {
+		dtrace_difemit_branch(e, "\xe9", 1, label);
+		return;
+	}
+
+	if (!flags) {
+		DTRACE_DIFEMIT(e, "\xb8");		/* mov eax, taken */
+		dtrace_difemit_imm(e, dtrace_difo_decode_taken(op), 4);
+		dtrace_difemit_ld(e, DTRACE_X86_RCX,
+		    offsetof(dtrace_difnative_t, dtdn_cc));
+		DTRACE_DIFEMIT(e, "\x0f\xa3\xc8");	/* bt eax, ecx */
+		dtrace_difemit_branch(e, "\x0f\x82", 2, label);	/* jc */
+		return;
+	}
+
+	switch (op) {
+	case DIF_OP_BE:
+		dtrace_difemit_branch(e, "\x0f\x84", 2, label);	/* je */
+		break;
+	case DIF_OP_BNE:
+		dtrace_difemit_branch(e, "\x0f\x85", 2, label);	/* jne */
+		break;
+	case DIF_OP_BG:
+		DTRACE_DIFEMIT(e, "\x74\x06");			/* je over */
+		dtrace_difemit_branch(e, "\x0f\x89", 2, label);	/* jns */
+		break;
+	case DIF_OP_BGU:
+		dtrace_difemit_branch(e, "\x0f\x87", 2, label);	/* ja */
+		break;
+	case DIF_OP_BGE:
+		dtrace_difemit_branch(e, "\x0f\x89", 2, label);	/* jns */
+		break;
+	case DIF_OP_BGEU:
+		dtrace_difemit_branch(e, "\x0f\x83", 2, label);	/* jae */
+		break;
+	case DIF_OP_BL:
+		dtrace_difemit_branch(e, "\x0f\x88", 2, label);	/* js */
+		break;
+	case DIF_OP_BLU:
+		dtrace_difemit_branch(e, "\x0f\x82", 2, label);	/* jb */
+		break;
+	case DIF_OP_BLE:
+		dtrace_difemit_branch(e, "\x0f\x84", 2, label);	/* je */
+		dtrace_difemit_branch(e, "\x0f\x88", 2, label);	/* js */
+		break;
+	case DIF_OP_BLEU:
+		dtrace_difemit_branch(e, "\x0f\x86", 2, label);	/* jbe */
+		break;
+	}
+}
+
+/*
+ * Emit the code of a division:  a divisor of zero is handed to
+ * dtrace_difnative_op() to fault, as the emulator's does.
+ */
+static void
+dtrace_difemit_div(dtrace_difemit_t *e, dif_instr_t instr, uint_t pc,
+    uint_t len)
+{
+	uint_t op = DIF_INSTR_OP(instr);
+	size_t skip;
+
+	dtrace_difemit_ld(e, DTRACE_X86_RAX,
+	    DTRACE_DIFNATIVE_REG(DIF_INSTR_R1(instr)));
+	dtrace_difemit_ld(e, DTRACE_X86_RCX,
+	    DTRACE_DIFNATIVE_REG(DIF_INSTR_R2(instr)));
+	DTRACE_DIFEMIT(e, "\x48\x85\xc9");		/* test rcx, rcx */
+	DTRACE_DIFEMIT(e, "\x75\x00");			/* jnz over op */
+	skip = e->dde_off;
+	dtrace_difemit_op(e, instr, pc, len);
+
+	if (skip <= e->dde_size)
+		e->dde_buf[skip - 1] = (uint8_t)(e->dde_off - skip);
+
+	if (op == DIF_OP_SDIV || op == DIF_OP_SREM) {
+		DTRACE_DIFEMIT(e, "\x48\x99");		/* cqo */
+		DTRACE_DIFEMIT(e, "\x48\xf7\xf9");	/* idiv rcx */
+	} else {
+		DTRACE_DIFEMIT(e, "\x31\xd2");		/* xor edx, edx */
+		DTRACE_DIFEMIT(e, "\x48\xf7\xf1");	/* div rcx */
+	}
+
+	dtrace_difemit_st(e, op == DIF_OP_SDIV || op == DIF_OP_UDIV ?
+	    DTRACE_X86_RAX : DTRACE_X86_RDX,
+	    DTRACE_DIFNATIVE_REG(DIF_INSTR_RD(instr)));
+}
+
+/*
+ * Return non-zero if the instruction has native code, whether its own or a
+ * call to dtrace_difnative_op().
+ */
+static int
+dtrace_difo_native_ok(dif_instr_t instr)
+{
+	switch (DIF_INSTR_OP(instr)) {
+	case DIF_OP_OR: case DIF_OP_XOR: case DIF_OP_AND:
+	case DIF_OP_SLL: case DIF_OP_SRL: case DIF_OP_SUB:
+	case DIF_OP_ADD: case DIF_OP_MUL: case DIF_OP_SDIV:
+	case DIF_OP_UDIV: case DIF_OP_SREM: case DIF_OP_UREM:
+	case DIF_OP_NOT: case DIF_OP_MOV: case DIF_OP_CMP:
+	case DIF_OP_TST: case DIF_OP_BA: case DIF_OP_BE:
+	case DIF_OP_BNE: case DIF_OP_BG: case DIF_OP_BGU:
+	case DIF_OP_BGE: case DIF_OP_BGEU: case DIF_OP_BL:
+	case DIF_OP_BLU: case DIF_OP_BLE: case DIF_OP_BLEU:
+	case DIF_OP_LDSB: case DIF_OP_LDSH: case DIF_OP_LDSW:
+	case DIF_OP_LDUB: case DIF_OP_LDUH: case DIF_OP_LDUW:
+	case DIF_OP_LDX: case DIF_OP_RLDSB: case DIF_OP_RLDSH:
+	case DIF_OP_RLDSW: case DIF_OP_RLDUB: case DIF_OP_RLDUH:
+	case DIF_OP_RLDUW: case DIF_OP_RLDX: case DIF_OP_RET:
+	case DIF_OP_NOP: case DIF_OP_SETX: case DIF_OP_SETS:
+	case DIF_OP_SCMP: case DIF_OP_LDGA: case DIF_OP_LDGS:
+		return (1);
+	default:
+		return (0);
+	}
+}
+#endif	/* _M_AMD64 */
+
+/*
+ * Compile the text of a validated DIF object to native code if
+ * dtrace_dif_native is set; see "DTrace Native DIF" in <sys/dtrace_impl.h>.
+ * A DIF object that cannot be compiled, or whose code cannot be made
+ * executable, is left to the emulator.  The code has no unwind data, so
+ * nothing that it calls may raise an exception through it:  loads catch
+ * their own faults.
+ */
+static void
+dtrace_difo_native(dtrace_difo_t *dp)
+{
+#ifdef _M_AMD64
+	const dif_instr_t *text = dp->dtdo_buf;
+	uint_t len = dp->dtdo_len, pc, i, *labels;
+	uint8_t *targets;
+	dtrace_difemit_t e;
+	void *code, *cookie;
+
+	ASSERT(dp->dtdo_native == NULL);
+
+	if (!dtrace_dif_native)
+		return;
+
+	for (pc = 0; pc < len; pc++) {
+		if (!dtrace_difo_native_ok(text[pc]))
+			return;
+	}
+
+	labels = kmem_alloc((len + 1) * sizeof (uint_t), KM_SLEEP);
+	targets = kmem_zalloc(len + 1, KM_SLEEP);
+
+	bzero(&e, sizeof (e));
+	e.dde_size = (len + 1) * DTRACE_DIFNATIVE_INSTRSIZE;
+	e.dde_buf = kmem_alloc(e.dde_size, KM_SLEEP);
+	e.dde_fixoff = kmem_alloc(2 * len * sizeof (uint_t), KM_SLEEP);
+	e.dde_fixpc = kmem_alloc(2 * len * sizeof (uint_t), KM_SLEEP);
+
+	for (pc = 0; pc < len; pc++) {
+		if (dtrace_difo_decode_taken(DIF_INSTR_OP(text[pc])) != 0)
+			targets[DIF_INSTR_LABEL(text[pc])] = 1;
+	}
+
+	DTRACE_DIFEMIT(&e, "\x53");			/* push rbx */
+	DTRACE_DIFEMIT(&e, "\x48\x83\xec\x20");		/* sub rsp, 32 */
+	DTRACE_DIFEMIT(&e, "\x48\x89\xcb");		/* mov rbx, rcx */
+
+	for (pc = 0; pc < len; pc++) {
+		dif_instr_t instr = text[pc];
+		uint_t op = DIF_INSTR_OP(instr), id;
+		size_t r1 = DTRACE_DIFNATIVE_REG(DIF_INSTR_R1(instr));
+		size_t r2 = DTRACE_DIFNATIVE_REG(DIF_INSTR_R2(instr));
+		size_t rd = DTRACE_DIFNATIVE_REG(DIF_INSTR_RD(instr));
+
+		labels[pc] = (uint_t)e.dde_off;
+
+		switch (op) {
+		case DIF_OP_OR:
+		case DIF_OP_XOR:
+		case DIF_OP_AND:
+		case DIF_OP_SLL:
+		case DIF_OP_SRL:
+		case DIF_OP_SUB:
+		case DIF_OP_ADD:
+		case DIF_OP_MUL:
+			dtrace_difemit_ld(&e, DTRACE_X86_RAX, r1);
+			dtrace_difemit_ld(&e, DTRACE_X86_RCX, r2);
+
+			switch (op) {
+			case DIF_OP_OR:
+				DTRACE_DIFEMIT(&e, "\x48\x09\xc8");
+				break;
+			case DIF_OP_XOR:
+				DTRACE_DIFEMIT(&e, "\x48\x31\xc8");
+				break;
+			case DIF_OP_AND:
+				DTRACE_DIFEMIT(&e, "\x48\x21\xc8");
+				break;
+			case DIF_OP_SLL:
+				DTRACE_DIFEMIT(&e, "\x48\xd3\xe0");
+				break;
+			case DIF_OP_SRL:
+				DTRACE_DIFEMIT(&e, "\x48\xd3\xe8");
+				break;
+			case DIF_OP_SUB:
+				DTRACE_DIFEMIT(&e, "\x48\x29\xc8");
+				break;
+			case DIF_OP_ADD:
+				DTRACE_DIFEMIT(&e, "\x48\x01\xc8");
+				break;
+			case DIF_OP_MUL:
+				DTRACE_DIFEMIT(&e, "\x48\x0f\xaf\xc1");
+				break;
+			}
+
+			dtrace_difemit_st(&e, DTRACE_X86_RAX, rd);
+			break;
+
+		case DIF_OP_SDIV:
+		case DIF_OP_UDIV:
+		case DIF_OP_SREM:
+		case DIF_OP_UREM:
+			dtrace_difemit_div(&e, instr, pc, len);
+			break;
+
+		case DIF_OP_NOT:
+		case DIF_OP_MOV:
+			dtrace_difemit_ld(&e, DTRACE_X86_RAX, r1);
+			if (op == DIF_OP_NOT)
+				DTRACE_DIFEMIT(&e, "\x48\xf7\xd0");
+			dtrace_difemit_st(&e, DTRACE_X86_RAX, rd);
+			break;
+
+		case DIF_OP_CMP:
+			/*
+			 * The condition codes are assembled without touching
+			 * the flags, which a following branch may test:
+			 * cmp rax, rcx; setz cl; setb dl; sets al; movzx each
+			 * of them; lea ecx, [rdx+rcx*4]; lea eax, [rcx+rax*8].
+			 */
+			dtrace_difemit_ld(&e, DTRACE_X86_RAX, r1);
+			dtrace_difemit_ld(&e, DTRACE_X86_RCX, r2);
+			DTRACE_DIFEMIT(&e, "\x48\x39\xc8");
+			DTRACE_DIFEMIT(&e, "\x0f\x94\xc1");
+			DTRACE_DIFEMIT(&e, "\x0f\x92\xc2");
+			DTRACE_DIFEMIT(&e, "\x0f\x98\xc0");
+			DTRACE_DIFEMIT(&e, "\x0f\xb6\xc9");
+			DTRACE_DIFEMIT(&e, "\x0f\xb6\xd2");
+			DTRACE_DIFEMIT(&e, "\x0f\xb6\xc0");
+			DTRACE_DIFEMIT(&e, "\x8d\x0c\x8a");
+			DTRACE_DIFEMIT(&e, "\x8d\x04\xc1");
+			dtrace_difemit_st(&e, DTRACE_X86_RAX,
+			    offsetof(dtrace_difnative_t, dtdn_cc));
 			break;
-		}
 
-		sval = 0;
-		srd = 0;
+		case DIF_OP_TST:
+			/* test rax, rax; setz al; movzx eax, al; shl eax, 2 */
+			dtrace_difemit_ld(&e, DTRACE_X86_RAX, r1);
+			DTRACE_DIFEMIT(&e, "\x48\x85\xc0");
+			DTRACE_DIFEMIT(&e, "\x0f\x94\xc0");
+			DTRACE_DIFEMIT(&e, "\x0f\xb6\xc0");
+			DTRACE_DIFEMIT(&e, "\xc1\xe0\x02");
+			dtrace_difemit_st(&e, DTRACE_X86_RAX,
+			    offsetof(dtrace_difnative_t, dtdn_cc));
+			break;
 
-		if (nkeys == 0)
-			continue;
+		case DIF_OP_BA:
+		case DIF_OP_BE:
+		case DIF_OP_BNE:
+		case DIF_OP_BG:
+		case DIF_OP_BGU:
+		case DIF_OP_BGE:
+		case DIF_OP_BGEU:
+		case DIF_OP_BL:
+		case DIF_OP_BLU:
+		case DIF_OP_BLE:
+		case DIF_OP_BLEU:
+			dtrace_difemit_bcc(&e, op, DIF_INSTR_LABEL(instr),
+			    pc > 0 && !targets[pc] &&
+			    DIF_INSTR_OP(text[pc - 1]) == DIF_OP_CMP);
+			break;
 
-		/*
-		 * We have a dynamic variable allocation; calculate its size.
-		 */
-		for (ksize = 0, i = 0; i < nkeys; i++)
-			ksize += P2ROUNDUP(key[i].dttk_size, sizeof (uint64_t));
+		case DIF_OP_RET:
+			dtrace_difemit_ld(&e, DTRACE_X86_RAX, rd);
+			/* add rsp, 32; pop rbx; ret */
+			DTRACE_DIFEMIT(&e, "\x48\x83\xc4\x20");
+			DTRACE_DIFEMIT(&e, "\x5b");
+			DTRACE_DIFEMIT(&e, "\xc3");
+			break;
 
-		size = sizeof (dtrace_dynvar_t);
-		size += sizeof (dtrace_key_t) * (nkeys - 1);
-		size += ksize;
+		case DIF_OP_NOP:
+			break;
 
-		/*
-		 * Now we need to determine the size of the stored data.
-		 */
-		id = DIF_INSTR_VAR(instr);
+		case DIF_OP_SETX:
+		case DIF_OP_SETS:
+			DTRACE_DIFEMIT(&e, "\x48\xb8");	/* mov rax, imm */
+			dtrace_difemit_imm(&e, op == DIF_OP_SETX ?
+			    dp->dtdo_inttab[DIF_INSTR_INTEGER(instr)] :
+			    (uint64_t)(uintptr_t)(dp->dtdo_strtab +
+			    DIF_INSTR_STRING(instr)), 8);
+			dtrace_difemit_st(&e, DTRACE_X86_RAX, rd);
+			break;
 
-		for (i = 0; i < dp->dtdo_varlen; i++) {
-			dtrace_difv_t *v = &dp->dtdo_vartab[i];
+		case DIF_OP_LDGS:
+			/*
+			 * The arguments that dtrace_dif_variable() finds in
+			 * the machine state are loaded from there, as the
+			 * decoded ldgs does.
+			 */
+			id = DIF_INSTR_VAR(instr);
 
-			if (v->dtdv_id == id && v->dtdv_scope == scope) {
-				size += v->dtdv_type.dtdt_size;
+			if (id >= DIF_VAR_ARG0 && id <= DIF_VAR_ARG9 &&
+			    id - DIF_VAR_ARG0 < sizeof (((dtrace_mstate_t *)
+			    NULL)->dtms_arg) / sizeof (uint64_t)) {
+				dtrace_difemit_ld(&e, DTRACE_X86_RAX,
+				    offsetof(dtrace_difnative_t, dtdn_mstate));
+				DTRACE_DIFEMIT(&e, "\x48\x8b\x80");
+				dtrace_difemit_imm(&e,
+				    offsetof(dtrace_mstate_t, dtms_arg) +
+				    (id - DIF_VAR_ARG0) * sizeof (uint64_t), 4);
+				dtrace_difemit_st(&e, DTRACE_X86_RAX, rd);
 				break;
 			}
+			/*FALLTHROUGH*/
+
+		default:
+			dtrace_difemit_op(&e, instr, pc, len);
+			break;
 		}
+	}
 
-		if (i == dp->dtdo_varlen)
-			return;
+	/*
+	 * The exit, through which faults leave and at which a DIF object
+	 * that runs off its end without a ret returns 0, as the emulator's
+	 * would.
+	 */
+	labels[len] = (uint_t)e.dde_off;
+	DTRACE_DIFEMIT(&e, "\x31\xc0");			/* xor eax, eax */
+	DTRACE_DIFEMIT(&e, "\x48\x83\xc4\x20");		/* add rsp, 32 */
+	DTRACE_DIFEMIT(&e, "\x5b");			/* pop rbx */
+	DTRACE_DIFEMIT(&e, "\xc3");			/* ret */
 
-		/*
-		 * We have the size.  If this is larger than the chunk size
-		 * for our dynamic variable state, reset the chunk size.
-		 */
-		size = P2ROUNDUP(size, sizeof (uint64_t));
+	if (e.dde_off <= e.dde_size) {
+		for (i = 0; i < e.dde_nfix; i++) {
+			uint_t off = e.dde_fixoff[i];
+			int32_t disp = (int32_t)(labels[e.dde_fixpc[i]] -
+			    (off + sizeof (int32_t)));
 
-		/*
-		 * Before setting the chunk size, check that we're not going
-		 * to set it to a negative value...
-		 */
-		if (size > LONG_MAX)
-			return;
+			ASSERT(disp >= 0);
+			bcopy(&disp, &e.dde_buf[off], sizeof (disp));
+		}
 
-		/*
-		 * ...and make certain that we didn't badly overflow.
-		 */
-		if (size < ksize || size < sizeof (dtrace_dynvar_t))
-			return;
+		if ((code = kmem_text_alloc(e.dde_off, &cookie)) != NULL) {
+			bcopy(e.dde_buf, code, e.dde_off);
 
-		if (size > vstate->dtvs_dynvars.dtds_chunksize)
-			vstate->dtvs_dynvars.dtds_chunksize = size;
+			if (kmem_text_seal(cookie) == 0) {
+				dp->dtdo_native = code;
+				dp->dtdo_ntext = cookie;
+			} else {
+				kmem_text_free(cookie);
+			}
+		}
 	}
+
+	kmem_free(e.dde_fixpc, 2 * len * sizeof (uint_t));
+	kmem_free(e.dde_fixoff, 2 * len * sizeof (uint_t));
+	kmem_free(e.dde_buf, (len + 1) * DTRACE_DIFNATIVE_INSTRSIZE);
+	kmem_free(targets, len + 1);
+	kmem_free(labels, (len + 1) * sizeof (uint_t));
+#endif	/* _M_AMD64 */
 }
 
 static void
@@ -11190,6 +12859,8 @@ dtrace_difo_init(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 	}
 
 	dtrace_difo_chunksize(dp, vstate);
+	dtrace_difo_decode(dp);
+	dtrace_difo_native(dp);
 	dtrace_difo_hold(dp);
 }
 
@@ -11300,6 +12971,11 @@ dtrace_difo_destroy(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 		kmem_free(dp->dtdo_strtab, dp->dtdo_strlen);
 	if (dp->dtdo_vartab != NULL)
 		kmem_free(dp->dtdo_vartab, dp->dtdo_varlen * sizeof (dtrace_difv_t));
+	if (dp->dtdo_dops != NULL)
+		kmem_free(dp->dtdo_dops,
+		    dp->dtdo_len * sizeof (dtrace_difdop_t));
+	if (dp->dtdo_ntext != NULL)
+		kmem_text_free(dp->dtdo_ntext);
 
 	kmem_free(dp, sizeof (dtrace_difo_t));
 }
@@ -11525,11 +13201,14 @@ dtrace_predicate_create(dtrace_difo_t *dp)
 	if (!dtrace_difo_cacheable(dp))
 		return (pred);
 
-	if (dtrace_predcache_id == DTRACE_CACHEIDNONE) {
+	if (dtrace_predcache_id == DTRACE_CACHEIDNONE ||
+	    dtrace_predcache_id > DTRACE_PREDCACHE_MAXID) {
 		/*
 		 * This is only theoretically possible -- we have had 2^32
-		 * cacheable predicates on this machine.  We cannot allow any
-		 * more predicates to become cacheable:  as unlikely as it is,
+		 * cacheable predicates on this machine (or, on 32-bit
+		 * platforms, as many as the generation of a thread's predicate
+		 * cache word can distinguish).  We cannot allow any more
+		 * predicates to become cacheable:  as unlikely as it is,
 		 * there may be a thread caching a (now stale) predicate cache
 		 * ID. (N.B.: the temptation is being successfully resisted to
 		 * have this cmn_err() "Holy shit -- we executed this code!")
@@ -11649,6 +13328,11 @@ dtrace_ecb_add(dtrace_state_t *state, dtrace_probe_t *probe)
 	ecb->dte_size = ecb->dte_needed = sizeof (dtrace_rechdr_t);
 	ecb->dte_alignment = sizeof (dtrace_epid_t);
 
+	if (state->dts_options[DTRACEOPT_ECBPROF] != DTRACEOPT_UNSET) {
+		ecb->dte_stat = kmem_zalloc(NCPU * sizeof (dtrace_ecbstat_t),
+		    KM_SLEEP);
+	}
+
 	epid = state->dts_epid++;
 
 	if (epid - 1 >= state->dts_necbs) {
@@ -12471,6 +14155,9 @@ dtrace_ecb_destroy(dtrace_ecb_t *ecb)
 	ASSERT(state->dts_ecbs[epid - 1] == ecb);
 	state->dts_ecbs[epid - 1] = NULL;
 
+	if (ecb->dte_stat != NULL)
+		kmem_free(ecb->dte_stat, NCPU * sizeof (dtrace_ecbstat_t));
+
 	kmem_free(ecb, sizeof (dtrace_ecb_t));
 }
 
@@ -12647,6 +14334,22 @@ dtrace_buffer_switch(dtrace_buffer_t *buf)
 	ASSERT(!(buf->dtb_flags & DTRACEBUF_RING));
 
 	cookie = dtrace_interrupt_disable();
+
+	if (buf->dtb_flags & DTRACEBUF_SPILL) {
+		/*
+		 * If this aggregation buffer spilled after the consumer
+		 * checked for a spill, the inactive buffer already holds the
+		 * spilled generation:  leave it be, and let the consumer copy
+		 * it out in lieu of a switch.
+		 */
+		if (buf->dtb_xamot_pending) {
+			dtrace_interrupt_enable(cookie);
+			return;
+		}
+
+		buf->dtb_xamot_pending = 1;
+	}
+
 	now = dtrace_gethrtime();
 	buf->dtb_tomax = xamot;
 	buf->dtb_xamot = tomax;
@@ -12663,6 +14366,85 @@ dtrace_buffer_switch(dtrace_buffer_t *buf)
 	dtrace_interrupt_enable(cookie);
 }
 
+/*
+ * Note:  called from probe context.  This function is called when an
+ * aggregation buffer with DTRACEBUF_SPILL set has run out of space; if the
+ * consumer has copied out the inactive buffer, the full active buffer is
+ * switched with it, to be collected as a spilled generation.  Returns
+ * non-zero if the buffers were switched.  As in dtrace_buffer_switch(), the
+ * atomicity of the switch with respect to the consumer's own switch on this
+ * CPU is assured by interrupts being disabled in probe context.
+ */
+static int
+dtrace_buffer_spill(dtrace_buffer_t *buf)
+{
+	caddr_t tomax = buf->dtb_tomax;
+
+	if (!(buf->dtb_flags & DTRACEBUF_SPILL) || buf->dtb_xamot_pending)
+		return (0);
+
+	buf->dtb_tomax = buf->dtb_xamot;
+	buf->dtb_xamot = tomax;
+	buf->dtb_xamot_drops = buf->dtb_drops;
+	buf->dtb_xamot_offset = buf->dtb_offset;
+	buf->dtb_xamot_errors = buf->dtb_errors;
+	buf->dtb_xamot_flags = buf->dtb_flags;
+	buf->dtb_offset = 0;
+	buf->dtb_drops = 0;
+	buf->dtb_errors = 0;
+	buf->dtb_flags &= ~(DTRACEBUF_ERROR | DTRACEBUF_DROPPED);
+
+	/*
+	 * The consumer may be looking for a spill from another CPU; it must
+	 * not see dtb_xamot_pending set before it can see the switch.
+	 */
+	dtrace_membar_producer();
+	buf->dtb_xamot_pending = 1;
+
+	return (1);
+}
+
+/*
+ * Note:  called from cross call context.  This function resizes a principal
+ * buffer on a CPU by switching its active buffer with a new, empty buffer of
+ * the new size; the old active buffer is left in the inactive buffer, to be
+ * copied out by the next snapshot.  As with dtrace_buffer_switch(), the
+ * atomicity of the operation is assured by disabling interrupts.  The new
+ * buffer pointer is cleared to indicate to the caller that the cross call has
+ * taken place.
+ */
+static void
+dtrace_buffer_resize(dtrace_bufresize_t *resize)
+{
+	dtrace_buffer_t *buf = resize->dtbr_buf;
+	dtrace_icookie_t cookie;
+	hrtime_t now;
+
+	ASSERT(!(buf->dtb_flags & (DTRACEBUF_NOSWITCH | DTRACEBUF_RING)));
+	ASSERT(!buf->dtb_xamot_pending);
+
+	cookie = dtrace_interrupt_disable();
+	now = dtrace_gethrtime();
+	buf->dtb_xamot = buf->dtb_tomax;
+	buf->dtb_xamot_size = buf->dtb_size;
+	buf->dtb_tomax = resize->dtbr_tomax;
+	buf->dtb_size = resize->dtbr_size;
+	buf->dtb_xamot_drops = buf->dtb_drops;
+	buf->dtb_xamot_offset = buf->dtb_offset;
+	buf->dtb_xamot_errors = buf->dtb_errors;
+	buf->dtb_xamot_flags = buf->dtb_flags;
+	buf->dtb_xamot_pending = 1;
+	buf->dtb_offset = 0;
+	buf->dtb_drops = 0;
+	buf->dtb_errors = 0;
+	buf->dtb_flags &= ~(DTRACEBUF_ERROR | DTRACEBUF_DROPPED);
+	buf->dtb_interval = now - buf->dtb_switched;
+	buf->dtb_switched = now;
+	dtrace_interrupt_enable(cookie);
+
+	resize->dtbr_tomax = NULL;
+}
+
 /*
  * Note:  called from cross call context.  This function activates a buffer
  * on a CPU.  As with dtrace_buffer_switch(), the atomicity of the operation
@@ -13222,6 +15004,16 @@ dtrace_buffer_free(dtrace_buffer_t *bufs)
 			continue;
 		}
 
+		if (buf->dtb_xamot_next != NULL) {
+			/*
+			 * This buffer was resized, and the old active buffer
+			 * was never copied out.
+			 */
+			kmem_free(buf->dtb_xamot, buf->dtb_xamot_size);
+			buf->dtb_xamot = buf->dtb_xamot_next;
+			buf->dtb_xamot_next = NULL;
+		}
+
 		if (buf->dtb_xamot != NULL) {
 			ASSERT(!(buf->dtb_flags & DTRACEBUF_NOSWITCH));
 			kmem_free(buf->dtb_xamot, buf->dtb_size);
@@ -13231,6 +15023,7 @@ dtrace_buffer_free(dtrace_buffer_t *bufs)
 		buf->dtb_size = 0;
 		buf->dtb_tomax = NULL;
 		buf->dtb_xamot = NULL;
+		buf->dtb_xamot_pending = 0;
 	}
 }
 
@@ -15020,8 +16813,16 @@ dtrace_dstate_init(dtrace_dstate_t *dstate, size_t size)
 		hashsize--;
 
 	dstate->dtds_hashsize = hashsize;
+	dstate->dtds_basehashsize = hashsize;
 	dstate->dtds_hash = dstate->dtds_base;
 
+	/*
+	 * If the space is exhausted, dtrace_dynvar_clean() will grow it by
+	 * regions as large as the chunks that follow the hash table.
+	 */
+	dstate->dtds_growsize = size - hashsize * sizeof (dtrace_dynhash_t);
+	dstate->dtds_growsize -= dstate->dtds_growsize % dstate->dtds_chunksize;
+
 	/*
 	 * Set all of our hash buckets to point to the single sink, and (if
 	 * it hasn't already been set), set the sink's hash value to be the
@@ -15096,11 +16897,21 @@ dtrace_dstate_init(dtrace_dstate_t *dstate, size_t size)
 static void
 dtrace_dstate_fini(dtrace_dstate_t *dstate)
 {
+	uint_t i;
+
 	ASSERT(MUTEX_HELD(&cpu_lock));
 
 	if (dstate->dtds_base == NULL)
 		return;
 
+	for (i = 0; i < dstate->dtds_ngrow; i++)
+		kmem_free(dstate->dtds_grow[i], dstate->dtds_growsize);
+
+	if (dstate->dtds_hash != dstate->dtds_base) {
+		kmem_free(dstate->dtds_hash,
+		    dstate->dtds_hashsize * sizeof (dtrace_dynhash_t));
+	}
+
 	kmem_free(dstate->dtds_base, dstate->dtds_size);
 	kmem_cache_free(dtrace_state_cache, dstate->dtds_percpu);
 }
@@ -15173,15 +16984,35 @@ static void
 dtrace_state_clean(void *arg)
 {
 	dtrace_state_t *state = arg;
+	dtrace_dstate_t *dstate = &state->dts_vstate.dtvs_dynvars;
 	dtrace_optval_t *opt = state->dts_options;
 
 	if (state->dts_activity == DTRACE_ACTIVITY_INACTIVE)
 		return;
 
-	dtrace_dynvar_clean(&state->dts_vstate.dtvs_dynvars);
+	/*
+	 * If dynamic variables have been dropped because cleaning has fallen
+	 * behind deallocation, clean twice as often (down to the minimum
+	 * cleaning interval); once it has caught up, relax the interval back
+	 * to that of the cleanrate option.
+	 */
+	switch (dstate->dtds_state) {
+	case DTRACE_DSTATE_DIRTY:
+	case DTRACE_DSTATE_RINSING:
+		state->dts_cleanrate = MAX(state->dts_cleanrate / 2,
+		    dtrace_cleanrate_min);
+		break;
+
+	default:
+		state->dts_cleanrate = MIN(state->dts_cleanrate * 2,
+		    opt[DTRACEOPT_CLEANRATE]);
+		break;
+	}
+
+	dtrace_dynvar_clean(dstate);
 	dtrace_speculation_clean(state);
 
-	callout_reset(&state->dts_cleaner, hz * opt[DTRACEOPT_CLEANRATE] / NANOSEC,
+	callout_reset(&state->dts_cleaner, hz * state->dts_cleanrate / NANOSEC,
 	    dtrace_state_clean, state);
 }
 
@@ -15293,6 +17124,8 @@ dtrace_state_create(struct cdev *dev, void *cred __unused)
 	 */
 	state->dts_buffer = kmem_zalloc(bufsize, KM_SLEEP);
 	state->dts_aggbuffer = kmem_zalloc(bufsize, KM_SLEEP);
+	state->dts_specfree = kmem_zalloc(NCPU * sizeof (dtrace_specfree_t),
+	    KM_SLEEP);
 
 #ifndef _WIN32
 	/*
@@ -15542,6 +17375,10 @@ dtrace_state_buffer(dtrace_state_t *state, dtrace_buffer_t *buf, int which)
 			flags |= DTRACEBUF_INACTIVE;
 	}
 
+	if (which == DTRACEOPT_AGGSIZE &&
+	    opt[DTRACEOPT_AGGSPILL] != DTRACEOPT_UNSET)
+		flags |= DTRACEBUF_SPILL;
+
 	for (size = opt[which]; size >= sizeof (uint64_t); size /= divisor) {
 		/*
 		 * The size must be 8-byte aligned.  If the size is not 8-byte
@@ -15560,44 +17397,203 @@ dtrace_state_buffer(dtrace_state_t *state, dtrace_buffer_t *buf, int which)
 			return (E2BIG);
 		}
 
-		rval = dtrace_buffer_alloc(buf, size, flags, cpu, &factor);
+		rval = dtrace_buffer_alloc(buf, size, flags, cpu, &factor);
+
+		if (rval != ENOMEM) {
+			opt[which] = size;
+			return (rval);
+		}
+
+		if (opt[DTRACEOPT_BUFRESIZE] == DTRACEOPT_BUFRESIZE_MANUAL)
+			return (rval);
+
+		for (divisor = 2; divisor < factor; divisor <<= 1)
+			continue;
+	}
+
+	return (ENOMEM);
+}
+
+static int
+dtrace_state_buffers(dtrace_state_t *state)
+{
+	dtrace_speculation_t *spec = state->dts_speculations;
+	int rval, i;
+
+	if ((rval = dtrace_state_buffer(state, state->dts_buffer,
+	    DTRACEOPT_BUFSIZE)) != 0)
+		return (rval);
+
+	if ((rval = dtrace_state_buffer(state, state->dts_aggbuffer,
+	    DTRACEOPT_AGGSIZE)) != 0)
+		return (rval);
+
+	for (i = 0; i < state->dts_nspeculations; i++) {
+		if ((rval = dtrace_state_buffer(state,
+		    spec[i].dtsp_buffer, DTRACEOPT_SPECSIZE)) != 0)
+			return (rval);
+	}
+
+	return (0);
+}
+
+/*
+ * Resize the principal buffers of an active state with a "switch" buffer
+ * policy to the specified size.  All of the new buffers are allocated before
+ * any buffer is resized, so that we either fail with no effect or resize
+ * every CPU's buffer -- save for any CPU that the cross call doesn't reach,
+ * which keeps its buffer.  The size that is passed back (and that becomes the
+ * value of the bufsize option) is the largest buffer size now in effect.
+ */
+static int
+dtrace_state_resize(dtrace_state_t *state, uint64_t *sizep)
+{
+	dtrace_optval_t *opt = state->dts_options;
+	dtrace_buffer_t *bufs = state->dts_buffer, *buf;
+	dtrace_bufresize_t resize;
+	size_t size = *sizep, max = 0;
+	caddr_t *tomax, xamot;
+	int i;
+
+	ASSERT(MUTEX_HELD(&dtrace_lock));
+
+	if (state->dts_activity != DTRACE_ACTIVITY_ACTIVE ||
+	    opt[DTRACEOPT_BUFPOLICY] != DTRACEOPT_BUFPOLICY_SWITCH)
+		return (EINVAL);
+
+	/*
+	 * As in dtrace_state_buffer(), the size must be 8-byte aligned, and
+	 * must accommodate both the prereserved space and the largest ECB.
+	 */
+	size -= size & (sizeof (uint64_t) - 1);
+
+	if (size < sizeof (uint64_t) || size < state->dts_reserve ||
+	    size < state->dts_needed)
+		return (E2BIG);
+
+	for (i = 0; i < NCPU; i++) {
+		/*
+		 * If the last resize has yet to be fully consumed on any CPU,
+		 * we can't resize again.
+		 */
+		if (bufs[i].dtb_xamot_pending)
+			return (EBUSY);
+	}
+
+	tomax = kmem_zalloc(NCPU * sizeof (caddr_t), KM_SLEEP);
+
+	for (i = 0; i < NCPU; i++) {
+		buf = &bufs[i];
+
+		if (buf->dtb_tomax == NULL)
+			continue;
+
+		ASSERT(buf->dtb_xamot_next == NULL);
+
+		if ((tomax[i] = kmem_zalloc(size,
+		    KM_NOSLEEP | KM_NORMALPRI)) == NULL)
+			goto err;
+
+		if ((buf->dtb_xamot_next = kmem_zalloc(size,
+		    KM_NOSLEEP | KM_NORMALPRI)) == NULL)
+			goto err;
+	}
+
+	for (i = 0; i < NCPU; i++) {
+		buf = &bufs[i];
+
+		if (tomax[i] == NULL)
+			continue;
+
+		xamot = buf->dtb_xamot;
+		resize.dtbr_buf = buf;
+		resize.dtbr_tomax = tomax[i];
+		resize.dtbr_size = size;
+
+		dtrace_xcall(i, (dtrace_xcall_t)dtrace_buffer_resize, &resize);
+
+		if (resize.dtbr_tomax != NULL) {
+			/*
+			 * The cross call did not take place -- presumably
+			 * because the CPU is not in the ready set.  This CPU
+			 * keeps its buffer.
+			 */
+			kmem_free(tomax[i], size);
+			kmem_free(buf->dtb_xamot_next, size);
+			buf->dtb_xamot_next = NULL;
+		} else {
+			/*
+			 * The inactive buffer has already been copied out;
+			 * it can be freed now.
+			 */
+			kmem_free(xamot, buf->dtb_xamot_size);
+		}
+
+		if (buf->dtb_size > max)
+			max = buf->dtb_size;
+	}
 
-		if (rval != ENOMEM) {
-			opt[which] = size;
-			return (rval);
-		}
+	kmem_free(tomax, NCPU * sizeof (caddr_t));
 
-		if (opt[DTRACEOPT_BUFRESIZE] == DTRACEOPT_BUFRESIZE_MANUAL)
-			return (rval);
+	if (max == 0)
+		return (ENOENT);
 
-		for (divisor = 2; divisor < factor; divisor <<= 1)
-			continue;
+	opt[DTRACEOPT_BUFSIZE] = max;
+	*sizep = max;
+
+	return (0);
+
+err:
+	for (i = 0; i < NCPU; i++) {
+		buf = &bufs[i];
+
+		if (tomax[i] != NULL)
+			kmem_free(tomax[i], size);
+
+		if (buf->dtb_xamot_next != NULL) {
+			kmem_free(buf->dtb_xamot_next, size);
+			buf->dtb_xamot_next = NULL;
+		}
 	}
 
+	kmem_free(tomax, NCPU * sizeof (caddr_t));
+
 	return (ENOMEM);
 }
 
-static int
-dtrace_state_buffers(dtrace_state_t *state)
+/*
+ * Sum the per-CPU profile of each of the specified number of EPIDs into the
+ * specified array.  EPIDs whose ECB has been destroyed or which were not
+ * profiled are returned with zero counts.
+ */
+static void
+dtrace_state_ecbprof(dtrace_state_t *state, dtrace_ecbprof_t *prof, int necbs)
 {
-	dtrace_speculation_t *spec = state->dts_speculations;
-	int rval, i;
+	int i, j;
 
-	if ((rval = dtrace_state_buffer(state, state->dts_buffer,
-	    DTRACEOPT_BUFSIZE)) != 0)
-		return (rval);
+	ASSERT(MUTEX_HELD(&dtrace_lock));
+	ASSERT(necbs <= state->dts_necbs);
 
-	if ((rval = dtrace_state_buffer(state, state->dts_aggbuffer,
-	    DTRACEOPT_AGGSIZE)) != 0)
-		return (rval);
+	for (i = 0; i < necbs; i++) {
+		dtrace_ecb_t *ecb = state->dts_ecbs[i];
+		dtrace_ecbprof_t *ep = &prof[i];
 
-	for (i = 0; i < state->dts_nspeculations; i++) {
-		if ((rval = dtrace_state_buffer(state,
-		    spec[i].dtsp_buffer, DTRACEOPT_SPECSIZE)) != 0)
-			return (rval);
-	}
+		ep->dtep_epid = i + 1;
 
-	return (0);
+		if (ecb == NULL || ecb->dte_stat == NULL)
+			continue;
+
+		for (j = 0; j < NCPU; j++) {
+			dtrace_ecbstat_t *es = &ecb->dte_stat[j];
+
+			ep->dtep_nfired += es->dtes_nfired;
+			ep->dtep_nmatched += es->dtes_nmatched;
+			ep->dtep_difops += es->dtes_difops;
+			ep->dtep_reserve += es->dtes_reserve;
+			ep->dtep_pred += es->dtes_pred;
+			ep->dtep_action += es->dtes_action;
+		}
+	}
 }
 
 static void
@@ -15785,6 +17781,39 @@ dtrace_state_go(dtrace_state_t *state, processorid_t *cpu)
 	if ((rval = dtrace_state_buffers(state)) != 0)
 		goto err;
 
+	/*
+	 * Spread the speculations across the per-CPU free lists; they will
+	 * migrate to the CPUs that actually use them as they are stolen and
+	 * freed.  Note that we push in reverse order so that each CPU will
+	 * hand out its speculations in ascending order.
+	 */
+	for (i = state->dts_nspeculations - 1; i >= 0; i--) {
+		spec = &state->dts_speculations[i];
+		spec->dtsp_next = state->dts_specfree[i % NCPU].dtsf_free;
+		state->dts_specfree[i % NCPU].dtsf_free = spec;
+	}
+
+	/*
+	 * If we are to profile our ECBs, allocate the per-CPU profile of
+	 * every ECB that was created before the option was set.  (ECBs
+	 * created from here on get theirs in dtrace_ecb_add().)  Our ECBs
+	 * can't be processed beyond the activity check in dtrace_probe()
+	 * until we're active, so they may be set without further ado.
+	 */
+	if (opt[DTRACEOPT_ECBPROF] != DTRACEOPT_UNSET) {
+		for (i = 0; i < state->dts_necbs; i++) {
+			dtrace_ecb_t *ecb = state->dts_ecbs[i];
+
+			if (ecb == NULL || ecb->dte_stat != NULL)
+				continue;
+
+			ecb->dte_stat = kmem_zalloc(NCPU *
+			    sizeof (dtrace_ecbstat_t), KM_SLEEP);
+		}
+
+		dtrace_membar_producer();
+	}
+
 	if ((sz = opt[DTRACEOPT_DYNVARSIZE]) == DTRACEOPT_UNSET)
 		sz = dtrace_dstate_defsize;
 
@@ -15835,6 +17864,7 @@ dtrace_state_go(dtrace_state_t *state, processorid_t *cpu)
 
 	state->dts_deadman = cyclic_add(&hdlr, &when);
 #else
+	state->dts_cleanrate = opt[DTRACEOPT_CLEANRATE];
 	callout_reset(&state->dts_cleaner, hz * opt[DTRACEOPT_CLEANRATE] / NANOSEC,
 	    dtrace_state_clean, state);
 	callout_reset(&state->dts_deadman, hz * dtrace_deadman_interval / NANOSEC,
@@ -15934,6 +17964,9 @@ err:
 	state->dts_nspeculations = 0;
 	state->dts_speculations = NULL;
 
+	for (i = 0; i < NCPU; i++)
+		state->dts_specfree[i].dtsf_free = NULL;
+
 out:
 	mutex_exit(&dtrace_lock);
 	mutex_exit(&cpu_lock);
@@ -16185,6 +18218,7 @@ dtrace_state_destroy(dtrace_state_t *state)
 
 	kmem_free(state->dts_buffer, bufsize);
 	kmem_free(state->dts_aggbuffer, bufsize);
+	kmem_free(state->dts_specfree, NCPU * sizeof (dtrace_specfree_t));
 
 	for (i = 0; i < nspec; i++)
 		kmem_free(spec[i].dtsp_buffer, bufsize);
@@ -18474,6 +20508,64 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 		return (err);
 	}
 
+	case DTRACEIOC_PROBEBATCH: {
+		dtrace_probebatch_t pb;
+		dtrace_probedesc_t *descs;
+		uint32_t priv = 0;
+		uid_t uid = 0;
+		zoneid_t zoneid = 0;
+		size_t size;
+
+		if (copyin((void *)arg, &pb, sizeof (pb)) != 0)
+			return (EFAULT);
+
+		pb.dtpb_match.dtpd_provider[DTRACE_PROVNAMELEN - 1] = '\0';
+		pb.dtpb_match.dtpd_mod[DTRACE_MODNAMELEN - 1] = '\0';
+		pb.dtpb_match.dtpd_func[DTRACE_FUNCNAMELEN - 1] = '\0';
+		pb.dtpb_match.dtpd_name[DTRACE_NAMELEN - 1] = '\0';
+
+		if (pb.dtpb_count == 0)
+			return (EINVAL);
+
+		if (pb.dtpb_count > DTRACE_PROBEBATCH_MAX)
+			pb.dtpb_count = DTRACE_PROBEBATCH_MAX;
+
+		/*
+		 * As with DTRACEIOC_PROBES, we give all providers the
+		 * opportunity to provide matching probes on the first call.
+		 */
+		if (pb.dtpb_match.dtpd_id == DTRACE_IDNONE) {
+			mutex_enter(&dtrace_provider_lock);
+			dtrace_probe_provide(&pb.dtpb_match, NULL);
+			mutex_exit(&dtrace_provider_lock);
+			pb.dtpb_match.dtpd_id++;
+		}
+
+		dtrace_cred2priv(CRED(), &priv, &uid, &zoneid);
+
+		size = pb.dtpb_count * sizeof (dtrace_probedesc_t);
+		descs = kmem_alloc(size, KM_SLEEP);
+
+		mutex_enter(&dtrace_lock);
+		rval = dtrace_probe_batch(&pb, descs, priv, uid, zoneid);
+		mutex_exit(&dtrace_lock);
+
+		if (rval == 0 && pb.dtpb_count != 0 &&
+		    copyout(descs, pb.dtpb_probes,
+		    pb.dtpb_count * sizeof (dtrace_probedesc_t)) != 0)
+			rval = EFAULT;
+
+		kmem_free(descs, size);
+
+		if (rval != 0)
+			return (rval);
+
+		if (copyout(&pb, (void *)arg, sizeof (pb)) != 0)
+			return (EFAULT);
+
+		return (0);
+	}
+
 	case DTRACEIOC_PROBEMATCH:
 	case DTRACEIOC_PROBES: {
 		dtrace_probe_t *probe = NULL;
@@ -18639,6 +20731,70 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 		return (0);
 	}
 
+	case DTRACEIOC_BUFRESIZE: {
+		uint64_t size;
+
+		if (copyin((void *)arg, &size, sizeof (size)) != 0)
+			return (EFAULT);
+
+		mutex_enter(&dtrace_lock);
+		rval = dtrace_state_resize(state, &size);
+		mutex_exit(&dtrace_lock);
+
+		if (rval != 0)
+			return (rval);
+
+		if (copyout(&size, (void *)arg, sizeof (size)) != 0)
+			return (EFAULT);
+
+		return (0);
+	}
+
+	case DTRACEIOC_ECBPROF: {
+		dtrace_ecbprofdesc_t desc;
+		dtrace_ecbprof_t *prof;
+		size_t size;
+		int necbs;
+
+		if (copyin((void *)arg, &desc, sizeof (desc)) != 0)
+			return (EFAULT);
+
+		mutex_enter(&dtrace_lock);
+		necbs = state->dts_epid - 1;
+
+		/*
+		 * If the consumer's array is too small, we just tell it how
+		 * many EPIDs there are so that it can try again.
+		 */
+		if (necbs == 0 || desc.dtepd_necbs < (uint64_t)necbs) {
+			mutex_exit(&dtrace_lock);
+			desc.dtepd_necbs = necbs;
+
+			if (copyout(&desc, (void *)arg, sizeof (desc)) != 0)
+				return (EFAULT);
+
+			return (0);
+		}
+
+		size = necbs * sizeof (dtrace_ecbprof_t);
+		prof = kmem_zalloc(size, KM_SLEEP);
+		dtrace_state_ecbprof(state, prof, necbs);
+		mutex_exit(&dtrace_lock);
+
+		rval = copyout(prof, desc.dtepd_prof, size);
+		kmem_free(prof, size);
+
+		if (rval != 0)
+			return (EFAULT);
+
+		desc.dtepd_necbs = necbs;
+
+		if (copyout(&desc, (void *)arg, sizeof (desc)) != 0)
+			return (EFAULT);
+
+		return (0);
+	}
+
 	case DTRACEIOC_DOFGET: {
 		dof_hdr_t hdr, *dof;
 		uint64_t len;
@@ -18669,6 +20825,8 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 		if (desc.dtbd_cpu < 0 || desc.dtbd_cpu >= NCPU)
 			return (EINVAL);
 
+		desc.dtbd_flags = 0;
+
 		mutex_enter(&dtrace_lock);
 
 		if (cmd == DTRACEIOC_BUFSNAP) {
@@ -18741,6 +20899,24 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 			return (ENOENT);
 		}
 
+		/*
+		 * If this aggregation buffer has spilled, the inactive buffer
+		 * holds the spilled generation; copy that out without a
+		 * switch, and have the consumer come back for the rest.  If
+		 * this principal buffer has been resized, the inactive buffer
+		 * likewise holds the contents of the old active buffer, which
+		 * we copy out in lieu of a switch.
+		 */
+		if (buf->dtb_xamot_pending) {
+			dtrace_membar_consumer();
+
+			if (buf->dtb_flags & DTRACEBUF_SPILL)
+				desc.dtbd_flags |= DTRACEBD_SPILLED;
+
+			state->dts_errors += buf->dtb_xamot_errors;
+			goto snapshot;
+		}
+
 		cached = buf->dtb_tomax;
 		ASSERT(!(buf->dtb_flags & DTRACEBUF_NOSWITCH));
 
@@ -18763,6 +20939,7 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 
 		ASSERT(cached == buf->dtb_xamot);
 
+snapshot:
 		/*
 		 * We have our snapshot; now copy it out.
 		 */
@@ -18778,6 +20955,22 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 		desc.dtbd_oldest = 0;
 		desc.dtbd_timestamp = buf->dtb_switched;
 
+		/*
+		 * The inactive buffer has been copied out.  If it was left by
+		 * a resize, it is replaced with one of the new size; either
+		 * way, it may now take a spill or a resize.
+		 */
+		if (buf->dtb_xamot_next != NULL) {
+			kmem_free(buf->dtb_xamot, buf->dtb_xamot_size);
+			buf->dtb_xamot = buf->dtb_xamot_next;
+			buf->dtb_xamot_next = NULL;
+		}
+
+		if (buf->dtb_xamot_pending) {
+			dtrace_membar_producer();
+			buf->dtb_xamot_pending = 0;
+		}
+
 		mutex_exit(&dtrace_lock);
 
 		/*
@@ -18840,6 +21033,7 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 			stat.dtst_dyndrops += dcpu->dtdsc_drops;
 			stat.dtst_dyndrops_dirty += dcpu->dtdsc_dirty_drops;
 			stat.dtst_dyndrops_rinsing += dcpu->dtdsc_rinsing_drops;
+			stat.dtst_dynsteals += dcpu->dtdsc_steals;
 
 			if (state->dts_buffer[i].dtb_flags & DTRACEBUF_FULL)
 				stat.dtst_filled++;
@@ -18854,12 +21048,16 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 				buf = &spec->dtsp_buffer[i];
 				stat.dtst_specdrops += buf->dtb_xamot_drops;
 			}
+
+			stat.dtst_specdrops_busy +=
+			    state->dts_specfree[i].dtsf_busy;
+			stat.dtst_specdrops_unavail +=
+			    state->dts_specfree[i].dtsf_unavail;
 		}
 
-		stat.dtst_specdrops_busy = state->dts_speculations_busy;
-		stat.dtst_specdrops_unavail = state->dts_speculations_unavail;
 		stat.dtst_stkstroverflows = state->dts_stkstroverflows;
 		stat.dtst_dblerrors = state->dts_dblerrors;
+		stat.dtst_dyngrows = dstate->dtds_ngrow;
 		stat.dtst_killed =
 		    (state->dts_activity == DTRACE_ACTIVITY_KILLED);
 		stat.dtst_errors = nerrs;
@@ -19498,6 +21696,8 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 		if (desc.dtbd_cpu >= NCPU)
 			return (ENOENT);
 
+		desc.dtbd_flags = 0;
+
 		mutex_enter(&dtrace_lock);
 
 		if (cmd == DTRACEIOC_BUFSNAP) {
@@ -19570,6 +21770,52 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 			return (ENOENT);
 		}
 
+		/*
+		 * If this aggregation buffer has spilled, the inactive buffer
+		 * holds the spilled generation; copy that out without a
+		 * switch, and have the consumer come back for the rest.  If
+		 * this principal buffer has been resized, the inactive buffer
+		 * likewise holds the contents of the old active buffer, which
+		 * we copy out in lieu of a switch.
+		 */
+		if (buf->dtb_xamot_pending) {
+			dtrace_membar_consumer();
+
+			if (buf->dtb_flags & DTRACEBUF_SPILL)
+				desc.dtbd_flags |= DTRACEBD_SPILLED;
+
+			state->dts_errors += buf->dtb_xamot_errors;
+			goto snapshot;
+		}
+
+		/*
+		 * Aggregation snapshots are inherently deltas:  switching the
+		 * aggregation buffer resets the hash in the newly active
+		 * buffer, so only keys touched since the last snapshot are
+		 * ever copied out, and libdtrace folds them into its own
+		 * hash.  If nothing has been aggregated on this CPU since the
+		 * last snapshot, there is no delta to return, and we can
+		 * avoid the cross call entirely.  (A racing probe firing
+		 * will simply be picked up by the next snapshot.)  This
+		 * matters on large machines where most CPUs are idle with
+		 * respect to a given enabling.
+		 */
+		if (cmd == DTRACEIOC_AGGSNAP && buf->dtb_offset == 0 &&
+		    buf->dtb_drops == 0 && buf->dtb_errors == 0) {
+			mutex_exit(&dtrace_lock);
+
+			desc.dtbd_size = 0;
+			desc.dtbd_drops = 0;
+			desc.dtbd_errors = 0;
+			desc.dtbd_oldest = 0;
+			desc.dtbd_timestamp = dtrace_gethrtime();
+
+			if (copyout(&desc, arg, sizeof (desc)) != 0)
+				return (EFAULT);
+
+			return (0);
+		}
+
 		cached = buf->dtb_tomax;
 		ASSERT(!(buf->dtb_flags & DTRACEBUF_NOSWITCH));
 
@@ -19592,6 +21838,7 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 
 		ASSERT(cached == buf->dtb_xamot);
 
+snapshot:
 		/*
 		 * We have our snapshot; now copy it out.
 		 */
@@ -19607,6 +21854,22 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 		desc.dtbd_oldest = 0;
 		desc.dtbd_timestamp = buf->dtb_switched;
 
+		/*
+		 * The inactive buffer has been copied out.  If it was left by
+		 * a resize, it is replaced with one of the new size; either
+		 * way, it may now take a spill or a resize.
+		 */
+		if (buf->dtb_xamot_next != NULL) {
+			kmem_free(buf->dtb_xamot, buf->dtb_xamot_size);
+			buf->dtb_xamot = buf->dtb_xamot_next;
+			buf->dtb_xamot_next = NULL;
+		}
+
+		if (buf->dtb_xamot_pending) {
+			dtrace_membar_producer();
+			buf->dtb_xamot_pending = 0;
+		}
+
 		mutex_exit(&dtrace_lock);
 
 		/*
@@ -19929,6 +22192,64 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 
 		return (0);
 	}
+	case DTRACEIOC_PROBEBATCH: {
+		dtrace_probebatch_t pb;
+		dtrace_probedesc_t *descs;
+		uint32_t priv = 0;
+		uid_t uid = 0;
+		zoneid_t zoneid = 0;
+		size_t size;
+		int rval;
+
+		if (copyin((void *)arg, &pb, sizeof (pb)) != 0)
+			return (EFAULT);
+
+		pb.dtpb_match.dtpd_provider[DTRACE_PROVNAMELEN - 1] = '\0';
+		pb.dtpb_match.dtpd_mod[DTRACE_MODNAMELEN - 1] = '\0';
+		pb.dtpb_match.dtpd_func[DTRACE_FUNCNAMELEN - 1] = '\0';
+		pb.dtpb_match.dtpd_name[DTRACE_NAMELEN - 1] = '\0';
+
+		if (pb.dtpb_count == 0)
+			return (EINVAL);
+
+		if (pb.dtpb_count > DTRACE_PROBEBATCH_MAX)
+			pb.dtpb_count = DTRACE_PROBEBATCH_MAX;
+
+		/*
+		 * As with DTRACEIOC_PROBES, we give all providers the
+		 * opportunity to provide matching probes on the first call.
+		 */
+		if (pb.dtpb_match.dtpd_id == DTRACE_IDNONE) {
+			mutex_enter(&dtrace_provider_lock);
+			dtrace_probe_provide(&pb.dtpb_match, NULL);
+			mutex_exit(&dtrace_provider_lock);
+			pb.dtpb_match.dtpd_id++;
+		}
+
+		dtrace_cred2priv(CRED(), &priv, &uid, &zoneid);
+
+		size = pb.dtpb_count * sizeof (dtrace_probedesc_t);
+		descs = kmem_alloc(size, KM_SLEEP);
+
+		mutex_enter(&dtrace_lock);
+		rval = dtrace_probe_batch(&pb, descs, priv, uid, zoneid);
+		mutex_exit(&dtrace_lock);
+
+		if (rval == 0 && pb.dtpb_count != 0 &&
+		    copyout(descs, pb.dtpb_probes,
+		    pb.dtpb_count * sizeof (dtrace_probedesc_t)) != 0)
+			rval = EFAULT;
+
+		kmem_free(descs, size);
+
+		if (rval != 0)
+			return (rval);
+
+		if (copyout(&pb, (void *)arg, sizeof (pb)) != 0)
+			return (EFAULT);
+
+		return (0);
+	}
 	case DTRACEIOC_PROBEMATCH:
 	case DTRACEIOC_PROBES: {
 		dtrace_probedesc_t desc;
@@ -20093,6 +22414,7 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 			stat.dtst_dyndrops += dcpu->dtdsc_drops;
 			stat.dtst_dyndrops_dirty += dcpu->dtdsc_dirty_drops;
 			stat.dtst_dyndrops_rinsing += dcpu->dtdsc_rinsing_drops;
+			stat.dtst_dynsteals += dcpu->dtdsc_steals;
 
 			if (state->dts_buffer[i].dtb_flags & DTRACEBUF_FULL)
 				stat.dtst_filled++;
@@ -20107,12 +22429,16 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 				buf = &spec->dtsp_buffer[i];
 				stat.dtst_specdrops += buf->dtb_xamot_drops;
 			}
+
+			stat.dtst_specdrops_busy +=
+			    state->dts_specfree[i].dtsf_busy;
+			stat.dtst_specdrops_unavail +=
+			    state->dts_specfree[i].dtsf_unavail;
 		}
 
-		stat.dtst_specdrops_busy = state->dts_speculations_busy;
-		stat.dtst_specdrops_unavail = state->dts_speculations_unavail;
 		stat.dtst_stkstroverflows = state->dts_stkstroverflows;
 		stat.dtst_dblerrors = state->dts_dblerrors;
+		stat.dtst_dyngrows = dstate->dtds_ngrow;
 		stat.dtst_killed =
 		    (state->dts_activity == DTRACE_ACTIVITY_KILLED);
 		stat.dtst_errors = nerrs;
@@ -20140,6 +22466,69 @@ dtrace_ioctl(struct dtrace_state *state, unsigned long cmd, void* arg)
 
 		return (0);
 	}
+	case DTRACEIOC_BUFRESIZE: {
+		uint64_t size;
+		int rval;
+
+		if (copyin(arg, &size, sizeof (size)) != 0)
+			return (EFAULT);
+
+		mutex_enter(&dtrace_lock);
+		rval = dtrace_state_resize(state, &size);
+		mutex_exit(&dtrace_lock);
+
+		if (rval != 0)
+			return (rval);
+
+		if (copyout(&size, arg, sizeof (size)) != 0)
+			return (EFAULT);
+
+		return (0);
+	}
+	case DTRACEIOC_ECBPROF: {
+		dtrace_ecbprofdesc_t desc;
+		dtrace_ecbprof_t *prof;
+		size_t size;
+		int necbs, rval;
+
+		if (copyin(arg, &desc, sizeof (desc)) != 0)
+			return (EFAULT);
+
+		mutex_enter(&dtrace_lock);
+		necbs = state->dts_epid - 1;
+
+		/*
+		 * If the consumer's array is too small, we just tell it how
+		 * many EPIDs there are so that it can try again.
+		 */
+		if (necbs == 0 || desc.dtepd_necbs < (uint64_t)necbs) {
+			mutex_exit(&dtrace_lock);
+			desc.dtepd_necbs = necbs;
+
+			if (copyout(&desc, arg, sizeof (desc)) != 0)
+				return (EFAULT);
+
+			return (0);
+		}
+
+		size = necbs * sizeof (dtrace_ecbprof_t);
+		prof = kmem_zalloc(size, KM_SLEEP);
+		dtrace_state_ecbprof(state, prof, necbs);
+		mutex_exit(&dtrace_lock);
+
+		rval = copyout(prof, desc.dtepd_prof, size);
+		kmem_free(prof, size);
+
+		if (rval != 0)
+			return (EFAULT);
+
+		desc.dtepd_necbs = necbs;
+
+		if (copyout(&desc, arg, sizeof (desc)) != 0)
+			return (EFAULT);
+
+		return (0);
+	}
 #ifdef _WIN32
 	case DTRACEIOC_ETWTRACE: {
 		dtrace_etwtracedesc_t detdesc;
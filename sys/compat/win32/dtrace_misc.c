@@ -205,6 +205,57 @@ void kmem_cache_destroy(struct kmem_cache *cachep)
 {
 }
 
+//
+// Executable memory.
+// Pages are mapped non-executable through an MDL, and made read/execute
+// when sealed. Where HVCI is enabled, MmProtectMdlSystemAddress() refuses
+// to make them executable and the DIF object stays with the emulator. The
+// cookie is the MDL.
+//
+
+void *kmem_text_alloc(size_t size, void **cookie)
+{
+    PHYSICAL_ADDRESS Low, High, Skip;
+    PMDL Mdl;
+    void *p;
+
+    Low.QuadPart = 0;
+    High.QuadPart = -1;
+    Skip.QuadPart = 0;
+
+    Mdl = MmAllocatePagesForMdlEx(Low, High, Skip, size, MmCached,
+        MM_ALLOCATE_FULLY_REQUIRED);
+    if (NULL == Mdl) {
+        return NULL;
+    }
+
+    p = MmMapLockedPagesSpecifyCache(Mdl, KernelMode, MmCached, NULL, FALSE,
+        NormalPagePriority | MdlMappingNoExecute);
+    if (NULL == p) {
+        MmFreePagesFromMdl(Mdl);
+        ExFreePool(Mdl);
+        return NULL;
+    }
+
+    *cookie = Mdl;
+    return p;
+}
+
+int kmem_text_seal(void *cookie)
+{
+    return NT_SUCCESS(MmProtectMdlSystemAddress((PMDL)cookie,
+        PAGE_EXECUTE_READ)) ? 0 : -1;
+}
+
+void kmem_text_free(void *cookie)
+{
+    PMDL Mdl = cookie;
+
+    MmUnmapLockedPages(Mdl->MappedSystemVa, Mdl);
+    MmFreePagesFromMdl(Mdl);
+    ExFreePool(Mdl);
+}
+
 //
 // Unique number provider.
 //
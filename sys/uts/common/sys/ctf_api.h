@@ -228,14 +228,19 @@ extern ctf_id_t ctf_add_volatile(ctf_file_t *, uint_t, ctf_id_t);
 
 extern int ctf_add_enumerator(ctf_file_t *, ctf_id_t, const char *, int);
 extern int ctf_add_member(ctf_file_t *, ctf_id_t, const char *, ctf_id_t);
+extern int ctf_add_member_at(ctf_file_t *, ctf_id_t, const char *, ctf_id_t,
+    size_t);
 
 extern int ctf_set_array(ctf_file_t *, ctf_id_t, const ctf_arinfo_t *);
+extern int ctf_set_size(ctf_file_t *, ctf_id_t, size_t);
 
 extern int ctf_delete_type(ctf_file_t *, ctf_id_t);
 
 extern int ctf_update(ctf_file_t *);
 extern int ctf_discard(ctf_file_t *);
 extern int ctf_write(ctf_file_t *, int);
+extern int ctf_write_indexed(ctf_file_t *, int);
+extern ctf_file_t *ctf_flatten(ctf_file_t *, ctf_id_t *, int *);
 
 #ifdef _KERNEL
 